@@ -0,0 +1,363 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#include "MidiSequencer.h"
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include "Stream.h"
+
+namespace
+{
+    const uint64_t MicrosecondsPerMinute = 60000000;
+
+    // Meta event types
+    const uint8_t MetaCuePoint = 0x07;
+    const uint8_t MetaEndOfTrack = 0x2f;
+    const uint8_t MetaTempo = 0x51;
+
+    bool _IsCueBefore(const CuePoint &cue, DWORD dwTicks)
+    {
+        return cue.GetTickPos() < dwTicks;
+    }
+
+    void _WriteBEDWORD(sci::ostream &stream, DWORD dw)
+    {
+        stream.WriteByte((uint8_t)(dw >> 24));
+        stream.WriteByte((uint8_t)(dw >> 16));
+        stream.WriteByte((uint8_t)(dw >> 8));
+        stream.WriteByte((uint8_t)dw);
+    }
+
+    void _WriteBEWORD(sci::ostream &stream, uint16_t w)
+    {
+        stream.WriteByte((uint8_t)(w >> 8));
+        stream.WriteByte((uint8_t)w);
+    }
+
+    void _WriteVarLen(std::vector<uint8_t> &data, DWORD value)
+    {
+        // Seven bits at a time, most significant first, with the high bit set on all but the last.
+        uint8_t bytes[5];
+        int count = 0;
+        do
+        {
+            bytes[count++] = (uint8_t)(value & 0x7f);
+            value >>= 7;
+        } while (value);
+        while (count > 1)
+        {
+            data.push_back(bytes[--count] | 0x80);
+        }
+        data.push_back(bytes[0]);
+    }
+}
+
+MidiSequencer::MidiSequencer() :
+    _dwTotalTicks(0),
+    _dwLoopPoint(SoundComponent::LoopPointNone),
+    _wTimeDivision(SCI_PPQN),
+    _wTempo(StandardTempo),
+    _fTempoChanged(true),
+    _dwTempoStartTicks(0),
+    _tempoStartMicroseconds(0),
+    _nextEvent(0),
+    _nextCue(0),
+    _fLoopPointPassed(true),
+    _dwSoundTicks(0),
+    _dwTicks(0),
+    _dwLastMessageTicks(0),
+    _loopCount(0),
+    _loopLimit((DWORD)-1),
+    _fDone(true)
+{
+}
+
+void MidiSequencer::SetSound(const SoundComponent &sound, DeviceType device)
+{
+    const SoundEventIndex &eventIndex = sound.GetEventIndex(device);
+    _events.assign(eventIndex.Events.begin(), eventIndex.Events.end());
+    _eventTicks.assign(eventIndex.EventTicks.begin(), eventIndex.EventTicks.end());
+    _cues.assign(sound.GetCuePoints().begin(), sound.GetCuePoints().end());
+    std::stable_sort(_cues.begin(), _cues.end(),
+        [](const CuePoint &cue1, const CuePoint &cue2) { return cue1.GetTickPos() < cue2.GetTickPos(); });
+    _dwTotalTicks = eventIndex.TotalTicks;
+    _dwLoopPoint = sound.GetLoopPoint();
+    _wTimeDivision = sound.GetTimeDivision();
+
+    _dwTicks = 0;
+    _dwLastMessageTicks = 0;
+    _loopCount = 0;
+    _dwTempoStartTicks = 0;
+    _tempoStartMicroseconds = 0;
+    _wTempo = sound.GetTempo();
+    _fTempoChanged = true;
+    Cue(0);
+}
+
+void MidiSequencer::SetTempo(uint16_t wTempo)
+{
+    assert(wTempo > 0);
+    if (wTempo != _wTempo)
+    {
+        _tempoStartMicroseconds = _TicksToMicroseconds(_dwTicks);
+        _dwTempoStartTicks = _dwTicks;
+        _wTempo = wTempo;
+        _fTempoChanged = true;
+    }
+}
+
+uint64_t MidiSequencer::_TicksToMicroseconds(DWORD dwTicks) const
+{
+    uint64_t ticksPerMinute = (uint64_t)_wTempo * _wTimeDivision;
+    if (ticksPerMinute == 0)
+    {
+        return _tempoStartMicroseconds;
+    }
+    return _tempoStartMicroseconds + (uint64_t)(dwTicks - _dwTempoStartTicks) * MicrosecondsPerMinute / ticksPerMinute;
+}
+
+size_t MidiSequencer::FindEvent(DWORD dwTicks) const
+{
+    return std::lower_bound(_eventTicks.begin(), _eventTicks.end(), dwTicks) - _eventTicks.begin();
+}
+
+void MidiSequencer::Cue(DWORD dwTicks)
+{
+    _Cue(dwTicks, dwTicks);
+}
+
+void MidiSequencer::_Cue(DWORD dwTicks, DWORD dwFirstTicks)
+{
+    _dwSoundTicks = min(dwTicks, _dwTotalTicks);
+    _nextEvent = FindEvent(dwFirstTicks);
+    _nextCue = std::lower_bound(_cues.begin(), _cues.end(), dwFirstTicks, _IsCueBefore) - _cues.begin();
+    _fLoopPointPassed = (_dwLoopPoint == SoundComponent::LoopPointNone) || (_dwLoopPoint < dwFirstTicks);
+    _fDone = _events.empty();
+}
+
+bool MidiSequencer::Advance(DWORD dwTicks, IMidiSink &sink)
+{
+    return _Play(sink, _dwTicks + dwTicks, false);
+}
+
+void MidiSequencer::Render(IMidiSink &sink, DWORD loops)
+{
+    DWORD loopLimitSave = _loopLimit;
+    _loopLimit = _loopCount + loops;
+    _Play(sink, 0, true);
+    _loopLimit = loopLimitSave;
+}
+
+bool MidiSequencer::_Play(IMidiSink &sink, DWORD dwTargetTicks, bool toEnd)
+{
+    enum class Next
+    {
+        End,
+        Event,
+        LoopPoint,
+        Cue,
+    };
+
+    while (!_fDone)
+    {
+        if (_fTempoChanged)
+        {
+            sink.OnTempo(_dwTicks, _wTempo);
+            _fTempoChanged = false;
+        }
+
+        // Work out what happens next. Events at the loop point come before it, since playback
+        // continues with the events after it. Cues come before events at the same time.
+        Next next = Next::End;
+        DWORD dwNextSoundTicks = _dwTotalTicks;
+        if (_nextEvent < _events.size())
+        {
+            next = Next::Event;
+            dwNextSoundTicks = _eventTicks[_nextEvent];
+        }
+        if (!_fLoopPointPassed && (_dwLoopPoint < dwNextSoundTicks))
+        {
+            next = Next::LoopPoint;
+            dwNextSoundTicks = _dwLoopPoint;
+        }
+        if ((_nextCue < _cues.size()) && (_cues[_nextCue].GetTickPos() <= dwNextSoundTicks))
+        {
+            next = Next::Cue;
+            dwNextSoundTicks = _cues[_nextCue].GetTickPos();
+        }
+
+        assert(dwNextSoundTicks >= _dwSoundTicks);
+        DWORD dwNextTicks = _dwTicks + (dwNextSoundTicks - _dwSoundTicks);
+        if (!toEnd && (dwNextTicks > dwTargetTicks))
+        {
+            _dwSoundTicks += dwTargetTicks - _dwTicks;
+            _dwTicks = dwTargetTicks;
+            break;
+        }
+        _dwTicks = dwNextTicks;
+        _dwSoundTicks = dwNextSoundTicks;
+
+        switch (next)
+        {
+        case Next::Event:
+        {
+            const SoundEvent &event = _events[_nextEvent];
+            MidiMessage message;
+            message.Ticks = _dwTicks;
+            message.DeltaTicks = _dwTicks - _dwLastMessageTicks;
+            message.Microseconds = _TicksToMicroseconds(_dwTicks);
+            message.Status = event.GetRawStatus();
+            message.Param1 = event.bParam1;
+            message.Param2 = event.bParam2;
+            sink.OnMessage(message);
+            _dwLastMessageTicks = _dwTicks;
+            _nextEvent++;
+            break;
+        }
+
+        case Next::LoopPoint:
+            sink.OnLoopPoint(_dwTicks);
+            _fLoopPointPassed = true;
+            break;
+
+        case Next::Cue:
+            sink.OnCue(_dwTicks, _cues[_nextCue]);
+            _nextCue++;
+            break;
+
+        case Next::End:
+            // A loop point at the very end would loop forever without playing anything.
+            if ((_dwLoopPoint < _dwTotalTicks) && (_loopCount < _loopLimit))
+            {
+                _loopCount++;
+                // We start playing events *after* the loop point, not at the loop point.
+                _Cue(_dwLoopPoint, _dwLoopPoint + 1);
+                sink.OnLoop(_dwTicks);
+            }
+            else
+            {
+                _fDone = true;
+            }
+            break;
+        }
+    }
+    return !_fDone;
+}
+
+MidiFileSink::MidiFileSink(uint16_t wTimeDivision) : _wTimeDivision(wTimeDivision), _dwLastTicks(0), _bRunningStatus(0)
+{
+    _track.reserve(4096);
+}
+
+void MidiFileSink::_WriteDelta(DWORD ticks)
+{
+    assert(ticks >= _dwLastTicks);
+    _WriteVarLen(_track, ticks - _dwLastTicks);
+    _dwLastTicks = ticks;
+}
+
+void MidiFileSink::_WriteMeta(DWORD ticks, uint8_t type, const uint8_t *data, size_t size)
+{
+    _WriteDelta(ticks);
+    _track.push_back(0xff);
+    _track.push_back(type);
+    _WriteVarLen(_track, (DWORD)size);
+    _track.insert(_track.end(), data, data + size);
+    // Meta events cancel running status.
+    _bRunningStatus = 0;
+}
+
+void MidiFileSink::OnMessage(const MidiMessage &message)
+{
+    if (message.Status >= SoundEvent::Special)
+    {
+        // Not a channel message, so we can't write it as one.
+        return;
+    }
+    _WriteDelta(message.Ticks);
+    if (message.Status != _bRunningStatus)
+    {
+        _track.push_back(message.Status);
+        _bRunningStatus = message.Status;
+    }
+    _track.push_back(message.Param1 & 0x7f);
+    uint8_t command = message.Status & 0xf0;
+    if ((command != SoundEvent::ProgramChange) && (command != SoundEvent::Pressure))
+    {
+        _track.push_back(message.Param2 & 0x7f);
+    }
+}
+
+void MidiFileSink::OnTempo(DWORD ticks, uint16_t tempo)
+{
+    DWORD microsecondsPerQuarterNote = (DWORD)(MicrosecondsPerMinute / (tempo ? tempo : 1));
+    uint8_t data[3] = { (uint8_t)(microsecondsPerQuarterNote >> 16), (uint8_t)(microsecondsPerQuarterNote >> 8), (uint8_t)microsecondsPerQuarterNote };
+    _WriteMeta(ticks, MetaTempo, data, sizeof(data));
+}
+
+void MidiFileSink::OnCue(DWORD ticks, const CuePoint &cue)
+{
+    // The same names we read in InitializeFromMidi: a + for cumulative cues.
+    std::string name = ((cue.GetType() == CuePoint::Cumulative) ? "+" : "") + std::to_string(cue.GetValue());
+    _WriteMeta(ticks, MetaCuePoint, reinterpret_cast<const uint8_t*>(name.c_str()), name.length());
+}
+
+void MidiFileSink::OnLoopPoint(DWORD ticks)
+{
+    static const char loopName[] = "loop";
+    _WriteMeta(ticks, MetaCuePoint, reinterpret_cast<const uint8_t*>(loopName), sizeof(loopName) - 1);
+}
+
+void MidiFileSink::WriteTo(sci::ostream &stream, DWORD ticks) const
+{
+    // The end of track meta event
+    std::vector<uint8_t> end;
+    _WriteVarLen(end, (ticks > _dwLastTicks) ? (ticks - _dwLastTicks) : 0);
+    end.push_back(0xff);
+    end.push_back(MetaEndOfTrack);
+    end.push_back(0);
+
+    stream.WriteBytes(reinterpret_cast<const uint8_t*>("MThd"), 4);
+    _WriteBEDWORD(stream, 6);
+    _WriteBEWORD(stream, 0);     // Format 0: a single track
+    _WriteBEWORD(stream, 1);
+    _WriteBEWORD(stream, _wTimeDivision);
+
+    stream.WriteBytes(reinterpret_cast<const uint8_t*>("MTrk"), 4);
+    _WriteBEDWORD(stream, (DWORD)(_track.size() + end.size()));
+    if (!_track.empty())
+    {
+        stream.WriteBytes(&_track[0], (int)_track.size());
+    }
+    stream.WriteBytes(&end[0], (int)end.size());
+}
+
+void MidiFileSink::Save(const std::string &filename, DWORD ticks) const
+{
+    sci::ostream stream;
+    WriteTo(stream, ticks);
+    std::ofstream midiFile;
+    midiFile.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+    midiFile.open(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    midiFile.write(reinterpret_cast<const char*>(stream.GetInternalPointer()), stream.GetDataSize());
+}
+
+void ExportSoundToMidiFile(const SoundComponent &sound, DeviceType device, const std::string &filename, DWORD loops)
+{
+    MidiSequencer sequencer;
+    sequencer.SetSound(sound, device);
+    MidiFileSink sink(sequencer.GetTimeDivision());
+    sequencer.Render(sink, loops);
+    sink.Save(filename, sequencer.GetTicks());
+}
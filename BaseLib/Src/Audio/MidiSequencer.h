@@ -0,0 +1,152 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#pragma once
+
+#include "Components/Sound.h"
+
+namespace sci
+{
+    class ostream;
+}
+
+//
+// A channel message sent by the sequencer.
+//
+struct MidiMessage
+{
+    DWORD Ticks;            // Since playback started, including any loops
+    DWORD DeltaTicks;       // Since the previous message
+    uint64_t Microseconds;  // Since playback started, at the sequencer's tempo
+    uint8_t Status;
+    uint8_t Param1;
+    uint8_t Param2;         // Unused for program changes and channel pressure
+};
+
+class IMidiSink
+{
+public:
+    virtual void OnMessage(const MidiMessage &message) = 0;
+    // Sent before the first message, and again whenever the tempo changes.
+    virtual void OnTempo(DWORD ticks, uint16_t tempo) {}
+    virtual void OnCue(DWORD ticks, const CuePoint &cue) {}
+    // Playback passed the loop point.
+    virtual void OnLoopPoint(DWORD ticks) {}
+    // Playback reached the end and went back to the loop point.
+    virtual void OnLoop(DWORD ticks) {}
+};
+
+//
+// Plays the events of a sound for one device into an IMidiSink, without any reference to
+// a real midi device or clock. Playback follows the interpreter: cues are reported as they're
+// passed, and at the end of the sound it continues after the loop point if there is one.
+// Once a sound is set, playing it doesn't allocate.
+//
+class MidiSequencer
+{
+public:
+    MidiSequencer();
+    MidiSequencer(const MidiSequencer &src) = delete;
+    MidiSequencer &operator=(const MidiSequencer &src) = delete;
+
+    // Takes a copy of what it needs, so the sound can change afterwards. Playback goes back to
+    // the beginning, at the sound's tempo.
+    void SetSound(const SoundComponent &sound, DeviceType device);
+    void SetTempo(uint16_t wTempo);
+    uint16_t GetTempo() const { return _wTempo; }
+    uint16_t GetTimeDivision() const { return _wTimeDivision; }
+    // How many times to go back to the loop point before stopping. There is no limit by default,
+    // as in the interpreter.
+    void SetLoopLimit(DWORD loops) { _loopLimit = loops; }
+
+    // Moves to dwTicks within the sound. Doesn't change the time since playback started.
+    void Cue(DWORD dwTicks);
+    // Sends everything in the next dwTicks to the sink. Returns false once the sound is done.
+    bool Advance(DWORD dwTicks, IMidiSink &sink);
+    // Plays to the end of the sound, going back to the loop point at most loops times.
+    void Render(IMidiSink &sink, DWORD loops = 0);
+
+    bool IsDone() const { return _fDone; }
+    DWORD GetTicks() const { return _dwTicks; }                 // Since playback started
+    DWORD GetSoundTicks() const { return _dwSoundTicks; }       // Within the sound
+    uint64_t GetMicroseconds() const { return _TicksToMicroseconds(_dwTicks); }
+    DWORD GetTotalTicks() const { return _dwTotalTicks; }
+    DWORD GetLoopCount() const { return _loopCount; }
+
+    // The events in the order they are played, with the absolute tick of each in the sound.
+    size_t GetEventCount() const { return _events.size(); }
+    const SoundEvent &GetEvent(size_t index) const { return _events[index]; }
+    DWORD GetEventTicks(size_t index) const { return _eventTicks[index]; }
+    // The first event at or after dwTicks, or GetEventCount() if there is none.
+    size_t FindEvent(DWORD dwTicks) const;
+
+private:
+    // Stops at dwTargetTicks since playback started, unless toEnd is set.
+    bool _Play(IMidiSink &sink, DWORD dwTargetTicks, bool toEnd);
+    // Moves to the first thing at or after dwTicks within the sound.
+    void _Cue(DWORD dwTicks, DWORD dwFirstTicks);
+    uint64_t _TicksToMicroseconds(DWORD dwTicks) const;
+
+    std::vector<SoundEvent> _events;
+    std::vector<DWORD> _eventTicks;
+    std::vector<CuePoint> _cues;        // By tick position
+    DWORD _dwTotalTicks;
+    DWORD _dwLoopPoint;
+    uint16_t _wTimeDivision;
+
+    uint16_t _wTempo;
+    bool _fTempoChanged;                // Not reported to the sink yet
+    DWORD _dwTempoStartTicks;
+    uint64_t _tempoStartMicroseconds;
+
+    size_t _nextEvent;
+    size_t _nextCue;
+    bool _fLoopPointPassed;
+    DWORD _dwSoundTicks;
+    DWORD _dwTicks;
+    DWORD _dwLastMessageTicks;
+    DWORD _loopCount;
+    DWORD _loopLimit;
+    bool _fDone;
+};
+
+//
+// Collects what the sequencer plays into a standard (format 0) midi file. Cues and the loop point
+// are written as cue point meta events, which InitializeFromMidi reads back.
+//
+class MidiFileSink : public IMidiSink
+{
+public:
+    MidiFileSink(uint16_t wTimeDivision);
+
+    void OnMessage(const MidiMessage &message) override;
+    void OnTempo(DWORD ticks, uint16_t tempo) override;
+    void OnCue(DWORD ticks, const CuePoint &cue) override;
+    void OnLoopPoint(DWORD ticks) override;
+
+    // Ends the track at ticks, which can be later than the last message.
+    void WriteTo(sci::ostream &stream, DWORD ticks) const;
+    void Save(const std::string &filename, DWORD ticks) const;
+
+private:
+    void _WriteDelta(DWORD ticks);
+    void _WriteMeta(DWORD ticks, uint8_t type, const uint8_t *data, size_t size);
+
+    uint16_t _wTimeDivision;
+    std::vector<uint8_t> _track;
+    DWORD _dwLastTicks;
+    uint8_t _bRunningStatus;
+};
+
+// Renders a sound as it plays on device into a midi file.
+void ExportSoundToMidiFile(const SoundComponent &sound, DeviceType device, const std::string &filename, DWORD loops = 0);
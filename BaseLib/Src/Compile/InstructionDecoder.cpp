@@ -0,0 +1,136 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#include "InstructionDecoder.h"
+#include <cassert>
+#include <cstring>
+
+namespace
+{
+    uint8_t _GetOperandSize(uint8_t rawOpcode, OperandType operandType)
+    {
+        switch (operandType)
+        {
+        case otVAR:
+        case otPVAR:
+        case otCLASS:
+        case otPROP:
+        case otSTRING:
+        case otSAID:
+        case otKERNEL:
+        case otLABEL:
+        case otPUBPROC:
+        case otINT:
+        case otUINT:
+        case otOFFS:
+            // The low bit of the opcode says whether these are bytes or words.
+            return (rawOpcode & 1) ? 1 : 2;
+        case otINT16:
+        case otUINT16:
+            return 2;
+        case otINT8:
+        case otUINT8:
+            return 1;
+        case otDEBUGSTRING:
+            return 0;
+        default:
+            assert(false && "Unknown operand type");
+            return 0;
+        }
+    }
+}
+
+InstructionDecoder::InstructionDecoder(const TargetArchitecture *arch) : _arch(arch)
+{
+    for (size_t raw = 0; raw < _entries.size(); raw++)
+    {
+        Entry &entry = _entries[raw];
+        entry = {};
+        entry.Op = arch->RawToOpcode(static_cast<uint8_t>(raw));
+        entry.Name = OpcodeToName(entry.Op, 0);
+        auto operandTypes = arch->GetOperandTypes(entry.Op);
+        assert(operandTypes.size() <= 3);
+        for (OperandType operandType : operandTypes)
+        {
+            if (operandType == 0)
+            {
+                // Some operand lists are padded out with zeros.
+                break;
+            }
+            entry.OperandTypes[entry.OperandCount] = operandType;
+            entry.OperandSizes[entry.OperandCount] = _GetOperandSize(static_cast<uint8_t>(raw), operandType);
+            entry.OperandCount++;
+        }
+    }
+}
+
+bool InstructionDecoder::Decode(const uint8_t *pCur, const uint8_t *pEnd, uint16_t offset, DecodedInstruction &instruction) const
+{
+    if (pCur >= pEnd)
+    {
+        return false;
+    }
+    const Entry &entry = _entries[*pCur];
+    instruction.Op = entry.Op;
+    instruction.RawOpcode = *pCur;
+    instruction.OperandCount = entry.OperandCount;
+    instruction.Name = entry.Name;
+    instruction.DebugString = nullptr;
+    instruction.Offset = offset;
+
+    const uint8_t *pOperand = pCur + 1;
+    for (uint8_t i = 0; i < entry.OperandCount; i++)
+    {
+        instruction.OperandTypes[i] = entry.OperandTypes[i];
+        size_t remaining = pEnd - pOperand;
+        uint16_t size = entry.OperandSizes[i];
+        if (size == 0)
+        {
+            const void *pNull = memchr(pOperand, 0, remaining);
+            if (!pNull)
+            {
+                return false;
+            }
+            size = static_cast<uint16_t>(static_cast<const uint8_t*>(pNull) - pOperand + 1);
+            instruction.DebugString = reinterpret_cast<const char *>(pOperand);
+            instruction.Operands[i] = 0;
+        }
+        else if (remaining < size)
+        {
+            return false;
+        }
+        else
+        {
+            instruction.Operands[i] = (size == 2) ? (pOperand[0] | (pOperand[1] << 8)) : pOperand[0];
+        }
+        instruction.OperandSizes[i] = size;
+        pOperand += size;
+    }
+    instruction.Size = static_cast<uint16_t>(pOperand - pCur);
+    return true;
+}
+
+const InstructionDecoder &GetInstructionDecoder(const TargetArchitecture *arch)
+{
+    // One for each architecture GetTargetArchitecture hands out. Function statics are initialized
+    // safely if several threads get here at once.
+    static const InstructionDecoder sci0(GetTargetArchitecture(sciVersion0));
+    static const InstructionDecoder sci2(GetTargetArchitecture(sciVersion2));
+    assert((arch == sci0.GetArchitecture()) || (arch == sci2.GetArchitecture()));
+    return (arch == sci2.GetArchitecture()) ? sci2 : sci0;
+}
+
+const InstructionDecoder &GetInstructionDecoder(const SCIVersion &version)
+{
+    return GetInstructionDecoder(GetTargetArchitecture(version));
+}
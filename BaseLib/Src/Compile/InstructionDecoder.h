@@ -0,0 +1,70 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#pragma once
+
+#include <array>
+#include "PMachine.h"
+#include "Version.h"
+
+//
+// An instruction decoded from script bytecode.
+//
+struct DecodedInstruction
+{
+    Opcode Op;
+    uint8_t RawOpcode;
+    uint8_t OperandCount;
+    OperandType OperandTypes[3];
+    uint16_t OperandSizes[3];   // In bytes
+    uint16_t Operands[3];       // As they are in the bytecode (0 for a debug string)
+    const char *Name;           // Doesn't distinguish leai from lea
+    const char *DebugString;    // Points into the bytecode, if there is an otDEBUGSTRING operand
+    uint16_t Offset;
+    uint16_t Size;              // Including the opcode
+};
+
+//
+// Decodes script bytecode for a particular TargetArchitecture. The opcode, operand layout and name
+// for each of the 256 possible raw opcodes are worked out once up front, so decoding an instruction
+// is a table lookup and a few reads, with no allocations.
+//
+class InstructionDecoder
+{
+public:
+    InstructionDecoder(const TargetArchitecture *arch);
+    InstructionDecoder(const InstructionDecoder &src) = delete;
+    InstructionDecoder &operator=(const InstructionDecoder &src) = delete;
+
+    // Returns false if the instruction at pCur runs past pEnd.
+    bool Decode(const uint8_t *pCur, const uint8_t *pEnd, uint16_t offset, DecodedInstruction &instruction) const;
+
+    const TargetArchitecture *GetArchitecture() const { return _arch; }
+
+private:
+    struct Entry
+    {
+        Opcode Op;
+        uint8_t OperandCount;
+        OperandType OperandTypes[3];
+        uint8_t OperandSizes[3];    // 0 for a null-terminated debug string
+        const char *Name;
+    };
+
+    const TargetArchitecture *_arch;
+    std::array<Entry, 256> _entries;
+};
+
+// The decoders are created once and can be used from any thread.
+const InstructionDecoder &GetInstructionDecoder(const TargetArchitecture *arch);
+const InstructionDecoder &GetInstructionDecoder(const SCIVersion &version);
@@ -0,0 +1,442 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#include "scii.h"
+#include "PMachine.h"
+#include <unordered_set>
+#include <algorithm>
+
+//
+// Peephole optimizations over a script's code, before it is sized and written out.
+//
+// Nothing here changes what the code does: redundant instructions are removed, and branches are
+// pointed directly at where they end up. Instructions that other parts of the script refer to
+// (procedure and method entry points) are never removed, and anything branching to a removed
+// instruction is moved to the instruction that follows it.
+//
+
+namespace
+{
+    bool _IsBranch(const scii &inst)
+    {
+        Opcode opcode = inst.get_opcode();
+        return (opcode == Opcode::BT) || (opcode == Opcode::BNT) || (opcode == Opcode::JMP);
+    }
+
+    bool _IsConditionalBranch(const scii &inst)
+    {
+        Opcode opcode = inst.get_opcode();
+        return (opcode == Opcode::BT) || (opcode == Opcode::BNT);
+    }
+
+    bool _IsLabelInstruction(const scii &inst)
+    {
+        return _IsBranch(inst) || (inst.get_opcode() == Opcode::CALL);
+    }
+
+    Opcode _InvertBranch(Opcode opcode)
+    {
+        assert((opcode == Opcode::BT) || (opcode == Opcode::BNT));
+        return (opcode == Opcode::BT) ? Opcode::BNT : Opcode::BT;
+    }
+
+    // Non-indexed acc loads and stores (lag, lal, lat, lap and sag, sal, sat, sap).
+    bool _IsLoadAcc(Opcode opcode) { return (opcode >= Opcode::LAG) && (opcode <= Opcode::LAP); }
+    bool _IsStoreAcc(Opcode opcode) { return (opcode >= Opcode::SAG) && (opcode <= Opcode::SAP); }
+    bool _IsSameVariable(const scii &load, const scii &store)
+    {
+        // Both groups list global, local, temp, param in the same order.
+        return ((static_cast<int>(load.get_opcode()) - static_cast<int>(Opcode::LAG)) == (static_cast<int>(store.get_opcode()) - static_cast<int>(Opcode::SAG))) &&
+            (load.get_first_operand() == store.get_first_operand());
+    }
+
+    // Pushes something onto the stack without any other side effects.
+    bool _IsPurePush(Opcode opcode)
+    {
+        switch (opcode)
+        {
+            case Opcode::PUSH:
+            case Opcode::PUSHI:
+            case Opcode::PUSH0:
+            case Opcode::PUSH1:
+            case Opcode::PUSH2:
+            case Opcode::PUSHSELF:
+            case Opcode::DUP:
+            case Opcode::PPREV:
+            case Opcode::LOFSS:
+            case Opcode::LSG:
+            case Opcode::LSL:
+            case Opcode::LST:
+            case Opcode::LSP:
+                return true;
+        }
+        return false;
+    }
+}
+
+class PeepholeOptimizer
+{
+public:
+    PeepholeOptimizer(const SCIVersion &version, std::list<scii> &code, const std::vector<code_pos> &entryPoints);
+
+    // Returns true if anything changed.
+    bool Run();
+
+    // Interface used by the rules.
+    const SCIVersion &GetVersion() const { return _version; }
+    bool IsEnd(code_pos pos) const { return pos == _code.end(); }
+    bool IsEntryPoint(code_pos pos) const { return _entryPoints.find(&*pos) != _entryPoints.end(); }
+    // Something other than the previous instruction leads here.
+    bool IsPinned(code_pos pos) const { return IsEntryPoint(pos) || (_incoming.find(&*pos) != _incoming.end()); }
+    void Retarget(code_pos branch, code_pos target);
+    void ReplaceWithReturn(code_pos pos);
+    // Removes pos (moving any branches that target it to the next instruction), and
+    // returns the next instruction. Fails (returning pos) for entry points.
+    code_pos Remove(code_pos pos);
+
+private:
+    void _Unlink(code_pos branch);
+
+    const SCIVersion &_version;
+    std::list<scii> &_code;
+    std::unordered_set<const scii*> _entryPoints;
+    std::unordered_map<const scii*, std::vector<code_pos>> _incoming;   // branch target -> branches
+    std::unordered_map<const scii*, size_t> _order;                     // For branch directions
+};
+
+namespace
+{
+    //
+    // The rules. Each one looks at the instruction at pos (and possibly those after it). If it changes
+    // anything it returns true, and leaves pos at a valid instruction (or the end) to continue from.
+    //
+    typedef bool(*ApplyPeepholeRule)(PeepholeOptimizer &optimizer, code_pos &pos);
+
+    struct PeepholeRule
+    {
+        const char *Name;
+        bool(*AppliesTo)(const SCIVersion &version);
+        ApplyPeepholeRule Apply;
+    };
+
+    // Point branches at the end of a chain of jumps, skipping over conditional branches that
+    // are known to go (or not go) a particular way, since the acc hasn't changed.
+    bool _ThreadBranches(PeepholeOptimizer &optimizer, code_pos &pos)
+    {
+        if (!_IsBranch(*pos))
+        {
+            return false;
+        }
+        bool isConditional = _IsConditionalBranch(*pos);
+        std::unordered_set<const scii*> visited = { &*pos };
+        code_pos target = pos->get_branch_target();
+        while (!optimizer.IsEnd(target) && visited.insert(&*target).second)
+        {
+            code_pos nextTarget;
+            if (target->get_opcode() == Opcode::JMP)
+            {
+                nextTarget = target->get_branch_target();
+            }
+            else if (isConditional && (target->get_opcode() == pos->get_opcode()))
+            {
+                nextTarget = target->get_branch_target();
+            }
+            else if (isConditional && (target->get_opcode() == _InvertBranch(pos->get_opcode())))
+            {
+                nextTarget = std::next(target);
+            }
+            else
+            {
+                break;
+            }
+            if (optimizer.IsEnd(nextTarget))
+            {
+                break;
+            }
+            target = nextTarget;
+        }
+
+        if (target != pos->get_branch_target())
+        {
+            optimizer.Retarget(pos, target);
+            return true;
+        }
+        return false;
+    }
+
+    // jmp to a ret -> ret
+    bool _JumpToReturn(PeepholeOptimizer &optimizer, code_pos &pos)
+    {
+        if (pos->get_opcode() == Opcode::JMP)
+        {
+            code_pos target = pos->get_branch_target();
+            if (!optimizer.IsEnd(target) && (target->get_opcode() == Opcode::RET))
+            {
+                optimizer.ReplaceWithReturn(pos);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Branches to the next instruction do nothing.
+    bool _BranchToNext(PeepholeOptimizer &optimizer, code_pos &pos)
+    {
+        if (_IsBranch(*pos) && !optimizer.IsEnd(std::next(pos)) && (pos->get_branch_target() == std::next(pos)) && !optimizer.IsEntryPoint(pos))
+        {
+            pos = optimizer.Remove(pos);
+            return true;
+        }
+        return false;
+    }
+
+    // bnt L; jmp M; L: -> bt M (and vice versa)
+    bool _BranchOverJump(PeepholeOptimizer &optimizer, code_pos &pos)
+    {
+        if (_IsConditionalBranch(*pos))
+        {
+            code_pos jump = std::next(pos);
+            if (!optimizer.IsEnd(jump) && (jump->get_opcode() == Opcode::JMP) && !optimizer.IsPinned(jump) &&
+                (pos->get_branch_target() == std::next(jump)) && (jump->get_branch_target() != jump) && !optimizer.IsEnd(jump->get_branch_target()))
+            {
+                pos->set_opcode(_InvertBranch(pos->get_opcode()));
+                optimizer.Retarget(pos, jump->get_branch_target());
+                optimizer.Remove(jump);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Nothing can reach the code after a ret or jmp, until the next thing that is branched to.
+    bool _UnreachableCode(PeepholeOptimizer &optimizer, code_pos &pos)
+    {
+        bool changed = false;
+        if ((pos->get_opcode() == Opcode::RET) || (pos->get_opcode() == Opcode::JMP))
+        {
+            code_pos next = std::next(pos);
+            while (!optimizer.IsEnd(next) && !optimizer.IsPinned(next))
+            {
+                next = optimizer.Remove(next);
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    // sag x; lag x -> sag x  (the acc already has the value)
+    bool _StoreThenLoad(PeepholeOptimizer &optimizer, code_pos &pos)
+    {
+        if (_IsStoreAcc(pos->get_opcode()))
+        {
+            code_pos next = std::next(pos);
+            if (!optimizer.IsEnd(next) && _IsLoadAcc(next->get_opcode()) && _IsSameVariable(*next, *pos) && !optimizer.IsPinned(next))
+            {
+                optimizer.Remove(next);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // lag x; sag x -> lag x  (x already has the value)
+    bool _LoadThenStore(PeepholeOptimizer &optimizer, code_pos &pos)
+    {
+        if (_IsLoadAcc(pos->get_opcode()))
+        {
+            code_pos next = std::next(pos);
+            if (!optimizer.IsEnd(next) && _IsStoreAcc(next->get_opcode()) && _IsSameVariable(*pos, *next) && !optimizer.IsPinned(next))
+            {
+                optimizer.Remove(next);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // push; toss -> nothing
+    bool _PushThenToss(PeepholeOptimizer &optimizer, code_pos &pos)
+    {
+        if (_IsPurePush(pos->get_opcode()) && !optimizer.IsEntryPoint(pos))
+        {
+            code_pos toss = std::next(pos);
+            if (!optimizer.IsEnd(toss) && (toss->get_opcode() == Opcode::TOSS) && !optimizer.IsPinned(toss) &&
+                (!optimizer.IsPinned(pos) || !optimizer.IsEnd(std::next(toss))))
+            {
+                pos = optimizer.Remove(pos);
+                pos = optimizer.Remove(pos);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool _AnyVersion(const SCIVersion &) { return true; }
+
+    // Threading comes first, since it turns many branches into ones the later rules recognize.
+    PeepholeRule g_peepholeRules[] =
+    {
+        { "thread branches", _AnyVersion, _ThreadBranches },
+        { "jmp to ret", _AnyVersion, _JumpToReturn },
+        { "branch to next", _AnyVersion, _BranchToNext },
+        { "branch over jmp", _AnyVersion, _BranchOverJump },
+        { "unreachable code", _AnyVersion, _UnreachableCode },
+        { "store then load", _AnyVersion, _StoreThenLoad },
+        { "load then store", _AnyVersion, _LoadThenStore },
+        { "push then toss", _AnyVersion, _PushThenToss },
+    };
+}
+
+PeepholeOptimizer::PeepholeOptimizer(const SCIVersion &version, std::list<scii> &code, const std::vector<code_pos> &entryPoints) : _version(version), _code(code)
+{
+    for (code_pos entryPoint : entryPoints)
+    {
+        if (!IsEnd(entryPoint))
+        {
+            _entryPoints.insert(&*entryPoint);
+        }
+    }
+    // Instructions are only ever removed, so the relative order stays valid.
+    size_t index = 0;
+    for (code_pos pos = _code.begin(); pos != _code.end(); ++pos)
+    {
+        _order[&*pos] = index++;
+        if (_IsLabelInstruction(*pos) && !IsEnd(pos->get_branch_target()))
+        {
+            _incoming[&*pos->get_branch_target()].push_back(pos);
+        }
+    }
+}
+
+void PeepholeOptimizer::_Unlink(code_pos branch)
+{
+    code_pos target = branch->get_branch_target();
+    if (!IsEnd(target))
+    {
+        auto it = _incoming.find(&*target);
+        if (it != _incoming.end())
+        {
+            auto &sources = it->second;
+            sources.erase(std::remove(sources.begin(), sources.end(), branch), sources.end());
+            if (sources.empty())
+            {
+                _incoming.erase(it);
+            }
+        }
+    }
+}
+
+void PeepholeOptimizer::Retarget(code_pos branch, code_pos target)
+{
+    assert(!IsEnd(target));
+    _Unlink(branch);
+    branch->set_branch_target(target, _order[&*target] > _order[&*branch]);
+    _incoming[&*target].push_back(branch);
+}
+
+void PeepholeOptimizer::ReplaceWithReturn(code_pos pos)
+{
+    _Unlink(pos);
+    *pos = scii(_version, Opcode::RET, pos->LineNumber);
+}
+
+code_pos PeepholeOptimizer::Remove(code_pos pos)
+{
+    if (IsEntryPoint(pos))
+    {
+        return pos;
+    }
+    code_pos next = std::next(pos);
+    auto it = _incoming.find(&*pos);
+    if (it != _incoming.end())
+    {
+        if (IsEnd(next))
+        {
+            return pos;
+        }
+        std::vector<code_pos> sources = std::move(it->second);
+        _incoming.erase(it);
+        for (code_pos source : sources)
+        {
+            source->set_branch_target(next, _order[&*next] > _order[&*source]);
+            _incoming[&*next].push_back(source);
+        }
+    }
+    if (_IsLabelInstruction(*pos))
+    {
+        _Unlink(pos);
+    }
+    _order.erase(&*pos);
+    _code.erase(pos);
+    return next;
+}
+
+bool PeepholeOptimizer::Run()
+{
+    bool changedAny = false;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        code_pos pos = _code.begin();
+        while (pos != _code.end())
+        {
+            bool applied = false;
+            for (const PeepholeRule &rule : g_peepholeRules)
+            {
+                if (rule.AppliesTo(_version) && rule.Apply(*this, pos))
+                {
+                    applied = true;
+                    break;
+                }
+            }
+            if (applied)
+            {
+                // Try again at wherever the rule left us.
+                changed = true;
+            }
+            else
+            {
+                ++pos;
+            }
+        }
+        changedAny = changedAny || changed;
+    }
+    return changedAny;
+}
+
+int scicode::optimize(const std::vector<code_pos> &entryPoints)
+{
+    for (scii &instruction : _code)
+    {
+        if (!instruction.is_branch_determined())
+        {
+            // There were errors, so don't bother.
+            return 0;
+        }
+    }
+    // Branches are resolved by now, so the fixup bookkeeping is no longer needed (and would
+    // refer to removed instructions).
+    _targetToSources.clear();
+
+    int sizeBefore = calc_size();
+    PeepholeOptimizer optimizer(_version, _code, entryPoints);
+    int saved = 0;
+    if (optimizer.Run())
+    {
+        _reset_sizes();
+        saved = sizeBefore - calc_size();
+    }
+    _reset_sizes();
+    return saved;
+}
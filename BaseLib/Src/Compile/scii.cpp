@@ -524,6 +524,15 @@ uint16_t scicode::calc_size()
     return wDistance;
 }
 
+// Start sizing from scratch, e.g. after instructions were removed and branches may be shorter.
+void scicode::_reset_sizes()
+{
+    for (scii &instruction : _code)
+    {
+        instruction.reset_size(true);
+    }
+}
+
 uint16_t scicode::offset_of(code_pos target)
 {
     uint16_t wDistance = 0;
@@ -779,7 +788,15 @@ scii::scii(const SCIVersion &version, Opcode bOpcode, _code_pos branch, bool fUn
 #endif
 }
 
-void scii::reset_size() { _wSize = 0; _opSize = Undefined; }
+void scii::reset_size(bool fForgetWordSize)
+{
+    _wSize = 0;
+    _opSize = Undefined;
+    if (fForgetWordSize)
+    {
+        _fForceWord = false;
+    }
+}
 
 void scii::set_branch_target(_code_pos offset, bool fForward)
 {
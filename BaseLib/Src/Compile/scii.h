@@ -65,7 +65,7 @@ public:
     scii(const SCIVersion &version, Opcode bOpcode, _code_pos branch, bool fUndetermined, int lineNumber);
 
     uint16_t size();
-    void reset_size();
+    void reset_size(bool fForgetWordSize = false);
     uint16_t calc_size(_code_pos self, int *pfNeedToRedo);
     void set_final_branch_operands(_code_pos self);
     void set_branch_target(_code_pos offset, bool fForward);
@@ -268,6 +268,10 @@ public:
 	bool in_branch_block(BranchBlockIndex index, uint16_t levels = 1);
 
     uint16_t calc_size();
+    // Peephole optimizations and branch threading, once all the code has been generated and all
+    // branches resolved. entryPoints are instructions referenced from outside the code (procedures,
+    // methods), which are kept. Returns the number of bytes saved.
+    int optimize(const std::vector<code_pos> &entryPoints);
     uint16_t offset_of(code_pos target);
     void write_code(ITrackCodeSink &trackCodeSink, std::vector<uint8_t> &output, std::vector<uint8_t> *debugInfoOpt);
     bool has_dangling_branches(bool &fAllBranchesAreReturns);
@@ -299,8 +303,10 @@ public:
     }
 
 private:
+    friend class PeepholeOptimizer;
 
     void _insertInstruction(const scii &inst);
+    void _reset_sizes();
     void _checkBranchResolution();
     bool _areAllPriorInstructionsReturns(const fixup_todos &todos);
 
@@ -15,11 +15,20 @@
 
 #include <cstdint>
 #include <memory>
+#include <unordered_set>
 
 struct ResourceComponent
 {
     virtual std::unique_ptr<ResourceComponent> Clone() const = 0;
 
+    // An estimate of the memory used by this component, for limiting the size of undo stacks.
+    // Components that can get large should override this.
+    virtual size_t GetMemorySize() const { return 0; }
+    // The same, but buffers that are shared with other components are only counted if they
+    // aren't already in seen (and are then added to it). Components with shared buffers should
+    // override this too.
+    virtual size_t AccumulateMemorySize(std::unordered_set<const void*> &seen) const { return GetMemorySize(); }
+
     // This is necessary, or else lists of ResourceComponents won't be properly destroyed.
     virtual ~ResourceComponent() {}
 };
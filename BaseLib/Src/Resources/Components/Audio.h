@@ -32,6 +32,8 @@ public:
         return std::make_unique<AudioComponent>(*this);
     }
 
+    size_t GetMemorySize() const override { return sizeof(*this) + DigitalSamplePCM.size(); }
+
     uint32_t GetLength() const { return (uint32_t)DigitalSamplePCM.size(); }
     uint32_t GetLengthInTicks() const;
     uint32_t GetBytesPerSecond() const;
@@ -2,6 +2,9 @@
 
 #include <vector>
 #include <unordered_set>
+#include <algorithm>
+#include <functional>
+#include <queue>
 #include <istream>
 #include <map>
 #include <set>
@@ -435,6 +438,16 @@ SoundComponent::SoundComponent(const SoundTraits& traits) : Traits(traits)
     Reset();
 }
 
+size_t SoundComponent::GetMemorySize() const
+{
+    size_t size = sizeof(*this) + Cues.size() * sizeof(CuePoint);
+    for (const ChannelInfo &channel : _allChannels)
+    {
+        size += sizeof(channel) + channel.Events.size() * sizeof(SoundEvent);
+    }
+    return size;
+}
+
 void SoundComponent::Reset()
 {
     _wDivision = SCI_PPQN; // by default
@@ -448,68 +461,70 @@ void SoundComponent::Reset()
     Cues.clear();
     _allChannels.clear();
     _tracks.clear();
+    _InvalidateEventIndex();
 }
 
 // Returns the total ticks
 DWORD CombineSoundEvents(const std::vector<std::vector<SoundEvent> >& channels, std::vector<SoundEvent>& results)
 {
-    // We'll need to store a position for each channel.  Let's initialize them to zero.
-    std::vector<size_t> _channelPos;
-    _channelPos.insert(_channelPos.begin(), channels.size(), 0);
-    // And keep a running count of the time delta for each track.
-    std::vector<DWORD> _channelTimeDelta;
-    _channelTimeDelta.insert(_channelTimeDelta.begin(), channels.size(), 0);
-
-    // And here's our overall time counter.
-    DWORD dwTimeDelta = 0;
-    DWORD dwLastTimeDelta = 0;
+    std::vector<const std::vector<SoundEvent>*> channelPointers;
+    channelPointers.reserve(channels.size());
+    for (const auto& channel : channels)
+    {
+        channelPointers.push_back(&channel);
+    }
+    return CombineSoundEvents(channelPointers, results);
+}
 
-    while (true)
+DWORD CombineSoundEvents(const std::vector<const std::vector<SoundEvent>*>& channels, std::vector<SoundEvent>& results)
+{
+    // A heap of the absolute time of the next event in each channel that has events left. Events
+    // at the same time come out in channel order.
+    typedef std::pair<DWORD, size_t> NextEvent;
+    std::priority_queue<NextEvent, std::vector<NextEvent>, std::greater<NextEvent>> nextEvents;
+    // We'll need to store a position for each channel.
+    std::vector<size_t> channelPos(channels.size(), 0);
+    size_t totalEvents = 0;
+    for (size_t i = 0; i < channels.size(); i++)
     {
-        // Find the next event, time-wise
-        DWORD dwClosest = (DWORD)(-1);
-        size_t bestChannel = channels.size(); // out of bounds
-        for (size_t i = 0; i < channels.size(); i++)
-        {
-            const std::vector<SoundEvent>& channelData = channels[i];
-            if (_channelPos[i] < channelData.size())
-            {
-                // Still events remaining in this track, so it's under consideration.
-                assert((_channelTimeDelta[i] + channelData[_channelPos[i]].wTimeDelta) >= dwTimeDelta);
-                DWORD dwTimeToNextEvent = (_channelTimeDelta[i] + channelData[_channelPos[i]].wTimeDelta) - dwTimeDelta;
-                if (dwTimeToNextEvent < dwClosest)
-                {
-                    bestChannel = i; // This is the best track so far.
-                    dwClosest = dwTimeToNextEvent;
-                }
-            }
-        }
-        if (bestChannel < channels.size())
+        totalEvents += channels[i]->size();
+        if (!channels[i]->empty())
         {
-            // Add this event.
-            size_t posInChannel = _channelPos[bestChannel];
-            SoundEvent event = channels[bestChannel][posInChannel];
-            // Now update things.
-            _channelTimeDelta[bestChannel] += event.wTimeDelta;
-            // This is now our new time delta
-            dwTimeDelta = _channelTimeDelta[bestChannel];
-            assert(dwTimeDelta < 0xf0000000);
-            _channelPos[bestChannel]++; // We took one event from this track.
-
-            // Fixup the event time before adding it.
-            assert(dwTimeDelta >= dwLastTimeDelta);
-            event.wTimeDelta = dwTimeDelta - dwLastTimeDelta;
-            results.push_back(event);
-            dwLastTimeDelta = dwTimeDelta;
+            nextEvents.emplace((*channels[i])[0].wTimeDelta, i);
         }
-        else
+    }
+    results.reserve(results.size() + totalEvents);
+
+    DWORD dwLastTimeDelta = 0;
+    while (!nextEvents.empty())
+    {
+        DWORD dwTimeDelta = nextEvents.top().first;
+        size_t channel = nextEvents.top().second;
+        nextEvents.pop();
+        assert(dwTimeDelta < 0xf0000000);
+
+        const std::vector<SoundEvent>& channelData = *channels[channel];
+        SoundEvent event = channelData[channelPos[channel]];
+        channelPos[channel]++; // We took one event from this track.
+        if (channelPos[channel] < channelData.size())
         {
-            break; // No more events left.
+            nextEvents.emplace(dwTimeDelta + channelData[channelPos[channel]].wTimeDelta, channel);
         }
+
+        // Fixup the event time before adding it.
+        assert(dwTimeDelta >= dwLastTimeDelta);
+        event.wTimeDelta = dwTimeDelta - dwLastTimeDelta;
+        results.push_back(event);
+        dwLastTimeDelta = dwTimeDelta;
     }
     return dwLastTimeDelta;
 }
 
+size_t SoundEventIndex::FindEvent(DWORD dwTicks) const
+{
+    return std::lower_bound(EventTicks.begin(), EventTicks.end(), dwTicks) - EventTicks.begin();
+}
+
 void ScanAndReadDigitalSample(ResourceEntity& resource, sci::istream stream)
 {
     resource.AddComponent(std::move(std::make_unique<AudioComponent>()));
@@ -1401,6 +1416,10 @@ SoundChangeHint SoundComponent::SetChannelId(DeviceType type, int channelId, boo
         }
         AssertNoDuplicateTracks(*this);
     }
+    if (hint != SoundChangeHint::None)
+    {
+        _InvalidateEventIndex();
+    }
     return hint;
 }
 
@@ -1474,6 +1493,42 @@ bool SoundComponent::DoesDeviceChannelIdOn(DeviceType device, int channelId) con
     }
 }
 
+const SoundEventIndex& SoundComponent::GetEventIndex(DeviceType device) const
+{
+    auto it = _eventIndices.Indices.find((uint8_t)device);
+    if (it != _eventIndices.Indices.end())
+    {
+        return it->second;
+    }
+
+    SoundEventIndex& index = _eventIndices.Indices[(uint8_t)device];
+    std::vector<const std::vector<SoundEvent>*> channels;
+    const TrackInfo* trackInfo = GetTrackInfo(device);
+    if (trackInfo)
+    {
+        for (int channelId : trackInfo->ChannelIds)
+        {
+            for (const auto& channelInfo : _allChannels)
+            {
+                if (channelInfo.Id == channelId)
+                {
+                    channels.push_back(&channelInfo.Events);
+                    break;
+                }
+            }
+        }
+    }
+    index.TotalTicks = CombineSoundEvents(channels, index.Events);
+    index.EventTicks.reserve(index.Events.size());
+    DWORD dwTicks = 0;
+    for (const SoundEvent& event : index.Events)
+    {
+        dwTicks += event.wTimeDelta;
+        index.EventTicks.push_back(dwTicks);
+    }
+    return index;
+}
+
 SoundChangeHint SoundComponent::_EnsureChannel15()
 {
     SoundChangeHint hint = SoundChangeHint::None;
@@ -1502,6 +1557,7 @@ SoundChangeHint SoundComponent::_EnsureChannel15()
         {
             track.ChannelIds.push_back(channel15.Id);
         }
+        _InvalidateEventIndex();
         hint |= SoundChangeHint::Changed;
     }
     return hint;
@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+#include <map>
 #include <vector>
 
 #include "Components/Audio.h"
@@ -93,6 +94,34 @@ private:
 };
 
 DWORD CombineSoundEvents(const std::vector<std::vector<SoundEvent> >& channels, std::vector<SoundEvent>& results);
+DWORD CombineSoundEvents(const std::vector<const std::vector<SoundEvent>*>& channels, std::vector<SoundEvent>& results);
+
+//
+// The events of one device's channels combined into a single stream, with the absolute tick
+// of each event so that positions can be found with a binary search.
+//
+struct SoundEventIndex
+{
+    SoundEventIndex() : TotalTicks(0) {}
+
+    std::vector<SoundEvent> Events;     // Time deltas are from the previous event
+    std::vector<DWORD> EventTicks;      // The absolute tick of each event
+    DWORD TotalTicks;
+
+    // The first event at or after dwTicks, or Events.size() if there is none.
+    size_t FindEvent(DWORD dwTicks) const;
+};
+
+// Event indices by device. These aren't carried over when a sound is copied, since copies are
+// generally made in order to be modified.
+struct SoundEventIndexCache
+{
+    SoundEventIndexCache() = default;
+    SoundEventIndexCache(const SoundEventIndexCache& src) {}
+    SoundEventIndexCache& operator=(const SoundEventIndexCache& src) { Indices.clear(); return *this; }
+
+    std::map<uint8_t, SoundEventIndex> Indices;
+};
 
 enum class SoundChangeHint
 {
@@ -186,6 +215,8 @@ public:
 
     void Reset();
 
+    size_t GetMemorySize() const override;
+
     friend void ScanAndReadDigitalSample(ResourceEntity& resource, sci::istream stream);
     friend void SoundWriteTo(const ResourceEntity& resource, sci::ostream& byteStream, std::map<BlobKey, uint32_t>& propertyBag);
     friend void SoundWriteToWorker(const SoundComponent& sound, sci::ostream& byteStream);
@@ -227,10 +258,14 @@ public:
     const ChannelInfo* GetChannelInfo(DeviceType device, int channelNumber) const;
     bool DoesDeviceHaveTracks(DeviceType device) const;
     bool DoesDeviceChannelIdOn(DeviceType device, int channelId) const;
+    // Built the first time it's asked for, and kept until Reset, SetChannelId or _EnsureChannel15
+    // changes the channels. Edits made directly through GetChannelInfos() don't clear it.
+    const SoundEventIndex& GetEventIndex(DeviceType device) const;
     const SoundTraits& Traits;
 
 private:
     SoundChangeHint _EnsureChannel15();
+    void _InvalidateEventIndex() { _eventIndices.Indices.clear(); }
 
     uint16_t _wDivision;
     DWORD LoopPoint;       // A single loop-point (tick position)
@@ -255,6 +290,8 @@ private:
     // Work on a different sound model.
     std::vector<ChannelInfo> _allChannels;
     std::vector<TrackInfo> _tracks;
+
+    mutable SoundEventIndexCache _eventIndices;
 };
 
 extern SoundTraits soundTraitsSCI0;
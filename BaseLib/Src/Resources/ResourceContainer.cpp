@@ -140,10 +140,19 @@ ResourceContainer::ResourceIterator::reference ResourceContainer::ResourceIterat
     return _CreateHelper(false);
 }
 
-ResourceContainer::ResourceIterator::reference ResourceContainer::ResourceIterator::_CreateHelper(bool delayDecompression) const
+ResourceContainer::ResourceIterator::reference ResourceContainer::ResourceIterator::CreateForVersion(const SCIVersion &version) const
+{
+    return _CreateHelper(false, &version);
+}
+
+ResourceContainer::ResourceIterator::reference ResourceContainer::ResourceIterator::_CreateHelper(bool delayDecompression, const SCIVersion *version) const
 {
     ResourceHeaderAgnostic rh;
     sci::istream packageByteStream = _GetResourceHeaderAndPackage(rh);
+    if (version)
+    {
+        rh.Version = *version;
+    }
 
     // We should validate against the type here.
     if (!IsFlagSet(_container->_resourceTypes, ResourceTypeToFlag(rh.Type)))
@@ -201,6 +210,11 @@ ResourceId ResourceContainer::ResourceIterator::GetResourceId()
     return _currentEntry.GetResourceId();
 }
 
+uint64_t ResourceContainer::ResourceIterator::GetStorageOrder() const
+{
+    return ((uint64_t)_state.mapIndex << 40) | ((uint64_t)_currentEntry.PackageNumber << 32) | _currentEntry.Offset;
+}
+
 void ResourceContainer::ResourceIterator::_GetNextEntry()
 {
     assert(!_atEnd);
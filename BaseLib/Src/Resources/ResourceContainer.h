@@ -136,6 +136,10 @@ public:
 
         reference CreateButDelayDecompression() const;
 
+        // Like operator*, but treats the resource as belonging to version (which determines how it's decompressed),
+        // instead of the version the container was created with.
+        reference CreateForVersion(const SCIVersion &version) const;
+
         ResourceHeaderAgnostic GetResourceHeader() const;
 
         ResourceIterator& operator++();
@@ -144,11 +148,15 @@ public:
         int GetResourceNumber();
         ResourceId GetResourceId();
 
+        // Orders resources by where they are stored (source, then volume, then offset). Reading them
+        // in this order avoids seeking back and forth through large volumes.
+        uint64_t GetStorageOrder() const;
+
     private:
 
         sci::istream _GetResourceHeaderAndPackage(ResourceHeaderAgnostic &rh) const;
         void _GetNextEntry();
-        reference _CreateHelper(bool delayDecompression) const;
+        reference _CreateHelper(bool delayDecompression, const SCIVersion *version = nullptr) const;
 
         IteratorStatePrivate _state;
 
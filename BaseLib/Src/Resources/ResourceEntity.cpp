@@ -87,12 +87,36 @@ std::unique_ptr<ResourceEntity> ResourceEntity::Clone() const
 
     for (auto &pair : components)
     {
-        std::unique_ptr<ResourceComponent> pCopy(pair.second->Clone());
+        std::shared_ptr<ResourceComponent> pCopy(pair.second->Clone());
         pClone->components[pair.first] = std::move(pCopy);
     }
     return pClone;
 }
 
+std::unique_ptr<ResourceEntity> ResourceEntity::CloneShared() const
+{
+    std::unique_ptr<ResourceEntity> pClone = std::make_unique<ResourceEntity>(Traits);
+    pClone->ResourceNumber = ResourceNumber;
+    pClone->PackageNumber = PackageNumber;
+    pClone->Base36Number = Base36Number;
+    pClone->SourceFlags = SourceFlags;
+    pClone->components = components;
+    return pClone;
+}
+
+size_t ResourceEntity::AccumulateMemorySize(std::unordered_set<const void*> &seen) const
+{
+    size_t size = sizeof(*this);
+    for (auto &pair : components)
+    {
+        if (seen.insert(pair.second.get()).second)
+        {
+            size += pair.second->AccumulateMemorySize(seen);
+        }
+    }
+    return size;
+}
+
 // ResourceEntityFactory
 
 std::unique_ptr<ResourceEntity> ResourceEntityFactory::CreateDefaultResource(const SCIVersion& version) const
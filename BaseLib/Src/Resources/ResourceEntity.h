@@ -17,6 +17,7 @@
 #include <typeindex>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "Components.h"
 #include "ResourceTypes.h"
@@ -64,6 +65,13 @@ public:
     // Or is the caller responsible?
     HRESULT InitFromResource(const ResourceBlob *prd);
     std::unique_ptr<ResourceEntity> Clone() const;
+    // Returns a copy that shares its components with this resource. Components are
+    // copied on write: GetComponentForWrite clones a shared component first.
+    // This lets the undo stack keep only the components that an edit changed.
+    std::unique_ptr<ResourceEntity> CloneShared() const;
+
+    // Adds the memory used by any components and buffers not already in seen, and adds them to it.
+    size_t AccumulateMemorySize(std::unordered_set<const void*> &seen) const;
     
     int ResourceNumber;
     int PackageNumber;
@@ -98,6 +106,8 @@ public:
         throw std::exception("No component of this type exists");
     }
 
+    // The component may be shared with copies made by CloneShared. Use GetComponentForWrite
+    // to modify it.
     template<typename _T>
     _T &GetComponent()
     {
@@ -110,6 +120,20 @@ public:
         throw std::exception("No component of this type exists");
     }
 
+    // Clones the component first if it's shared with copies made by CloneShared.
+    template<typename _T>
+    _T &GetComponentForWrite()
+    {
+        const std::type_info& r2 = typeid(_T);
+        auto result = components.find(std::type_index(r2));
+        if (result != components.end())
+        {
+            _EnsureUnique(result->second);
+            return static_cast<_T&>(*(result->second));
+        }
+        throw std::exception("No component of this type exists");
+    }
+
     template<typename _T>
     _T *TryGetComponent()
     {
@@ -137,7 +161,7 @@ public:
     template<typename _T>
     void AddComponent(std::unique_ptr<_T> pComponent)
     {
-        std::unique_ptr<ResourceComponent> pTemp(pComponent.release());
+        std::shared_ptr<ResourceComponent> pTemp(pComponent.release());
         const std::type_info& r2 = typeid(_T);
         components[std::type_index(r2)] = std::move(pTemp);
     }
@@ -170,7 +194,15 @@ public:
     ResourceType GetType() const { return Traits.Type; }
 
 private:
-    std::unordered_map<std::type_index, std::unique_ptr<ResourceComponent>> components;
+    static void _EnsureUnique(std::shared_ptr<ResourceComponent> &component)
+    {
+        if (component.use_count() > 1)
+        {
+            component = component->Clone();
+        }
+    }
+
+    std::unordered_map<std::type_index, std::shared_ptr<ResourceComponent>> components;
 };
 
 class ResourceEntityFactory
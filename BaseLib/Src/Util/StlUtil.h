@@ -292,6 +292,135 @@ namespace sci
         _T *_data;
         size_t _size;
     };
+
+    // Like array, but copies share the same buffer. The buffer is only duplicated when
+    // one of the sharing instances is accessed non-const (copy-on-write), so callers
+    // that only read the data should do so through a const reference.
+    template<typename _T>
+    class shared_array
+    {
+    private:
+        struct _Buffer
+        {
+            _Buffer(size_t size) : data(new _T[size]), generation(0) {}
+            std::unique_ptr<_T[]> data;
+            uint32_t generation;    // Bumped by each non-const access
+        };
+
+    public:
+        // Refers to the buffer of a shared_array without keeping it alive or counting as one of
+        // the instances that share it.
+        class weak_ref
+        {
+        public:
+            weak_ref() : _generation(0) {}
+            weak_ref(const shared_array &src) : _buffer(src._buffer), _generation(src._buffer ? src._buffer->generation : 0) {}
+
+            // True if src has the (non-empty) buffer this was made from, and it hasn't been
+            // accessed non-const since.
+            bool refers_to(const shared_array &src) const
+            {
+                return src._buffer && !_buffer.owner_before(src._buffer) && !src._buffer.owner_before(_buffer) &&
+                    (src._buffer->generation == _generation);
+            }
+
+        private:
+            std::weak_ptr<_Buffer> _buffer;
+            uint32_t _generation;
+        };
+
+        shared_array() : _size(0) {}
+        shared_array(size_t size) : shared_array() { _allocateInternal(size); }
+
+        void allocate(size_t size)
+        {
+            _allocateInternal(size);
+        }
+
+        void assign(const _T *begin, const _T *end)
+        {
+            assert((end - begin) <= (ptrdiff_t)_size);
+            std::copy(begin, end, _mutableData());
+        }
+
+        void swap(shared_array &src)
+        {
+            std::swap(_buffer, src._buffer);
+            std::swap(_size, src._size);
+        }
+
+        void fill(_T value)
+        {
+            std::fill_n(_mutableData(), _size, value);
+        }
+
+        void fill(size_t position, size_t length, _T value)
+        {
+            assert((position + length) <= _size);
+            std::fill_n(_mutableData() + position, length, value);
+        }
+
+        _T *begin() { return _mutableData(); }
+        _T *end() { return _mutableData() + _size; }
+        const _T *begin() const { return _constData(); }
+        const _T *end() const { return _constData() + _size; }
+
+        size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+
+        // True if both refer to the same (non-empty) buffer.
+        bool shares_with(const shared_array &other) const { return _buffer && (_buffer == other._buffer); }
+        bool is_shared() const { return _buffer && (_buffer.use_count() > 1); }
+
+        _T& operator[](size_t index)
+        {
+            return _mutableData()[index];
+        }
+
+        const _T& operator[](size_t index) const
+        {
+            return _constData()[index];
+        }
+
+    private:
+        void _allocateInternal(size_t size)
+        {
+            if (size == 0)
+            {
+                _buffer.reset();
+            }
+            else
+            {
+                _buffer = std::make_shared<_Buffer>(size);
+            }
+            _size = size;
+        }
+
+        const _T *_constData() const
+        {
+            return _buffer ? _buffer->data.get() : nullptr;
+        }
+
+        _T *_mutableData()
+        {
+            if (!_buffer)
+            {
+                return nullptr;
+            }
+            if (is_shared())
+            {
+                std::shared_ptr<_Buffer> copy = std::make_shared<_Buffer>(_size);
+                std::copy(_buffer->data.get(), _buffer->data.get() + _size, copy->data.get());
+                _buffer = copy;
+            }
+            // We can't tell whether the caller writes, so assume it does.
+            _buffer->generation++;
+            return _buffer->data.get();
+        }
+
+        std::shared_ptr<_Buffer> _buffer;
+        size_t _size;
+    };
 }
 
 // A remove_if for associative containers.
@@ -17,6 +17,7 @@
 #include "Disassembler.h"
 #include "DisassembleHelper.h"
 #include "FunctionRef.h"
+#include "InstructionDecoder.h"
 #include "PMachine.h"
 #include "scii.h"
 
@@ -25,32 +26,16 @@
 
 inline bool InspectCode(const TargetArchitecture* arch, const uint8_t *pBegin, const uint8_t *pEnd, uint16_t wBaseOffset, FunctionRef<bool(Opcode, uint16_t[3], uint16_t)> analyzeInstruction)
 {
+    const InstructionDecoder &decoder = GetInstructionDecoder(arch);
     try
     {
         const uint8_t *pCur = pBegin;
-        uint16_t wOffset = wBaseOffset;
-        while (pCur < pEnd) // Possibility of read AVs here, but we catch exceptions.
+        DecodedInstruction instruction;
+        // A truncated instruction at the end is left out.
+        while (decoder.Decode(pCur, pEnd, static_cast<uint16_t>(wBaseOffset + (pCur - pBegin)), instruction))
         {
-            uint8_t bRawOpcode = *pCur;
-            Opcode opcode = arch->RawToOpcode(bRawOpcode);
-            // Advance past opcode
-            pCur++;
-            wOffset++;
-            uint16_t wOperandsRaw[3];
-            auto opTypes = arch->GetOperandTypes(opcode);
-            for (int i = 0; i < opTypes.size(); i++)
-            {
-                int cIncr = GetOperandSize(bRawOpcode, opTypes[i], pCur);
-                if (cIncr == 0)
-                {
-                    break;
-                }
-                wOperandsRaw[i] = (cIncr == 2) ? *((uint16_t*)pCur) : *pCur;
-
-                pCur += cIncr;
-                wOffset += cIncr;
-            }
-            if (!analyzeInstruction(opcode, wOperandsRaw, wOffset))
+            pCur += instruction.Size;
+            if (!analyzeInstruction(instruction.Op, instruction.Operands, instruction.Offset + instruction.Size))
             {
                 return false;
             }
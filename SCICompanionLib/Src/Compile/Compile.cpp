@@ -2828,6 +2828,10 @@ CodeResult FunctionBase::OutputByteCode(CompileContext &context) const
 
 CodeResult ProcedureDefinition::OutputByteCode(CompileContext &context) const
 {
+    if (context.StrippedProcedures.find(this) != context.StrippedProcedures.end())
+    {
+        return 0; // Nothing calls it
+    }
     declare_conditional isCondition(context, false);
     change_meaning meaning(context, false);
     ClassContext classContext(context, GetOwnerClass());
@@ -3838,6 +3842,93 @@ void MaybeSubstituteWithSimpleValue(CompileContext &context, std::unique_ptr<Syn
     }
 }
 
+// Replaces if statements whose conditions are compile time constants with the branch that is taken,
+// and removes while loops that never run. cond statements are just a wrapper around a chain of ifs,
+// so they're unwrapped too. node is reset if nothing remains.
+void RemoveDeadBranches(CompileContext &context, std::unique_ptr<SyntaxNode> &node)
+{
+    while (node)
+    {
+        uint16_t result;
+        IfStatement *ifStatement = SafeSyntaxNode<IfStatement>(node.get());
+        WhileLoop *whileLoop = SafeSyntaxNode<WhileLoop>(node.get());
+        CondStatement *condStatement = SafeSyntaxNode<CondStatement>(node.get());
+        if (ifStatement && ifStatement->GetCondition()->Evaluate(context.GetLookupDefine(), result, nullptr))
+        {
+            if (result)
+            {
+                node = std::move(ifStatement->GetStatement1Internal());
+            }
+            else
+            {
+                // This resets node if there is no else.
+                node = std::move(ifStatement->GetStatement2Internal());
+            }
+        }
+        else if (whileLoop && whileLoop->GetCondition()->Evaluate(context.GetLookupDefine(), result, nullptr) && !result)
+        {
+            node.reset();
+        }
+        else if (condStatement && condStatement->_clausesTemp.empty())
+        {
+            node = std::move(condStatement->GetStatement1Internal());
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+void RemoveDeadBranchesInExpression(CompileContext &context, std::unique_ptr<SyntaxNode> &node)
+{
+    if (node)
+    {
+        RemoveDeadBranches(context, node);
+        if (!node)
+        {
+            // A constant false condition leaves 0 in the acc.
+            node = std::make_unique<PropertyValueNode>(0);
+        }
+    }
+}
+
+// Whether the statements are a body of code (as opposed to parameters or operands), where the
+// value of anything but the last statement is unused.
+bool IsCodeBody(SyntaxNode &node)
+{
+    return dynamic_cast<CodeBlock*>(&node) ||
+        dynamic_cast<FunctionBase*>(&node) ||
+        dynamic_cast<WhileLoop*>(&node) ||
+        dynamic_cast<DoLoop*>(&node) ||
+        dynamic_cast<ForLoop*>(&node) ||
+        dynamic_cast<CaseStatementBase*>(&node);
+}
+
+void RemoveDeadBranchesInStatements(CompileContext &context, SyntaxNodeVector &statements, bool isCodeBody)
+{
+    for (size_t i = 0; i < statements.size(); )
+    {
+        RemoveDeadBranches(context, statements[i]);
+        if (statements[i])
+        {
+            i++;
+        }
+        else if (isCodeBody && (i + 1 < statements.size()))
+        {
+            // The value of anything but the last statement is unused, so it can just go away.
+            statements.erase(statements.begin() + i);
+        }
+        else
+        {
+            // Parameters and operands need to stay where they are, so they get the 0 that a
+            // false condition leaves in the acc.
+            statements[i] = std::make_unique<PropertyValueNode>(0);
+            i++;
+        }
+    }
+}
+
 class EvaluateConstantExpressionsHelper : public sci::IExploreNode
 {
 public:
@@ -3851,6 +3942,7 @@ private:
             StatementsNode *statements = dynamic_cast<StatementsNode*>(&node);
             if (statements)
             {
+                RemoveDeadBranchesInStatements(_context, statements->GetStatements(), IsCodeBody(node));
                 for (std::unique_ptr<SyntaxNode> &statement : statements->GetStatements())
                 {
                     MaybeSubstituteWithSimpleValue(_context, statement);
@@ -3860,12 +3952,14 @@ private:
             OneStatementNode *oneStatement = dynamic_cast<OneStatementNode*>(&node);
             if (oneStatement)
             {
+                RemoveDeadBranchesInExpression(_context, oneStatement->GetStatement1Internal());
                 MaybeSubstituteWithSimpleValue(_context, oneStatement->GetStatement1Internal());
             }
 
             TwoStatementNode *twoStatement = dynamic_cast<TwoStatementNode*>(&node);
             if (twoStatement)
             {
+                RemoveDeadBranchesInExpression(_context, twoStatement->GetStatement2Internal());
                 MaybeSubstituteWithSimpleValue(_context, twoStatement->GetStatement2Internal());
             }
 
@@ -3877,7 +3971,8 @@ private:
 
 void EvaluateConstantExpressions(CompileContext &context, sci::Script &script)
 {
-    // Replace any constant expressions with their evaluated form.
+    // Replace any constant expressions with their evaluated form, and remove code in branches
+    // that can never be taken.
     // REVIEW: This could cause problems if we provided weakptrs to certain objects to the compile context.
     EvaluateConstantExpressionsHelper evaluate(context);
     script.Traverse(evaluate);
@@ -136,9 +136,9 @@ TextComponent& CompileResults::GetTextComponent()
 // e.g. Name is "Feature"
 void CompileContext::_LoadSCO(const std::string& name, bool fErrorIfNotFound)
 {
-    auto sco = _fileLoader->LoadSCOFile(name, _tables.Selectors());
+    auto sco = _tables.SCOs().Load(name, *_fileLoader, _tables.Selectors());
     if (sco.ok()) {
-        auto scriptNumber = sco->GetScriptNumber();
+        auto scriptNumber = (*sco)->GetScriptNumber();
         _scos[scriptNumber] = *std::move(sco);
     }
     else if (fErrorIfNotFound)
@@ -151,11 +151,10 @@ void CompileContext::_LoadSCO(const std::string& name, bool fErrorIfNotFound)
 // Doesn't produce an error if we can't get one.  (Maybe it should?)
 void CompileContext::_LoadSCOIfNone(WORD wScript)
 {
-    auto iter = _scos.find(wScript);
-    if ((iter == _scos.end()) || (iter->second.IsEmpty()))
+    // The "this" script is never loaded from disk.
+    if ((wScript != _wScriptNumber) && (_scos.find(wScript) == _scos.end()))
     {
-        assert((wScript != _wScriptNumber) && (_wScriptNumber != InvalidResourceNumber));
-        // The "this" script should always be found.
+        assert(_wScriptNumber != InvalidResourceNumber);
         std::string scriptName = _numberToNameMap[wScript];
         if (scriptName.empty())
         {
@@ -170,6 +169,34 @@ void CompileContext::_LoadSCOIfNone(WORD wScript)
     }
 }
 
+bool CompileContext::_LookupGlobalVariable(const std::string &name, WORD &wIndex)
+{
+    // Globals are the script variables of main (which may be the script we're compiling).
+    if (_wScriptNumber == 0)
+    {
+        return _scriptSCO.GetVariableIndex(name, wIndex);
+    }
+    auto it = _scos.find(0);
+    return (it != _scos.end()) && it->second->GetVariableIndex(name, wIndex);
+}
+
+const CSCOObjectClass *CompileContext::_FindSCOClass(const std::string &className)
+{
+    const CSCOObjectClass *pClass = nullptr;
+    if (!_scriptSCO.GetClass(className, &pClass))
+    {
+        for (WordSCOMap::value_type& p : _scos)
+        {
+            pClass = p.second->GetClass(className);
+            if (pClass)
+            {
+                break;
+            }
+        }
+    }
+    return pClass;
+}
+
 const uint16_t TempTokenBase = 2345;
 
 ContextLookupDefine::ContextLookupDefine(CompileContext* parent): _parent(parent)
@@ -201,6 +228,7 @@ CompileContext::CompileContext(SCIClassBrowser& browser, CResourceMap& resource_
                                ICompileLog& results, bool generateDebugInfo) :
     FunctionBaseForPrescan(nullptr),
     GenerateDebugInfo(generateDebugInfo),
+    OptimizeCode(false),
     _nextTempToken(TempTokenBase),
     _browser(browser),
     _fileLoader(std::make_unique<ResourceMapCompilerFileLoader>(&resource_map)),
@@ -258,8 +286,16 @@ WORD CompileContext::GetScriptNumber()
 
 WORD CompileContext::AddStringResourceTuple(const string& str)
 {
+    // The same text only needs to be in the text resource once.
+    auto it = _resourceStringIndices.find(str);
+    if (it != _resourceStringIndices.end())
+    {
+        return it->second;
+    }
     _resourceStrings.push_back(str);
-    return (WORD)(_resourceStrings.size() - 1);
+    WORD index = (WORD)(_resourceStrings.size() - 1);
+    _resourceStringIndices[str] = index;
+    return index;
 }
 
 const vector<string>& CompileContext::GetResourceStrings()
@@ -403,7 +439,7 @@ ResolvedToken CompileContext::LookupToken(const SyntaxNode* pNodeForError, const
         {
             // ResolvedToken::GlobalVariable
             // Keep going - check for global vars (script 0)
-            if (_scos[0].GetVariableIndex(str, wIndex))
+            if (_LookupGlobalVariable(str, wIndex))
             // May not have a main - that's ok, this will create a dummy empty one.
             {
                 dataType = DataTypeAny;
@@ -475,15 +511,12 @@ bool CompileContext::LookupSpeciesIndex(const string& str, SpeciesIndex& wSpecie
 {
     // Check the scoFiles for this class. We used to check the index of the class in the sco file, then
     // reference the global class table to find the species#. No need for that though.
-    for (WordSCOMap::value_type& p : _scos)
+    const CSCOObjectClass* pClass = _FindSCOClass(str);
+    if (pClass)
     {
-        CSCOFile& scoFile = p.second;
-        if (scoFile.GetClassSpecies(str, wSpeciesIndex))
-        {
-            return true;
-        }
+        wSpeciesIndex = pClass->GetSpecies();
     }
-    return false;
+    return pClass != nullptr;
 }
 
 bool CompileContext::IsDefaultSelector(uint16_t value)
@@ -525,10 +558,20 @@ std::string CompileContext::SpeciesIndexToDataTypeString(SpeciesIndex wSpeciesIn
         WORD wScript, wClassIndexInScript;
         if (_tables.Species().GetSpeciesLocation(wSpeciesIndex, wScript, wClassIndexInScript))
         {
-            _LoadSCOIfNone(wScript);
-            CSCOFile& scoFile = _scos[wScript];
             // Find the name.
-            dataType = scoFile.GetClassName(wClassIndexInScript);
+            if (wScript == _wScriptNumber)
+            {
+                dataType = _scriptSCO.GetClassName(wClassIndexInScript);
+            }
+            else
+            {
+                _LoadSCOIfNone(wScript);
+                auto it = _scos.find(wScript);
+                if (it != _scos.end())
+                {
+                    dataType = it->second->GetClassName(wClassIndexInScript);
+                }
+            }
         }
     }
 
@@ -582,20 +625,15 @@ vector<species_property> CompileContext::GetSpeciesProperties(const string& spec
     if (!speciesNames.empty())
     {
         // Find the scofile that contains this species.
-        for (WordSCOMap::value_type& p : _scos)
+        const CSCOObjectClass* pClass = _FindSCOClass(speciesNames);
+        if (pClass)
         {
-            CSCOFile& scoFile = p.second;
-            const CSCOObjectClass* pClass = nullptr;
-            if (scoFile.GetClass(speciesNames, &pClass))
+            // We have the class.
+            const vector<CSCOObjectProperty>& properties = pClass->GetProperties();
+            for (auto& theProp : properties)
             {
-                // We have the class.
-                const vector<CSCOObjectProperty>& properties = pClass->GetProperties();
-                for (auto& theProp : properties)
-                {
-                    species_property specProp = {theProp.GetSelector(), theProp.GetValue(), DataTypeAny, false};
-                    propertiesRet.push_back(specProp);
-                }
-                break;
+                species_property specProp = {theProp.GetSelector(), theProp.GetValue(), DataTypeAny, false};
+                propertiesRet.push_back(specProp);
             }
         }
     }
@@ -681,7 +719,8 @@ ProcedureType CompileContext::LookupProc(const string& str, WORD& wScript, WORD&
         else
         {
             // Then main
-            if (_scos[0].GetExportIndex(str, wIndex))
+            auto mainIt = _scos.find(0);
+            if ((_wScriptNumber == 0) ? _scriptSCO.GetExportIndex(str, wIndex) : ((mainIt != _scos.end()) && mainIt->second->GetExportIndex(str, wIndex)))
             {
                 // Found a proc in main.
                 type = ProcedureMain;
@@ -692,14 +731,19 @@ ProcedureType CompileContext::LookupProc(const string& str, WORD& wScript, WORD&
                 // Then other sco files.
                 for (WordSCOMap::value_type& p : _scos)
                 {
-                    CSCOFile& scoFile = p.second;
-                    if (scoFile.GetExportIndex(str, wIndex))
+                    if (p.second->GetExportIndex(str, wIndex))
                     {
                         // Found it.
-                        wScript = scoFile.GetScriptNumber();
+                        wScript = p.first;
                         type = ProcedureExternal;
+                        break;
                     }
                 }
+                if ((type == ProcedureUnknown) && _scriptSCO.GetExportIndex(str, wIndex))
+                {
+                    wScript = _wScriptNumber;
+                    type = ProcedureExternal;
+                }
             }
         }
     }
@@ -748,9 +792,23 @@ bool CompileContext::_GetSCOObject(SpeciesIndex wSpecies, CSCOObjectClass& scoOb
         WORD wScript, wClassIndexInScript;
         if (_tables.Species().GetSpeciesLocation(wSpecies, wScript, wClassIndexInScript))
         {
-            _LoadSCOIfNone(wScript);
-            CSCOFile& scoFile = _scos[wScript];
-            scoObject = scoFile.GetObjectBySpecies(wSpecies);
+            if (wScript == _wScriptNumber)
+            {
+                scoObject = _scriptSCO.GetObjectBySpecies(wSpecies);
+            }
+            else
+            {
+                // Classes in scripts we've already seen this build can be found without going through the script name.
+                std::shared_ptr<const IndexedSCOFile> sco;
+                const CSCOObjectClass* pClass = nullptr;
+                if (!_tables.SCOs().FindClassBySpecies(wSpecies, sco, pClass) || (sco->GetScriptNumber() != wScript))
+                {
+                    _LoadSCOIfNone(wScript);
+                    auto it = _scos.find(wScript);
+                    pClass = (it != _scos.end()) ? it->second->GetClassBySpecies(wSpecies) : nullptr;
+                }
+                scoObject = pClass ? *pClass : CSCOObjectClass();
+            }
             fRet = true;
         }
     }
@@ -1145,6 +1203,16 @@ bool CompileContext::ScanObjectMethod(const std::string& objectName, const std::
 // Other public functions
 vector<call_pair>& CompileContext::GetCalls() { return _calls; }
 vector<code_pos>& CompileContext::GetExports() { return _exports; }
+vector<code_pos> CompileContext::GetCodeEntryPoints()
+{
+    // Exports are local procedures too.
+    vector<code_pos> entryPoints;
+    for (auto &localProc : _localProcs)
+    {
+        entryPoints.push_back(localProc.second);
+    }
+    return entryPoints;
+}
 vector<WORD>& CompileContext::GetPublicInstanceOffsets() { return _publicInstances; }
 
 void CompileResults::SetAutoTextNumber(uint16_t autoTextNumber)
@@ -1169,7 +1237,9 @@ void CompileContext::SetScriptNumber()
         ReportError(&_script, "Script number must be less than %d: %d", _version.GetMaximumResourceNumber(),
                     _wScriptNumber);
     }
-    _scos[_wScriptNumber].SetScriptNumber(_wScriptNumber);
+    _scriptSCO.SetScriptNumber(_wScriptNumber);
+    // If we happened to use our own (old) .sco file, the one we're generating replaces it.
+    _scos.erase(_wScriptNumber);
 }
 
 WORD CompileContext::EnsureSpeciesTableEntry(WORD wIndexInScript)
@@ -1195,8 +1265,8 @@ void CompileContext::AddSCOClass(CSCOObjectClass scoClass, bool fInstance)
     else
     {
         assert(_wScriptNumber != InvalidResourceNumber);
-        assert(_scos[_wScriptNumber].GetScriptNumber() != 0xffff); // Script number not supplied yet.
-        _scos[_wScriptNumber].AddObject(scoClass);
+        assert(_scriptSCO.GetScriptNumber() != 0xffff); // Script number not supplied yet.
+        _scriptSCO.AddObject(scoClass);
     }
 }
 
@@ -1204,19 +1274,19 @@ void CompileContext::ReplaceSCOClass(CSCOObjectClass scoClass)
 {
     // This is a bit of a hack.
     assert(_wScriptNumber != InvalidResourceNumber);
-    _scos[_wScriptNumber].ReplaceObject(scoClass);
+    _scriptSCO.ReplaceObject(scoClass);
 }
 
 void CompileContext::AddSCOVariable(CSCOLocalVariable scoVar)
 {
     assert(_wScriptNumber != InvalidResourceNumber);
-    _scos[_wScriptNumber].AddVariable(scoVar);
+    _scriptSCO.AddVariable(scoVar);
 }
 
 void CompileContext::AddSCOPublics(CSCOPublicExport scoPublic)
 {
     assert(_wScriptNumber != InvalidResourceNumber);
-    _scos[_wScriptNumber].AddPublic(scoPublic);
+    _scriptSCO.AddPublic(scoPublic);
 }
 
 std::vector<CSCOObjectClass>& CompileContext::GetInstanceSCOs()
@@ -1227,7 +1297,7 @@ std::vector<CSCOObjectClass>& CompileContext::GetInstanceSCOs()
 CSCOFile& CompileContext::GetScriptSCO()
 {
     assert(_wScriptNumber != InvalidResourceNumber);
-    return _scos[_wScriptNumber];
+    return _scriptSCO;
 }
 
 std::string CompileContext::LookupSelectorName(WORD wIndex) const
@@ -17,6 +17,7 @@
 
 #include "scii.h"
 #include "SCO.h"
+#include "SCOCache.h"
 #include "Vocab000.h"
 #include "Vocab99x.h"
 #include "ScriptOMSmall.h"
@@ -52,6 +53,7 @@ namespace sci
     class PropertyValueNode;
     class VariableDecl;
     class FunctionBase;
+    class ProcedureDefinition;
 }
 class CResourceMap;
 class IOutputByteCode;
@@ -123,13 +125,15 @@ struct CompileQuery
 // Size in bytes of generated script
 struct CompileStats
 {
-    CompileStats() : Objects(0), Locals(0), Code(0), Strings(0), Saids(0) {}
+    CompileStats() : Objects(0), Locals(0), Code(0), Strings(0), Saids(0), CodeSaved(0), PoolingSaved(0) {}
 
     int Objects;
     int Locals;
     int Code;
     int Strings;
     int Saids;
+    int CodeSaved;      // By the peephole optimizer
+    int PoolingSaved;   // By sharing identical strings and saids
 };
 
 class CompilerFileLoader
@@ -222,6 +226,9 @@ public:
     const sci::FunctionBase *FunctionBaseForPrescan;
 
     bool GenerateDebugInfo;
+    bool OptimizeCode;
+    // Public procedures that are left out of the generated code and the .sco file.
+    std::unordered_set<const sci::ProcedureDefinition*> StrippedProcedures;
 
 private:
     std::map<std::string, uint16_t> *_GetTempTokenMap(sci::ValueType type);
@@ -248,8 +255,11 @@ private:
     sci::Script &_script;       // Script being compiled
     sci::Script *_pErrorScript;  // Current script used for error reporting (could be header file)
 
-    typedef std::unordered_map<WORD, CSCOFile> WordSCOMap;
+    // The .sco files for the scripts we use. These are shared with the rest of the build.
+    typedef std::unordered_map<WORD, std::shared_ptr<const IndexedSCOFile>> WordSCOMap;
     WordSCOMap _scos;
+    // The .sco file for the script being compiled.
+    CSCOFile _scriptSCO;
     std::unordered_map<WORD, std::string> _numberToNameMap;
     std::vector<CSCOObjectClass> _instances;
     WORD _wScriptNumber;
@@ -268,6 +278,8 @@ private:
     // Loads an SCOFile if we don't already have one for this script.
     // Doesn't produce an error if we can't get one.  (Maybe it should?)
     void _LoadSCOIfNone(WORD wScript);
+    bool _LookupGlobalVariable(const std::string &name, WORD &wIndex);
+    const CSCOObjectClass *_FindSCOClass(const std::string &className);
 
     bool _WasSinkWritten(uint16_t tempToken);
 
@@ -375,6 +387,8 @@ public:
     // Other public functions
     std::vector<call_pair> &GetCalls();
     std::vector<code_pos> &GetExports();
+    // Procedures and methods: code that is referenced from outside the code itself.
+    std::vector<code_pos> GetCodeEntryPoints();
     std::vector<WORD> &GetPublicInstanceOffsets();
     void SetScriptNumber();
     WORD EnsureSpeciesTableEntry(WORD wIndexInScript);
@@ -429,6 +443,7 @@ private:
 
     // List of resource strings we'll need to write to a text resource
     std::vector<std::string> _resourceStrings;
+    std::unordered_map<std::string, WORD> _resourceStringIndices;
 
     std::string _className;
     std::string _superClassName;
@@ -502,6 +517,7 @@ ArrayCodeResult OutputByteCodeForRange(CompileContext &context, C&& container)
 // is kept across individual compiles.
 // Both the species and selector tables may be modified.  They will be updated in the game
 // when Save is called.
+// The .sco files loaded during compilation are also kept here, so they're shared for the whole build.
 //
 class CompileTables
 {
@@ -512,11 +528,18 @@ public:
     const KernelTable &Kernels() { return _kernels; }
     SpeciesTable &Species() { return _species; }
     SelectorTable &Selectors() { return _selectors; }
+    SCOCache &SCOs() { return _scos; }
+    // The export slots of public procedures that nothing in the game calls, with the name of the procedure
+    // in each, by script number. A procedure is left out when scripts are compiled with these tables if
+    // all the slots it is exported in are here.
+    std::unordered_map<uint16_t, std::map<uint16_t, std::string>> &StrippedProcedures() { return _strippedProcedures; }
 private:
     const Vocab000 *_pVocab;
     KernelTable _kernels;
     SpeciesTable _species;
     SelectorTable _selectors;
+    SCOCache _scos;
+    std::unordered_map<uint16_t, std::map<uint16_t, std::string>> _strippedProcedures;
 };
 
 //
@@ -578,7 +601,7 @@ private:
 // The be-all end-all function for compiling a script.
 // Returns true if there were no errors.
 //
-bool GenerateScriptResource(SCIClassBrowser& browser, CResourceMap& resource_map, const SCIVersion& version, sci::Script &script, PrecompiledHeaders &headers, CompileTables &tables, CompileResults &results, bool generateDebugInfo);
+bool GenerateScriptResource(SCIClassBrowser& browser, CResourceMap& resource_map, const SCIVersion& version, sci::Script &script, PrecompiledHeaders &headers, CompileTables &tables, CompileResults &results, bool generateDebugInfo, bool optimizeCode);
 void ErrorHelper(CompileContext &context, const ISourceCodePosition *pPos, const std::string &text, const std::string &identifier, bool checkUse = true);
 bool NewCompileScript(CompileResults &results, CompileLog &log, CompileTables &tables, PrecompiledHeaders &headers, ScriptId &script);
 std::unique_ptr<sci::Script> SimpleCompile(CompileLog &log, ScriptId &scriptId, bool addCommentsToOM = false);
@@ -178,6 +178,19 @@ std::string CompiledScript::GetStringOrSaidFromOffset(uint16_t value, ValueType
             type = ValueType::Said;
             stringValue = _saidStrings[index];
         }
+        else
+        {
+            // The compiler's string pooling may point into the end of another string.
+            for (size_t i = 0; i < _strings.size(); i++)
+            {
+                if ((value > _stringsOffset[i]) && (value <= (_stringsOffset[i] + _strings[i].length())))
+                {
+                    type = ValueType::String;
+                    stringValue = _strings[i].substr(value - _stringsOffset[i]);
+                    break;
+                }
+            }
+        }
     }
 
     return stringValue;
@@ -19,6 +19,7 @@
 #include "OutputCodeHelper.h"
 #include "PMachine.h"
 #include "Vocab000.h"
+#include "InstructionDecoder.h"
 using namespace std;
 
 #define STATE_CALCBRANCHES 0
@@ -26,7 +27,54 @@ using namespace std;
 
 const char InvalidLookupError[] = "LOOKUP_ERROR";
 
-void _GetVarType(std::ostream &out, Opcode bOpcode, uint16_t wIndex, IObjectFileScriptLookups *pOFLookups)
+namespace
+{
+    // These match what an ostream in hex mode with a fill of '0' would produce, which is what the
+    // rest of the disassembly uses.
+    void _AppendHex(std::string &line, uint16_t value, int width = 0)
+    {
+        static const char hexDigits[] = "0123456789abcdef";
+        char digits[4];
+        int count = 0;
+        do
+        {
+            digits[count++] = hexDigits[value & 0xf];
+            value >>= 4;
+        } while (value);
+        for (int i = count; i < width; i++)
+        {
+            line.push_back('0');
+        }
+        while (count > 0)
+        {
+            line.push_back(digits[--count]);
+        }
+    }
+
+    void _AppendRightAligned(std::string &line, const char *psz, int width)
+    {
+        size_t length = strlen(psz);
+        if ((int)length < width)
+        {
+            line.append(width - length, ' ');
+        }
+        line.append(psz, length);
+    }
+
+    // The target of a branch, call or lofsa, relative to the pc after the instruction.
+    uint16_t _RelativeTarget(const DecodedInstruction &instruction, int operandIndex)
+    {
+        uint16_t wRelOffset = instruction.Operands[operandIndex];
+        if ((instruction.OperandSizes[operandIndex] == 1) && (wRelOffset >= 0x0080))
+        {
+            // It was a negative number, expressed in a byte.
+            wRelOffset |= 0xff00;
+        }
+        return instruction.Offset + instruction.Size + wRelOffset;
+    }
+}
+
+void _GetVarType(std::string &line, Opcode bOpcode, uint16_t wIndex, IObjectFileScriptLookups *pOFLookups)
 {
     // This is a 0-127 opcode.
     // Use the lowest two bits to determine the var type
@@ -36,28 +84,28 @@ void _GetVarType(std::ostream &out, Opcode bOpcode, uint16_t wIndex, IObjectFile
         // Get the global's name if possible
         if (pOFLookups)
         {
-            out << pOFLookups->ReverseLookupGlobalVariableName(wIndex);
+            line += pOFLookups->ReverseLookupGlobalVariableName(wIndex);
         }
         else
         {
-            out << _GetGlobalVariableName(wIndex);
+            line += _GetGlobalVariableName(wIndex);
         }
         break;
     case 1:
-        out << _GetLocalVariableName(wIndex, 0xffff);
+        line += _GetLocalVariableName(wIndex, 0xffff);
         break;
     case 2:
-        out << _GetTempVariableName(wIndex);
+        line += _GetTempVariableName(wIndex);
         break;
     case 3:
         if (wIndex == 0)
         {
             // parameter 0 is the count of parameters.
-            out << "paramTotal";
+            line += "paramTotal";
         }
         else
         {
-            out << _GetParamVariableName(wIndex);
+            line += _GetParamVariableName(wIndex);
         }
         break;
     }
@@ -100,66 +148,29 @@ int GetOperandSize(BYTE bOpcode, OperandType operandType, const uint8_t *pNext)
 }
 
 // This really needs a re-working, it should not be responsible for outputting text.
+// Each instruction's text is put together in a buffer and written to the stream in one go. The stream
+// is assumed to be in hex mode, as it is for the rest of the disassembly.
 void DisassembleCode(SCIVersion version, std::ostream &out, ICompiledScriptLookups *pLookups, IObjectFileScriptLookups *pOFLookups, const ICompiledScriptSpecificLookups *pScriptThings, const ILookupPropertyName *pPropertyNames, const BYTE *pBegin, const BYTE *pEnd, uint16_t wBaseOffset, AnalyzeInstructionPtr analyzeInstruction)
 {
-    auto arch = GetTargetArchitecture(version);
+    const InstructionDecoder &decoder = GetInstructionDecoder(version);
     try
     {
         set<uint16_t> codeLabelOffsets; // Keep track of places that are branched to.
+        std::string line;
+        line.reserve(256);
         for (int state = 0; state < 2; state++)
         {
             const BYTE *pCur = pBegin;
             uint16_t wOffset = wBaseOffset;
             auto currentLabelOffset = codeLabelOffsets.begin(); // for STATE_CALCBRANCHES
-            while (pCur < pEnd) // Possibility of read AVs here, but we catch exceptions.
+            DecodedInstruction instruction;
+            // A truncated instruction at the end is left out.
+            while (decoder.Decode(pCur, pEnd, wOffset, instruction))
             {
-                BYTE bRawOpcode = *pCur;
-                Opcode bOpcode = arch->RawToOpcode(bRawOpcode);
-
+                Opcode bOpcode = instruction.Op;
                 assert(bOpcode <= Opcode::LastOne);
-                const char *pszOpcode = OpcodeToName(bOpcode, 0);   // Passing zero here is ok, since this code will never show an LEAI instruction.
-                bool bByte = (*pCur) & 1; // Is this a "byte" opcode or a "word" opcode.
-                bool fDone = false;
-
-                char szBuf[50];
-                size_t cchBufLimit = 30;
-                assert(cchBufLimit < ARRAYSIZE(szBuf));
-                if (state == STATE_OUTPUT)
-                {
-                    if ((currentLabelOffset != codeLabelOffsets.end()) && (*currentLabelOffset == wOffset))
-                    {
-                        // We're at label.
-                        out << endl << "        code_" << setw(4) << setfill('0') << wOffset << endl;
-                        ++currentLabelOffset;
-                    }
-                    out << "  " << setw(4) << setfill('0') << wOffset << ":";
-                    int indent = 22;
-                    const BYTE *pCurTemp = pCur; // skip past opcode
-                    auto opTypes = arch->GetOperandTypes(bOpcode);
-                    for (int i = -1; i < opTypes.size(); i++)
-                    {
-                        int cIncr = (i == -1) ? 1 : GetOperandSize(bRawOpcode, opTypes[i], pCur + 1);
-                        if (cIncr == 0)
-                        {
-                            break;
-                        }
-                        else
-                        {
-                            uint16_t wOperandTemp = (cIncr == 2) ? *((uint16_t*)pCurTemp) : *pCurTemp;
-                            out << setw((cIncr == 1) ? 2 : 4);
-                            out << setfill('0') << wOperandTemp << " ";
-                            pCurTemp += cIncr;
-                            indent -= (cIncr == 1) ? 3 : 5; // How many chars were written...
-                        }
-                    }
-                    assert(indent > 0);
-                    out << setw(indent) << setfill(' ') << pszOpcode << " "; // Indent x chars, and print opcode
-                }
-
-
-                pCur++; // skip past opcode
-                wOffset++;
-                uint16_t wOperandStart = wOffset;
+                pCur += instruction.Size;
+                wOffset += instruction.Size;
 
                 if (state == STATE_CALCBRANCHES)
                 {
@@ -168,183 +179,191 @@ void DisassembleCode(SCIVersion version, std::ostream &out, ICompiledScriptLooku
                     {
                         // This is a branch instruction.  Figure out the offset.
                         // The relative offset is either a byte or word, and is calculated post instruction
-                        // (hence we add 1 or 2 to our calculation)
-                        codeLabelOffsets.insert(CalcOffset(arch, wOperandStart, (bByte ? ((uint16_t)*pCur) : (*((uint16_t*)pCur))), bByte, bRawOpcode));
+                        codeLabelOffsets.insert(_RelativeTarget(instruction, 0));
                     }
+                    continue;
+                }
+
+                line.clear();
+                if ((currentLabelOffset != codeLabelOffsets.end()) && (*currentLabelOffset == instruction.Offset))
+                {
+                    // We're at label.
+                    line += "\n        code_";
+                    _AppendHex(line, instruction.Offset, 4);
+                    line += '\n';
+                    ++currentLabelOffset;
                 }
+                line += "  ";
+                _AppendHex(line, instruction.Offset, 4);
+                line += ':';
+
+                // Indent 22 chars, and print opcode
+                _AppendRightAligned(line, instruction.Name, 22);
+                line += ' ';
 
-                uint16_t wOperandsRaw[3];
                 uint16_t wOperands[3];
-                auto opTypes = arch->GetOperandTypes(bOpcode);
-                for (int i = 0; !fDone && i < opTypes.size(); i++)
+                for (int i = 0; i < instruction.OperandCount; i++)
                 {
-                    szBuf[0] = 0;
-                    int cIncr = GetOperandSize(bRawOpcode, opTypes[i], pCur);
-                    if (cIncr == 0)
+                    wOperands[i] = instruction.Operands[i];
+                    switch (instruction.OperandTypes[i])
                     {
+                    case otINT:
+                    case otUINT:
+                    case otINT16:
+                    case otINT8:
+                    case otUINT8:
+                    case otUINT16:
+                    case otPVAR:
+                        _AppendHex(line, wOperands[i]);
                         break;
-                    }
-                    if (state == STATE_OUTPUT)
-                    {
-                        wOperandsRaw[i] = (cIncr == 2) ? *((uint16_t*)pCur) : *pCur;
-                        wOperands[i] = wOperandsRaw[i];
-                        switch (opTypes[i])
+                    case otKERNEL:
+                        line += pLookups->LookupKernelName(wOperands[i]);
+                        break;
+                    case otPUBPROC:
+                        line += "procedure_";
+                        _AppendHex(line, wOperands[i], 4);
+                        break;
+                    case otSAID:
+                        line += "said_";
+                        _AppendHex(line, wOperands[i], 4);
+                        break;
+                    case otOFFS:
+                        // This is a bit of a hack here.  We're making the assumption that a otOFFS parameter
+                        // is the one and only parameter for this opcode.
+                        assert(instruction.OperandCount == (i + 1));
+                        if (!version.lofsaOpcodeIsAbsolute)
                         {
-                        case otINT:
-                        case otUINT:
-                        case otINT16:
-                        case otINT8:
-                        case otUINT8:
-                        case otUINT16:
-                        case otPVAR:
-                            out << wOperands[i];
-                            break;
-                        case otKERNEL:
-                            out << pLookups->LookupKernelName(wOperands[i]);
-                            break;
-                        case otPUBPROC:
-                            out << "procedure_" << setw(4) << setfill('0') << wOperands[i];
-                            break;
-                        case otSAID:
-                            out << "said_" << setw(4) << setfill('0') << wOperands[i];
-                            break;
-                        case otOFFS:
-                            // This is a bit of a hack here.  We're making the assumption that a otOFFS parameter
-                            // is the one and only parameter for this opcode.  CalcOffset makes this assumption
-                            // in order to calculate the offset.
-                            assert(opTypes.size() == (i + 1));
-                            if (version.lofsaOpcodeIsAbsolute)
-                            {
-                                wOperands[i] = wOperandsRaw[i]; // Unnecessary, but reinforces the point.
-                            }
-                            else
-                            {
-                                wOperands[i] = CalcOffset(arch, wOperandStart, wOperandsRaw[i], bByte, bRawOpcode);
-                            }
-                            out << "$" << setw(4) << setfill('0') << wOperands[i];
-                            break;
-
-                        case otPROP:
-                            // This value is an offset from the beginning of this object's species
-                            // So, get the species, and then divide this value by 2, and use it as an index into its
-                            // selector thang.
-                            //
-                            if (pPropertyNames)
-                            {
-                                out << pPropertyNames->LookupPropertyName(pLookups, wOperands[i]);
-                            }
-                            else
-                            {
-                                out << " // (property opcode in procedure)";
-                            }
-                            break;
-
-                        case otCLASS:
-                            out << pLookups->LookupClassName(wOperands[i]);
-                            break;
-
-                        case otVAR:
-                            _GetVarType(out, bOpcode, wOperands[i], pOFLookups);
-                            break;
-
-                        case otLABEL:
-                            // This is a relative position from the post pc
-                            out << ((bOpcode == Opcode::CALL) ? "proc" : "code") << "_" << setw(4) << setfill('0') <<
-                                CalcOffset(arch, wOperandStart, wOperands[i], bByte,
-                                           bRawOpcode);
-                            break;
-
-                        case otDEBUGSTRING:
-                            // Filename
-                            out << "\"" << reinterpret_cast<const char *>(pCur) << "\"";
-                            break;
-
-                        default:
-                            assert(false && "Unknown operand type");
-                            out << "$" << setw(4) << setfill('0') << wOperands[i];
-                            break;
+                            wOperands[i] = _RelativeTarget(instruction, i);
                         }
-                        out << " ";
-                    }
-                    pCur += cIncr;
-                    wOffset += cIncr;
-                }
+                        line += '$';
+                        _AppendHex(line, wOperands[i], 4);
+                        break;
 
-                if (analyzeInstruction && (state == STATE_OUTPUT))
-                {
-                    (*analyzeInstruction)(bOpcode, wOperandsRaw, wOffset);
-                }
+                    case otPROP:
+                        // This value is an offset from the beginning of this object's species
+                        // So, get the species, and then divide this value by 2, and use it as an index into its
+                        // selector thang.
+                        //
+                        if (pPropertyNames)
+                        {
+                            line += pPropertyNames->LookupPropertyName(pLookups, wOperands[i]);
+                        }
+                        else
+                        {
+                            line += " // (property opcode in procedure)";
+                        }
+                        break;
 
-                if (state == STATE_OUTPUT)
-                {
-                    // Time for comments (for some instructions)
-                    szBuf[0] = 0;
-                    switch (bOpcode)
-                    {
-                    case Opcode::LINK:
-                        out << "// (var $" << wOperands[0] << ")";
+                    case otCLASS:
+                        line += pLookups->LookupClassName(wOperands[i]);
                         break;
 
-                    case Opcode::LOFSS:
-                    case Opcode::LOFSA:
-                    {
-                        // This is an offset... it could be an interesting one, like a string or said.
-                        ICompiledScriptSpecificLookups::ObjectType type;
-                        std::string name = InvalidLookupError;
-                        pScriptThings->LookupObjectName(wOperands[0], type, name);
-                        out << "// " << name;
-                    }
+                    case otVAR:
+                        _GetVarType(line, bOpcode, wOperands[i], pOFLookups);
                         break;
 
-                    case Opcode::PUSHI:
-                        out << "// $" << wOperands[0] << " " << pLookups->LookupSelectorName(wOperands[0]);
+                    case otLABEL:
+                        // This is a relative position from the post pc
+                        line += (bOpcode == Opcode::CALL) ? "proc_" : "code_";
+                        _AppendHex(line, _RelativeTarget(instruction, i), 4);
                         break;
-                        // could do it for push0, push1, etc..., but it's just clutter, and rarely the intention.
 
-                    case Opcode::CALLE:
-                    case Opcode::CALLB:
-                        // Try to get the public export name.
-                        if (pOFLookups)
-                        {
-                            uint16_t wScript;
-                            uint16_t wIndex;
-                            if (Opcode::CALLB == bOpcode)
-                            {
-                                wScript = 0;
-                                wIndex = wOperands[0];
-                            }
-                            else
-                            {
-                                wScript = wOperands[0];
-                                wIndex = wOperands[1];
-                            }
-                            out << "// " << pOFLookups->ReverseLookupPublicExportName(wScript, wIndex) << " ";
-                        }
+                    case otDEBUGSTRING:
+                        // Filename
+                        line += '"';
+                        line += instruction.DebugString;
+                        line += '"';
                         break;
 
+                    default:
+                        assert(false && "Unknown operand type");
+                        line += '$';
+                        _AppendHex(line, wOperands[i], 4);
+                        break;
                     }
+                    line += ' ';
+                }
+
+                if (analyzeInstruction)
+                {
+                    (*analyzeInstruction)(bOpcode, instruction.Operands, wOffset);
+                }
 
-                    out << endl;
-                    switch (bOpcode)
+                // Time for comments (for some instructions)
+                switch (bOpcode)
+                {
+                case Opcode::LINK:
+                    line += "// (var $";
+                    _AppendHex(line, wOperands[0]);
+                    line += ')';
+                    break;
+
+                case Opcode::LOFSS:
+                case Opcode::LOFSA:
+                {
+                    // This is an offset... it could be an interesting one, like a string or said.
+                    ICompiledScriptSpecificLookups::ObjectType type;
+                    std::string name = InvalidLookupError;
+                    pScriptThings->LookupObjectName(wOperands[0], type, name);
+                    line += "// ";
+                    line += name;
+                }
+                    break;
+
+                case Opcode::PUSHI:
+                    line += "// $";
+                    _AppendHex(line, wOperands[0]);
+                    line += ' ';
+                    line += pLookups->LookupSelectorName(wOperands[0]);
+                    break;
+                    // could do it for push0, push1, etc..., but it's just clutter, and rarely the intention.
+
+                case Opcode::CALLE:
+                case Opcode::CALLB:
+                    // Try to get the public export name.
+                    if (pOFLookups)
                     {
-                    case Opcode::SEND:
-                    case Opcode::CALL:
-                    case Opcode::CALLB:
-                    case Opcode::CALLE:
-                    case Opcode::CALLK:
-                    case Opcode::SELF:
-                    case Opcode::SUPER:
-                        // Add another carriage return after these instructions
-                        out << endl;
-                        break;
+                        uint16_t wScript;
+                        uint16_t wIndex;
+                        if (Opcode::CALLB == bOpcode)
+                        {
+                            wScript = 0;
+                            wIndex = wOperands[0];
+                        }
+                        else
+                        {
+                            wScript = wOperands[0];
+                            wIndex = wOperands[1];
+                        }
+                        line += "// ";
+                        line += pOFLookups->ReverseLookupPublicExportName(wScript, wIndex);
+                        line += ' ';
                     }
+                    break;
+
+                }
+
+                line += '\n';
+                switch (bOpcode)
+                {
+                case Opcode::SEND:
+                case Opcode::CALL:
+                case Opcode::CALLB:
+                case Opcode::CALLE:
+                case Opcode::CALLK:
+                case Opcode::SELF:
+                case Opcode::SUPER:
+                    // Add another carriage return after these instructions
+                    line += '\n';
+                    break;
                 }
+                out.write(line.data(), line.size());
             }
         }
     }
     catch (...)
     {
-        // In case we read more than there was.
+        // In case the lookups fail.
         appState->LogInfo("Error while disassembling script.");
     }
 }
@@ -593,4 +612,46 @@ void DisassembleScript(const CompiledScript &script, std::ostream &out, ICompile
         DisassembleFunction(script, out, pLookups, pOFLookups, *it, codePointersTO);
         it++;
     }
+}
+
+namespace
+{
+    // Lets the disassembly stream write directly into a string, rather than into a stringstream's own
+    // buffer that then needs to be copied out.
+    class StringAppendBuffer : public std::streambuf
+    {
+    public:
+        StringAppendBuffer(std::string &text) : _text(text) {}
+
+    protected:
+        int_type overflow(int_type ch) override
+        {
+            if (!traits_type::eq_int_type(ch, traits_type::eof()))
+            {
+                _text.push_back(traits_type::to_char_type(ch));
+            }
+            return traits_type::not_eof(ch);
+        }
+
+        std::streamsize xsputn(const char *s, std::streamsize count) override
+        {
+            _text.append(s, (size_t)count);
+            return count;
+        }
+
+    private:
+        std::string &_text;
+    };
+
+    // Roughly how many characters of disassembly there are for each byte of script.
+    const size_t DisassemblyCharsPerByte = 16;
+}
+
+void DisassembleScript(const CompiledScript &script, std::string &text, ICompiledScriptLookups *pLookups, IObjectFileScriptLookups *pOFLookups, const Vocab000 *pWords)
+{
+    text.clear();
+    text.reserve(script.GetRawBytes().size() * DisassemblyCharsPerByte);
+    StringAppendBuffer buffer(text);
+    std::ostream out(&buffer);
+    DisassembleScript(script, out, pLookups, pOFLookups, pWords);
 }
\ No newline at end of file
@@ -20,6 +20,9 @@ enum class Opcode : uint8_t;
 //void AnalyzeInstruction(uint8_t opcode, const uint16_t *operands);
 typedef void(*AnalyzeInstructionPtr)(Opcode opcode, const uint16_t *operands, uint16_t currentPCOffset);
 
+// Disassembles the code from pBegin to pEnd, which is at wBaseOffset in the script. out should be in hex mode.
+void DisassembleCode(SCIVersion version, std::ostream &out, ICompiledScriptLookups *pLookups, IObjectFileScriptLookups *pOFLookups, const ICompiledScriptSpecificLookups *pScriptThings, const ILookupPropertyName *pPropertyNames, const uint8_t *pBegin, const uint8_t *pEnd, uint16_t wBaseOffset, AnalyzeInstructionPtr analyzeInstruction = nullptr);
+
 
 void DisassembleObject(const CompiledScript &script, 
     const CompiledObject &object,
@@ -34,3 +37,7 @@ void DisassembleObject(const CompiledScript &script,
 
 struct Vocab000;
 void DisassembleScript(const CompiledScript &script, std::ostream &out, ICompiledScriptLookups *pLookups, IObjectFileScriptLookups *pOFLookups, const Vocab000 *pWords, const std::string *pMessage = nullptr, AnalyzeInstructionPtr analyzeInstruction = nullptr);
+// Disassembles straight into text, which has room reserved up front for a script of this size.
+// Scripts can be disassembled like this on several threads at once, as long as each thread has its
+// own pOFLookups (which loads object files as it goes).
+void DisassembleScript(const CompiledScript &script, std::string &text, ICompiledScriptLookups *pLookups, IObjectFileScriptLookups *pOFLookups, const Vocab000 *pWords);
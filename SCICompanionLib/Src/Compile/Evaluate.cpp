@@ -139,7 +139,17 @@ bool EvalBinaryOp(Opcode opcode, uint16_t aUnsigned, uint16_t bUnsigned, uint16_
             result = (b == 0) ? 0 : (a / b);
             break;
         case Opcode::MOD:
-            result = (b == 0) ? 0 : (a & b);
+            // Like the interpreter, the result is never negative.
+            if (b == 0)
+            {
+                result = 0;
+            }
+            else
+            {
+                int modulo = abs(b);
+                int remainder = a % modulo;
+                result = (uint16_t)((remainder < 0) ? (remainder + modulo) : remainder);
+            }
             break;
         case Opcode::AND:
             result = (aUnsigned & bUnsigned);
@@ -159,6 +169,29 @@ bool EvalBinaryOp(Opcode opcode, uint16_t aUnsigned, uint16_t bUnsigned, uint16_
 
 bool BinaryOp::Evaluate(ILookupDefine &context, uint16_t &result, CompileContext *reportError) const
 {
+    if ((Operator == BinaryOperator::LogicalAnd) || (Operator == BinaryOperator::LogicalOr))
+    {
+        // These short-circuit, so if the first operand decides it the second never runs and
+        // doesn't need to be constant. The result is always 0 or 1.
+        bool isAnd = (Operator == BinaryOperator::LogicalAnd);
+        uint16_t valueA;
+        bool good = _statement1->Evaluate(context, valueA, reportError);
+        if (good)
+        {
+            if (isAnd ? !valueA : !!valueA)
+            {
+                result = isAnd ? 0 : 1;
+            }
+            else
+            {
+                uint16_t valueB;
+                good = _statement2->Evaluate(context, valueB, reportError);
+                result = valueB ? 1 : 0;
+            }
+        }
+        return good;
+    }
+
     uint16_t valueA;
     bool good = _statement1->Evaluate(context, valueA, reportError);
     if (good)
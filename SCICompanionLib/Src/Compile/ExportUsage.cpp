@@ -0,0 +1,199 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#include "stdafx.h"
+#include "ExportUsage.h"
+#include "CodeInspector.h"
+#include "Vocab99x.h"
+
+using namespace std;
+
+const int UnknownValue = -1;
+
+void ExportReferences::Scan(const CompiledScript &script)
+{
+    const TargetArchitecture *arch = GetTargetArchitecture(script.GetVersion());
+    const uint8_t *pRaw = script.GetRawBytes().data();
+    for (const CodeSection &section : script._codeSections)
+    {
+        // The values pushed since the stack was last consumed, or UnknownValue if they can't be
+        // worked out. This is enough to follow the parameters to a kernel call, which are always
+        // pushed right before it.
+        vector<int> pushed;
+        int acc = UnknownValue;
+        InspectCode(arch, pRaw + section.begin, pRaw + section.end, section.begin,
+            [&](Opcode opcode, uint16_t wOperands[3], uint16_t wOffset)
+        {
+            switch (opcode)
+            {
+                case Opcode::LDI:
+                    acc = wOperands[0];
+                    break;
+                case Opcode::PUSHI:
+                    pushed.push_back(wOperands[0]);
+                    break;
+                case Opcode::PUSH0:
+                    pushed.push_back(0);
+                    break;
+                case Opcode::PUSH1:
+                    pushed.push_back(1);
+                    break;
+                case Opcode::PUSH2:
+                    pushed.push_back(2);
+                    break;
+                case Opcode::PUSH:
+                    pushed.push_back(acc);
+                    break;
+                case Opcode::DUP:
+                    pushed.push_back(pushed.empty() ? UnknownValue : pushed.back());
+                    break;
+                case Opcode::LOFSS:
+                case Opcode::PUSHSELF:
+                case Opcode::PTOS:
+                case Opcode::IPTOS:
+                case Opcode::DPTOS:
+                    pushed.push_back(UnknownValue);
+                    break;
+
+                case Opcode::CALLB:
+                    _used.emplace(0, wOperands[0]);
+                    pushed.clear();
+                    acc = UnknownValue;
+                    break;
+                case Opcode::CALLE:
+                    _used.emplace(wOperands[0], wOperands[1]);
+                    pushed.clear();
+                    acc = UnknownValue;
+                    break;
+                case Opcode::CALLK:
+                    if (_lookups.LookupKernelName(wOperands[0]) == "ScriptID")
+                    {
+                        _OnScriptID(pushed, wOperands[1]);
+                    }
+                    pushed.clear();
+                    acc = UnknownValue;
+                    break;
+
+                default:
+                {
+                    uint8_t bOpcode = static_cast<uint8_t>(opcode);
+                    if (bOpcode >= static_cast<uint8_t>(Opcode::FirstLoadStore))
+                    {
+                        // Load, store, increment and decrement of variables.
+                        bool isStore = ((bOpcode & VO_DEC_AND_LOAD) == VO_STORE);
+                        bool toStack = ((bOpcode & VO_STACK) != 0);
+                        if (isStore)
+                        {
+                            // Stack stores pop the value, and indexed ones take the index from the acc.
+                            pushed.clear();
+                        }
+                        else if (toStack)
+                        {
+                            pushed.push_back(UnknownValue);
+                        }
+                        else
+                        {
+                            acc = UnknownValue;
+                        }
+                    }
+                    else
+                    {
+                        // Anything else might consume the stack, or change the acc.
+                        pushed.clear();
+                        acc = UnknownValue;
+                    }
+                }
+                    break;
+            }
+            return true;
+        });
+    }
+}
+
+void ExportReferences::_OnScriptID(const vector<int> &pushed, uint16_t wFrameBytes)
+{
+    // The parameter count is pushed first, followed by the script and export numbers.
+    size_t paramCount = wFrameBytes / 2;
+    int script = UnknownValue;
+    int index = UnknownValue;
+    if ((paramCount >= 1) && (pushed.size() >= (paramCount + 1)))
+    {
+        size_t firstParam = pushed.size() - paramCount;
+        script = pushed[firstParam];
+        if (paramCount >= 2)
+        {
+            index = pushed[firstParam + 1];
+        }
+    }
+
+    if (paramCount < 2)
+    {
+        // (ScriptID n) is export 0, which is always used.
+    }
+    else if ((script != UnknownValue) && (index != UnknownValue))
+    {
+        _used.emplace((uint16_t)script, (uint16_t)index);
+    }
+    else if (script != UnknownValue)
+    {
+        _allOfScript.insert((uint16_t)script);
+    }
+    else if (index != UnknownValue)
+    {
+        _indexInAnyScript.insert((uint16_t)index);
+    }
+    else
+    {
+        _unresolved = true;
+    }
+}
+
+bool ExportReferences::IsUsed(uint16_t wScript, uint16_t wIndex) const
+{
+    return (wIndex == 0) ||
+        (_used.find(make_pair(wScript, wIndex)) != _used.end()) ||
+        (_allOfScript.find(wScript) != _allOfScript.end()) ||
+        (_indexInAnyScript.find(wIndex) != _indexInAnyScript.end());
+}
+
+bool FindUnusedExports(GlobalCompiledScriptLookups &lookups, ObjectFileScriptLookups &objectFileLookups, vector<UnusedExport> &unused)
+{
+    vector<CompiledScript*> scripts = lookups.GetGlobalClassTable().GetAllScripts();
+
+    ExportReferences references(lookups);
+    for (const CompiledScript *script : scripts)
+    {
+        references.Scan(*script);
+    }
+
+    if (!references.HasUnresolved())
+    {
+        for (const CompiledScript *script : scripts)
+        {
+            uint16_t wScript = script->GetScriptNumber();
+            for (size_t i = 0; i < script->_exportsTO.size(); i++)
+            {
+                uint16_t wOffset = script->_exportsTO[i];
+                bool isInstance = script->IsExportAnObject(wOffset);
+                if ((isInstance || script->IsExportAProcedure(wOffset)) && !references.IsUsed(wScript, (uint16_t)i))
+                {
+                    UnusedExport unusedExport = { wScript, (uint16_t)i, "", isInstance };
+                    CompiledObject *object = isInstance ? script->GetObjectForExport(wOffset) : nullptr;
+                    unusedExport.Name = object ? object->GetName() : objectFileLookups.ReverseLookupPublicExportName(wScript, (uint16_t)i);
+                    unused.push_back(unusedExport);
+                }
+            }
+        }
+    }
+    return !references.HasUnresolved();
+}
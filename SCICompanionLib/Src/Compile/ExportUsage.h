@@ -0,0 +1,62 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#pragma once
+
+class GlobalCompiledScriptLookups;
+class ObjectFileScriptLookups;
+class CompiledScript;
+
+//
+// Collects the exports referenced by the code in a set of compiled scripts.
+//
+class ExportReferences
+{
+public:
+    ExportReferences(GlobalCompiledScriptLookups &lookups) : _lookups(lookups), _unresolved(false) {}
+
+    void Scan(const CompiledScript &script);
+    bool IsUsed(uint16_t wScript, uint16_t wIndex) const;
+    // Whether a ScriptID call was found whose script and export number both couldn't be worked out.
+    bool HasUnresolved() const { return _unresolved; }
+
+private:
+    void _OnScriptID(const std::vector<int> &pushed, uint16_t wFrameBytes);
+
+    GlobalCompiledScriptLookups &_lookups;
+    std::set<std::pair<uint16_t, uint16_t>> _used;
+    std::set<uint16_t> _allOfScript;         // (ScriptID 100 someVariable)
+    std::set<uint16_t> _indexInAnyScript;    // (ScriptID someVariable 1)
+    bool _unresolved;
+};
+
+//
+// A public procedure or instance that no script in the game refers to.
+//
+struct UnusedExport
+{
+    uint16_t Script;
+    uint16_t Index;
+    std::string Name;
+    bool IsInstance;
+};
+
+//
+// Builds the cross-script reference graph for all the compiled scripts in the game, and returns the
+// exports that nothing refers to. References come from callb and calle instructions, and from
+// ScriptID kernel calls. Export 0 of each script is always considered used, since the interpreter and
+// (ScriptID n) refer to it.
+// Returns false if a ScriptID call's script and export number couldn't both be worked out, in which
+// case anything might be referenced and nothing is reported.
+//
+bool FindUnusedExports(GlobalCompiledScriptLookups &lookups, ObjectFileScriptLookups &objectFileLookups, std::vector<UnusedExport> &unused);
@@ -12,7 +12,6 @@
     GNU General Public License for more details.
 ***************************************************************************/
 #include "stdafx.h"
-#include <numeric>
 #include "CompileInterfaces.h"
 #include "CompileContext.h"
 #include "SCO.h"
@@ -240,6 +239,78 @@ vector<ExportTableInfo> GetExportTableOrder(CompileContext *contextOptional, con
     return table;
 }
 
+//
+// Drops the public procedures that a whole-game build found nothing else calls (see FindUnusedExports),
+// as long as they aren't called from within this script either. A procedure that is exported in several
+// slots is only dropped if none of them are used. Their export slots are left empty, so the export
+// numbers of everything else stay the same. They're also left out of the .sco file, so that a script
+// which starts calling one later on fails to compile, instead of calling an empty export at runtime.
+//
+void _StripUnusedProcedures(CompileTables &tables, CompileContext &context, Script &script, vector<ExportTableInfo> &exportTableOrder)
+{
+    auto itUnused = tables.StrippedProcedures().find(script.GetScriptNumber());
+    if (itUnused != tables.StrippedProcedures().end())
+    {
+        set<string> calledLocally;
+        EnumScriptElements<ProcedureCall>(script,
+            [&calledLocally](ProcedureCall &procCall)
+        {
+            calledLocally.insert(procCall.GetName());
+        });
+        EnumScriptElements<Asm>(script,
+            [&calledLocally](Asm &asmInstruction)
+        {
+            const ComplexPropertyValue *pValue = asmInstruction.GetStatements().empty() ? nullptr : SafeSyntaxNode<ComplexPropertyValue>(asmInstruction.GetStatements()[0].get());
+            if ((asmInstruction.GetName() == "call") && pValue)
+            {
+                calledLocally.insert(pValue->GetStringValue());
+            }
+        });
+
+        // A procedure can be exported in more than one slot.
+        map<const ProcedureDefinition*, vector<size_t>> procedureSlots;
+        for (size_t slot = 0; slot < exportTableOrder.size(); slot++)
+        {
+            if (exportTableOrder[slot].Type == ExportType::Procedure)
+            {
+                procedureSlots[static_cast<ProcedureDefinition*>(exportTableOrder[slot].SyntaxNodeWeak)].push_back(slot);
+            }
+        }
+
+        const map<uint16_t, string> &unusedSlots = itUnused->second;
+        set<int> strippedRefIndices;
+        for (auto &procedureAndSlots : procedureSlots)
+        {
+            const string &name = procedureAndSlots.first->GetName();
+            bool allSlotsUnused = all_of(procedureAndSlots.second.begin(), procedureAndSlots.second.end(),
+                [&](size_t slot)
+            {
+                // The name guards against the exports having moved around since the build that found them unused.
+                auto itSlot = unusedSlots.find((uint16_t)slot);
+                return (itSlot != unusedSlots.end()) && (itSlot->second == name);
+            });
+            if (allSlotsUnused && (calledLocally.find(name) == calledLocally.end()))
+            {
+                context.StrippedProcedures.insert(procedureAndSlots.first);
+                strippedRefIndices.insert(exportTableOrder[procedureAndSlots.second[0]].ReferenceIndex);
+                for (size_t slot : procedureAndSlots.second)
+                {
+                    exportTableOrder[slot] = ExportTableInfo();
+                }
+            }
+        }
+
+        // The procedures that remain are tracked in order as their code is generated, so close up the gaps.
+        for (ExportTableInfo &entry : exportTableOrder)
+        {
+            if (entry.Type == ExportType::Procedure)
+            {
+                entry.ReferenceIndex -= (int)distance(strippedRefIndices.begin(), strippedRefIndices.lower_bound(entry.ReferenceIndex));
+            }
+        }
+    }
+}
+
 //
 // Writes the class or instance described by object, into the script resource output stream.
 //
@@ -543,6 +614,11 @@ void _Section2_Code(const Script &script, CompileContext &context, vector<BYTE>
     context.FixupLocalCalls();
     context.FixupAsmLabelBranches();
 
+    if (context.OptimizeCode)
+    {
+        results.Stats.CodeSaved += context.code().optimize(context.GetCodeEntryPoints());
+    }
+
     uint16_t codeSizeBase = context.code().calc_size();
     bool fRoundUp = make_even(codeSizeBase);
 
@@ -622,16 +698,31 @@ void _Section4_Saids(CompileContext &context, vector<BYTE> &output, CompileResul
         push_word(output, 4);
         size_t saidSizeIndex = output.size();
         push_word(output, 0); // Temporary size...
+        // Different said strings can parse to the same thing (e.g. spacing or word synonyms), so
+        // they're pooled by their said stream.
+        unordered_map<string, uint16_t> writtenSaids;
         // Now actually write out the saids into the stream.
         for (auto &said : saids)
         {
-            // a) Get the index to which we'll write the said stream.
-            uint16_t wAbsolute = (uint16_t)output.size();
-            context.WroteSource(context.GetTempToken(ValueType::Said, said), wAbsolute);
-
-            // b) Parse the said stream
-            ParseSaidString(&context, context.GetLookupSaids(), said, &output, nullptr);
-            // c) update the offset...
+            // a) Parse the said stream
+            vector<uint8_t> saidStream;
+            ParseSaidString(&context, context.GetLookupSaids(), said, &saidStream, nullptr);
+
+            // b) Point to an identical one, or write it at the end.
+            string key(saidStream.begin(), saidStream.end());
+            auto it = writtenSaids.find(key);
+            if (it != writtenSaids.end())
+            {
+                context.WroteSource(context.GetTempToken(ValueType::Said, said), it->second);
+                results.Stats.PoolingSaved += (int)saidStream.size();
+            }
+            else
+            {
+                uint16_t wAbsolute = (uint16_t)output.size();
+                context.WroteSource(context.GetTempToken(ValueType::Said, said), wAbsolute);
+                writtenSaids[key] = wAbsolute;
+                output.insert(output.end(), saidStream.begin(), saidStream.end());
+            }
         }
 
         // How much room did that take?
@@ -653,8 +744,34 @@ void _Section5_Strings(CompileContext &context, vector<BYTE> &outputScr, vector<
     auto strings = context.GetStringsThatWereWritten();
     if (!strings.empty())
     {
-        // Compute the length of all the strings.
-        WORD wStringSectionSize = accumulate(strings.begin(), strings.end(), 0, [](std::string::size_type sumSoFar, const std::string &theString) { return sumSoFar + theString.length() + 1; });
+        // When optimizing, a string that is the tail end of another one points into it instead of
+        // being written again. Longer strings go first so their tails are in the pool.
+        if (context.OptimizeCode)
+        {
+            stable_sort(strings.begin(), strings.end(), [](const std::string &a, const std::string &b) { return a.length() > b.length(); });
+        }
+
+        // Map each string (and tails, when optimizing) to its position relative to the start of the strings.
+        unordered_map<string, uint16_t> pool;
+        vector<const string *> stringsToWrite;
+        WORD wStringSectionSize = 0;
+        for (auto &theString : strings)
+        {
+            if (pool.find(theString) == pool.end())
+            {
+                size_t lastTail = context.OptimizeCode ? theString.length() : 0;
+                for (size_t i = 0; i <= lastTail; i++)
+                {
+                    pool.emplace(theString.substr(i), (uint16_t)(wStringSectionSize + i));
+                }
+                stringsToWrite.push_back(&theString);
+                wStringSectionSize += (WORD)(theString.length() + 1);
+            }
+            else
+            {
+                results.Stats.PoolingSaved += (int)(theString.length() + 1);
+            }
+        }
 
         // Round it up to a WORD boundary:
         bool fRoundUp = make_even(wStringSectionSize);
@@ -666,14 +783,16 @@ void _Section5_Strings(CompileContext &context, vector<BYTE> &outputScr, vector<
             push_word(outputHeap, wStringSectionSize + 4);
         }
 
-        for (auto &theString : strings)
+        uint16_t stringsStart = (uint16_t)outputHeap.size();
+        for (const string *theString : stringsToWrite)
         {
-            // Get the index to which we'll write the string.
-            uint16_t wAbsolute = (uint16_t)outputHeap.size();
-            context.WroteSource(context.GetTempToken(ValueType::String, theString), wAbsolute);
-            outputHeap.insert(outputHeap.end(), theString.begin(), theString.end());
+            outputHeap.insert(outputHeap.end(), theString->begin(), theString->end());
             outputHeap.push_back(0);
         }
+        for (auto &theString : strings)
+        {
+            context.WroteSource(context.GetTempToken(ValueType::String, theString), stringsStart + pool[theString]);
+        }
 
         zero_pad(outputHeap, fRoundUp);
     }
@@ -830,8 +949,11 @@ void GenerateSCOPublics(CompileContext &context, const Script &script)
             case ExportType::Procedure:
             {
                 auto pProc = static_cast<sci::ProcedureDefinition*>(exportTableInfo.SyntaxNodeWeak);
-                CSCOPublicExport procExport(pProc->GetName(), wIndex);
-                context.AddSCOPublics(procExport);
+                if (context.StrippedProcedures.find(pProc) == context.StrippedProcedures.end())
+                {
+                    CSCOPublicExport procExport(pProc->GetName(), wIndex);
+                    context.AddSCOPublics(procExport);
+                }
             }
                 break;
 
@@ -1215,12 +1337,13 @@ void CommonScriptPrep(Script &script, CompileContext &context, CompileResults &r
     }
 }
 
-bool GenerateScriptResource_SCI0(SCIClassBrowser& browser, CResourceMap& resource_map, const SCIVersion& version, Script &script, PrecompiledHeaders &headers, CompileTables &tables, CompileResults &results, bool generateDebugInfo)
+bool GenerateScriptResource_SCI0(SCIClassBrowser& browser, CResourceMap& resource_map, const SCIVersion& version, Script &script, PrecompiledHeaders &headers, CompileTables &tables, CompileResults &results, bool generateDebugInfo, bool optimizeCode)
 {
     vector<BYTE> &output = results.GetScriptResource();
 
     // Create our "CompileContext", which holds state during the compilation.
     CompileContext context(browser, resource_map, version, script, headers, tables, results.GetLog(), generateDebugInfo);
+    context.OptimizeCode = optimizeCode;
 
     _Section3_Synonyms(script, context, output, results);
 
@@ -1229,6 +1352,7 @@ bool GenerateScriptResource_SCI0(SCIClassBrowser& browser, CResourceMap& resourc
     // To figure out how many exports we have, let's look at the public procedures and public instances
     size_t offsetOfExports = 0;
     vector<ExportTableInfo> exportTableOrder = GetExportTableOrder(nullptr, script);
+    _StripUnusedProcedures(tables, context, script, exportTableOrder);
     // Christmas Card Demo 1990 VGA will not work properly if we output empty exports tables.
     if (!exportTableOrder.empty())
     {
@@ -1381,7 +1505,7 @@ void WriteClassToHeap(const CSCOObjectClass &oClass, bool isInstance, vector<uin
     }
 }
 
-bool GenerateScriptResource_SCI11(SCIClassBrowser& browser, CResourceMap& resource_map, const SCIVersion& version, Script &script, PrecompiledHeaders &headers, CompileTables &tables, CompileResults &results, bool generateDebugInfo)
+bool GenerateScriptResource_SCI11(SCIClassBrowser& browser, CResourceMap& resource_map, const SCIVersion& version, Script &script, PrecompiledHeaders &headers, CompileTables &tables, CompileResults &results, bool generateDebugInfo, bool optimizeCode)
 {
     vector<BYTE> &outputScr = results.GetScriptResource();
     vector<BYTE> &outputHeap = results.GetHeapResource();
@@ -1405,6 +1529,7 @@ bool GenerateScriptResource_SCI11(SCIClassBrowser& browser, CResourceMap& resour
     CompileContext context(browser, resource_map, version,
                            script, headers, tables, results.GetLog(),
                            generateDebugInfo);
+    context.OptimizeCode = optimizeCode;
 
     CommonScriptPrep(script, context, results);
     // Errors above could mean crashes below. Bail out now.
@@ -1421,6 +1546,7 @@ bool GenerateScriptResource_SCI11(SCIClassBrowser& browser, CResourceMap& resour
         size_t numExports = 0;
         size_t offsetOfExports = 0;
         vector<ExportTableInfo> exportTableOrder = GetExportTableOrder(nullptr, script);
+        _StripUnusedProcedures(tables, context, script, exportTableOrder);
         _Exports_SCI11(script, context, outputScr, exportTableOrder, offsetOfExports);
 
         // Generate SCO objects for the classes and instances in the script.  We want to do this before generating any code,
@@ -1545,14 +1671,14 @@ bool GenerateScriptResource_SCI11(SCIClassBrowser& browser, CResourceMap& resour
     return !context.HasErrors();
 }
 
-bool GenerateScriptResource(SCIClassBrowser& browser, CResourceMap& resource_map, const SCIVersion& version, sci::Script &script, PrecompiledHeaders &headers, CompileTables &tables, CompileResults &results, bool generateDebugInfo)
+bool GenerateScriptResource(SCIClassBrowser& browser, CResourceMap& resource_map, const SCIVersion& version, sci::Script &script, PrecompiledHeaders &headers, CompileTables &tables, CompileResults &results, bool generateDebugInfo, bool optimizeCode)
 {
     if (version.SeparateHeapResources)
     {
-        return GenerateScriptResource_SCI11(browser, resource_map, version, script, headers, tables, results, generateDebugInfo);
+        return GenerateScriptResource_SCI11(browser, resource_map, version, script, headers, tables, results, generateDebugInfo, optimizeCode);
     }
     else
     {
-        return GenerateScriptResource_SCI0(browser, resource_map, version, script, headers, tables, results, generateDebugInfo);
+        return GenerateScriptResource_SCI0(browser, resource_map, version, script, headers, tables, results, generateDebugInfo, optimizeCode);
     }
 }
\ No newline at end of file
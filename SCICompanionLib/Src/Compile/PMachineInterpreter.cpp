@@ -0,0 +1,871 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#include "stdafx.h"
+#include "PMachineInterpreter.h"
+#include "CompiledScript.h"
+#include "InstructionDecoder.h"
+#include "format.h"
+
+using namespace std;
+
+// In Evaluate.cpp, so we do arithmetic exactly like constant folding does.
+bool EvalUnaryOp(Opcode opcode, uint16_t aUnsigned, uint16_t &result);
+bool EvalBinaryOp(Opcode opcode, uint16_t aUnsigned, uint16_t bUnsigned, uint16_t &result);
+
+const uint16_t ObjectSegment = 0xffff;
+const uint16_t VariableSegment = 0xfffe;
+const uint16_t FirstScriptSegment = 1;     // Addresses in script n have segment n + 1
+const size_t MaxCallDepth = 256;
+const size_t MaxSuperClassChain = 64;
+
+class CallDepthGuard
+{
+public:
+    CallDepthGuard(size_t &depth, size_t &maxDepth) : _depth(depth)
+    {
+        if (++_depth > MaxCallDepth)
+        {
+            --_depth;
+            throw std::runtime_error("Calls are nested too deeply.");
+        }
+        maxDepth = max(maxDepth, _depth);
+    }
+    ~CallDepthGuard() { --_depth; }
+
+private:
+    size_t &_depth;
+};
+
+PMachineInterpreter::PMachineInterpreter(const SCIVersion &version) : _version(version), _instructionLimit(0), _rest(0), _callDepth(0)
+{
+}
+
+void PMachineInterpreter::AddScript(const CompiledScript &script)
+{
+    uint16_t scriptNumber = script.GetScriptNumber();
+    LoadedScript &loaded = _scripts[scriptNumber];
+    loaded.Script = &script;
+    loaded.Locals.clear();
+    loaded.LocalsInitialized = false;
+    for (const auto &object : script.GetObjects())
+    {
+        if (!object->IsInstance())
+        {
+            _speciesToClass[object->GetSpecies()] = make_pair(scriptNumber, object.get());
+        }
+    }
+}
+
+void PMachineInterpreter::AddScripts(GlobalClassTable &classTable)
+{
+    for (CompiledScript *script : classTable.GetAllScripts())
+    {
+        AddScript(*script);
+    }
+}
+
+PMachineInterpreter::LoadedScript &PMachineInterpreter::_GetScript(uint16_t script)
+{
+    auto it = _scripts.find(script);
+    if (it == _scripts.end())
+    {
+        throw std::runtime_error(fmt::format("Script {0} isn't loaded.", script));
+    }
+    return it->second;
+}
+
+vector<PMachineValue> &PMachineInterpreter::_GetLocals(LoadedScript &loaded)
+{
+    if (!loaded.LocalsInitialized)
+    {
+        // Set this first, since the values may refer to objects whose properties refer back here.
+        loaded.LocalsInitialized = true;
+        uint16_t scriptNumber = loaded.Script->GetScriptNumber();
+        vector<PMachineValue> locals;
+        for (const CompiledVarValue &value : loaded.Script->_localVars)
+        {
+            locals.push_back(_FromScriptValue(scriptNumber, value.value, value.isObjectOrString));
+        }
+        loaded.Locals = locals;
+    }
+    return loaded.Locals;
+}
+
+vector<PMachineValue> &PMachineInterpreter::_GetGlobals(uint16_t index)
+{
+    auto it = _scripts.find(0);
+    if (it != _scripts.end())
+    {
+        return _GetLocals(it->second);
+    }
+    // Without a main script, there are as many globals as are used.
+    if (index >= _globalsIfNoScript0.size())
+    {
+        _globalsIfNoScript0.resize(index + 1);
+    }
+    return _globalsIfNoScript0;
+}
+
+PMachineValue &PMachineInterpreter::Global(uint16_t index)
+{
+    vector<PMachineValue> &globals = _GetGlobals(index);
+    if (index >= globals.size())
+    {
+        throw std::runtime_error(fmt::format("Global {0} is out of range.", index));
+    }
+    return globals[index];
+}
+
+//
+// Values stored in scripts (local variables, property values, lofsa) are addresses in the script if
+// they are marked as an object or string.
+//
+PMachineValue PMachineInterpreter::_FromScriptValue(uint16_t script, uint16_t value, bool isObjectOrString)
+{
+    if (isObjectOrString)
+    {
+        const CompiledObject *object = _GetScript(script).Script->GetObjectForExport(value);
+        if (object)
+        {
+            return _GetObjectValue(script, object);
+        }
+        return PMachineValue(FirstScriptSegment + script, value);
+    }
+    return PMachineValue(value);
+}
+
+PMachineValue PMachineInterpreter::_GetObjectValue(uint16_t script, const CompiledObject *object)
+{
+    auto it = _objectHandles.find(object);
+    if (it != _objectHandles.end())
+    {
+        return PMachineValue(ObjectSegment, it->second);
+    }
+
+    // Instances in SCI0 don't have their own selector list, so use the one from their class.
+    const vector<uint16_t> *propertySelectors = &object->GetProperties();
+    if (propertySelectors->size() != object->GetPropertyValues().size())
+    {
+        auto itClass = _speciesToClass.find(object->GetSpecies());
+        if ((itClass == _speciesToClass.end()) || (itClass->second.second->GetProperties().size() != object->GetPropertyValues().size()))
+        {
+            throw std::runtime_error(fmt::format("Can't find the properties for {0}.", object->GetName()));
+        }
+        propertySelectors = &itClass->second.second->GetProperties();
+    }
+
+    // Register the object before converting its property values, which may refer back to it.
+    uint16_t handle = (uint16_t)_objects.size();
+    _objectHandles[object] = handle;
+    _objects.push_back({ script, object, propertySelectors, {} });
+    vector<PMachineValue> properties;
+    for (const CompiledVarValue &value : object->GetPropertyValues())
+    {
+        properties.push_back(_FromScriptValue(script, value.value, value.isObjectOrString));
+    }
+    _objects[handle].Properties = properties;
+    return PMachineValue(ObjectSegment, handle);
+}
+
+PMachineInterpreter::RuntimeObject &PMachineInterpreter::_GetRuntimeObject(PMachineValue object)
+{
+    if ((object.Segment != ObjectSegment) || (object.Offset >= _objects.size()))
+    {
+        throw std::runtime_error(fmt::format("{0:04x}:{1:04x} is not an object.", object.Segment, object.Offset));
+    }
+    return _objects[object.Offset];
+}
+
+int PMachineInterpreter::_FindProperty(const RuntimeObject &object, uint16_t selector)
+{
+    const vector<uint16_t> &selectors = *object.PropertySelectors;
+    auto it = find(selectors.begin(), selectors.end(), selector);
+    return (it == selectors.end()) ? -1 : (int)(it - selectors.begin());
+}
+
+bool PMachineInterpreter::_FindMethod(uint16_t objectScript, const CompiledObject *object, uint16_t selector, uint16_t &script, uint16_t &codeOffset)
+{
+    script = objectScript;
+    for (size_t i = 0; object && (i < MaxSuperClassChain); i++)
+    {
+        const vector<uint16_t> &methods = object->GetMethods();
+        auto it = find(methods.begin(), methods.end(), selector);
+        if (it != methods.end())
+        {
+            codeOffset = object->GetMethodCodePointersTO()[it - methods.begin()];
+            return true;
+        }
+
+        // Instances have their class as their super class
+        auto itSuper = _speciesToClass.find(object->GetSuperClass());
+        object = nullptr;
+        if (itSuper != _speciesToClass.end())
+        {
+            script = itSuper->second.first;
+            object = itSuper->second.second;
+        }
+    }
+    return false;
+}
+
+PMachineValue PMachineInterpreter::GetObject(uint16_t script, const std::string &name)
+{
+    for (const auto &object : _GetScript(script).Script->GetObjects())
+    {
+        if (object->GetName() == name)
+        {
+            return _GetObjectValue(script, object.get());
+        }
+    }
+    throw std::runtime_error(fmt::format("Script {0} has no object called {1}.", script, name));
+}
+
+PMachineValue PMachineInterpreter::GetClass(uint16_t species)
+{
+    auto it = _speciesToClass.find(species);
+    if (it == _speciesToClass.end())
+    {
+        throw std::runtime_error(fmt::format("Class {0} isn't loaded.", species));
+    }
+    return _GetObjectValue(it->second.first, it->second.second);
+}
+
+PMachineValue PMachineInterpreter::Clone(PMachineValue object)
+{
+    RuntimeObject clone = _GetRuntimeObject(object);
+    _objects.push_back(clone);
+    return PMachineValue(ObjectSegment, (uint16_t)(_objects.size() - 1));
+}
+
+PMachineValue PMachineInterpreter::GetProperty(PMachineValue object, uint16_t selector)
+{
+    RuntimeObject &runtimeObject = _GetRuntimeObject(object);
+    int index = _FindProperty(runtimeObject, selector);
+    if (index == -1)
+    {
+        throw std::runtime_error(fmt::format("{0} has no property {1}.", runtimeObject.Object->GetName(), selector));
+    }
+    return runtimeObject.Properties[index];
+}
+
+void PMachineInterpreter::SetProperty(PMachineValue object, uint16_t selector, PMachineValue value)
+{
+    RuntimeObject &runtimeObject = _GetRuntimeObject(object);
+    int index = _FindProperty(runtimeObject, selector);
+    if (index == -1)
+    {
+        throw std::runtime_error(fmt::format("{0} has no property {1}.", runtimeObject.Object->GetName(), selector));
+    }
+    runtimeObject.Properties[index] = value;
+}
+
+std::string PMachineInterpreter::GetObjectName(PMachineValue object)
+{
+    return _GetRuntimeObject(object).Object->GetName();
+}
+
+std::string PMachineInterpreter::GetString(PMachineValue value)
+{
+    if ((value.Segment < FirstScriptSegment) || (value.Segment >= VariableSegment))
+    {
+        throw std::runtime_error(fmt::format("{0:04x}:{1:04x} is not a string.", value.Segment, value.Offset));
+    }
+    const CompiledScript &script = *_GetScript(value.Segment - FirstScriptSegment).Script;
+    sci::ValueType type;
+    std::string text = script.GetStringOrSaidFromOffset(value.Offset, type);
+    if ((type == sci::ValueType::None) && !_version.SeparateHeapResources)
+    {
+        // Somewhere in the middle of a string. In SCI0 they're in the script resource.
+        const vector<uint8_t> &raw = script.GetRawBytes();
+        for (size_t i = value.Offset; (i < raw.size()) && raw[i]; i++)
+        {
+            text.push_back((char)raw[i]);
+        }
+    }
+    return text;
+}
+
+PMachineInterpreter::VariableAddress PMachineInterpreter::_GetVariableAddress(const Frame &frame, uint16_t type, uint16_t index)
+{
+    VariableAddress address = { type, frame.Script->Script->GetScriptNumber(), index };
+    if (type == VO_TEMP)
+    {
+        address.Index += frame.TempBase;
+    }
+    else if (type == VO_PARAM)
+    {
+        address.Index += frame.ParamBase;
+        if (address.Index >= frame.TempBase)
+        {
+            throw std::runtime_error(fmt::format("Parameter {0} is out of range.", index));
+        }
+    }
+    return address;
+}
+
+PMachineValue &PMachineInterpreter::_Variable(const VariableAddress &address)
+{
+    switch (address.Type)
+    {
+        case VO_GLOBAL:
+            return Global((uint16_t)address.Index);
+
+        case VO_LOCAL:
+        {
+            vector<PMachineValue> &locals = _GetLocals(_GetScript(address.Script));
+            if (address.Index >= locals.size())
+            {
+                throw std::runtime_error(fmt::format("Local {0} is out of range in script {1}.", address.Index, address.Script));
+            }
+            return locals[address.Index];
+        }
+
+        default:
+            if (address.Index >= _stack.size())
+            {
+                throw std::runtime_error("Temporary variable is out of range.");
+            }
+            return _stack[address.Index];
+    }
+}
+
+PMachineValue &PMachineInterpreter::Dereference(PMachineValue address)
+{
+    if ((address.Segment != VariableSegment) || (address.Offset >= _variableAddresses.size()))
+    {
+        throw std::runtime_error(fmt::format("{0:04x}:{1:04x} is not a variable address.", address.Segment, address.Offset));
+    }
+    return _Variable(_variableAddresses[address.Offset]);
+}
+
+void PMachineInterpreter::_Push(PMachineValue value)
+{
+    _stack.push_back(value);
+    _stats.MaxStackDepth = max(_stats.MaxStackDepth, _stack.size());
+}
+
+PMachineValue PMachineInterpreter::_Pop()
+{
+    if (_stack.empty())
+    {
+        throw std::runtime_error("Stack underflow.");
+    }
+    PMachineValue value = _stack.back();
+    _stack.pop_back();
+    return value;
+}
+
+PMachineValue PMachineInterpreter::CallProcedure(uint16_t script, uint16_t exportIndex, const std::vector<PMachineValue> &params)
+{
+    const CompiledScript &compiledScript = *_GetScript(script).Script;
+    if (exportIndex >= compiledScript._exportsTO.size())
+    {
+        throw std::runtime_error(fmt::format("Script {0} has no export {1}.", script, exportIndex));
+    }
+    return CallCode(script, compiledScript._exportsTO[exportIndex], params);
+}
+
+PMachineValue PMachineInterpreter::CallCode(uint16_t script, uint16_t codeOffset, const std::vector<PMachineValue> &params)
+{
+    size_t paramBase = _stack.size();
+    _Push((uint16_t)params.size());
+    for (const PMachineValue &param : params)
+    {
+        _Push(param);
+    }
+    return _Call(script, codeOffset, PMachineValue(), paramBase, paramBase);
+}
+
+PMachineValue PMachineInterpreter::Send(PMachineValue object, uint16_t selector, const std::vector<PMachineValue> &params)
+{
+    size_t frameStart = _stack.size();
+    _Push(selector);
+    _Push((uint16_t)params.size());
+    for (const PMachineValue &param : params)
+    {
+        _Push(param);
+    }
+    return _SendFrame(object, nullptr, frameStart, PMachineValue());
+}
+
+PMachineValue PMachineInterpreter::_Call(uint16_t script, uint16_t codeOffset, PMachineValue self, size_t paramBase, size_t restoreTo)
+{
+    CallDepthGuard depthGuard(_callDepth, _stats.MaxCallDepth);
+    Frame frame = { &_GetScript(script), self, paramBase, _stack.size() };
+    PMachineValue acc = _Execute(frame, codeOffset);
+    _stack.resize(restoreTo);
+    return acc;
+}
+
+PMachineValue PMachineInterpreter::_SendFrame(PMachineValue object, const std::pair<uint16_t, const CompiledObject*> *superClass, size_t frameStart, PMachineValue acc)
+{
+    size_t frameEnd = _stack.size();
+    size_t pos = frameStart;
+    while (pos < frameEnd)
+    {
+        if ((pos + 1) >= frameEnd)
+        {
+            throw std::runtime_error("Bad send frame.");
+        }
+        uint16_t selector = _stack[pos].Offset;
+        size_t argc = _stack[pos + 1].Offset;
+        if ((pos + 2 + argc) > frameEnd)
+        {
+            throw std::runtime_error("Bad send frame.");
+        }
+        _stats.Sends++;
+
+        // Don't hang onto this, since a method call might create objects.
+        RuntimeObject &target = _GetRuntimeObject(object);
+        int propertyIndex = _FindProperty(target, selector);
+        if (propertyIndex != -1)
+        {
+            if (argc == 0)
+            {
+                acc = target.Properties[propertyIndex];
+            }
+            else
+            {
+                target.Properties[propertyIndex] = _stack[pos + 2];
+            }
+        }
+        else
+        {
+            uint16_t methodScript, codeOffset;
+            bool found = superClass ?
+                _FindMethod(superClass->first, superClass->second, selector, methodScript, codeOffset) :
+                _FindMethod(target.Script, target.Object, selector, methodScript, codeOffset);
+            if (!found)
+            {
+                throw std::runtime_error(fmt::format("{0} does not understand selector {1}.", target.Object->GetName(), selector));
+            }
+            // The rest of the send stays on the stack while the method runs.
+            acc = _Call(methodScript, codeOffset, object, pos + 1, frameEnd);
+        }
+        pos += 2 + argc;
+    }
+    _stack.resize(frameStart);
+    return acc;
+}
+
+PMachineValue PMachineInterpreter::_Execute(Frame &frame, uint16_t pc)
+{
+    const InstructionDecoder &decoder = GetInstructionDecoder(_version);
+    const uint16_t scriptNumber = frame.Script->Script->GetScriptNumber();
+    const vector<uint8_t> &code = frame.Script->Script->GetRawBytes();
+    PMachineValue acc;
+    while (true)
+    {
+        if (pc >= code.size())
+        {
+            throw std::runtime_error(fmt::format("Ran off the end of script {0}.", scriptNumber));
+        }
+        DecodedInstruction instruction;
+        if (!decoder.Decode(&code[0] + pc, &code[0] + code.size(), pc, instruction))
+        {
+            throw std::runtime_error(fmt::format("Bad instruction at {0:04x} in script {1}.", pc, scriptNumber));
+        }
+        Opcode opcode = instruction.Op;
+        pc += instruction.Size;
+
+        // Relative offsets and immediate values in bytes are signed. Debug strings (filenames) come
+        // through as 0.
+        uint16_t operands[3] = { 0, 0, 0 };
+        for (uint8_t i = 0; i < instruction.OperandCount; i++)
+        {
+            operands[i] = instruction.Operands[i];
+            OperandType opType = instruction.OperandTypes[i];
+            bool isSigned = (opType == otINT) || (opType == otINT8) || (opType == otLABEL) || (opType == otOFFS);
+            if ((instruction.OperandSizes[i] == 1) && isSigned && (operands[i] & 0x80))
+            {
+                operands[i] |= 0xff00;
+            }
+        }
+
+        _stats.Instructions++;
+        if ((size_t)opcode < TOTAL_OPCODES)
+        {
+            _stats.OpcodeCounts[(size_t)opcode]++;
+        }
+        if (_instructionLimit && (_stats.Instructions > _instructionLimit))
+        {
+            throw std::runtime_error("The instruction limit was reached.");
+        }
+
+        uint8_t bOpcode = static_cast<uint8_t>(opcode);
+        if ((bOpcode >= static_cast<uint8_t>(Opcode::FirstLoadStore)) && (bOpcode <= static_cast<uint8_t>(Opcode::LastLoadStore)))
+        {
+            uint16_t index = operands[0];
+            if (bOpcode & VO_ACC_AS_INDEX_MOD)
+            {
+                index += acc.Offset;
+            }
+            VariableAddress address = _GetVariableAddress(frame, bOpcode & VO_TYPEMASK, index);
+            bool toStack = (bOpcode & VO_STACK) != 0;
+            PMachineValue value;
+            switch (bOpcode & VO_DEC_AND_LOAD)
+            {
+                case VO_LOAD:
+                    value = _Variable(address);
+                    break;
+                case VO_STORE:
+                    if (toStack || (bOpcode & VO_ACC_AS_INDEX_MOD))
+                    {
+                        // The acc was used for the index, so the value comes from the stack.
+                        value = _Pop();
+                        _Variable(address) = value;
+                        if (!toStack)
+                        {
+                            acc = value;
+                        }
+                    }
+                    else
+                    {
+                        _Variable(address) = acc;
+                    }
+                    continue;
+                case VO_INC_AND_LOAD:
+                    value = PMachineValue(_Variable(address).Offset + 1);
+                    _Variable(address) = value;
+                    break;
+                case VO_DEC_AND_LOAD:
+                    value = PMachineValue(_Variable(address).Offset - 1);
+                    _Variable(address) = value;
+                    break;
+            }
+            if (toStack)
+            {
+                _Push(value);
+            }
+            else
+            {
+                acc = value;
+            }
+            continue;
+        }
+
+        switch (opcode)
+        {
+            case Opcode::BNOT:
+            case Opcode::NOT:
+            case Opcode::NEG:
+            {
+                uint16_t result;
+                EvalUnaryOp(opcode, acc.Offset, result);
+                acc = result;
+            }
+                break;
+
+            case Opcode::ADD:
+            case Opcode::SUB:
+            {
+                PMachineValue a = _Pop();
+                uint16_t result = (opcode == Opcode::ADD) ? (a.Offset + acc.Offset) : (a.Offset - acc.Offset);
+                // Pointer arithmetic keeps the segment, and the difference between two pointers is a number.
+                uint16_t segment = 0;
+                if (a.Segment != acc.Segment)
+                {
+                    segment = a.IsNumber() ? acc.Segment : a.Segment;
+                }
+                else if (opcode == Opcode::ADD)
+                {
+                    segment = a.Segment;
+                }
+                acc = PMachineValue(segment, result);
+            }
+                break;
+
+            case Opcode::EQ:
+            case Opcode::NE:
+            {
+                PMachineValue a = _Pop();
+                _prev = acc;
+                acc = PMachineValue(((a == acc) == (opcode == Opcode::EQ)) ? 1 : 0);
+            }
+                break;
+
+            case Opcode::GT:
+            case Opcode::GE:
+            case Opcode::LT:
+            case Opcode::LE:
+            case Opcode::UGT:
+            case Opcode::UGE:
+            case Opcode::ULT:
+            case Opcode::ULE:
+            {
+                PMachineValue a = _Pop();
+                _prev = acc;
+                uint16_t result;
+                EvalBinaryOp(opcode, a.Offset, acc.Offset, result);
+                acc = result;
+            }
+                break;
+
+            case Opcode::MUL:
+            case Opcode::DIV:
+            case Opcode::MOD:
+            case Opcode::SHR:
+            case Opcode::SHL:
+            case Opcode::XOR:
+            case Opcode::AND:
+            case Opcode::OR:
+            {
+                PMachineValue a = _Pop();
+                uint16_t result;
+                EvalBinaryOp(opcode, a.Offset, acc.Offset, result);
+                acc = result;
+            }
+                break;
+
+            case Opcode::BT:
+                if (acc != PMachineValue())
+                {
+                    pc += operands[0];
+                }
+                break;
+            case Opcode::BNT:
+                if (acc == PMachineValue())
+                {
+                    pc += operands[0];
+                }
+                break;
+            case Opcode::JMP:
+                pc += operands[0];
+                break;
+
+            case Opcode::LDI:
+                acc = operands[0];
+                break;
+            case Opcode::PUSH:
+                _Push(acc);
+                break;
+            case Opcode::PUSHI:
+                _Push(operands[0]);
+                break;
+            case Opcode::PUSH0:
+            case Opcode::PUSH1:
+            case Opcode::PUSH2:
+                _Push((uint16_t)(bOpcode - static_cast<uint8_t>(Opcode::PUSH0)));
+                break;
+            case Opcode::PUSHSELF:
+                _Push(frame.Self);
+                break;
+            case Opcode::TOSS:
+                _Pop();
+                break;
+            case Opcode::DUP:
+            {
+                PMachineValue top = _Pop();
+                _Push(top);
+                _Push(top);
+            }
+                break;
+            case Opcode::LINK:
+                for (uint16_t i = 0; i < operands[0]; i++)
+                {
+                    _Push(PMachineValue());
+                }
+                break;
+
+            case Opcode::CALL:
+            case Opcode::CALLB:
+            case Opcode::CALLE:
+            case Opcode::CALLK:
+            {
+                uint16_t frameBytes = (opcode == Opcode::CALLE) ? operands[2] : operands[1];
+                size_t argc = frameBytes / 2 + _rest;
+                if ((argc + 1) > _stack.size())
+                {
+                    throw std::runtime_error("Stack underflow.");
+                }
+                size_t paramBase = _stack.size() - argc - 1;
+                _stack[paramBase].Offset += _rest;
+                _rest = 0;
+
+                if (opcode == Opcode::CALLK)
+                {
+                    _stats.KernelCalls++;
+                    acc = _kernelHandler ? _kernelHandler(*this, operands[0], &_stack[paramBase]) : PMachineValue();
+                    _stack.resize(paramBase);
+                }
+                else if (opcode == Opcode::CALL)
+                {
+                    acc = _Call(scriptNumber, pc + operands[0], frame.Self, paramBase, paramBase);
+                }
+                else
+                {
+                    uint16_t script = (opcode == Opcode::CALLB) ? 0 : operands[0];
+                    uint16_t exportIndex = (opcode == Opcode::CALLB) ? operands[0] : operands[1];
+                    const CompiledScript &compiledScript = *_GetScript(script).Script;
+                    if (exportIndex >= compiledScript._exportsTO.size())
+                    {
+                        throw std::runtime_error(fmt::format("Script {0} has no export {1}.", script, exportIndex));
+                    }
+                    acc = _Call(script, compiledScript._exportsTO[exportIndex], frame.Self, paramBase, paramBase);
+                }
+            }
+                break;
+
+            case Opcode::RET:
+                return acc;
+
+            case Opcode::SEND:
+            case Opcode::SELF:
+            case Opcode::SUPER:
+            {
+                uint16_t frameBytes = (opcode == Opcode::SUPER) ? operands[1] : operands[0];
+                size_t frameSize = frameBytes / 2 + _rest;
+                if (frameSize > _stack.size())
+                {
+                    throw std::runtime_error("Stack underflow.");
+                }
+                size_t frameStart = _stack.size() - frameSize;
+                if (_rest && (frameSize >= 2))
+                {
+                    _stack[frameStart + 1].Offset += _rest;
+                }
+                _rest = 0;
+
+                if (opcode == Opcode::SUPER)
+                {
+                    auto it = _speciesToClass.find(operands[0]);
+                    if (it == _speciesToClass.end())
+                    {
+                        throw std::runtime_error(fmt::format("Class {0} isn't loaded.", operands[0]));
+                    }
+                    acc = _SendFrame(frame.Self, &it->second, frameStart, acc);
+                }
+                else
+                {
+                    acc = _SendFrame((opcode == Opcode::SELF) ? frame.Self : acc, nullptr, frameStart, acc);
+                }
+            }
+                break;
+
+            case Opcode::CLASS:
+                acc = GetClass(operands[0]);
+                break;
+
+            case Opcode::REST:
+            {
+                uint16_t argc = _stack[frame.ParamBase].Offset;
+                for (uint16_t i = operands[0]; i <= argc; i++)
+                {
+                    _Push(_Variable(_GetVariableAddress(frame, VO_PARAM, i)));
+                }
+                _rest = (argc >= operands[0]) ? (argc - operands[0] + 1) : 0;
+            }
+                break;
+
+            case Opcode::LEA:
+            {
+                uint16_t type = (operands[0] >> 1) & LEA_VARIABLEMASK;
+                uint16_t index = operands[1];
+                if ((operands[0] >> 1) & LEA_ACC_AS_INDEX_MOD)
+                {
+                    index += acc.Offset;
+                }
+                VariableAddress address = _GetVariableAddress(frame, type, index);
+                auto it = _variableAddressHandles.find(address);
+                if (it == _variableAddressHandles.end())
+                {
+                    it = _variableAddressHandles.emplace(address, (uint16_t)_variableAddresses.size()).first;
+                    _variableAddresses.push_back(address);
+                }
+                acc = PMachineValue(VariableSegment, it->second);
+            }
+                break;
+
+            case Opcode::SELFID:
+                acc = frame.Self;
+                break;
+            case Opcode::PPREV:
+                _Push(_prev);
+                break;
+
+            case Opcode::PTOA:
+            case Opcode::ATOP:
+            case Opcode::PTOS:
+            case Opcode::STOP:
+            case Opcode::IPTOA:
+            case Opcode::DPTOA:
+            case Opcode::IPTOS:
+            case Opcode::DPTOS:
+            {
+                size_t index = operands[0] / 2;
+                if (index >= _GetRuntimeObject(frame.Self).Properties.size())
+                {
+                    throw std::runtime_error(fmt::format("Property {0} is out of range for {1}.", index, GetObjectName(frame.Self)));
+                }
+                PMachineValue &property = _GetRuntimeObject(frame.Self).Properties[index];
+                switch (opcode)
+                {
+                    case Opcode::PTOA:
+                        acc = property;
+                        break;
+                    case Opcode::ATOP:
+                        property = acc;
+                        break;
+                    case Opcode::PTOS:
+                        _Push(property);
+                        break;
+                    case Opcode::STOP:
+                        property = _Pop();
+                        break;
+                    case Opcode::IPTOA:
+                    case Opcode::IPTOS:
+                        property = PMachineValue(property.Offset + 1);
+                        break;
+                    case Opcode::DPTOA:
+                    case Opcode::DPTOS:
+                        property = PMachineValue(property.Offset - 1);
+                        break;
+                }
+                if ((opcode == Opcode::IPTOA) || (opcode == Opcode::DPTOA))
+                {
+                    acc = property;
+                }
+                else if ((opcode == Opcode::IPTOS) || (opcode == Opcode::DPTOS))
+                {
+                    _Push(property);
+                }
+            }
+                break;
+
+            case Opcode::LOFSA:
+            case Opcode::LOFSS:
+            {
+                uint16_t address = _version.lofsaOpcodeIsAbsolute ? operands[0] : (uint16_t)(pc + operands[0]);
+                PMachineValue value = _FromScriptValue(scriptNumber, address, true);
+                if (opcode == Opcode::LOFSA)
+                {
+                    acc = value;
+                }
+                else
+                {
+                    _Push(value);
+                }
+            }
+                break;
+
+            case Opcode::LineNumber:
+            case Opcode::Filename:
+                // Debug information only.
+                break;
+
+            default:
+                throw std::runtime_error(fmt::format("Unsupported opcode {0} at {1:04x} in script {2}.", OpcodeToName(opcode, operands[0]), pc, scriptNumber));
+        }
+    }
+}
@@ -0,0 +1,176 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#pragma once
+
+#include <functional>
+#include <tuple>
+#include "PMachine.h"
+#include "Version.h"
+
+class CompiledScript;
+class CompiledObject;
+class GlobalClassTable;
+class PMachineInterpreter;
+
+//
+// A value in the interpreter. Numbers have a zero segment. Objects, addresses in a script (strings
+// and saids) and addresses of variables have a non-zero one, so they can be told apart from numbers.
+//
+struct PMachineValue
+{
+    PMachineValue() : Segment(0), Offset(0) {}
+    PMachineValue(uint16_t value) : Segment(0), Offset(value) {}
+    PMachineValue(uint16_t segment, uint16_t offset) : Segment(segment), Offset(offset) {}
+
+    bool IsNumber() const { return Segment == 0; }
+    bool operator==(const PMachineValue &other) const { return (Segment == other.Segment) && (Offset == other.Offset); }
+    bool operator!=(const PMachineValue &other) const { return !(*this == other); }
+
+    uint16_t Segment;
+    uint16_t Offset;
+};
+
+struct PMachineStats
+{
+    PMachineStats() : Instructions(0), KernelCalls(0), Sends(0), MaxStackDepth(0), MaxCallDepth(0)
+    {
+        std::fill(std::begin(OpcodeCounts), std::end(OpcodeCounts), 0);
+    }
+
+    uint64_t Instructions;
+    uint64_t OpcodeCounts[TOTAL_OPCODES];
+    uint64_t KernelCalls;
+    uint64_t Sends;             // Each message in a send counts once
+    size_t MaxStackDepth;       // In values
+    size_t MaxCallDepth;
+};
+
+// Handles a callk. params[0] is the parameter count, as in the real interpreter, and the return value
+// goes in the acc.
+typedef std::function<PMachineValue(PMachineInterpreter &interpreter, uint16_t kernel, const PMachineValue *params)> PMachineKernelHandler;
+
+//
+// Executes the bytecode in compiled SCI0 - SCI1.1 script resources, without a game running. Kernel
+// calls go to a handler supplied by the caller, which by default returns 0. Used for checking that
+// compiler output behaves the same, and for measuring what code generation changes cost at runtime.
+// Errors (bad opcodes, unknown selectors, running away) throw std::runtime_error.
+//
+class PMachineInterpreter
+{
+public:
+    PMachineInterpreter(const SCIVersion &version);
+    PMachineInterpreter(const PMachineInterpreter &src) = delete;
+    PMachineInterpreter &operator=(const PMachineInterpreter &src) = delete;
+
+    // The scripts must outlive the interpreter. Script 0's local variables are the globals.
+    void AddScript(const CompiledScript &script);
+    void AddScripts(GlobalClassTable &classTable);
+
+    void SetKernelHandler(PMachineKernelHandler handler) { _kernelHandler = handler; }
+    // 0 means no limit.
+    void SetInstructionLimit(uint64_t limit) { _instructionLimit = limit; }
+
+    PMachineValue CallProcedure(uint16_t script, uint16_t exportIndex, const std::vector<PMachineValue> &params);
+    PMachineValue CallCode(uint16_t script, uint16_t codeOffset, const std::vector<PMachineValue> &params);
+    PMachineValue Send(PMachineValue object, uint16_t selector, const std::vector<PMachineValue> &params);
+
+    PMachineValue GetObject(uint16_t script, const std::string &name);
+    PMachineValue GetClass(uint16_t species);
+    // A copy of object, as the Clone kernel would make.
+    PMachineValue Clone(PMachineValue object);
+    PMachineValue GetProperty(PMachineValue object, uint16_t selector);
+    void SetProperty(PMachineValue object, uint16_t selector, PMachineValue value);
+    std::string GetObjectName(PMachineValue object);
+    // The string a script address points to, for kernel handlers.
+    std::string GetString(PMachineValue value);
+    // The variable an address from lea refers to.
+    PMachineValue &Dereference(PMachineValue address);
+    PMachineValue &Global(uint16_t index);
+
+    const PMachineStats &GetStats() const { return _stats; }
+    void ResetStats() { _stats = PMachineStats(); }
+
+private:
+    struct LoadedScript
+    {
+        const CompiledScript *Script;
+        std::vector<PMachineValue> Locals;
+        bool LocalsInitialized;
+    };
+
+    struct RuntimeObject
+    {
+        uint16_t Script;
+        const CompiledObject *Object;
+        const std::vector<uint16_t> *PropertySelectors;
+        std::vector<PMachineValue> Properties;
+    };
+
+    struct VariableAddress
+    {
+        uint16_t Type;
+        uint16_t Script;        // For locals
+        size_t Index;           // Temps and params are absolute stack indices
+        bool operator<(const VariableAddress &other) const
+        {
+            return std::tie(Type, Script, Index) < std::tie(other.Type, other.Script, other.Index);
+        }
+    };
+
+    struct Frame
+    {
+        LoadedScript *Script;
+        PMachineValue Self;
+        size_t ParamBase;       // Stack index of the parameter count
+        size_t TempBase;
+    };
+
+    LoadedScript &_GetScript(uint16_t script);
+    std::vector<PMachineValue> &_GetLocals(LoadedScript &loaded);
+    std::vector<PMachineValue> &_GetGlobals(uint16_t index);
+    PMachineValue _FromScriptValue(uint16_t script, uint16_t value, bool isObjectOrString);
+    PMachineValue _GetObjectValue(uint16_t script, const CompiledObject *object);
+    RuntimeObject &_GetRuntimeObject(PMachineValue object);
+    int _FindProperty(const RuntimeObject &object, uint16_t selector);
+    bool _FindMethod(uint16_t objectScript, const CompiledObject *object, uint16_t selector, uint16_t &script, uint16_t &codeOffset);
+    PMachineValue &_Variable(const VariableAddress &address);
+    VariableAddress _GetVariableAddress(const Frame &frame, uint16_t type, uint16_t index);
+
+    void _Push(PMachineValue value);
+    PMachineValue _Pop();
+    // The stack is restored to restoreTo when the code returns.
+    PMachineValue _Call(uint16_t script, uint16_t codeOffset, PMachineValue self, size_t paramBase, size_t restoreTo);
+    PMachineValue _Execute(Frame &frame, uint16_t pc);
+    // Sends the messages on the stack from frameStart onwards to object, and pops them. If superClass
+    // isn't null, methods are looked up starting there instead (for super).
+    PMachineValue _SendFrame(PMachineValue object, const std::pair<uint16_t, const CompiledObject*> *superClass, size_t frameStart, PMachineValue acc);
+
+    SCIVersion _version;
+    PMachineKernelHandler _kernelHandler;
+    uint64_t _instructionLimit;
+    PMachineStats _stats;
+
+    std::unordered_map<uint16_t, LoadedScript> _scripts;
+    std::unordered_map<uint16_t, std::pair<uint16_t, const CompiledObject*>> _speciesToClass;
+    std::vector<RuntimeObject> _objects;
+    std::unordered_map<const CompiledObject*, uint16_t> _objectHandles;
+    std::vector<VariableAddress> _variableAddresses;        // For lea
+    std::map<VariableAddress, uint16_t> _variableAddressHandles;
+
+    std::vector<PMachineValue> _stack;
+    std::vector<PMachineValue> _globalsIfNoScript0;
+    PMachineValue _prev;
+    uint16_t _rest;
+    size_t _callDepth;
+};
@@ -0,0 +1,146 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#include "stdafx.h"
+#include "SCOCache.h"
+#include "CompileContext.h"
+
+using namespace std;
+
+IndexedSCOFile::IndexedSCOFile(CSCOFile sco) : _sco(std::move(sco))
+{
+    // emplace doesn't overwrite, so the first of any duplicate names wins.
+    const vector<CSCOLocalVariable> &vars = _sco.GetVariables();
+    for (size_t i = 0; i < vars.size(); i++)
+    {
+        _variableIndices.emplace(vars[i].GetName(), (WORD)i);
+    }
+    for (const CSCOPublicExport &publicExport : _sco.GetExports())
+    {
+        _exportIndices.emplace(publicExport.GetName(), publicExport.GetIndex());
+    }
+    const vector<CSCOObjectClass> &classes = _sco.GetObjects();
+    for (size_t i = 0; i < classes.size(); i++)
+    {
+        _classIndices.emplace(classes[i].GetName(), i);
+        _speciesIndices.emplace(classes[i].GetSpecies(), i);
+    }
+}
+
+bool IndexedSCOFile::GetVariableIndex(const std::string &name, WORD &wIndex) const
+{
+    auto it = _variableIndices.find(name);
+    bool fRet = (it != _variableIndices.end());
+    if (fRet)
+    {
+        wIndex = it->second;
+    }
+    return fRet;
+}
+
+bool IndexedSCOFile::GetExportIndex(const std::string &name, WORD &wIndex) const
+{
+    auto it = _exportIndices.find(name);
+    bool fRet = (it != _exportIndices.end());
+    if (fRet)
+    {
+        wIndex = it->second;
+    }
+    return fRet;
+}
+
+const CSCOObjectClass *IndexedSCOFile::GetClass(const std::string &className) const
+{
+    auto it = _classIndices.find(className);
+    return (it != _classIndices.end()) ? &_sco.GetObjects()[it->second] : nullptr;
+}
+
+const CSCOObjectClass *IndexedSCOFile::GetClassBySpecies(WORD species) const
+{
+    auto it = _speciesIndices.find(species);
+    return (it != _speciesIndices.end()) ? &_sco.GetObjects()[it->second] : nullptr;
+}
+
+absl::StatusOr<std::shared_ptr<const IndexedSCOFile>> SCOCache::Load(const std::string &objectName, CompilerFileLoader &loader, const SelectorTable &selectors)
+{
+    // Script names are file names, so they're case insensitive.
+    string key = objectName;
+    transform(key.begin(), key.end(), key.begin(), ::tolower);
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto it = _byName.find(key);
+        if (it != _byName.end())
+        {
+            return it->second;
+        }
+    }
+
+    // Read it without holding the lock. Failures aren't cached, since the .sco may be generated later in the build.
+    auto sco = loader.LoadSCOFile(objectName, selectors);
+    if (!sco.ok())
+    {
+        return sco.status();
+    }
+    auto indexed = make_shared<const IndexedSCOFile>(*std::move(sco));
+
+    lock_guard<mutex> lock(_mutex);
+    auto result = _byName.emplace(key, indexed);
+    if (result.second)
+    {
+        for (const CSCOObjectClass &theClass : indexed->GetSCO().GetObjects())
+        {
+            _bySpecies[theClass.GetSpecies()] = indexed;
+        }
+    }
+    // If someone else got there first, share theirs.
+    return result.first->second;
+}
+
+bool SCOCache::FindClassBySpecies(WORD species, std::shared_ptr<const IndexedSCOFile> &sco, const CSCOObjectClass *&pClass) const
+{
+    lock_guard<mutex> lock(_mutex);
+    auto it = _bySpecies.find(species);
+    if (it != _bySpecies.end())
+    {
+        sco = it->second;
+        pClass = sco->GetClassBySpecies(species);
+    }
+    return (it != _bySpecies.end());
+}
+
+void SCOCache::Invalidate(WORD scriptNumber)
+{
+    lock_guard<mutex> lock(_mutex);
+    for (auto it = _byName.begin(); it != _byName.end();)
+    {
+        if (it->second->GetScriptNumber() == scriptNumber)
+        {
+            it = _byName.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    for (auto it = _bySpecies.begin(); it != _bySpecies.end();)
+    {
+        if (it->second->GetScriptNumber() == scriptNumber)
+        {
+            it = _bySpecies.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,72 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#pragma once
+
+#include <memory>
+#include <absl/status/statusor.h>
+#include "SCO.h"
+
+class CompilerFileLoader;
+class SelectorTable;
+
+//
+// A loaded .sco file that no longer changes, with hashed lookups by name and species.
+// Lookups by name return the first match, just like the CSCOFile ones.
+//
+class IndexedSCOFile
+{
+public:
+    explicit IndexedSCOFile(CSCOFile sco);
+    IndexedSCOFile(const IndexedSCOFile &src) = delete;
+    IndexedSCOFile &operator=(const IndexedSCOFile &src) = delete;
+
+    const CSCOFile &GetSCO() const { return _sco; }
+    WORD GetScriptNumber() const { return _sco.GetScriptNumber(); }
+    std::string GetClassName(WORD wIndex) const { return _sco.GetClassName(wIndex); }
+
+    bool GetVariableIndex(const std::string &name, WORD &wIndex) const;
+    bool GetExportIndex(const std::string &name, WORD &wIndex) const;
+    const CSCOObjectClass *GetClass(const std::string &className) const;
+    const CSCOObjectClass *GetClassBySpecies(WORD species) const;
+
+private:
+    CSCOFile _sco;
+    std::unordered_map<std::string, WORD> _variableIndices;
+    std::unordered_map<std::string, WORD> _exportIndices;       // Maps to the export number, not the position in the list.
+    std::unordered_map<std::string, size_t> _classIndices;
+    std::unordered_map<WORD, size_t> _speciesIndices;
+};
+
+//
+// The .sco files used during a build. Each one is read from disk once and then shared by all the
+// scripts that use it, instead of being re-read for each CompileContext.
+// An entry is only dropped when its script's .sco file is regenerated.
+//
+class SCOCache
+{
+public:
+    // e.g. objectName is "Feature"
+    absl::StatusOr<std::shared_ptr<const IndexedSCOFile>> Load(const std::string &objectName, CompilerFileLoader &loader, const SelectorTable &selectors);
+
+    // Finds a class by species number, among all the .sco files loaded so far.
+    bool FindClassBySpecies(WORD species, std::shared_ptr<const IndexedSCOFile> &sco, const CSCOObjectClass *&pClass) const;
+
+    // Call this when a script's .sco file has been rewritten.
+    void Invalidate(WORD scriptNumber);
+
+private:
+    mutable std::mutex _mutex;
+    std::unordered_map<std::string, std::shared_ptr<const IndexedSCOFile>> _byName;
+    std::unordered_map<WORD, std::shared_ptr<const IndexedSCOFile>> _bySpecies;
+};
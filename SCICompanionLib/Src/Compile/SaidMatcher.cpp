@@ -0,0 +1,713 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#include "stdafx.h"
+#include "SaidMatcher.h"
+#include "CompiledScript.h"
+#include "CompileInterfaces.h"
+#include "CompileContext.h"
+#include "ResourceMap.h"
+#include "GameFolderHelper.h"
+#include <chrono>
+#include <format.h>
+
+using namespace std;
+
+// Said tokens
+const uint16_t SaidComma = 0xf0;
+const uint16_t SaidAmpersand = 0xf1;
+const uint16_t SaidSlash = 0xf2;
+const uint16_t SaidOpenParen = 0xf3;
+const uint16_t SaidCloseParen = 0xf4;
+const uint16_t SaidOpenBracket = 0xf5;
+const uint16_t SaidCloseBracket = 0xf6;
+const uint16_t SaidPound = 0xf7;
+const uint16_t SaidLessThan = 0xf8;
+const uint16_t SaidGreaterThan = 0xf9;
+
+const uint16_t AnyWord = 0xfff;
+
+// Below this, it isn't worth starting another thread.
+const size_t MinSentencesPerThread = 256;
+// We don't list every sentence when a corpus has thousands that don't match.
+const size_t MaxSentencesListed = 100;
+
+bool _IsSaidToken(uint16_t value)
+{
+    return (value >= SaidComma) && (value <= SaidGreaterThan);
+}
+
+bool _IsAt(const vector<uint16_t> &sequence, size_t pos, uint16_t token)
+{
+    return (pos < sequence.size()) && (sequence[pos] == token);
+}
+
+class Vocab000LookupSaids : public ILookupSaids
+{
+public:
+    Vocab000LookupSaids(const Vocab000 &vocab) : _vocab(vocab) {}
+
+    bool LookupWord(const std::string &word, uint16_t &wordGroup) override
+    {
+        Vocab000::WordGroup group;
+        bool result = _vocab.LookupWord(word, group);
+        wordGroup = (uint16_t)group;
+        return result;
+    }
+
+private:
+    const Vocab000 &_vocab;
+};
+
+SaidMatcher::SaidMatcher(const Vocab000 &vocab) : _vocab(vocab), _unsupported(0)
+{
+}
+
+void SaidMatcher::AddScript(const CompiledScript &script)
+{
+    uint16_t scriptNumber = script.GetScriptNumber();
+    for (const auto &synonymPair : script.GetSynonyms())
+    {
+        for (uint16_t synonym : synonymPair.second)
+        {
+            if (scriptNumber == 0)
+            {
+                _globalSynonyms[synonym] = synonymPair.first;
+            }
+            else
+            {
+                _scriptSynonyms[scriptNumber][synonym] = synonymPair.first;
+                _scriptSynonymWords.insert(synonym);
+            }
+        }
+    }
+
+    static const string c_saidTokens = ",&/()[]#<>";
+    for (const auto &sequence : script.GetSaids())
+    {
+        string text;
+        for (uint16_t value : sequence)
+        {
+            text += _IsSaidToken(value) ? string(1, c_saidTokens[value - SaidComma]) : _vocab.Lookup(value);
+        }
+        AddSpec(scriptNumber, sequence, text);
+    }
+}
+
+bool SaidMatcher::AddSpec(uint16_t script, const std::string &text)
+{
+    vector<uint8_t> stream;
+    vector<string> words;
+    Vocab000LookupSaids lookup(_vocab);
+    ParseSaidString(nullptr, lookup, text, &stream, nullptr, &words);
+
+    // Words come out big-endian, and unknown words are left out.
+    vector<uint16_t> sequence;
+    size_t wordCount = 0;
+    for (size_t i = 0; (i < stream.size()) && (stream[i] != 0xff); i++)
+    {
+        if (stream[i] >= SaidComma)
+        {
+            sequence.push_back(stream[i]);
+        }
+        else if ((i + 1) < stream.size())
+        {
+            sequence.push_back((uint16_t)((stream[i] << 8) | stream[i + 1]));
+            wordCount++;
+            i++;
+        }
+    }
+    if (wordCount != words.size())
+    {
+        _unsupported++;
+        return false;
+    }
+    return AddSpec(script, sequence, text);
+}
+
+bool SaidMatcher::AddSpec(uint16_t script, const std::vector<uint16_t> &sequence, const std::string &text)
+{
+    SaidSpec spec;
+    spec.Script = script;
+    spec.Text = text;
+
+    // [verb] [/ direct object] [/ indirect object] [>], where parts after the first may be optional: [/...]
+    size_t pos = 0;
+    int partIndex = 0;
+    int optionalDepth = 0;
+    bool ok = _ParsePart(sequence, pos, spec, spec.Parts[0]);
+    while (ok && (pos < sequence.size()))
+    {
+        uint16_t token = sequence[pos];
+        if ((token == SaidSlash) || ((token == SaidOpenBracket) && _IsAt(sequence, pos + 1, SaidSlash)))
+        {
+            bool optional = (token == SaidOpenBracket);
+            pos += optional ? 2 : 1;
+            if (optional)
+            {
+                optionalDepth++;
+            }
+            ok = (++partIndex < (int)ARRAYSIZE(spec.Parts));
+            if (ok)
+            {
+                spec.Parts[partIndex].Optional = (optionalDepth > 0);
+                ok = _ParsePart(sequence, pos, spec, spec.Parts[partIndex]);
+            }
+        }
+        else if ((token == SaidCloseBracket) && (optionalDepth > 0))
+        {
+            optionalDepth--;
+            pos++;
+        }
+        else if (token == SaidGreaterThan)
+        {
+            spec.Incomplete = true;
+            pos++;
+        }
+        else
+        {
+            ok = false;
+        }
+    }
+    ok = ok && (optionalDepth == 0);
+
+    if (!ok)
+    {
+        _unsupported++;
+        return false;
+    }
+    spec.PartCount = partIndex + 1;
+
+    // Index by verb, where the verb is a plain word in every alternative.
+    size_t specIndex = _specs.size();
+    vector<uint16_t> verbs;
+    bool indexable = true;
+    if (spec.Parts[0].Expression == -1)
+    {
+        verbs.push_back(0);
+    }
+    else
+    {
+        for (const SaidAlternative &alternative : spec.Expressions[spec.Parts[0].Expression])
+        {
+            const SaidTerm &head = alternative.Head;
+            indexable = indexable && (head.Expression == -1) && !head.Optional && (head.Group != AnyWord);
+            verbs.push_back(head.Group);
+        }
+    }
+    if (indexable)
+    {
+        sort(verbs.begin(), verbs.end());
+        verbs.erase(unique(verbs.begin(), verbs.end()), verbs.end());
+        for (uint16_t verb : verbs)
+        {
+            _specsByVerb[verb].push_back(specIndex);
+        }
+    }
+    else
+    {
+        _specsWithAnyVerb.push_back(specIndex);
+    }
+    _specs.push_back(spec);
+    return true;
+}
+
+bool SaidMatcher::_ParsePart(const std::vector<uint16_t> &sequence, size_t &pos, SaidSpec &spec, SaidPart &part)
+{
+    // A part can be empty.
+    if ((pos >= sequence.size()) ||
+        (sequence[pos] == SaidSlash) || (sequence[pos] == SaidGreaterThan) || (sequence[pos] == SaidCloseBracket) ||
+        ((sequence[pos] == SaidOpenBracket) && _IsAt(sequence, pos + 1, SaidSlash)))
+    {
+        part.Expression = -1;
+        return true;
+    }
+    return _ParseExpression(sequence, pos, spec, part.Expression);
+}
+
+bool SaidMatcher::_ParseExpression(const std::vector<uint16_t> &sequence, size_t &pos, SaidSpec &spec, int &expression)
+{
+    // Reserve our spot first, since terms may add their own expressions.
+    expression = (int)spec.Expressions.size();
+    spec.Expressions.emplace_back();
+    bool ok = true;
+    bool more = true;
+    while (ok && more)
+    {
+        SaidAlternative alternative;
+        ok = _ParseTerm(sequence, pos, spec, alternative.Head);
+        // Modifiers: <word, or optionally [<word]
+        while (ok && (_IsAt(sequence, pos, SaidLessThan) || (_IsAt(sequence, pos, SaidOpenBracket) && _IsAt(sequence, pos + 1, SaidLessThan))))
+        {
+            bool optional = _IsAt(sequence, pos, SaidOpenBracket);
+            pos += optional ? 2 : 1;
+            SaidTerm modifier;
+            ok = _ParseTerm(sequence, pos, spec, modifier);
+            if (ok && optional)
+            {
+                modifier.Optional = true;
+                ok = _IsAt(sequence, pos, SaidCloseBracket);
+                pos++;
+            }
+            alternative.Modifiers.push_back(modifier);
+        }
+        spec.Expressions[expression].push_back(alternative);
+        more = _IsAt(sequence, pos, SaidComma);
+        if (more)
+        {
+            pos++;
+        }
+    }
+    return ok;
+}
+
+bool SaidMatcher::_ParseTerm(const std::vector<uint16_t> &sequence, size_t &pos, SaidSpec &spec, SaidTerm &term)
+{
+    if (pos >= sequence.size())
+    {
+        return false;
+    }
+    uint16_t value = sequence[pos++];
+    if (!_IsSaidToken(value))
+    {
+        term.Group = value;
+        return true;
+    }
+    else if ((value == SaidOpenParen) || (value == SaidOpenBracket))
+    {
+        term.Optional = (value == SaidOpenBracket);
+        bool ok = _ParseExpression(sequence, pos, spec, term.Expression);
+        ok = ok && _IsAt(sequence, pos, term.Optional ? SaidCloseBracket : SaidCloseParen);
+        pos++;
+        return ok;
+    }
+    // & and # aren't supported, and anything else is out of place.
+    return false;
+}
+
+bool SaidMatcher::Tokenize(const std::string &sentence, std::vector<uint16_t> &wordGroups, std::string *unknownWord) const
+{
+    wordGroups.clear();
+    string word;
+    for (size_t i = 0; i <= sentence.length(); i++)
+    {
+        char ch = (i < sentence.length()) ? sentence[i] : ' ';
+        if (IsValidVocabChar(ch))
+        {
+            word.push_back((char)tolower((uint8_t)ch));
+        }
+        else if (!word.empty())
+        {
+            Vocab000::WordGroup group;
+            if (!_vocab.LookupWord(word, group))
+            {
+                if (unknownWord)
+                {
+                    *unknownWord = word;
+                }
+                return false;
+            }
+            wordGroups.push_back((uint16_t)group);
+            word.clear();
+        }
+    }
+    return !wordGroups.empty();
+}
+
+void SaidMatcher::Analyze(const std::vector<uint16_t> &wordGroups, SaidSlot slots[3]) const
+{
+    _Analyze(wordGroups, nullptr, slots);
+}
+
+void SaidMatcher::_Analyze(const std::vector<uint16_t> &wordGroups, const SynonymMap *scriptSynonyms, SaidSlot slots[3]) const
+{
+    for (int i = 0; i < 3; i++)
+    {
+        slots[i] = SaidSlot();
+    }
+    SaidSlot &verb = slots[0];
+    SaidSlot &directObject = slots[1];
+    SaidSlot &indirectObject = slots[2];
+
+    vector<uint16_t> adjectives;
+    uint16_t preposition = 0;
+    bool first = true;
+    for (uint16_t word : wordGroups)
+    {
+        auto itSynonym = _globalSynonyms.find(word);
+        if (itSynonym != _globalSynonyms.end())
+        {
+            word = itSynonym->second;
+        }
+        if (scriptSynonyms)
+        {
+            itSynonym = scriptSynonyms->find(word);
+            if (itSynonym != scriptSynonyms->end())
+            {
+                word = itSynonym->second;
+            }
+        }
+
+        WordClass wordClass = WordClass::Unknown;
+        _vocab.GetGroupClass(word, &wordClass);
+        bool isVerb = (wordClass & (WordClass::ImperativeVerb | WordClass::IndicativeVerb)) != WordClass::Unknown;
+        if (wordClass == WordClass::Article)
+        {
+            continue;
+        }
+
+        if (first && isVerb)
+        {
+            verb.Root = word;
+        }
+        else if ((wordClass & WordClass::Proposition) != WordClass::Unknown)
+        {
+            if (preposition && verb.Root && !directObject.Root)
+            {
+                verb.Modifiers.push_back(preposition);
+            }
+            preposition = word;
+        }
+        else if ((wordClass & WordClass::Noun) != WordClass::Unknown)
+        {
+            SaidSlot nounPhrase;
+            nounPhrase.Root = word;
+            nounPhrase.Modifiers = adjectives;
+            adjectives.clear();
+            if (preposition && directObject.Root)
+            {
+                // put key in box
+                nounPhrase.Modifiers.push_back(preposition);
+                indirectObject = nounPhrase;
+            }
+            else if (!directObject.Root)
+            {
+                // look at tree: the preposition goes with the verb
+                if (preposition)
+                {
+                    verb.Modifiers.push_back(preposition);
+                }
+                directObject = nounPhrase;
+            }
+            else if (!indirectObject.Root)
+            {
+                // give man key: the first one is the indirect object
+                indirectObject = directObject;
+                directObject = nounPhrase;
+            }
+            preposition = 0;
+        }
+        else if ((wordClass & WordClass::QualifyingAdjective) != WordClass::Unknown)
+        {
+            adjectives.push_back(word);
+        }
+        else if ((wordClass & WordClass::Adverb) != WordClass::Unknown)
+        {
+            verb.Modifiers.push_back(word);
+        }
+        else if (isVerb && !verb.Root)
+        {
+            verb.Root = word;
+        }
+        // Anything else (conjunctions, pronouns, numbers) is ignored.
+        first = false;
+    }
+
+    // look in, or open big: left over words go with what they'd most likely modify.
+    if (preposition)
+    {
+        verb.Modifiers.push_back(preposition);
+    }
+    if (!adjectives.empty() && directObject.Root)
+    {
+        directObject.Modifiers.insert(directObject.Modifiers.end(), adjectives.begin(), adjectives.end());
+    }
+}
+
+bool SaidMatcher::_MatchTerm(const SaidSpec &spec, const SaidTerm &term, const SaidSlot &slot) const
+{
+    if (!slot.Root)
+    {
+        return term.Optional;
+    }
+    if (term.Expression == -1)
+    {
+        return (term.Group == slot.Root) || (term.Group == AnyWord);
+    }
+    return _MatchExpression(spec, term.Expression, slot);
+}
+
+bool SaidMatcher::_MatchExpression(const SaidSpec &spec, int expression, const SaidSlot &slot) const
+{
+    for (const SaidAlternative &alternative : spec.Expressions[expression])
+    {
+        bool match = _MatchTerm(spec, alternative.Head, slot);
+        for (size_t i = 0; match && (i < alternative.Modifiers.size()); i++)
+        {
+            const SaidTerm &modifier = alternative.Modifiers[i];
+            if (!modifier.Optional)
+            {
+                // Any of the sentence's modifiers will do, and the sentence can have others.
+                match = false;
+                for (uint16_t word : slot.Modifiers)
+                {
+                    SaidSlot modifierSlot;
+                    modifierSlot.Root = word;
+                    if (_MatchTerm(spec, modifier, modifierSlot))
+                    {
+                        match = true;
+                        break;
+                    }
+                }
+            }
+        }
+        if (match)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SaidMatcher::Matches(const SaidSpec &spec, const SaidSlot slots[3]) const
+{
+    for (int i = 0; i < (int)ARRAYSIZE(spec.Parts); i++)
+    {
+        const SaidSlot &slot = slots[i];
+        if (i < spec.PartCount)
+        {
+            const SaidPart &part = spec.Parts[i];
+            if (part.Expression == -1)
+            {
+                if (slot.Root)
+                {
+                    return false;
+                }
+            }
+            else if (!slot.Root)
+            {
+                if (!part.Optional)
+                {
+                    return false;
+                }
+            }
+            else if (!_MatchExpression(spec, part.Expression, slot))
+            {
+                return false;
+            }
+        }
+        else if (slot.Root && !spec.Incomplete)
+        {
+            // The sentence says more than the spec.
+            return false;
+        }
+    }
+    return true;
+}
+
+void SaidMatcher::_Match(const std::vector<uint16_t> &wordGroups, std::vector<size_t> &specIndices) const
+{
+    SaidSlot slots[3];
+    _Analyze(wordGroups, nullptr, slots);
+
+    // Only analyze again with a script's synonyms if the sentence has any of them.
+    bool needScriptSynonyms = false;
+    for (uint16_t word : wordGroups)
+    {
+        needScriptSynonyms = needScriptSynonyms || (_scriptSynonymWords.find(word) != _scriptSynonymWords.end());
+    }
+    unordered_map<uint16_t, array<SaidSlot, 3>> scriptSlots;
+
+    auto tryMatch = [&](size_t specIndex)
+    {
+        const SaidSpec &spec = _specs[specIndex];
+        const SaidSlot *slotsToUse = slots;
+        if (needScriptSynonyms)
+        {
+            auto itSynonyms = _scriptSynonyms.find(spec.Script);
+            if (itSynonyms != _scriptSynonyms.end())
+            {
+                auto itSlots = scriptSlots.find(spec.Script);
+                if (itSlots == scriptSlots.end())
+                {
+                    itSlots = scriptSlots.emplace(spec.Script, array<SaidSlot, 3>()).first;
+                    _Analyze(wordGroups, &itSynonyms->second, &itSlots->second[0]);
+                }
+                slotsToUse = &itSlots->second[0];
+            }
+        }
+        if (Matches(spec, slotsToUse))
+        {
+            specIndices.push_back(specIndex);
+        }
+    };
+
+    // Synonyms can change the verb, so when they're in play, look at all verbs.
+    if (needScriptSynonyms)
+    {
+        for (size_t i = 0; i < _specs.size(); i++)
+        {
+            tryMatch(i);
+        }
+    }
+    else
+    {
+        auto itVerb = _specsByVerb.find(slots[0].Root);
+        if (itVerb != _specsByVerb.end())
+        {
+            for (size_t specIndex : itVerb->second)
+            {
+                tryMatch(specIndex);
+            }
+        }
+        for (size_t specIndex : _specsWithAnyVerb)
+        {
+            tryMatch(specIndex);
+        }
+        sort(specIndices.begin(), specIndices.end());
+    }
+}
+
+bool SaidMatcher::Match(const std::string &sentence, std::vector<size_t> &specIndices) const
+{
+    specIndices.clear();
+    vector<uint16_t> wordGroups;
+    if (!Tokenize(sentence, wordGroups))
+    {
+        return false;
+    }
+    _Match(wordGroups, specIndices);
+    return true;
+}
+
+SaidMatchResults SaidMatcher::MatchAll(const std::vector<std::string> &sentences) const
+{
+    SaidMatchResults results;
+    results.Matches.resize(sentences.size());
+    results.Understood.resize(sentences.size());
+
+    int threadCount = max(1, min((int)std::thread::hardware_concurrency(), (int)(sentences.size() / MinSentencesPerThread)));
+    results.Threads = threadCount;
+    vector<vector<size_t>> threadSpecHits(threadCount, vector<size_t>(_specs.size(), 0));
+
+    auto start = chrono::steady_clock::now();
+    auto worker = [&](int threadIndex)
+    {
+        vector<size_t> &specHits = threadSpecHits[threadIndex];
+        vector<uint16_t> wordGroups;
+        for (size_t i = threadIndex; i < sentences.size(); i += threadCount)
+        {
+            // Each sentence has its own slot in the results, so there's no contention.
+            bool understood = Tokenize(sentences[i], wordGroups);
+            if (understood)
+            {
+                _Match(wordGroups, results.Matches[i]);
+                for (size_t specIndex : results.Matches[i])
+                {
+                    specHits[specIndex]++;
+                }
+            }
+            results.Understood[i] = understood ? 1 : 0;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threadCount; i++)
+    {
+        threads.emplace_back(worker, i);
+    }
+    worker(0);
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    results.Seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    results.SpecHits.assign(_specs.size(), 0);
+    for (const vector<size_t> &specHits : threadSpecHits)
+    {
+        for (size_t i = 0; i < specHits.size(); i++)
+        {
+            results.SpecHits[i] += specHits[i];
+        }
+    }
+    for (size_t i = 0; i < sentences.size(); i++)
+    {
+        if (!results.Understood[i])
+        {
+            results.NotUnderstood++;
+        }
+        else if (results.Matches[i].empty())
+        {
+            results.Unmatched++;
+        }
+    }
+    return results;
+}
+
+void ReportSaidCoverage(CResourceMap &resourceMap, const SCIVersion &version, CompileLog &log, const Vocab000 &vocab000, const std::string &corpusFile)
+{
+    vector<string> sentences;
+    ifstream corpus(corpusFile);
+    if (!corpus)
+    {
+        log.ReportResult(CompileResult(fmt::format("Unable to open the said corpus {0}.", corpusFile), CompileResult::CompileResultType::CRT_Error));
+        return;
+    }
+    string line;
+    while (getline(corpus, line))
+    {
+        if (line.find_first_not_of(" \t\r") != string::npos)
+        {
+            sentences.push_back(line);
+        }
+    }
+
+    SaidMatcher matcher(vocab000);
+    for (ScriptId scriptId : resourceMap.GetAllScripts())
+    {
+        CompiledScript script(scriptId.GetResourceNumber());
+        if (script.Load(resourceMap.Helper(), version, scriptId.GetResourceNumber()))
+        {
+            matcher.AddScript(script);
+        }
+    }
+
+    SaidMatchResults results = matcher.MatchAll(sentences);
+    const vector<SaidSpec> &specs = matcher.GetSpecs();
+
+    size_t listed = 0;
+    for (size_t i = 0; (i < sentences.size()) && (listed < MaxSentencesListed); i++)
+    {
+        if (!results.Understood[i] || results.Matches[i].empty())
+        {
+            log.ReportResult(CompileResult(fmt::format("{0}: \"{1}\"", results.Understood[i] ? "No said matches" : "Not understood", sentences[i]), CompileResult::CompileResultType::CRT_Warning));
+            listed++;
+        }
+    }
+
+    size_t neverMatched = 0;
+    for (size_t i = 0; i < specs.size(); i++)
+    {
+        if (results.SpecHits[i] == 0)
+        {
+            log.ReportResult(CompileResult(fmt::format("Script {0}: '{1}' is never matched", specs[i].Script, specs[i].Text), ResourceType::Script, specs[i].Script, 0));
+            neverMatched++;
+        }
+    }
+
+    log.ReportResult(CompileResult(fmt::format("Said coverage: {0} sentences, {1} not understood, {2} matched no said. {3} of {4} saids were never matched ({5} couldn't be evaluated).",
+        sentences.size(), results.NotUnderstood, results.Unmatched, neverMatched, specs.size(), matcher.GetUnsupportedCount())));
+    log.ReportResult(CompileResult(fmt::format("Matched {0:.0f} sentences per second on {1} threads.",
+        (results.Seconds > 0) ? (sentences.size() / results.Seconds) : 0.0, results.Threads)));
+}
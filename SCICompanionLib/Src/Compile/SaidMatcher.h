@@ -0,0 +1,139 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#pragma once
+
+#include "Vocab000.h"
+
+class CompiledScript;
+class CompileLog;
+class CResourceMap;
+
+//
+// A said spec compiled into a tree. Expressions, alternatives and terms refer to each other by
+// index into the spec's Expressions.
+//
+struct SaidTerm
+{
+    SaidTerm() : Group(0), Expression(-1), Optional(false) {}
+
+    uint16_t Group;             // A word group, if Expression is -1
+    int Expression;
+    bool Optional;              // Inside [ ]
+};
+
+struct SaidAlternative
+{
+    SaidTerm Head;
+    std::vector<SaidTerm> Modifiers;    // Each after a <
+};
+
+typedef std::vector<SaidAlternative> SaidExpression;    // Alternatives separated by ,
+
+struct SaidPart
+{
+    SaidPart() : Expression(-1), Optional(false) {}
+
+    int Expression;             // -1 for an empty part
+    bool Optional;              // [/...]
+};
+
+struct SaidSpec
+{
+    SaidSpec() : Script(0), PartCount(0), Incomplete(false) {}
+
+    uint16_t Script;
+    std::string Text;
+    std::vector<SaidExpression> Expressions;
+    SaidPart Parts[3];          // Verb, direct object, indirect object
+    int PartCount;
+    bool Incomplete;            // Ends with >, so the sentence may have more
+};
+
+// The verb, direct object and indirect object of a player's sentence.
+struct SaidSlot
+{
+    SaidSlot() : Root(0) {}
+
+    uint16_t Root;              // 0 if empty
+    std::vector<uint16_t> Modifiers;    // Adjectives, prepositions and adverbs
+};
+
+struct SaidMatchResults
+{
+    SaidMatchResults() : NotUnderstood(0), Unmatched(0), Seconds(0), Threads(0) {}
+
+    std::vector<std::vector<size_t>> Matches;   // For each sentence, the indices of the specs it triggers
+    std::vector<size_t> SpecHits;               // For each spec, the number of sentences that trigger it
+    std::vector<uint8_t> Understood;            // For each sentence, non-zero if every word is in the vocabulary
+    size_t NotUnderstood;
+    size_t Unmatched;                           // Understood, but triggers no spec
+    double Seconds;
+    int Threads;
+};
+
+//
+// Evaluates which said specs a player's sentence would trigger, for checking a corpus of sentences
+// against every said in a game. Sentences are split into verb, direct object and indirect object with
+// a simple imperative grammar based on word classes, which covers the common forms but is not the
+// game's parser. Synonyms from script 0 apply everywhere, and a script's own synonyms apply to its saids.
+//
+class SaidMatcher
+{
+public:
+    SaidMatcher(const Vocab000 &vocab);
+
+    void AddScript(const CompiledScript &script);
+    // Returns false if the spec uses a word that isn't in the vocabulary, or operators that aren't supported (& and #).
+    bool AddSpec(uint16_t script, const std::vector<uint16_t> &sequence, const std::string &text);
+    bool AddSpec(uint16_t script, const std::string &text);
+    const std::vector<SaidSpec> &GetSpecs() const { return _specs; }
+    size_t GetUnsupportedCount() const { return _unsupported; }
+
+    // Returns false (and the word) if a word isn't in the vocabulary.
+    bool Tokenize(const std::string &sentence, std::vector<uint16_t> &wordGroups, std::string *unknownWord = nullptr) const;
+    void Analyze(const std::vector<uint16_t> &wordGroups, SaidSlot slots[3]) const;
+    bool Matches(const SaidSpec &spec, const SaidSlot slots[3]) const;
+
+    // Returns false if the sentence isn't understood.
+    bool Match(const std::string &sentence, std::vector<size_t> &specIndices) const;
+    // Matches the sentences on all processors.
+    SaidMatchResults MatchAll(const std::vector<std::string> &sentences) const;
+
+private:
+    typedef std::unordered_map<uint16_t, uint16_t> SynonymMap;   // Synonym -> main word
+
+    bool _ParsePart(const std::vector<uint16_t> &sequence, size_t &pos, SaidSpec &spec, SaidPart &part);
+    bool _ParseExpression(const std::vector<uint16_t> &sequence, size_t &pos, SaidSpec &spec, int &expression);
+    bool _ParseTerm(const std::vector<uint16_t> &sequence, size_t &pos, SaidSpec &spec, SaidTerm &term);
+    void _Analyze(const std::vector<uint16_t> &wordGroups, const SynonymMap *scriptSynonyms, SaidSlot slots[3]) const;
+    bool _MatchExpression(const SaidSpec &spec, int expression, const SaidSlot &slot) const;
+    bool _MatchTerm(const SaidSpec &spec, const SaidTerm &term, const SaidSlot &slot) const;
+    void _Match(const std::vector<uint16_t> &wordGroups, std::vector<size_t> &specIndices) const;
+
+    const Vocab000 &_vocab;
+    std::vector<SaidSpec> _specs;
+    size_t _unsupported;
+
+    // Specs by the word groups their verb can be, and those that can't be indexed that way.
+    std::unordered_map<uint16_t, std::vector<size_t>> _specsByVerb;
+    std::vector<size_t> _specsWithAnyVerb;
+
+    SynonymMap _globalSynonyms;
+    std::unordered_map<uint16_t, SynonymMap> _scriptSynonyms;
+    std::unordered_set<uint16_t> _scriptSynonymWords;     // So we know when a sentence needs them
+};
+
+// Matches each line in corpusFile against every said in the game's compiled scripts, and reports how
+// many sentences are understood and matched, which saids are never triggered, and the throughput.
+void ReportSaidCoverage(CResourceMap &resourceMap, const SCIVersion &version, CompileLog &log, const Vocab000 &vocab000, const std::string &corpusFile);
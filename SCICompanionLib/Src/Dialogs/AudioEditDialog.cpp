@@ -68,7 +68,8 @@ void AudioEditDialog::DoDataExchange(CDataExchange* pDX)
     {
         m_wndCheckFinal.SetCheck(BST_CHECKED);
         m_wndButtonProcess.SetIcon(IDI_REFRESH, 0, 0, 0, 16, 16);
-        m_wndComboBit.SetCurSel(IsFlagSet(_audio->Flags, AudioFlags::SixteenBit) ? 1 : 0);
+        // The combo has 8 bit, 16 bit, and then the DPCM compressed versions of each.
+        m_wndComboBit.SetCurSel((IsFlagSet(_audio->Flags, AudioFlags::SixteenBit) ? 1 : 0) + (IsFlagSet(_audio->Flags, AudioFlags::DPCM) ? 2 : 0));
 
         m_wndWaveformNegative.SetResource(&_negative->Audio);
 
@@ -149,7 +150,7 @@ void AudioEditDialog::OnCbnSelchangeComboBit()
     int curSel = m_wndComboBit.GetCurSel();
     if (curSel != CB_ERR)
     {
-        if (curSel == 0)
+        if ((curSel % 2) == 0)
         {
             _audio->Flags &= ~(AudioFlags::SixteenBit | AudioFlags::Signed);
         }
@@ -157,6 +158,15 @@ void AudioEditDialog::OnCbnSelchangeComboBit()
         {
             _audio->Flags |= (AudioFlags::SixteenBit | AudioFlags::Signed);
         }
+        // DPCM is applied when the resource is saved, so the PCM data is the same either way.
+        if (curSel >= 2)
+        {
+            _audio->Flags |= AudioFlags::DPCM;
+        }
+        else
+        {
+            _audio->Flags &= ~AudioFlags::DPCM;
+        }
         // Process, so that the data in the audio matches the bit depth we just set.
         OnBnClickedButtonProcess();
     }
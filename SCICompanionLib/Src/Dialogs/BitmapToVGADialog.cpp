@@ -67,6 +67,7 @@ CBitmapToVGADialog::CBitmapToVGADialog(
     _alphaThreshold = 128;
     _allowInsertAtCurrentPosition = allowInsertAtCurrentPosition;
     _needsUpdate = true;
+    _trackingSlider = false;
 
     if (fixedPalette)
     {
@@ -533,7 +534,7 @@ void _Overlay(Cel &cel, const Cel *currentBackgroundOptional)
 
 std::unique_ptr<Cel> GdiPlusBitmapToCel(
     Gdiplus::Bitmap &bmpCurrent,
-    bool performDither,
+    DitherAlgorithm colorDither,
     bool gammaCorrected,
     DitherAlgorithm alphaDither,
     ColorMatching colorMatching,
@@ -572,7 +573,7 @@ std::unique_ptr<Cel> GdiPlusBitmapToCel(
             targetColors[i].rgbReserved = usableColors[i] ? 0x1 : 0x0;
         }
 
-        RGBToPalettized(colorMatching, &temp->Data[0], imageData.get(), cx, cy, performDither, gammaCorrected, paletteSize, mapping, targetColors, transparentColor, excludeTransparentColorFromPalette, convertStatus);
+        RGBToPalettized(colorMatching, &temp->Data[0], imageData.get(), cx, cy, colorDither, gammaCorrected, paletteSize, mapping, targetColors, transparentColor, excludeTransparentColorFromPalette, convertStatus);
 
         finalResult = move(temp);
     }
@@ -593,6 +594,8 @@ void CBitmapToVGADialog::_Update()
     DitherAlgorithm alphaDither = (DitherAlgorithm)m_wndComboDitherAlpha.GetCurSel();
     bool excludeTransparentColorFromPalette = m_wndCheckDontUseInPalette.GetCheck() == BST_CHECKED;
     bool performDither = (m_wndDither.GetCheck() == BST_CHECKED);
+    // Error diffusion is too slow to keep up while a slider is being dragged, so use an ordered dither until it's released.
+    DitherAlgorithm colorDither = performDither ? (_trackingSlider ? DitherAlgorithm::OrderedBayer : DitherAlgorithm::FloydSteinberg) : DitherAlgorithm::None;
 
     // We need to generate a final image for m_wndPic
     switch (_paletteAlgorithm)
@@ -638,7 +641,7 @@ void CBitmapToVGADialog::_Update()
                             ditherRefPalette.Colors[i].rgbReserved = (referencePalette.Colors[i].rgbReserved == 0x0) ? 0x1: 0x0;
                         }
                         BitmapConvertStatus convertStatus;
-                        RGBToPalettized(_colorMatching, sciBits.get(), imageData.get(), cx, cy, performDither, gammaCorrected, ARRAYSIZE(ditherRefPalette.Colors), ditherRefPalette.Mapping, ditherRefPalette.Colors, _transparentColor, excludeTransparentColorFromPalette, convertStatus);
+                        RGBToPalettized(_colorMatching, sciBits.get(), imageData.get(), cx, cy, colorDither, gammaCorrected, ARRAYSIZE(ditherRefPalette.Colors), ditherRefPalette.Mapping, ditherRefPalette.Colors, _transparentColor, excludeTransparentColorFromPalette, convertStatus);
                     }
 
                     temp->Data.allocate(PaddedSize(temp->size));
@@ -660,7 +663,7 @@ void CBitmapToVGADialog::_Update()
             BitmapConvertStatus convertStatus = BitmapConvertStatus::None;
             _finalResult = GdiPlusBitmapToCel(
                 *_pbmpCurrent,
-                performDither,
+                colorDither,
                 gammaCorrected,
                 alphaDither,
                 _colorMatching,
@@ -811,7 +814,10 @@ void CBitmapToVGADialog::OnScaleClicked()
 
 void CBitmapToVGADialog::OnHScroll(UINT nSBCode, UINT nPos, CScrollBar *pWnd)
 {
+    // We'll get a TB_ENDTRACK when the thumb is released, which will produce the full quality image.
+    _trackingSlider = (nSBCode == TB_THUMBTRACK);
     UpdateData(TRUE);
+    _trackingSlider = false;
 }
 
 void CBitmapToVGADialog::OnTimer(UINT_PTR nIDEvent)
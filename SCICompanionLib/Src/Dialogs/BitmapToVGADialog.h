@@ -150,6 +150,7 @@ private:
     bool _allowInsertAtCurrentPosition;
 
     bool _needsUpdate;
+    bool _trackingSlider;
 
     uint8_t _transparentColor;
     uint8_t _alphaThreshold;
@@ -181,7 +182,7 @@ public:
 
 std::unique_ptr<Cel> GdiPlusBitmapToCel(
     Gdiplus::Bitmap &bmpCurrent,
-    bool performDither,
+    DitherAlgorithm colorDither,
     bool gammaCorrected,
     DitherAlgorithm alphaDither,
     ColorMatching colorMatching,
@@ -19,6 +19,8 @@
 #include "ScriptOM.h"
 #include "NewCompileDialog.h"
 #include "ScriptDocument.h"
+#include "CompiledScript.h"
+#include "ExportUsage.h"
 #include <filesystem>
 #include <regex>
 
@@ -40,6 +42,8 @@ CNewCompileDialog::CNewCompileDialog(const std::unordered_set<std::string> &scri
     _fResult = false;
     _fAbort = false;
     _fDone = false;
+    _fCompileErrors = false;
+    _fStripping = false;
 }
 
 CNewCompileDialog::~CNewCompileDialog()
@@ -91,7 +95,10 @@ LRESULT CNewCompileDialog::CompileAll(WPARAM wParam, LPARAM lParam)
     {
         // Do a compile
       CompileResults results(appState->GetVersion() ,_log);
-        NewCompileScript(results, _log, _tables, _headers, scriptId);
+        if (!NewCompileScript(results, _log, _tables, _headers, scriptId))
+        {
+            _fCompileErrors = true;
+        }
 
         // The compile is done.  Post the results.
         appState->OutputAddBatch(OutputPaneType::Compile, _log.Results());
@@ -104,6 +111,13 @@ LRESULT CNewCompileDialog::CompileAll(WPARAM wParam, LPARAM lParam)
         {
             PostMessage(UWM_STARTCOMPILE, 0, 0); // Start another compile
         }
+        else if (_CheckExportUsage())
+        {
+            // Recompile the scripts that have unused procedures
+            _nScript = 0;
+            m_wndProgress.SetRange32(0, (int)_scripts.size());
+            PostMessage(UWM_STARTCOMPILE, 0, 0);
+        }
         else
         {
             // Change the text to close:
@@ -116,6 +130,61 @@ LRESULT CNewCompileDialog::CompileAll(WPARAM wParam, LPARAM lParam)
     return 0;
 }
 
+//
+// After the whole game is compiled, looks for public procedures and instances that nothing refers to.
+// Returns true if the scripts with unused procedures should be compiled again without them.
+//
+bool CNewCompileDialog::_CheckExportUsage()
+{
+    const GameFolderHelper &helper = appState->GetResourceMap().Helper();
+    bool strip = helper.GetStripUnusedExports();
+    bool restartCompile = false;
+    // Only a successful build of every script says anything about what's unused.
+    if (!_fStripping && _scriptsToRecompile.empty() && !_fCompileErrors && (strip || helper.GetReportUnusedExports()))
+    {
+        _log.Clear();
+        GlobalCompiledScriptLookups lookups;
+        ObjectFileScriptLookups objectFileLookups(helper, _tables.Selectors());
+        std::vector<UnusedExport> unused;
+        if (!lookups.Load(appState->GetVersion(), helper.GetResourceLoader()))
+        {
+            _log.ReportResult(CompileResult("Unable to load the compiled scripts to look for unused exports.", CompileResult::CompileResultType::CRT_Warning));
+        }
+        else if (!FindUnusedExports(lookups, objectFileLookups, unused))
+        {
+            _log.ReportResult(CompileResult("Unable to determine unused exports: a ScriptID call has neither a constant script nor a constant export number.", CompileResult::CompileResultType::CRT_Message));
+        }
+        else
+        {
+            for (const UnusedExport &unusedExport : unused)
+            {
+                _log.ReportResult(CompileResult(fmt::format("Script {0}: public {1} {2} (export {3}) is never used.", unusedExport.Script, unusedExport.IsInstance ? "instance" : "procedure", unusedExport.Name, unusedExport.Index), CompileResult::CompileResultType::CRT_Warning));
+                if (strip && !unusedExport.IsInstance && !unusedExport.Name.empty())
+                {
+                    _tables.StrippedProcedures()[unusedExport.Script][unusedExport.Index] = unusedExport.Name;
+                }
+            }
+
+            if (!_tables.StrippedProcedures().empty())
+            {
+                std::vector<ScriptId> scriptsToStrip;
+                std::copy_if(_scripts.begin(), _scripts.end(), std::back_inserter(scriptsToStrip),
+                    [&](const ScriptId &scriptId)
+                {
+                    return _tables.StrippedProcedures().find(scriptId.GetResourceNumber()) != _tables.StrippedProcedures().end();
+                }
+                );
+                _log.ReportResult(CompileResult(fmt::format("Removing unused procedures from {0} scripts. They are also left out of the .sco files, so these scripts need to be compiled again before anything can start calling them.", scriptsToStrip.size())));
+                _scripts = scriptsToStrip;
+                _fStripping = true;
+                restartCompile = !_scripts.empty();
+            }
+        }
+        appState->OutputAddBatch(OutputPaneType::Compile, _log.Results());
+    }
+    return restartCompile;
+}
+
 void CNewCompileDialog::DoDataExchange(CDataExchange* pDX)
 {
 	CDialog::DoDataExchange(pDX);
@@ -32,6 +32,7 @@ public:
 protected:
 	virtual void DoDataExchange(CDataExchange* pDX);    // DDX/DDV support
     LRESULT CompileAll(WPARAM wParam, LPARAM lParam);
+    bool _CheckExportUsage();
     virtual BOOL OnInitDialog();
     virtual void OnDestroy();
 	DECLARE_MESSAGE_MAP()
@@ -41,6 +42,8 @@ protected:
     bool _fResult;
     bool _fAbort;
     bool _fDone;
+    bool _fCompileErrors;
+    bool _fStripping;     // Second pass, without unused procedures
     int _nScript;
     std::vector<ScriptId> _scripts;
     CompileTables _tables;
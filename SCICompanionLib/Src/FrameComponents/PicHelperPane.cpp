@@ -32,6 +32,12 @@ PicHelperPane::~PicHelperPane()
 }
 
 void PicHelperPane::DrawOnPic(ViewPort &viewPort, PicData &picData, PicScreenFlags flags) {}
+bool PicHelperPane::GetDrawBounds(size16 picSize, sRECT &bounds)
+{
+    // We don't draw anything.
+    bounds = { 0, 0, 0, 0 };
+    return true;
+}
 
 void PicHelperPane::DoDataExchange(CDataExchange* pDX)
 {
@@ -39,6 +39,7 @@ public:
     // IPicDrawPlugin
     void DrawOnPic(ViewPort &viewPort, PicData &picData, PicScreenFlags flags) override;
     bool WillDrawOnPic() override { return false; }
+    bool GetDrawBounds(size16 picSize, sRECT &bounds) override;
     PicScreenFlags GetRequiredScreens() override;
     PicPositionFlags GetRequiredPicPosition() override {
         return PicPositionFlags::PostPlugin | PicPositionFlags::Final;      // Potentially we could hide the thing, then only require 
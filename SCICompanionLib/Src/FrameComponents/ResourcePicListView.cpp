@@ -26,6 +26,7 @@
 #include "QueueItems.h"
 #include "PaletteOperations.h"
 #include "ResourceBlob.h"
+#include "ThumbnailCache.h"
 
 using namespace std;
 
@@ -73,10 +74,17 @@ CResourcePicListCtrl::~CResourcePicListCtrl()
 
 PICWORKRESULT *PICWORKRESULT::CreateFromWorkItem(PICWORKITEM *pWorkItem)
 {
-    HBITMAP hbm = NULL;
-    std::unique_ptr<ResourceEntity> picResource = CreateResourceFromResourceData(pWorkItem->blob);
-    // Draw this pic!
-    hbm = GetPicBitmap(PicScreen::Visual, picResource->GetComponent<PicComponent>(), picResource->TryGetComponent<PaletteComponent>(), DefaultPicWidth, _GetPicBitmapHeight());
+    int cy = _GetPicBitmapHeight();
+    ThumbnailKey key(ThumbnailKind::PicList);
+    key.Add(pWorkItem->blob).AddValue(DefaultPicWidth).AddValue(cy).AddValue(appState->_fNoGdiPlus);
+    HBITMAP hbm = appState->GetThumbnailCache().TryGetBitmap(key.GetValue());
+    if (!hbm)
+    {
+        std::unique_ptr<ResourceEntity> picResource = CreateResourceFromResourceData(pWorkItem->blob);
+        // Draw this pic!
+        hbm = GetPicBitmap(PicScreen::Visual, picResource->GetComponent<PicComponent>(), picResource->TryGetComponent<PaletteComponent>(), DefaultPicWidth, cy);
+        appState->GetThumbnailCache().PutBitmap(key.GetValue(), hbm);
+    }
 
     PICWORKRESULT *pResult = new PICWORKRESULT;
     if (pResult)
@@ -574,7 +574,7 @@ void CNewRasterResourceDocument::_ApplyImageSequenceNew(uint8_t transparentColor
             {
                 if (resource.TryGetComponent<PaletteComponent>())
                 {
-                    PaletteComponent &existingPalette = resource.GetComponent<PaletteComponent>();
+                    PaletteComponent &existingPalette = resource.GetComponentForWrite<PaletteComponent>();
                     existingPalette = *optionalNewPalette;
                 }
                 else
@@ -75,7 +75,9 @@ public:
         const ResourceEntity *pEntity = static_cast<const ResourceEntity*>(GetResource());
         if (pEntity)
         {
-            std::unique_ptr<ResourceEntity> pNew = pEntity->Clone();
+            // The clone shares its components with the current resource. Only those that the
+            // functions ask for (or get through GetComponentForWrite) are actually copied.
+            std::unique_ptr<ResourceEntity> pNew = pEntity->CloneShared();
             ResourceEntity *temp = pNew.get();
             if (preview)
             {
@@ -86,7 +88,7 @@ public:
             // Allows modification of the ResourceEntity itself
             pf(*temp);
             // Allows modification of the components attached to it
-            auto updateHint = f(temp->GetComponent<_TComponentArgs>()...);
+            auto updateHint = f(temp->GetComponentForWrite<_TComponentArgs>()...);
 
             static_assert(std::is_base_of<CObject, decltype(updateHint)>::value, "The value returned by the function must be a subclass of CObject. Use WrapHint.");
 
@@ -130,6 +132,16 @@ public:
         return modified;
     }
 
+    // For the few edits that change the current resource in place instead of adding to the undo stack
+    // (e.g. while the user is dragging something). The component is un-shared first, so the other
+    // resources in the undo stack keep their own version of it.
+    template<typename _T>
+    _T *GetCurrentComponentForWrite()
+    {
+        ResourceEntity *pEntity = const_cast<ResourceEntity*>(static_cast<const ResourceEntity*>(GetResource()));
+        return (pEntity && pEntity->TryGetComponent<_T>()) ? &pEntity->GetComponentForWrite<_T>() : nullptr;
+    }
+
     void _OnSuccessfulSave(const ResourceEntity *pResource) override
     {
         SetLastSaved(pResource);
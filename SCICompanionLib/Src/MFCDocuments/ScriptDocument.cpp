@@ -178,6 +178,10 @@ void CScriptDocument::OnCompile()
             results.Stats.Saids
         );
         log.ReportResult(CompileResult(info));
+        if (results.Stats.CodeSaved)
+        {
+            log.ReportResult(CompileResult(fmt::format("Optimizer saved {0} bytes of code", results.Stats.CodeSaved)));
+        }
 
         HRESULT hr = defer.Commit();
         if (FAILED(hr))
@@ -247,9 +251,16 @@ bool NewCompileScript(CompileResults &results, CompileLog &log, CompileTables &t
 
             // Compile and save script resource.
             // Compile our own script!
-            if (GenerateScriptResource(appState->GetClassBrowser(), appState->GetResourceMap(), appState->GetVersion(), *pScript, headers, tables, results, appState->GetResourceMap().Helper().GetGenerateDebugInfo()))
+            if (GenerateScriptResource(appState->GetClassBrowser(), appState->GetResourceMap(), appState->GetVersion(), *pScript, headers, tables, results, appState->GetResourceMap().Helper().GetGenerateDebugInfo(), appState->GetResourceMap().Helper().GetOptimizeCode()))
             {
                 WORD wNum = results.GetScriptNumber();
+                if (results.Stats.PoolingSaved)
+                {
+                    log.ReportResult(
+                        CompileResult(fmt::format("Script {0}: pooling strings and saids saved {1} bytes", wNum, results.Stats.PoolingSaved),
+                        CompileResult::CompileResultType::CRT_Message)
+                        );
+                }
 
                 // Save the text resource - but only if it's different than what's there (otherwise needless text resource turds pile up)
                 if (!results.GetTextComponent().Texts.empty())
@@ -295,6 +306,8 @@ bool NewCompileScript(CompileResults &results, CompileLog &log, CompileTables &t
                 CSCOFile &sco = results.GetSCO();
                 {
                     SaveSCOFile(helper, sco, script);
+                    // Anything compiled after this in the same build needs to see the new one.
+                    tables.SCOs().Invalidate(wNum);
                 }
 
                 if (!results.GetDebugInfo().empty())
@@ -224,14 +224,14 @@ void CSoundDoc::_OnImportMidi()
 
 void CSoundDoc::SetTempo(WORD wTempo)
 {
-    SoundComponent *pSound = const_cast<SoundComponent*>(GetSoundComponent());
+    const SoundComponent *pSound = GetSoundComponent();
     if (pSound)
     {
         if (pSound->GetTempo() != wTempo)
         {
             // Special case for tempo - don't make a new sound.  The tempo will change many times a second
             // when the user is sliding the tempo slider.
-            pSound->SetTempo(wTempo);
+            GetCurrentComponentForWrite<SoundComponent>()->SetTempo(wTempo);
         }
     }
 }
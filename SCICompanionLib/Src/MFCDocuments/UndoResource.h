@@ -19,9 +19,14 @@
 // _TItem is the resource type
 // ptrdiff_t is any extra info (like cursor position) you wish to include with the undo snapshot
 //
+// Undo frames are expected to share unchanged components with their neighbours (see
+// ResourceEntity::CloneShared), so the stack is limited by the memory it actually uses
+// rather than by the number of frames.
+//
 
-#define MAX_UNDO 100
-#define AGGRESSIVITY_UNDO 30
+#define MAX_UNDO_BYTES (64 * 1024 * 1024)
+#define MIN_UNDO 10     // We always keep at least this many frames, regardless of their size.
+#define MAX_UNDO 1000   // For resources whose components don't report their size.
 
 template <class _TBase, class _TItem>
 class CUndoResource : public _TBase
@@ -175,24 +180,26 @@ private:
 
     void _TrimUndoStack()
     {
-        if (_undo.size() > MAX_UNDO)
+        // Components and buffers shared between frames are only counted once, against the
+        // newest frame that uses them. So dropping the oldest frame frees exactly what it was
+        // charged.
+        std::vector<size_t> frameSizes(_undo.size());
+        std::unordered_set<const void*> seen;
+        size_t total = 0;
+        auto sizeIt = frameSizes.rbegin();
+        for (auto it = _undo.rbegin(); it != _undo.rend(); ++it, ++sizeIt)
+        {
+            *sizeIt = it->item->AccumulateMemorySize(seen);
+            total += *sizeIt;
+        }
+
+        // Drop the oldest frames until we're within budget (but never the one we're on).
+        size_t dropped = 0;
+        while ((_undo.size() > MIN_UNDO) && (_undo.begin() != _pos) &&
+            ((_undo.size() > MAX_UNDO) || (total > MAX_UNDO_BYTES)))
         {
-            // Remove every other stored frame, up to a certain point.
-            _MyListType::iterator pos = _undo.begin();
-            BOOL fRemove = FALSE;
-            for (int i = 0; i < AGGRESSIVITY_UNDO; i++)
-            {
-                if (pos != _pos) // Skip it if it's where we currently are!
-                {
-                    _MyListType::iterator posToMaybeDelete = pos;
-                    ++pos;
-                    if (fRemove)
-                    {
-                        _undo.erase(posToMaybeDelete);
-                    }
-                    fRemove = !fRemove;
-                }
-            }
+            total -= frameSizes[dropped++];
+            _undo.pop_front();
         }
     }
 
@@ -61,12 +61,14 @@
 #include "DecompileDialog.h"
 #include "ResourceContainer.h"
 #include "AudioMap.h"
+#include "AudioCacheResourceSource.h"
 #include <regex>
 #include "ResourceBlob.h"
 #include "GenerateDocsDialog.h"
 #include "DependencyTracker.h"
 #include "MessageSource.h"
 #include "ValidateSaid.h"
+#include "SaidMatcher.h"
 #include "OutputScriptStrings.h"
 #include <filesystem>
 #include <regex>
@@ -1917,9 +1919,71 @@ void CMainFrame::OnRebuildResources()
     PurgeUnnecessaryResources();
 }
 
+namespace
+{
+    // Shows audio repackaging progress in the status bar. Pressing escape cancels.
+    class StatusBarAudioRebuildProgress : public IAudioRebuildProgress
+    {
+    public:
+        StatusBarAudioRebuildProgress(CFrameWnd *frame) : _frame(frame), _lastPercent(-1), _cancelled(false) {}
+
+        void OnClipWritten(size_t clipsWritten, size_t clipCount) override
+        {
+            int percent = clipCount ? (int)(clipsWritten * 100 / clipCount) : 100;
+            if (percent != _lastPercent)
+            {
+                _lastPercent = percent;
+                _frame->SetMessageText(fmt::format("Repackaging audio: {0}% (press Esc to cancel)", percent).c_str());
+                CWnd *messageBar = _frame->GetMessageBar();
+                if (messageBar)
+                {
+                    messageBar->UpdateWindow();
+                }
+            }
+        }
+
+        bool IsCancelled() override
+        {
+            // Repackaging runs on the UI thread, so no key messages are processed while it's going.
+            // Check whether escape is held down instead (only while we're the foreground window), so
+            // the keyboard input queue is left alone.
+            if (!_cancelled && (::GetForegroundWindow() == _frame->GetSafeHwnd()))
+            {
+                _cancelled = ((::GetAsyncKeyState(VK_ESCAPE) & 0x8000) != 0);
+            }
+            return _cancelled;
+        }
+
+    private:
+        CFrameWnd *_frame;
+        int _lastPercent;
+        bool _cancelled;
+    };
+}
+
 void CMainFrame::OnRepackageAudio()
 {
-    appState->GetResourceMap().RepackageAudio();
+    CWaitCursor waitCursor;
+    StatusBarAudioRebuildProgress progress(this);
+    AudioRebuildStats stats;
+    appState->GetResourceMap().RepackageAudio(false, &progress, &stats);
+    SetMessageText(AFX_IDS_IDLEMESSAGE);
+
+    vector<CompileResult> results;
+    if (stats.Cancelled)
+    {
+        results.emplace_back("Audio repackaging was cancelled. The game's audio files were not changed.", CompileResult::CompileResultType::CRT_Message);
+    }
+    else if (stats.Rebuilt)
+    {
+        results.emplace_back(fmt::format("Repackaged {0} audio clips ({1}KB, {2}KB saved by sharing identical clips)", stats.ClipCount, stats.BytesWritten / 1024, stats.BytesDeduplicated / 1024), CompileResult::CompileResultType::CRT_Message);
+        results.emplace_back(fmt::format("Peak audio buffered: {0}KB, peak working set: {1}KB", stats.PeakBytesBuffered / 1024, stats.PeakWorkingSet / 1024), CompileResult::CompileResultType::CRT_Message);
+    }
+    else
+    {
+        results.emplace_back("Audio is already up-to-date.", CompileResult::CompileResultType::CRT_Message);
+    }
+    appState->OutputResults(OutputPaneType::Compile, results);
 }
 
 void CMainFrame::OnRebuildClassTable()
@@ -2750,6 +2814,11 @@ void CMainFrame::OnValidateAllSaids()
     {
         CompileLog log;
         ValidateSaids(appState->GetResourceMap(), appState->GetVersion(), log, *vocab);
+        std::string corpusFile = appState->GetResourceMap().Helper().GetSaidCorpusFile();
+        if (!corpusFile.empty())
+        {
+            ReportSaidCoverage(appState->GetResourceMap(), appState->GetVersion(), log, *vocab, corpusFile);
+        }
         appState->OutputResults(OutputPaneType::Compile, log.Results());
     }
 }
@@ -2420,7 +2420,7 @@ void CPicView::_MovePriorityBar(bool commit, int dy)
 
     // Find the pri bar command
     // HACK: We're modifying the pic commands directly.
-    vector<PicCommand> &commands = const_cast<vector<PicCommand>&>(GetDocument()->GetPic()->commands);
+    vector<PicCommand> &commands = GetDocument()->GetCurrentComponentForWrite<PicComponent>()->commands;
     size_t i = 0;
     for (i = 0; i < commands.size(); i++)
     {
@@ -3136,6 +3136,72 @@ void CPicView::DrawOnPic(ViewPort &viewPort, PicData &picData, PicScreenFlags fl
     }
 }
 
+// This needs to cover everything that DrawOnPic draws.
+bool CPicView::GetDrawBounds(size16 picSize, sRECT &bounds)
+{
+    if ((_fShowingEgo && !_GetEditPic()->Traits->IsVGA) || (_fPreviewClips && _fMouseWithin && !_transformingCoords))
+    {
+        return false;
+    }
+
+    std::vector<PicCommand> commands;
+    if (_fDrawingLine)
+    {
+        commands.push_back(PicCommand::CreateLine((uint16_t)_xOld, (uint16_t)_yOld, (uint16_t)_ptCurrentHover.x, (uint16_t)_ptCurrentHover.y));
+    }
+    if (_fDrawingCircle)
+    {
+        PicCommand command;
+        command.CreateCircle((uint16_t)_xOld, (uint16_t)_yOld, (uint16_t)_ptCurrentHover.x, (uint16_t)_ptCurrentHover.y);
+        commands.push_back(command);
+    }
+    CPicDoc *pDoc = GetDocument();
+    if (_fPreviewPen && _fMouseWithin && !_transformingCoords && pDoc)
+    {
+        PenStyle penStyle = pDoc->GetPenStyle();
+        commands.push_back(PicCommand::CreatePattern((uint16_t)_ptCurrentHover.x, (uint16_t)_ptCurrentHover.y,
+            penStyle.bPatternSize, _bRandomNR, penStyle.fPattern, penStyle.fRectangle));
+    }
+    if (!_pastedCommands.empty())
+    {
+        PICCOMMAND_ADJUST adjust = { 0 };
+        _InitCommandAdjust(&adjust);
+        for (const PicCommand &pastedCommand : _pastedCommands)
+        {
+            PicCommand command = pastedCommand;
+            if (Command_Adjust(picSize, &command, &adjust))
+            {
+                commands.push_back(command);
+            }
+        }
+    }
+
+    bounds = { 0, 0, 0, 0 };
+    for (const PicCommand &command : commands)
+    {
+        sRECT rc;
+        if (!Command_GetDrawBounds(picSize, &command, &rc))
+        {
+            return false;
+        }
+        if ((rc.left < rc.right) && (rc.top < rc.bottom))
+        {
+            if (bounds.left < bounds.right)
+            {
+                bounds.left = min(bounds.left, rc.left);
+                bounds.top = min(bounds.top, rc.top);
+                bounds.right = max(bounds.right, rc.right);
+                bounds.bottom = max(bounds.bottom, rc.bottom);
+            }
+            else
+            {
+                bounds = rc;
+            }
+        }
+    }
+    return true;
+}
+
 // Every thing that is in here must adhere to the current palette and operates within "native" SCI
 // resolution.
 void CPicView::_OnDraw(CDC* pDC, PicScreen screen)
@@ -4052,7 +4118,7 @@ void CPicView::_TransformPoint(bool commit, CPoint pt)
         // Apply changes works on a clone of the current resource, while the current resource
         // goes into the undo stack. Since we've been modifying the current resource, we
         // need to restore it before applying our final changes to the clone.
-        _transformCommandMod->ApplyDifference(const_cast<PicComponent&>(*GetDocument()->GetPic()), 0, 0);
+        _transformCommandMod->ApplyDifference(*GetDocument()->GetCurrentComponentForWrite<PicComponent>(), 0, 0);
 
         GetDocument()->ApplyChanges<PicComponent>(
             [this, dx, dy](PicComponent &pic)
@@ -4065,7 +4131,7 @@ void CPicView::_TransformPoint(bool commit, CPoint pt)
     else
     {
         // We have to go poking around in the resource directly
-        _transformCommandMod->ApplyDifference(const_cast<PicComponent&>(*GetDocument()->GetPic()), dx, dy);
+        _transformCommandMod->ApplyDifference(*GetDocument()->GetCurrentComponentForWrite<PicComponent>(), dx, dy);
         // As a result we need to tell people manually to update
     }
 }
@@ -72,6 +72,7 @@ public:
     void DrawOnPic(ViewPort &viewPort, PicData &picData, PicScreenFlags flags) override;
     bool WillDrawOnPic() override;
     PicScreenFlags GetRequiredScreens() override;
+    bool GetDrawBounds(size16 picSize, sRECT &bounds) override;
     PicPositionFlags GetRequiredPicPosition() {
         // Pre and post. Pre because we want to ensure we keep around the main buffer
         // in order to quickly draw drawing tools on top. And Post because that's what
@@ -30,6 +30,7 @@
 #include "ResourceBlob.h"
 #include "BaseResourceUtil.h"
 #include "ResourceUtil.h"
+#include "ThumbnailCache.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -177,9 +178,12 @@ CelIndex _FindBestPreviewCel(int dimensions, RasterComponent &raster)
 
 VIEWWORKRESULT *VIEWWORKRESULT::CreateFromWorkItem(VIEWWORKITEM *pWorkItem)
 {
-    HBITMAP hbmp = nullptr;
+    // The merged palette depends on the global palette, so that's part of the key.
+    ThumbnailKey key(ThumbnailKind::ViewList);
+    key.Add(pWorkItem->blob).Add(appState->GetResourceMap().GetPalette999()).AddValue(VIEW_IMAGE_SIZE);
+    HBITMAP hbmp = appState->GetThumbnailCache().TryGetBitmap(key.GetValue());
 
-    std::unique_ptr<ResourceEntity> pEntity = CreateResourceFromResourceData(pWorkItem->blob);
+    std::unique_ptr<ResourceEntity> pEntity = hbmp ? nullptr : CreateResourceFromResourceData(pWorkItem->blob);
     if (pEntity)
     {
         RasterComponent &raster = pEntity->GetComponent<RasterComponent>();
@@ -196,6 +200,7 @@ VIEWWORKRESULT *VIEWWORKRESULT::CreateFromWorkItem(VIEWWORKITEM *pWorkItem)
             previewCel = _FindBestPreviewCel(VIEW_IMAGE_SIZE, raster);
         }
         hbmp = GetBitmap(raster, palette.get(), previewCel, VIEW_IMAGE_SIZE, VIEW_IMAGE_SIZE, BitmapScaleOptions::AllowMag | BitmapScaleOptions::AllowMin);
+        appState->GetThumbnailCache().PutBitmap(key.GetValue(), hbmp);
     }
 
     VIEWWORKRESULT *pResult = new VIEWWORKRESULT;
@@ -2555,7 +2555,7 @@ void CRasterView::_OnPaste(bool fTransparent, bool provideOptions)
                         std::unique_ptr<Cel> finalResult =
                             GdiPlusBitmapToCel(
                             *pBitmap,
-                            false,  // No dither
+                            DitherAlgorithm::None,  // No dither
                             true,   // gamma corrected
                             DitherAlgorithm::None,  // No alpha dither
                             ColorMatching::RGB,
@@ -2578,7 +2578,7 @@ void CRasterView::_OnPaste(bool fTransparent, bool provideOptions)
                                 finalResult =
                                     GdiPlusBitmapToCel(
                                     *pBitmap,
-                                    false,  // No dither
+                                    DitherAlgorithm::None,  // No dither
                                     true,   // gamma corrected
                                     DitherAlgorithm::None,  // No alpha dither
                                     ColorMatching::RGB,
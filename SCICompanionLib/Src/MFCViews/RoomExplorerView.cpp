@@ -27,6 +27,7 @@
 #include "ResourceBlob.h"
 #include "BaseResourceUtil.h"
 #include "ResourceUtil.h"
+#include "ThumbnailCache.h"
 
 using namespace sci;
 using namespace std;
@@ -272,27 +273,61 @@ void OrganizeGrid(std::vector<uint16_t> &unprocessedRooms, int suggestedWidth, c
 CRoomExplorerWorkResult *CRoomExplorerWorkResult::CreateFromWorkItem(CRoomExplorerWorkItem *pWorkItem)
 {
     CRoomExplorerWorkResult *pResult = NULL;
-    BOOL fOk = FALSE;
     if (pWorkItem->blob.GetType() == ResourceType::Pic)
     {
-        unique_ptr<ResourceEntity> picEntity = CreateResourceFromResourceData(pWorkItem->blob);
-        PicComponent &pic = picEntity->GetComponent<PicComponent>();
-        PaletteComponent *palette = picEntity->TryGetComponent<PaletteComponent>();
-        PicDrawManager pdm(&pic, palette);
-		std::unique_ptr<BYTE[]> dataDisplay = std::make_unique<BYTE[]>(pic.Size.cx * pic.Size.cy);
-        std::unique_ptr<BYTE[]> dataAux = std::make_unique<BYTE[]>(pic.Size.cx * pic.Size.cy);
-        fOk = TRUE;
-        pdm.CopyBitmap(PicScreen::Visual, PicPosition::Final, pic.Size, dataDisplay.get(), dataAux.get(), nullptr);
-
+        // The composited room only depends on the pic and the views (and where they are placed).
+        ThumbnailKey key(ThumbnailKind::RoomExplorer);
+        key.Add(pWorkItem->blob);
         for (auto &pRoomView : pWorkItem->_views)
         {
-            std::unique_ptr<ResourceEntity> view(CreateViewResourceFactory()->CreateResource(appState->GetVersion()));
-            if (SUCCEEDED(view->InitFromResource(&pRoomView->blob)))
+            key.Add(pRoomView->blob).AddValue(pRoomView->wx).AddValue(pRoomView->wy).AddValue(pRoomView->wLoop).AddValue(pRoomView->wCel);
+        }
+
+        std::unique_ptr<BYTE[]> dataDisplay;
+        std::unique_ptr<PaletteComponent> optionalPalette;
+        ThumbnailImage image;
+        if (appState->GetThumbnailCache().TryGet(key.GetValue(), image) && (image.bits.size() == (size_t)(image.cx * image.cy)))
+        {
+            dataDisplay = std::make_unique<BYTE[]>(image.bits.size());
+            memcpy(dataDisplay.get(), &image.bits[0], image.bits.size());
+            if (!image.colors.empty())
+            {
+                optionalPalette = std::make_unique<PaletteComponent>();
+                memcpy(optionalPalette->Colors, &image.colors[0], min(sizeof(optionalPalette->Colors), image.colors.size() * sizeof(RGBQUAD)));
+            }
+        }
+        else
+        {
+            unique_ptr<ResourceEntity> picEntity = CreateResourceFromResourceData(pWorkItem->blob);
+            PicComponent &pic = picEntity->GetComponent<PicComponent>();
+            PaletteComponent *palette = picEntity->TryGetComponent<PaletteComponent>();
+            PicDrawManager pdm(&pic, palette);
+            dataDisplay = std::make_unique<BYTE[]>(pic.Size.cx * pic.Size.cy);
+            std::unique_ptr<BYTE[]> dataAux = std::make_unique<BYTE[]>(pic.Size.cx * pic.Size.cy);
+            pdm.CopyBitmap(PicScreen::Visual, PicPosition::Final, pic.Size, dataDisplay.get(), dataAux.get(), nullptr);
+
+            for (auto &pRoomView : pWorkItem->_views)
+            {
+                std::unique_ptr<ResourceEntity> view(CreateViewResourceFactory()->CreateResource(appState->GetVersion()));
+                if (SUCCEEDED(view->InitFromResource(&pRoomView->blob)))
+                {
+                    DrawViewWithPriority(pic.Size, dataDisplay.get(), pdm.GetPicBits(PicScreen::Priority, PicPosition::Final, pic.Size), PriorityFromY(pRoomView->wy, *pdm.GetViewPort(PicPosition::Final)),
+                        pRoomView->wx, pRoomView->wy,
+                        view.get(), pRoomView->wLoop, pRoomView->wCel);
+                }
+            }
+
+            image.cx = pic.Size.cx;
+            image.cy = pic.Size.cy;
+            image.bitsPerPixel = 8;
+            image.bits.assign(dataDisplay.get(), dataDisplay.get() + pic.Size.cx * pic.Size.cy);
+            // Make a copy of the palette so we can draw it correctly:
+            if (palette)
             {
-                DrawViewWithPriority(pic.Size, dataDisplay.get(), pdm.GetPicBits(PicScreen::Priority, PicPosition::Final, pic.Size), PriorityFromY(pRoomView->wy, *pdm.GetViewPort(PicPosition::Final)),
-                    pRoomView->wx, pRoomView->wy,
-                    view.get(), pRoomView->wLoop, pRoomView->wCel);
+                optionalPalette.reset(new PaletteComponent(*palette));
+                image.colors.assign(palette->Colors, palette->Colors + ARRAYSIZE(palette->Colors));
             }
+            appState->GetThumbnailCache().Put(key.GetValue(), image);
         }
 
         // Now make a smushed down bitmap for all this.
@@ -302,11 +337,7 @@ CRoomExplorerWorkResult *CRoomExplorerWorkResult::CreateFromWorkItem(CRoomExplor
             pResult->wScript = pWorkItem->wScript;
             // Result takes ownership:
             pResult->pBitmapData.swap(dataDisplay);
-            // Make a copy of the palette so we can draw it correctly:
-            if (palette)
-            {
-                pResult->optionalPalette.reset(new PaletteComponent(*palette));
-            }
+            pResult->optionalPalette.swap(optionalPalette);
         }
     }
     return pResult;
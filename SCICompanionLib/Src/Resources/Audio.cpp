@@ -101,6 +101,146 @@ static void deDPCM8(uint8_t *soundBuf, sci::istream &audioStream, uint32_t n) {
     }
 }
 
+// Compression routines. These mirror the decoders above exactly: each step picks the delta that lands
+// nearest the target sample once the decoder has clamped it, and then tracks the value the decoder will
+// actually produce, so errors don't accumulate. Near the limits, a delta that overshoots can be clamped
+// back onto the target, so anything the decoder produced is compressed again without loss.
+
+static uint8_t enDPCM16Sample(int32_t &s, int32_t target)
+{
+    int32_t diff = target - s;
+    uint8_t sign = 0;
+    if (diff < 0)
+    {
+        sign = 0x80;
+        diff = -diff;
+    }
+    // The table is increasing, so the nearest entry is either the first one >= diff, or the one before.
+    // Clamping only ever pulls an overshoot back towards the target, so this holds after clamping too.
+    const uint16_t *tableEnd = tableDPCM16 + ARRAYSIZE(tableDPCM16);
+    const uint16_t *entry = std::lower_bound(tableDPCM16, tableEnd, (uint32_t)diff);
+    int32_t result;
+    if (entry == tableEnd)
+    {
+        entry--;
+        result = min(32767, max(-32768, s + (sign ? -(int32_t)*entry : (int32_t)*entry)));
+    }
+    else
+    {
+        result = min(32767, max(-32768, s + (sign ? -(int32_t)*entry : (int32_t)*entry)));
+        if (entry != tableDPCM16)
+        {
+            // Ties go to the smaller delta, unless the larger one is clamped closer.
+            int32_t resultBefore = min(32767, max(-32768, s + (sign ? -(int32_t)entry[-1] : (int32_t)entry[-1])));
+            if (abs(target - resultBefore) <= abs(target - result))
+            {
+                entry--;
+                result = resultBefore;
+            }
+        }
+    }
+    s = result;
+    return sign | (uint8_t)(entry - tableDPCM16);
+}
+
+static void enDPCM16(const int16_t *samples, uint32_t n, std::vector<uint8_t> &dest)
+{
+    dest.resize(n);
+    uint8_t *out = n ? &dest[0] : nullptr;
+    int32_t s = 0;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        *out++ = enDPCM16Sample(s, samples[i]);
+    }
+}
+
+// Maps (target - current) + 255 to the nibble whose delta is nearest.
+struct DPCM8NibbleTable
+{
+    DPCM8NibbleTable()
+    {
+        for (int diff = -255; diff <= 255; diff++)
+        {
+            uint8_t best = 0;
+            int bestError = INT_MAX;
+            for (uint8_t nibble = 0; nibble < 16; nibble++)
+            {
+                int delta = (nibble & 8) ? -(int)tableDPCM8[7 - (nibble & 7)] : (int)tableDPCM8[nibble & 7];
+                int error = abs(diff - delta);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = nibble;
+                }
+            }
+            Nibbles[diff + 255] = best;
+        }
+    }
+
+    uint8_t Nibbles[511];
+};
+
+static uint8_t enDPCM8Nibble(int32_t &s, uint8_t target)
+{
+    static const DPCM8NibbleTable table;
+    uint8_t nibble = table.Nibbles[(int)target - s + 255];
+    // Let the decoder tell us where we end up.
+    int32_t next = s;
+    uint8_t actual;
+    deDPCM8Nibble(&actual, next, nibble);
+    if (actual != target)
+    {
+        // The table doesn't know about clamping, which may bring another delta closer (e.g. from 237,
+        // 15 and 21 are as near as each other to 255, but only 21 gets there).
+        int bestError = abs((int)target - (int)actual);
+        for (uint8_t other = 0; other < 16; other++)
+        {
+            int32_t otherNext = s;
+            deDPCM8Nibble(&actual, otherNext, other);
+            int error = abs((int)target - (int)actual);
+            if (error < bestError)
+            {
+                bestError = error;
+                nibble = other;
+                next = otherNext;
+            }
+        }
+    }
+    s = next;
+    return nibble;
+}
+
+static void enDPCM8(const uint8_t *samples, uint32_t n, std::vector<uint8_t> &dest)
+{
+    dest.resize((n + 1) / 2);
+    uint8_t *out = dest.empty() ? nullptr : &dest[0];
+    int32_t s = 0x80;
+    uint32_t i = 0;
+    for (; (i + 1) < n; i += 2)
+    {
+        uint8_t high = enDPCM8Nibble(s, samples[i]);
+        *out++ = (uint8_t)((high << 4) | enDPCM8Nibble(s, samples[i + 1]));
+    }
+    if (i < n)
+    {
+        // An odd number of samples: the last one is repeated.
+        *out++ = (uint8_t)(enDPCM8Nibble(s, samples[i]) << 4);
+    }
+}
+
+void EncodeDPCM(const AudioComponent &audio, std::vector<uint8_t> &dest)
+{
+    if (IsFlagSet(audio.Flags, AudioFlags::SixteenBit))
+    {
+        uint32_t sampleCount = audio.GetLength() / 2;
+        enDPCM16(sampleCount ? reinterpret_cast<const int16_t*>(&audio.DigitalSamplePCM[0]) : nullptr, sampleCount, dest);
+    }
+    else
+    {
+        enDPCM8(audio.DigitalSamplePCM.empty() ? nullptr : &audio.DigitalSamplePCM[0], audio.GetLength(), dest);
+    }
+}
+
 const char solMarker[] = "SOL";
 
 uint32_t AudioEstimateSize(const ResourceEntity &resource)
@@ -111,7 +251,16 @@ uint32_t AudioEstimateSize(const ResourceEntity &resource)
         size += SyncEstimateSize(*resource.TryGetComponent<SyncComponent>());
     }
     size += sizeof(AudioHeader);
-    size += resource.GetComponent<AudioComponent>().DigitalSamplePCM.size();
+    const AudioComponent &audio = resource.GetComponent<AudioComponent>();
+    if (IsFlagSet(audio.Flags, AudioFlags::DPCM))
+    {
+        // One byte per 16 bit sample, or one nibble per 8 bit sample.
+        size += IsFlagSet(audio.Flags, AudioFlags::SixteenBit) ? (audio.GetLength() / 2) : ((audio.GetLength() + 1) / 2);
+    }
+    else
+    {
+        size += audio.GetLength();
+    }
     return size;
 }
 
@@ -133,11 +282,24 @@ void AudioWriteTo(const ResourceEntity &resource, sci::ostream &byteStream, std:
     header.flags = audio.Flags;
     header.audioType = *((uint32_t*)solMarker);
     header.sampleRate = audio.Frequency;
-    header.sizeExcludingHeader = audio.GetLength();
+    // The component always holds PCM. If it's flagged as DPCM, we compress it on the way out.
+    std::vector<uint8_t> compressed;
+    const uint8_t *data = audio.DigitalSamplePCM.empty() ? nullptr : &audio.DigitalSamplePCM[0];
+    uint32_t dataSize = audio.GetLength();
+    if (IsFlagSet(audio.Flags, AudioFlags::DPCM))
+    {
+        EncodeDPCM(audio, compressed);
+        data = compressed.empty() ? nullptr : &compressed[0];
+        dataSize = (uint32_t)compressed.size();
+    }
+    header.sizeExcludingHeader = dataSize;
     // PROBLEM: headers are different sizes in different games.
     // This particular one only works with SQ5 and KQ6
     byteStream << header;
-    byteStream.WriteBytes(&audio.DigitalSamplePCM[0], (int)audio.DigitalSamplePCM.size());
+    if (dataSize)
+    {
+        byteStream.WriteBytes(data, (int)dataSize);
+    }
 }
 
 void AudioReadFromHelper(ResourceEntity &resource, sci::istream &stream, const std::map<BlobKey, uint32_t> &propertyBag, bool isWave)
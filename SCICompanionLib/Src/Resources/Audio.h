@@ -34,4 +34,7 @@ struct AudioHeader
 std::unique_ptr<ResourceEntityFactory> CreateAudioResourceFactory();
 std::unique_ptr<ResourceEntityFactory> CreateWaveAudioResourceFactory();
 uint32_t AudioEstimateSize(const ResourceEntity &resource);
+// Compresses the component's PCM data (8 or 16 bit, based on its flags) into the DPCM format that
+// AudioFlags::DPCM resources are stored in.
+void EncodeDPCM(const AudioComponent &audio, std::vector<uint8_t> &dest);
 std::string GetAudioLength(const AudioComponent &audio);
\ No newline at end of file
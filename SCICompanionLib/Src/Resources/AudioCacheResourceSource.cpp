@@ -24,6 +24,10 @@
 #include <filesystem>
 #include "ResourceBlob.h"
 #include "ResourceMap.h"
+#include <deque>
+#include <psapi.h>
+
+#pragma comment( lib, "psapi.lib" )
 
 namespace sys = std::filesystem;
 
@@ -243,6 +247,7 @@ AudioCacheResourceSource::AudioCacheResourceSource(
     _mapContext(mapContext),
     _access(access),
     _enumInitialized(false),
+    _rebuildProgress(nullptr),
     _resourceMap(std::make_shared<ResourceManagerImpl>(resourceMap, helper))
 {
     if (IsFlagSet(access, ResourceSourceAccessFlags::ReadWrite))
@@ -759,71 +764,349 @@ AppendBehavior AudioCacheResourceSource::AppendResources(
     return AppendBehavior::Replace;
 }
 
-void RebuildFromResources(const SCIVersion& version,
+namespace
+{
+    // Don't read ahead more than this much audio while rebuilding. A single clip that is larger is still
+    // read, on its own.
+    const size_t AudioPrefetchBudget = 8 * 1024 * 1024;
+
+    // These map formats store each offset relative to the previous entry, so a map's offsets must never decrease.
+    bool _UsesOffsetDeltas(AudioMapVersion version)
+    {
+        return (version == AudioMapVersion::FiveBytes) || (version == AudioMapVersion::SyncMapLate);
+    }
+
+    // 64-bit FNV-1a
+    uint64_t _HashClip(const uint8_t* data, size_t size)
+    {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= data[i];
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    // Accumulates stats and checks for cancellation across all the audio maps being rebuilt.
+    // It also remembers every clip that has been written, so that identical ones (the same recording is often used
+    // for several message tuples) are only stored once.
+    class AudioRebuildTracker
+    {
+    public:
+        AudioRebuildTracker(IAudioRebuildProgress* progress, AudioRebuildStats& stats, size_t clipCount) :
+            _progress(progress), _stats(stats), _clipCount(clipCount) {}
+
+        // Returns true if an identical clip (sync and audio data) was already written to stream, in which case offset
+        // receives its location. Otherwise, the caller must write it at the current position.
+        // Clips written for other audio maps are only reused if allowOtherMaps is set: with relative offsets,
+        // pointing far back into the volume could produce offset deltas that don't fit in the map.
+        // The hash only picks the candidates. Their bytes are read back from stream and compared.
+        bool TryReuseClip(std::iostream& stream, int mapNumber, bool allowOtherMaps, const uint8_t* data, size_t size, uint32_t syncSize, uint32_t& offset)
+        {
+            offset = static_cast<uint32_t>(stream.tellp());
+            if (size == 0)
+            {
+                return false;
+            }
+
+            std::vector<WrittenClip>& candidates = _writtenClips[&stream][_HashClip(data, size)];
+            for (const WrittenClip& clip : candidates)
+            {
+                if ((clip.Size == size) && (clip.SyncSize == syncSize) && (allowOtherMaps || (clip.MapNumber == mapNumber)) &&
+                    _IsWrittenClip(stream, clip, data, offset))
+                {
+                    offset = clip.Offset;
+                    _stats.BytesDeduplicated += size;
+                    _OnClipDone();
+                    return true;
+                }
+            }
+            candidates.push_back({ offset, (uint32_t)size, syncSize, mapNumber });
+            return false;
+        }
+
+        void OnClipWritten(uint64_t size)
+        {
+            _stats.BytesWritten += size;
+            _OnClipDone();
+        }
+
+        bool IsCancelled()
+        {
+            if (!_stats.Cancelled && _progress && _progress->IsCancelled())
+            {
+                _stats.Cancelled = true;
+            }
+            return _stats.Cancelled;
+        }
+
+        void OnBuffered(size_t bytes)
+        {
+            _stats.PeakBytesBuffered = max(_stats.PeakBytesBuffered, bytes);
+        }
+
+    private:
+        // writePosition is where the next clip goes.
+        bool _IsWrittenClip(std::iostream& stream, const WrittenClip& clip, const uint8_t* data, uint32_t writePosition)
+        {
+            _compareBuffer.resize(clip.Size);
+            stream.seekg(clip.Offset);
+            stream.read(reinterpret_cast<char*>(&_compareBuffer[0]), clip.Size);
+            // A file stream reads and writes at the same position.
+            stream.seekp(writePosition);
+            return memcmp(&_compareBuffer[0], data, clip.Size) == 0;
+        }
+
+        void _OnClipDone()
+        {
+            _stats.ClipCount++;
+            if (_progress)
+            {
+                _progress->OnClipWritten(_stats.ClipCount, _clipCount);
+            }
+        }
+
+        struct WrittenClip
+        {
+            uint32_t Offset;
+            uint32_t Size;
+            uint32_t SyncSize;
+            int MapNumber;
+        };
+
+        IAudioRebuildProgress* _progress;
+        AudioRebuildStats& _stats;
+        size_t _clipCount;
+        // Per output stream, keyed by the hash of the clip data.
+        std::unordered_map<const std::iostream*, std::unordered_map<uint64_t, std::vector<WrittenClip>>> _writtenClips;
+        std::vector<uint8_t> _compareBuffer;
+    };
+
+    void _AppendFileContents(const std::string& filename, std::vector<uint8_t>& data)
+    {
+        std::ifstream file;
+        file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        file.open(filename, std::ios_base::binary | std::ios_base::in);
+        file.seekg(0, std::ios_base::end);
+        size_t size = static_cast<size_t>(file.tellg());
+        file.seekg(0, std::ios_base::beg);
+        size_t start = data.size();
+        data.resize(start + size);
+        if (size > 0)
+        {
+            file.read(reinterpret_cast<char*>(&data[start]), size);
+        }
+    }
+
+    // Entries that share a clip may point backwards, so put them back in offset order.
+    void _SortByOffset(std::vector<AudioMapEntry>& entries)
+    {
+        std::stable_sort(entries.begin(), entries.end(),
+            [](const AudioMapEntry& one, const AudioMapEntry& two) { return one.Offset < two.Offset; });
+    }
+
+    // Loads audio blobs on a background thread, in the order given, while the caller writes them out.
+    // Reading stops when AudioPrefetchBudget bytes are waiting to be written.
+    class AudioBlobPrefetcher
+    {
+    public:
+        AudioBlobPrefetcher(std::vector<ResourceContainer::iterator> toRead) :
+            _toRead(std::move(toRead)), _bytesHeld(0), _peakBytesHeld(0), _lastSize(0), _stop(false)
+        {
+            _thread = std::thread(&AudioBlobPrefetcher::_Worker, this);
+        }
+
+        ~AudioBlobPrefetcher()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _spaceAvailable.notify_one();
+            _thread.join();
+        }
+
+        // Returns the next blob, waiting for it if necessary. The previous one must have been released already.
+        std::unique_ptr<ResourceBlob> Next()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _bytesHeld -= _lastSize;
+            _lastSize = 0;
+            _spaceAvailable.notify_one();
+            _blobAvailable.wait(lock, [this]() { return !_queue.empty() || _error; });
+            if (_queue.empty())
+            {
+                std::rethrow_exception(_error);
+            }
+            std::unique_ptr<ResourceBlob> blob = std::move(_queue.front());
+            _queue.pop_front();
+            _lastSize = blob->GetDecompressedLength();
+            return blob;
+        }
+
+        size_t GetPeakBytesHeld()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _peakBytesHeld;
+        }
+
+    private:
+        void _Worker()
+        {
+            try
+            {
+                for (const auto& it : _toRead)
+                {
+                    {
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        _spaceAvailable.wait(lock, [this]() { return _stop || (_bytesHeld < AudioPrefetchBudget); });
+                        if (_stop)
+                        {
+                            return;
+                        }
+                    }
+                    std::unique_ptr<ResourceBlob> blob = *it;
+                    {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        _bytesHeld += blob->GetDecompressedLength();
+                        _peakBytesHeld = max(_peakBytesHeld, _bytesHeld);
+                        _queue.push_back(std::move(blob));
+                    }
+                    _blobAvailable.notify_one();
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _error = std::current_exception();
+            }
+            _blobAvailable.notify_one();
+        }
+
+        std::vector<ResourceContainer::iterator> _toRead;
+
+        std::mutex _mutex;
+        std::condition_variable _blobAvailable;
+        std::condition_variable _spaceAvailable;
+        std::deque<std::unique_ptr<ResourceBlob>> _queue;
+        size_t _bytesHeld;      // Queued, plus the one the caller is writing
+        size_t _peakBytesHeld;
+        size_t _lastSize;
+        bool _stop;
+        std::exception_ptr _error;
+
+        std::thread _thread;
+    };
+}
+
+// Returns false if cancelled.
+bool RebuildFromResources(const SCIVersion& version,
                           const std::string& gameFolder,
                           AudioMapComponent& audioMap, int number,
-                          std::ostream& writeStream)
+                          std::iostream& writeStream,
+                          AudioRebuildTracker& tracker)
 {
     auto helper = GameFolderHelper::Create();
     helper->SetGameFolder(gameFolder);
 
-    // First, cache all the blobs
-    std::unordered_map<uint64_t, std::unique_ptr<ResourceBlob>> blobs;
+    // First, find where all the clips are, without loading them.
+    std::unordered_map<uint64_t, ResourceContainer::iterator> clips;
     int mapContext = (number == version.AudioMapResourceNumber) ? -1 : number;
     auto resourceContainer = helper->Resources(version, ResourceTypeFlags::Audio,
                                               ResourceEnumFlags::MostRecentOnly
                                               | ResourceEnumFlags::AddInDefaultEnumFlags,
                                               nullptr, mapContext);
-    for (auto& blob : *resourceContainer)
+    for (auto it = resourceContainer->begin(); it != resourceContainer->end(); ++it)
     {
-        uint64_t key = _GetLookupKey(blob->GetNumber(), blob->GetBase36());
-        blobs[key] = std::move(blob);
+        ResourceId id = it.GetResourceId();
+        // If a clip shows up more than once, the last one wins, as it does when the game is loaded.
+        clips.insert_or_assign(_GetLookupKey(id.GetNumber(), id.GetBase36()), it);
     }
 
-    std::vector<AudioMapEntry> newEntries;
+    // Copy them in the order they're stored, so both the source and destination are accessed sequentially.
+    // The audio map entries are reordered to match, since all that matters is that their offsets increase.
+    std::vector<std::pair<AudioMapEntry, ResourceContainer::iterator>> toCopy;
     for (auto& entry : audioMap.Entries)
     {
-        uint32_t tuple = GetMessageTuple(entry);
-        uint64_t key = _GetLookupKey(entry.Number, tuple);
-        auto itFind = blobs.find(key);
-        if (itFind != blobs.end())
+        auto itFind = clips.find(_GetLookupKey(entry.Number, GetMessageTuple(entry)));
+        if (itFind != clips.end())
         {
-            ResourceBlob& blob = *itFind->second;
-            entry.Offset = static_cast<uint32_t>(writeStream.tellp());
-            entry.SyncSize = 0;
-            auto props = blob.GetPropertyBag();
-            auto itProp = props.find(BlobKey::LipSyncDataSize);
-            if (itProp != props.end())
-            {
-                entry.SyncSize = itProp->second;
-            }
-            newEntries.push_back(entry);
+            toCopy.emplace_back(entry, itFind->second);
+        }
+        // else leave it out
+    }
+    std::stable_sort(toCopy.begin(), toCopy.end(),
+        [](const std::pair<AudioMapEntry, ResourceContainer::iterator>& one, const std::pair<AudioMapEntry, ResourceContainer::iterator>& two)
+    {
+        return one.second.GetStorageOrder() < two.second.GetStorageOrder();
+    });
 
-            // Transfer data
-            if (blob.GetDecompressedLength() > 0)
+    std::vector<ResourceContainer::iterator> toRead;
+    for (auto& copy : toCopy)
+    {
+        toRead.push_back(copy.second);
+    }
+    AudioBlobPrefetcher prefetcher(std::move(toRead));
+
+    bool allowOtherMaps = !_UsesOffsetDeltas(audioMap.Version);
+    std::vector<AudioMapEntry> newEntries;
+    for (auto& copy : toCopy)
+    {
+        if (tracker.IsCancelled())
+        {
+            return false;
+        }
+
+        AudioMapEntry& entry = copy.first;
+        std::unique_ptr<ResourceBlob> blob = prefetcher.Next();
+        entry.SyncSize = 0;
+        auto props = blob->GetPropertyBag();
+        auto itProp = props.find(BlobKey::LipSyncDataSize);
+        if (itProp != props.end())
+        {
+            entry.SyncSize = itProp->second;
+        }
+
+        // Transfer data, unless we already have an identical clip
+        if (!tracker.TryReuseClip(writeStream, number, allowOtherMaps, blob->GetData(), blob->GetDecompressedLength(), entry.SyncSize, entry.Offset))
+        {
+            if (blob->GetDecompressedLength() > 0)
             {
-                writeStream.write(reinterpret_cast<const char*>(blob.GetData()),
-                                  blob.GetDecompressedLength());
+                writeStream.write(reinterpret_cast<const char*>(blob->GetData()),
+                                  blob->GetDecompressedLength());
             }
-            blob.GetReadStream();
+            tracker.OnClipWritten(blob->GetDecompressedLength());
         }
-        // else leave it out
+        newEntries.push_back(entry);
     }
+    tracker.OnBuffered(prefetcher.GetPeakBytesHeld());
 
     // Assign the new ones...
+    _SortByOffset(newEntries);
     std::swap(audioMap.Entries, newEntries);
+    return true;
 }
 
-void RebuildFromAudioCacheFiles(SCIVersion version,
+// Returns false if cancelled.
+bool RebuildFromAudioCacheFiles(SCIVersion version,
                                 const std::string& cacheSubfolder,
                                 AudioMapComponent& audioMap, int number,
-                                std::ostream& writeStream)
+                                std::iostream& writeStream,
+                                AudioRebuildTracker& tracker)
 {
     bool isMain = number == version.AudioMapResourceNumber;
+    bool allowOtherMaps = !_UsesOffsetDeltas(audioMap.Version);
 
     std::vector<AudioMapEntry> newEntries;
+    std::vector<uint8_t> clip;
     for (auto& entry : audioMap.Entries)
     {
+        if (tracker.IsCancelled())
+        {
+            return false;
+        }
+
         uint32_t tuple = isMain ? NoBase36 : GetMessageTuple(entry);
         auto resource_num = ResourceNum::CreateWithBase36(entry.Number, tuple);
         std::string fullPathAudio = cacheSubfolder + "\\" + GetFileNameFor(
@@ -835,27 +1118,27 @@ void RebuildFromAudioCacheFiles(SCIVersion version,
                 ResourceId(ResourceType::Sync, resource_num), version);
         }
 
-        entry.Offset = static_cast<uint32_t>(writeStream.tellp());
         entry.SyncSize = 0;
-        // If it exists, open sync file and write it. Then take note of size. Then write audio.
+        // If it exists, read the sync file and then the audio file. The sync size is noted in the map.
         if (sys::exists(sys::path(fullPathAudio)))
         {
+            clip.clear();
             if (!fullPathSync.empty() && sys::exists(sys::path(fullPathSync)))
             {
-                std::ifstream syncFile;
-                syncFile.exceptions(
-                    std::ifstream::failbit | std::ifstream::badbit);
-                syncFile.open(fullPathSync,
-                              std::ios_base::binary | std::ios_base::in);
-                writeStream << syncFile.rdbuf();
-                entry.SyncSize = (uint32_t)writeStream.tellp() - entry.Offset;
+                _AppendFileContents(fullPathSync, clip);
+                entry.SyncSize = static_cast<uint16_t>(clip.size());
             }
+            _AppendFileContents(fullPathAudio, clip);
 
-            std::ifstream audFile;
-            audFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-            audFile.open(fullPathAudio,
-                         std::ios_base::binary | std::ios_base::in);
-            writeStream << audFile.rdbuf();
+            const uint8_t* clipData = clip.empty() ? nullptr : &clip[0];
+            if (!tracker.TryReuseClip(writeStream, number, allowOtherMaps, clipData, clip.size(), entry.SyncSize, entry.Offset))
+            {
+                if (!clip.empty())
+                {
+                    writeStream.write(reinterpret_cast<const char*>(clipData), clip.size());
+                }
+                tracker.OnClipWritten(clip.size());
+            }
 
             newEntries.push_back(entry);
         }
@@ -863,12 +1146,14 @@ void RebuildFromAudioCacheFiles(SCIVersion version,
     }
 
     // Assign the new ones...
+    _SortByOffset(newEntries);
     std::swap(audioMap.Entries, newEntries);
+    return true;
 }
 
-std::ostream* _ChooseBakOutputStream(const AudioCacheResourceSource::IResourceManager* resourceMap, int number,
-                                     std::ofstream& audStream,
-                                     std::ofstream& sfxStream)
+std::iostream* _ChooseBakOutputStream(const AudioCacheResourceSource::IResourceManager* resourceMap, int number,
+                                      std::fstream& audStream,
+                                      std::fstream& sfxStream)
 {
     AudioVolumeName volumeName;
     if (number == resourceMap->GetVersion().AudioMapResourceNumber)
@@ -879,16 +1164,17 @@ std::ostream* _ChooseBakOutputStream(const AudioCacheResourceSource::IResourceMa
     {
         volumeName = GetVolumeToUse(resourceMap->GetVersion(), number);
     }
-    std::ofstream* toUse = (volumeName == AudioVolumeName::Aud)
+    std::fstream* toUse = (volumeName == AudioVolumeName::Aud)
                                ? &audStream
                                : &sfxStream;
 
     if (!toUse->is_open())
     {
         std::string path = GetAudioVolumePath(resourceMap->GetGameFolder(), true, volumeName);
-        toUse->exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        toUse->exceptions(std::fstream::failbit | std::fstream::badbit);
+        // Opened for reading too, so that duplicate clips can be compared with what was written.
         toUse->open(
-            path, std::ios_base::out | std::ios_base::trunc |
+            path, std::ios_base::in | std::ios_base::out | std::ios_base::trunc |
             std::ios_base::binary);
     }
 
@@ -946,17 +1232,31 @@ void AudioCacheResourceSource::RebuildResources(
 
     // We can avoid doing anything here if we know that all cached files have up-to-date versions built into the game's resources.
     bool needToRebuild = !allCacheFilesUpToDate || force;
+    _rebuildStats = AudioRebuildStats();
     if (needToRebuild)
     {
-        // 3) Based on the information in the audio maps, write the necessary audio resources into the audio volume files (resource.aud/resource.sfx, as appropriate)
-        std::ofstream audStream;
-        std::ofstream sfxStream;
+        _rebuildStats.Rebuilt = true;
+        size_t clipCount = 0;
         for (int amNumber : audioMapNumbers)
         {
             auto itAudioMapPair = audioMaps.find(amNumber);
             if (itAudioMapPair != audioMaps.end())
             {
-                std::ostream& streamToUse = *_ChooseBakOutputStream(
+                clipCount += itAudioMapPair->second->GetComponent<AudioMapComponent>().Entries.size();
+            }
+        }
+        AudioRebuildTracker tracker(_rebuildProgress, _rebuildStats, clipCount);
+
+        // 3) Based on the information in the audio maps, write the necessary audio resources into the audio volume files (resource.aud/resource.sfx, as appropriate)
+        std::fstream audStream;
+        std::fstream sfxStream;
+        bool completed = true;
+        for (int amNumber : audioMapNumbers)
+        {
+            auto itAudioMapPair = audioMaps.find(amNumber);
+            if (completed && (itAudioMapPair != audioMaps.end()))
+            {
+                std::iostream& streamToUse = *_ChooseBakOutputStream(
                     _resourceMap.get(), itAudioMapPair->first, audStream,
                     sfxStream);
 
@@ -978,22 +1278,44 @@ void AudioCacheResourceSource::RebuildResources(
                     //  Copy all the cache files directly into this stream...
                     std::string cacheSubfolder = GetCacheFolder() + fmt::format(
                         "\\{0}", audioMapResource->ResourceNumber);
-                    RebuildFromAudioCacheFiles(_resourceMap->GetVersion(), cacheSubfolder,
+                    completed = RebuildFromAudioCacheFiles(_resourceMap->GetVersion(), cacheSubfolder,
                                                audioMapResource->GetComponent<
                                                    AudioMapComponent>(),
                                                audioMapResource->ResourceNumber,
-                                               streamToUse);
+                                               streamToUse, tracker);
                 }
                 else
                 {
                     // Copy straight from the resources.
-                    RebuildFromResources(_resourceMap->GetVersion(), _resourceMap->GetGameFolder(),
+                    completed = RebuildFromResources(_resourceMap->GetVersion(), _resourceMap->GetGameFolder(),
                                          audioMapResource->GetComponent<
                                              AudioMapComponent>(),
                                          audioMapResource->ResourceNumber,
-                                         streamToUse);
+                                         streamToUse, tracker);
+                }
+            }
+        }
+
+        PROCESS_MEMORY_COUNTERS memoryCounters = {};
+        memoryCounters.cb = sizeof(memoryCounters);
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &memoryCounters, sizeof(memoryCounters)))
+        {
+            _rebuildStats.PeakWorkingSet = memoryCounters.PeakWorkingSetSize;
+        }
+
+        if (!completed)
+        {
+            // Cancelled. Leave the game's audio volumes and maps alone, and discard the partially written ones.
+            for (AudioVolumeName volumeName : { AudioVolumeName::Aud, AudioVolumeName::Sfx })
+            {
+                std::fstream& bakStream = (volumeName == AudioVolumeName::Aud) ? audStream : sfxStream;
+                if (bakStream.is_open())
+                {
+                    bakStream.close();
+                    deletefile(GetAudioVolumePath(_resourceMap->GetGameFolder(), true, volumeName));
                 }
             }
+            return;
         }
 
         // 4) Test that we can open the non bak versions for writing
@@ -24,6 +24,30 @@ class CResourceMap;
 
 extern const char* pszAudioCacheFolder;
 
+// Lets a caller follow, and cancel, a rebuild of the audio volumes (resource.aud/resource.sfx).
+class IAudioRebuildProgress
+{
+public:
+    virtual ~IAudioRebuildProgress() = default;
+
+    // Called after each clip is written.
+    virtual void OnClipWritten(size_t clipsWritten, size_t clipCount) = 0;
+    virtual bool IsCancelled() = 0;
+};
+
+struct AudioRebuildStats
+{
+    AudioRebuildStats() : Rebuilt(false), Cancelled(false), ClipCount(0), BytesWritten(0), BytesDeduplicated(0), PeakBytesBuffered(0), PeakWorkingSet(0) {}
+
+    bool Rebuilt;               // false if everything was already up-to-date
+    bool Cancelled;
+    size_t ClipCount;
+    uint64_t BytesWritten;
+    uint64_t BytesDeduplicated;  // Not written, because an identical clip was already in the volume
+    size_t PeakBytesBuffered;   // The most audio data held in memory at once
+    size_t PeakWorkingSet;      // The process's peak working set, as of the end of the rebuild
+};
+
 // ResourceSource for the audio resources cached by SCI Companion
 //
 // The SCI Companion folder tree for audio cache files looks like this:
@@ -74,6 +98,10 @@ public:
     void RebuildResources(bool force, ResourceSource& source,
                           std::map<ResourceType, RebuildStats>& stats) override;
 
+    // Optional, for RebuildResources.
+    void SetRebuildProgress(IAudioRebuildProgress* progress) { _rebuildProgress = progress; }
+    const AudioRebuildStats& GetRebuildStats() const { return _rebuildStats; }
+
     // A way to call RemoveEntry directly, for more efficiency.
     void RemoveEntries(int number, const std::vector<uint32_t> tuples);
     void SaveOrRemoveNegatives(const std::vector<ResourceEntity*> negatives);
@@ -101,6 +129,9 @@ private:
 
     bool _enumInitialized;
 
+    IAudioRebuildProgress* _rebuildProgress;
+    AudioRebuildStats _rebuildStats;
+
     std::shared_ptr<IResourceManager> _resourceMap;
 };
 
@@ -0,0 +1,322 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#include "stdafx.h"
+#include "CelRLE.h"
+#include <emmintrin.h>
+#include <intrin.h>
+
+namespace
+{
+    // Walks the cel's scanlines in the order the RLE data describes them (top to bottom, which
+    // is the reverse of how they're stored).
+    class CelDest
+    {
+    public:
+        CelDest(uint8_t *bits, uint16_t cx, uint16_t cy, size_t stride, uint8_t transparentColor) :
+            _bits(bits), _cx(cx), _stride(stride), _transparent(transparentColor), _y(cy), _x(0), _line(nullptr)
+        {
+            _NextLine();
+        }
+
+        bool IsDone() const { return _line == nullptr; }
+
+        void Fill(size_t count, uint8_t color)
+        {
+            while ((count > 0) && _line)
+            {
+                size_t amount = min(count, (size_t)(_cx - _x));
+                memset(_line + _x, color, amount);
+                _Advance(amount);
+                count -= amount;
+            }
+        }
+
+        void FillTransparent(size_t count)
+        {
+            Fill(count, _transparent);
+        }
+
+        void Copy(const uint8_t *src, size_t count)
+        {
+            while ((count > 0) && _line)
+            {
+                size_t amount = min(count, (size_t)(_cx - _x));
+                memcpy(_line + _x, src, amount);
+                src += amount;
+                _Advance(amount);
+                count -= amount;
+            }
+        }
+
+        // Fills whatever is left with the transparent color.
+        void FillRemaining()
+        {
+            if (_line)
+            {
+                memset(_line + _x, _transparent, _stride - _x);
+                memset(_bits, _transparent, _y * _stride);
+                _line = nullptr;
+            }
+        }
+
+    private:
+        void _Advance(size_t amount)
+        {
+            _x += amount;
+            if (_x == _cx)
+            {
+                memset(_line + _cx, _transparent, _stride - _cx);
+                _NextLine();
+            }
+        }
+
+        void _NextLine()
+        {
+            _x = 0;
+            if (_y > 0)
+            {
+                _y--;
+                _line = _bits + _y * _stride;
+            }
+            else
+            {
+                _line = nullptr;
+            }
+        }
+
+        uint8_t *_bits;
+        size_t _cx;
+        size_t _stride;
+        uint8_t _transparent;
+        size_t _y;
+        size_t _x;
+        uint8_t *_line;
+    };
+
+    bool _DecodeEGA(CelRLEBuffer &rle, CelDest &dest)
+    {
+        const uint8_t *src = rle.begin;
+        const uint8_t *srcEnd = rle.end;
+        while (!dest.IsDone() && (src < srcEnd))
+        {
+            uint8_t b = *src++;
+            dest.Fill(b >> 4, b & 0x0f);
+        }
+        rle.begin = src;
+        return dest.IsDone();
+    }
+
+    template<bool _Interleaved>
+    bool _DecodeVGA(CelRLEBuffer &rle, CelRLEBuffer *literal, CelDest &dest)
+    {
+        const uint8_t *src = rle.begin;
+        const uint8_t *srcEnd = rle.end;
+        const uint8_t *lit = _Interleaved ? nullptr : literal->begin;
+        const uint8_t *litEndStorage = _Interleaved ? nullptr : literal->end;
+        // If the literal data is interleaved with the RLE data, we read both from the same place.
+        const uint8_t *&litCur = _Interleaved ? src : lit;
+        const uint8_t *&litEnd = _Interleaved ? srcEnd : litEndStorage;
+
+        bool ok = true;
+        while (ok && !dest.IsDone() && (src < srcEnd))
+        {
+            uint8_t b = *src++;
+            size_t count = (b & 0x3f);
+            switch (b >> 6)
+            {
+                case 0x01:
+                    // Copy next count + 64 bytes as is
+                    count += 64;
+                    // fall through...
+                case 0x00:
+                    // Copy next count bytes as is
+                    ok = ((size_t)(litEnd - litCur) >= count);
+                    if (ok)
+                    {
+                        dest.Copy(litCur, count);
+                        litCur += count;
+                    }
+                    break;
+                case 0x02:
+                    // Set next count bytes to color
+                    ok = (litCur < litEnd);
+                    if (ok)
+                    {
+                        dest.Fill(count, *litCur++);
+                    }
+                    break;
+                case 0x03:
+                    // Set next count bytes to transparent
+                    dest.FillTransparent(count);
+                    break;
+            }
+        }
+
+        rle.begin = src;
+        if (!_Interleaved)
+        {
+            literal->begin = lit;
+        }
+        return dest.IsDone();
+    }
+
+    // The VGA encoding supports up to 127 for literal runs, but SV.exe barfs on that, so we limit ourselves to 63.
+    const size_t MaxVGARun = 0x3f;
+    const size_t MaxEGARun = 0x0f;
+
+    // The number of pixels to copy as is, before we hit something worth encoding as a run.
+    // Sequences of 2 are allowed in these (since it would end up costing the same just to keep going),
+    // except for the transparent color.
+    size_t _GetLiteralRun(const uint8_t *bits, size_t limit, uint8_t transparentColor)
+    {
+        size_t count = 1;
+        size_t identicalCount = 1;
+        uint8_t previousColor = bits[0];
+        while (count < limit)
+        {
+            uint8_t nextColor = bits[count];
+            count++;
+            if (nextColor == previousColor)
+            {
+                identicalCount++;
+                if ((identicalCount >= 3) || (previousColor == transparentColor))
+                {
+                    count -= identicalCount;
+                    assert(count > 0);
+                    break;
+                }
+            }
+            else
+            {
+                identicalCount = 1;
+                previousColor = nextColor;
+            }
+        }
+        return count;
+    }
+
+    void _EncodeVGALine(const uint8_t *line, size_t cx, uint8_t transparentColor, std::vector<uint8_t> &rle, std::vector<uint8_t> &literal)
+    {
+        size_t x = 0;
+        while (x < cx)
+        {
+            size_t limit = min(cx - x, MaxVGARun);
+            size_t count = GetIdenticalPixelRun(line + x, limit);
+            if (count > 1)
+            {
+                if (line[x] == transparentColor)
+                {
+                    rle.push_back((uint8_t)((0x3 << 6) | count));
+                }
+                else
+                {
+                    rle.push_back((uint8_t)((0x2 << 6) | count));
+                    literal.push_back(line[x]);
+                }
+            }
+            else
+            {
+                count = _GetLiteralRun(line + x, limit, transparentColor);
+                rle.push_back((uint8_t)count);
+                literal.insert(literal.end(), line + x, line + x + count);
+            }
+            x += count;
+        }
+    }
+
+    void _EncodeEGALine(const uint8_t *line, size_t cx, std::vector<uint8_t> &rle)
+    {
+        size_t x = 0;
+        while (x < cx)
+        {
+            size_t count = GetIdenticalPixelRun(line + x, min(cx - x, MaxEGARun));
+            rle.push_back((uint8_t)((count << 4) | line[x]));
+            x += count;
+        }
+    }
+}
+
+size_t GetIdenticalPixelRun(const uint8_t *bits, size_t limit)
+{
+    if (limit == 0)
+    {
+        return 0;
+    }
+    size_t count = 1;
+    // Compare 16 pixels at a time against the first one.
+    __m128i target = _mm_set1_epi8((char)bits[0]);
+    while ((count + 16) <= limit)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bits + count));
+        unsigned long different = (~(unsigned long)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, target))) & 0xffff;
+        if (different)
+        {
+            unsigned long index;
+            _BitScanForward(&index, different);
+            return count + index;
+        }
+        count += 16;
+    }
+    while ((count < limit) && (bits[count] == bits[0]))
+    {
+        count++;
+    }
+    return count;
+}
+
+bool DecodeCelRLE(CelRLEFormat format, CelRLEBuffer &rle, CelRLEBuffer *literal, uint8_t *bits, uint16_t cx, uint16_t cy, size_t stride, uint8_t transparentColor)
+{
+    if ((cx == 0) || (cy == 0))
+    {
+        memset(bits, transparentColor, stride * cy);
+        return true;
+    }
+
+    CelDest dest(bits, cx, cy, stride, transparentColor);
+    bool ok;
+    if (format == CelRLEFormat::EGA)
+    {
+        ok = _DecodeEGA(rle, dest);
+    }
+    else if (literal)
+    {
+        ok = _DecodeVGA<false>(rle, literal, dest);
+    }
+    else
+    {
+        ok = _DecodeVGA<true>(rle, nullptr, dest);
+    }
+    dest.FillRemaining();
+    return ok;
+}
+
+void EncodeCelRLE(CelRLEFormat format, const uint8_t *bits, uint16_t cx, uint16_t cy, size_t stride, uint8_t transparentColor, std::vector<uint8_t> &rle, std::vector<uint8_t> &literal)
+{
+    if (cx == 0)
+    {
+        return;
+    }
+    for (int y = cy - 1; y >= 0; y--)
+    {
+        const uint8_t *line = bits + y * stride;
+        if (format == CelRLEFormat::EGA)
+        {
+            _EncodeEGALine(line, cx, rle);
+        }
+        else
+        {
+            _EncodeVGALine(line, cx, transparentColor, rle, literal);
+        }
+    }
+}
@@ -0,0 +1,49 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#pragma once
+
+// Raw pointer kernels for the cel RLE encodings used by views and pics.
+//
+// Cel pixels are bottom-up with a padded stride (see CX_ACTUAL), while the RLE data describes
+// the cel top-down with no padding. Runs may cross scanlines when decoding (Sierra's own data does this),
+// but the encoder never produces them.
+
+enum class CelRLEFormat
+{
+    // A single stream of bytes: high nibble is the count, low nibble the color.
+    EGA,
+    // Two bit opcode plus six bit count. Literal and fill colors are read from the literal stream, which
+    // may be the same as the RLE stream (VGA1.0), or a separate one (VGA1.1 and SCI2).
+    VGA,
+};
+
+struct CelRLEBuffer
+{
+    const uint8_t *begin;
+    const uint8_t *end;
+};
+
+// Decodes into bits (which must have room for stride * cy bytes). The padding at the end
+// of each scanline is filled with the transparent color, as are any pixels left over if
+// the RLE data runs out.
+// If literal is nullptr, the literal data is interleaved with the RLE data.
+// On return, rle.begin (and literal.begin) point just past the data that was consumed.
+// Returns false if the data ran out before the cel was filled.
+bool DecodeCelRLE(CelRLEFormat format, CelRLEBuffer &rle, CelRLEBuffer *literal, uint8_t *bits, uint16_t cx, uint16_t cy, size_t stride, uint8_t transparentColor);
+
+// Encodes the cel. To interleave the literal data with the RLE data, pass the same vector for both.
+void EncodeCelRLE(CelRLEFormat format, const uint8_t *bits, uint16_t cx, uint16_t cy, size_t stride, uint8_t transparentColor, std::vector<uint8_t> &rle, std::vector<uint8_t> &literal);
+
+// Returns the number of pixels from the start of bits that are equal to the first one, up to limit.
+size_t GetIdenticalPixelRun(const uint8_t *bits, size_t limit);
@@ -58,6 +58,31 @@ const Cel& RasterComponent::GetCel(CelIndex index) const
     return Loops[index.loop].Cels[index.cel];
 }
 
+size_t RasterComponent::GetMemorySize() const
+{
+    std::unordered_set<const void*> seen;
+    return AccumulateMemorySize(seen);
+}
+
+size_t RasterComponent::AccumulateMemorySize(std::unordered_set<const void*> &seen) const
+{
+    size_t size = sizeof(*this);
+    for (const Loop &loop : Loops)
+    {
+        size += sizeof(loop);
+        for (const Cel &cel : loop.Cels)
+        {
+            size += sizeof(cel);
+            // Copies of cels share their pixels, so count each buffer once.
+            if (!cel.Data.empty() && seen.insert(cel.Data.begin()).second)
+            {
+                size += cel.Data.size();
+            }
+        }
+    }
+    return size;
+}
+
 const Cel& RasterComponent::GetCelFallback(CelIndex index) const
 {
     uint16_t loopNumber = min(index.loop, (uint16_t)(LoopCount() - 1));
@@ -37,6 +37,10 @@ const std::string PatchFileKey = "SaveToPatchFiles";
 const std::string TrueValue = "true";
 const std::string FalseValue = "false";
 const std::string GenerateDebugInfoKey = "GenerateDebugInfo";
+const std::string OptimizeCodeKey = "OptimizeCode";
+const std::string ReportUnusedExportsKey = "ReportUnusedExports";
+const std::string StripUnusedExportsKey = "StripUnusedExports";
+const std::string SaidCorpusKey = "SaidCorpus";
 
 namespace
 {
@@ -513,6 +517,40 @@ bool GameFolderHelper::GetGenerateDebugInfo() const
     return (value == TrueValue);
 }
 
+bool GameFolderHelper::GetOptimizeCode() const
+{
+    std::string value = GetIniString(GameSection, OptimizeCodeKey,
+                                     FalseValue.c_str());
+    std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+    return (value == TrueValue);
+}
+
+bool GameFolderHelper::GetReportUnusedExports() const
+{
+    std::string value = GetIniString(GameSection, ReportUnusedExportsKey,
+                                     FalseValue.c_str());
+    std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+    return (value == TrueValue);
+}
+
+bool GameFolderHelper::GetStripUnusedExports() const
+{
+    std::string value = GetIniString(GameSection, StripUnusedExportsKey,
+                                     FalseValue.c_str());
+    std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+    return (value == TrueValue);
+}
+
+std::string GameFolderHelper::GetSaidCorpusFile() const
+{
+    std::string value = GetIniString(GameSection, SaidCorpusKey);
+    if (!value.empty() && PathIsRelative(value.c_str()))
+    {
+        value = GameFolder + "\\" + value;
+    }
+    return value;
+}
+
 ResourceSaveLocation GameFolderHelper::GetResourceSaveLocation(
     ResourceSaveLocation location) const
 {
@@ -131,6 +131,11 @@ public:
     void SetUndither(bool undither) const;
 
     bool GetGenerateDebugInfo() const;
+    bool GetOptimizeCode() const;
+    bool GetReportUnusedExports() const;
+    bool GetStripUnusedExports() const;
+    // Full path of a file of player sentences to check saids against, or empty.
+    std::string GetSaidCorpusFile() const;
 
     ResourceSaveLocation GetResourceSaveLocation(
         ResourceSaveLocation location) const;
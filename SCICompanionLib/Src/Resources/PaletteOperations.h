@@ -51,6 +51,8 @@ struct PaletteComponent : public ResourceComponent
         return std::make_unique<PaletteComponent>(*this);
     }
 
+    size_t GetMemorySize() const override { return sizeof(*this); }
+
     bool operator==(const PaletteComponent &src);
     bool operator!=(const PaletteComponent &src);
 
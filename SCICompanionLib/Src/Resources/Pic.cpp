@@ -1291,6 +1291,36 @@ bool IsSame(const PicComponent *one, const PicComponent *two)
 
 PicComponent::PicComponent() : PicComponent(&picTraitsEGA) {}
 
+size_t PicComponent::GetMemorySize() const
+{
+    std::unordered_set<const void*> seen;
+    return AccumulateMemorySize(seen);
+}
+
+size_t PicComponent::AccumulateMemorySize(std::unordered_set<const void*> &seen) const
+{
+    size_t size = sizeof(*this) + commands.capacity() * sizeof(PicCommand);
+    for (const PicCommand &command : commands)
+    {
+        // Embedded bitmaps and palettes are the bulk of VGA pics.
+        if ((command.type == PicCommand::DrawBitmap) && command.drawVisualBitmap.pCel)
+        {
+            const Cel &cel = *command.drawVisualBitmap.pCel;
+            size += sizeof(Cel);
+            // Copies of cels share their pixels, so count each buffer once.
+            if (!cel.Data.empty() && seen.insert(cel.Data.begin()).second)
+            {
+                size += cel.Data.size();
+            }
+        }
+        else if (command.type == PicCommand::SetPalette)
+        {
+            size += sizeof(EGACOLOR) * PALETTE_SIZE;
+        }
+    }
+    return size;
+}
+
 PicComponent::PicComponent(const PicTraits *traits) : Traits(traits), Size(size16(DEFAULT_PIC_WIDTH, DEFAULT_PIC_HEIGHT)), UniqueId(g_PicIds++)  {}
 
 class PicResourceFactory : public ResourceEntityFactory
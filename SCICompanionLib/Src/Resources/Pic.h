@@ -44,6 +44,9 @@ struct PicComponent : ResourceComponent
         return std::make_unique<PicComponent>(*this);
     }
 
+    size_t GetMemorySize() const override;
+    size_t AccumulateMemorySize(std::unordered_set<const void*> &seen) const override;
+
     std::vector<PicCommand> commands;
     size16 Size;
     const PicTraits *Traits;
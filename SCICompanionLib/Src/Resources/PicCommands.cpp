@@ -364,6 +364,69 @@ void PastedCommands_GetBounds(size16 displaySize, const PicCommand *pCommand, si
 }
 
 
+bool Command_GetDrawBounds(size16 displaySize, const PicCommand *pCommand, sRECT *prc)
+{
+    bool fKnown = true;
+    int left = 0;
+    int top = 0;
+    int right = 0;
+    int bottom = 0;
+    switch (pCommand->type)
+    {
+        case PicCommand::Line:
+            left = min(pCommand->drawLine.xFrom, pCommand->drawLine.xTo);
+            right = max(pCommand->drawLine.xFrom, pCommand->drawLine.xTo) + 1;
+            top = min(pCommand->drawLine.yFrom, pCommand->drawLine.yTo);
+            bottom = max(pCommand->drawLine.yFrom, pCommand->drawLine.yTo) + 1;
+            break;
+
+        case PicCommand::Circle:
+            // The lines that make up the circle may stray a pixel outside.
+            left = min(pCommand->circle.xFrom, pCommand->circle.xTo) - 1;
+            right = max(pCommand->circle.xFrom, pCommand->circle.xTo) + 2;
+            top = min(pCommand->circle.yFrom, pCommand->circle.yTo) - 1;
+            bottom = max(pCommand->circle.yFrom, pCommand->circle.yTo) + 2;
+            break;
+
+        case PicCommand::Pattern:
+        {
+            // Same adjustments as _DrawPattern
+            int size = pCommand->drawPattern.bPatternSize;
+            int x = pCommand->drawPattern.x;
+            int y = pCommand->drawPattern.y;
+            x = max(x, size);
+            x = min(x, displaySize.cx - 1 - size);
+            y = max(y, size);
+            y = min(y, displaySize.cy - 1 - size);
+            left = x - size;
+            right = x + size + 2;
+            top = y - size;
+            bottom = y + size + 1;
+            break;
+        }
+
+        case PicCommand::Fill:
+        case PicCommand::DrawBitmap:
+        case PicCommand::PicClips:
+            fKnown = false;
+            break;
+
+        default:
+            // Doesn't draw anything.
+            break;
+    }
+
+    if (fKnown)
+    {
+        prc->left = (int16_t)max(left, 0);
+        prc->top = (int16_t)max(top, 0);
+        prc->right = (int16_t)max(prc->left, min(right, (int)displaySize.cx));
+        prc->bottom = (int16_t)max(prc->top, min(bottom, (int)displaySize.cy));
+    }
+    return fKnown;
+}
+
+
 bool PastedCommands_ContainDrawCommands(const PicCommand *pCommands, size_t cCommands)
 {
     bool fContain = FALSE;
@@ -741,7 +804,170 @@ void _PlotPixNonStd(int cx, int cy, PicData *pData, int16_t x, int16_t y, PicScr
 
 
 
-#define LINEMACRO(pData, startx, starty, deltalinear, deltanonlinear, linearvar, nonlinearvar, \
+//
+// Writes the pixels for a line or pattern command. _Screens is the set of screens (visual, priority and control)
+// that the command draws to and that are being redrawn. It's fixed at compile time so that the per-pixel work
+// has no flag tests: the flags are looked at once per command, in _DispatchPlotter.
+//
+template<typename _TFormat, int _Screens>
+class PixelPlotter
+{
+public:
+    PixelPlotter(PicData *pData, PicScreenFlags auxSet, typename _TFormat::PixelType color, uint8_t bPriorityValue, uint8_t bControlValue) :
+        _visual(pData->pdataVisual), _priority(pData->pdataPriority), _control(pData->pdataControl), _aux(pData->pdataAux),
+        _cx(pData->size.cx), _cy(pData->size.cy), _auxSet((uint8_t)auxSet), _color(color), _priorityValue(bPriorityValue), _controlValue(bControlValue) {}
+
+    // Same as _PlotPix
+    void Plot(int16_t x, int16_t y)
+    {
+        if (x < 0 || y < 0 || x >= _cx || y >= _cy)
+        {
+            return;
+        }
+        int p = BUFFEROFFSET_NONSTD(_cx, _cy, x, y);
+        if (_Screens & (int)PicScreenFlags::Visual)
+        {
+            _visual[p] = _TFormat::Plot(x, y, _color);
+        }
+        if (_Screens & (int)PicScreenFlags::Priority)
+        {
+            _priority[p] = _priorityValue;
+        }
+        if (_Screens & (int)PicScreenFlags::Control)
+        {
+            _control[p] = _controlValue;
+        }
+        _aux[p] |= _auxSet;
+    }
+
+    // Plots every pixel from xFrom to xTo (inclusive) on row y.
+    void PlotHorizontal(int xFrom, int xTo, int y)
+    {
+        if (xFrom > xTo)
+        {
+            std::swap(xFrom, xTo);
+        }
+        xFrom = max(xFrom, 0);
+        xTo = min(xTo, _cx - 1);
+        if ((y < 0) || (y >= _cy) || (xFrom > xTo))
+        {
+            return;
+        }
+        int p = BUFFEROFFSET_NONSTD(_cx, _cy, xFrom, y);
+        size_t count = xTo - xFrom + 1;
+        if (_Screens & (int)PicScreenFlags::Visual)
+        {
+            // Dithering alternates between two values along a row.
+            uint8_t even = _TFormat::Plot((int16_t)xFrom, (int16_t)y, _color);
+            uint8_t odd = _TFormat::Plot((int16_t)(xFrom + 1), (int16_t)y, _color);
+            if (even == odd)
+            {
+                memset(_visual + p, even, count);
+            }
+            else
+            {
+                for (size_t i = 0; i < count; i++)
+                {
+                    _visual[p + i] = (i & 1) ? odd : even;
+                }
+            }
+        }
+        if (_Screens & (int)PicScreenFlags::Priority)
+        {
+            memset(_priority + p, _priorityValue, count);
+        }
+        if (_Screens & (int)PicScreenFlags::Control)
+        {
+            memset(_control + p, _controlValue, count);
+        }
+        if (_auxSet)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                _aux[p + i] |= _auxSet;
+            }
+        }
+    }
+
+    // Plots every pixel from yFrom to yTo (inclusive) on column x.
+    void PlotVertical(int x, int yFrom, int yTo)
+    {
+        if (yFrom > yTo)
+        {
+            std::swap(yFrom, yTo);
+        }
+        yFrom = max(yFrom, 0);
+        yTo = min(yTo, _cy - 1);
+        if ((x < 0) || (x >= _cx) || (yFrom > yTo))
+        {
+            return;
+        }
+        for (int y = yFrom; y <= yTo; y++)
+        {
+            int p = BUFFEROFFSET_NONSTD(_cx, _cy, x, y);
+            if (_Screens & (int)PicScreenFlags::Visual)
+            {
+                _visual[p] = _TFormat::Plot((int16_t)x, (int16_t)y, _color);
+            }
+            if (_Screens & (int)PicScreenFlags::Priority)
+            {
+                _priority[p] = _priorityValue;
+            }
+            if (_Screens & (int)PicScreenFlags::Control)
+            {
+                _control[p] = _controlValue;
+            }
+            _aux[p] |= _auxSet;
+        }
+    }
+
+private:
+    uint8_t *_visual;
+    uint8_t *_priority;
+    uint8_t *_control;
+    uint8_t *_aux;
+    int _cx;
+    int _cy;
+    uint8_t _auxSet;
+    typename _TFormat::PixelType _color;
+    uint8_t _priorityValue;
+    uint8_t _controlValue;
+};
+
+// Calls rasterizer.Draw with the PixelPlotter that matches the screens being drawn to.
+template<typename _TFormat, typename _TRasterizer>
+void _DispatchPlotter(PicData *pData, PicScreenFlags dwDrawEnable, PicScreenFlags auxSet, typename _TFormat::PixelType color, uint8_t bPriorityValue, uint8_t bControlValue, const _TRasterizer &rasterizer)
+{
+    switch ((int)(pData->dwMapsToRedraw & dwDrawEnable & PicScreenFlags::All))
+    {
+        case 0:
+            rasterizer.Draw(PixelPlotter<_TFormat, 0>(pData, auxSet, color, bPriorityValue, bControlValue));
+            break;
+        case 1:
+            rasterizer.Draw(PixelPlotter<_TFormat, 1>(pData, auxSet, color, bPriorityValue, bControlValue));
+            break;
+        case 2:
+            rasterizer.Draw(PixelPlotter<_TFormat, 2>(pData, auxSet, color, bPriorityValue, bControlValue));
+            break;
+        case 3:
+            rasterizer.Draw(PixelPlotter<_TFormat, 3>(pData, auxSet, color, bPriorityValue, bControlValue));
+            break;
+        case 4:
+            rasterizer.Draw(PixelPlotter<_TFormat, 4>(pData, auxSet, color, bPriorityValue, bControlValue));
+            break;
+        case 5:
+            rasterizer.Draw(PixelPlotter<_TFormat, 5>(pData, auxSet, color, bPriorityValue, bControlValue));
+            break;
+        case 6:
+            rasterizer.Draw(PixelPlotter<_TFormat, 6>(pData, auxSet, color, bPriorityValue, bControlValue));
+            break;
+        case 7:
+            rasterizer.Draw(PixelPlotter<_TFormat, 7>(pData, auxSet, color, bPriorityValue, bControlValue));
+            break;
+    }
+}
+
+#define LINEMACRO(plotter, startx, starty, deltalinear, deltanonlinear, linearvar, nonlinearvar, \
                   linearend, nonlinearstart, linearmod, nonlinearmod) \
    x = (startx); y = (starty); \
    incrNE = ((deltalinear) > 0)? (deltalinear) : -(deltalinear); \
@@ -750,60 +976,86 @@ void _PlotPixNonStd(int cx, int cy, PicData *pData, int16_t x, int16_t y, PicScr
    incrE = ((deltanonlinear) > 0) ? -(deltanonlinear) : (deltanonlinear);  \
    d = nonlinearstart-1;  \
    while (linearvar != (linearend)) { \
-     _PlotPix<_TFormat>(pData, x,y, dwDrawEnable, auxSet, color, bPriorityValue, bControlValue); \
+     plotter.Plot(x, y); \
      linearvar += linearmod; \
      if ((d+=incrE) < 0) { \
        d += incrNE; \
        nonlinearvar += nonlinearmod; \
      }; \
    }; \
-   _PlotPix<_TFormat>(pData, x, y, dwDrawEnable, auxSet, color, bPriorityValue, bControlValue);
+   plotter.Plot(x, y);
 
-template<typename _TFormat>
-void _DitherLine(PicData *pData, int16_t xStart, int16_t yStart, int16_t xEnd, int16_t yEnd, typename _TFormat::PixelType color, uint8_t bPriorityValue, uint8_t bControlValue, PicScreenFlags dwDrawEnable)
+struct LineRasterizer
 {
-    int dx, dy, incrE, incrNE, d, finalx, finaly;
-    int x = (int)xStart;
-    int y = (int)yStart;
-    dx = (int)xEnd - (int)x;
-    dy = (int)yEnd - (int)y;
-    finalx = (int)xEnd;
-    finaly = (int)yEnd;
-
-    PicScreenFlags auxSet = _GetAuxSet<_TFormat>(color, bPriorityValue, bControlValue, dwDrawEnable);
+    int16_t xStart;
+    int16_t yStart;
+    int16_t xEnd;
+    int16_t yEnd;
 
-    dx = abs(dx);
-    dy = abs(dy);
+    template<typename _TPlotter>
+    void Draw(_TPlotter plotter) const
+    {
+        int dx, dy, incrE, incrNE, d, finalx, finaly;
+        int x = (int)xStart;
+        int y = (int)yStart;
+        dx = (int)xEnd - (int)x;
+        dy = (int)yEnd - (int)y;
+        finalx = (int)xEnd;
+        finaly = (int)yEnd;
 
-    if (dx > dy) {
-        if (finalx < x) {
-            if (finaly < y) { /* llu == left-left-up */
-                LINEMACRO(pData, x, y, dx, dy, x, y, finalx, dx, -1, -1);
-            } else {         /* lld */
-                LINEMACRO(pData, x, y, dx, dy, x, y, finalx, dx, -1, 1);
-            }
-        } else { /* x1 >= x */
-            if (finaly < y) { /* rru */
-                LINEMACRO(pData, x, y, dx, dy, x, y, finalx, dx, 1, -1);
-            } else {         /* rrd */
-                LINEMACRO(pData, x, y, dx, dy, x, y, finalx, dx, 1, 1);
-            }
+        // Straight lines touch every pixel between the end points, so they can be done in spans.
+        if (dy == 0)
+        {
+            plotter.PlotHorizontal(x, finalx, y);
+            return;
+        }
+        if (dx == 0)
+        {
+            plotter.PlotVertical(x, y, finaly);
+            return;
         }
-    } else { /* dx <= dy */
-        if (finaly < y) {
-            if (finalx < x) { /* luu */
-                LINEMACRO(pData, x, y, dy, dx, y, x, finaly, dy, -1, -1);
-            } else {         /* ruu */
-                LINEMACRO(pData, x, y, dy, dx, y, x, finaly, dy, -1, 1);
+
+        dx = abs(dx);
+        dy = abs(dy);
+
+        if (dx > dy) {
+            if (finalx < x) {
+                if (finaly < y) { /* llu == left-left-up */
+                    LINEMACRO(plotter, x, y, dx, dy, x, y, finalx, dx, -1, -1);
+                } else {         /* lld */
+                    LINEMACRO(plotter, x, y, dx, dy, x, y, finalx, dx, -1, 1);
+                }
+            } else { /* x1 >= x */
+                if (finaly < y) { /* rru */
+                    LINEMACRO(plotter, x, y, dx, dy, x, y, finalx, dx, 1, -1);
+                } else {         /* rrd */
+                    LINEMACRO(plotter, x, y, dx, dy, x, y, finalx, dx, 1, 1);
+                }
             }
-        } else { /* y1 >= y */
-            if (finalx < x) { /* ldd */
-                LINEMACRO(pData, x, y, dy, dx, y, x, finaly, dy, 1, -1);
-            } else {         /* rdd */
-                LINEMACRO(pData, x, y, dy, dx, y, x, finaly, dy, 1, 1);
+        } else { /* dx <= dy */
+            if (finaly < y) {
+                if (finalx < x) { /* luu */
+                    LINEMACRO(plotter, x, y, dy, dx, y, x, finaly, dy, -1, -1);
+                } else {         /* ruu */
+                    LINEMACRO(plotter, x, y, dy, dx, y, x, finaly, dy, -1, 1);
+                }
+            } else { /* y1 >= y */
+                if (finalx < x) { /* ldd */
+                    LINEMACRO(plotter, x, y, dy, dx, y, x, finaly, dy, 1, -1);
+                } else {         /* rdd */
+                    LINEMACRO(plotter, x, y, dy, dx, y, x, finaly, dy, 1, 1);
+                }
             }
         }
     }
+};
+
+template<typename _TFormat>
+void _DitherLine(PicData *pData, int16_t xStart, int16_t yStart, int16_t xEnd, int16_t yEnd, typename _TFormat::PixelType color, uint8_t bPriorityValue, uint8_t bControlValue, PicScreenFlags dwDrawEnable)
+{
+    PicScreenFlags auxSet = _GetAuxSet<_TFormat>(color, bPriorityValue, bControlValue, dwDrawEnable);
+    LineRasterizer line = { xStart, yStart, xEnd, yEnd };
+    _DispatchPlotter<_TFormat>(pData, dwDrawEnable, auxSet, color, bPriorityValue, bControlValue, line);
 }
 
 
@@ -843,44 +1095,32 @@ uint8_t junqindex[128] = { /* starting points for junq fill */
 0x06, 0x6f, 0xc6, 0x4a, 0xa4, 0x75, 0x97, 0xe1
 };
 
-//
-// fPattern:        pattern or solid?
-// fRectangle:      rect or circle?
-//
-template<typename _TFormat>
-void _DrawPattern(PicData *pData, int16_t x, int16_t y, typename _TFormat::PixelType color, uint8_t bPriorityValue, uint8_t bControlValue, PicScreenFlags dwDrawEnable, bool fPattern, uint8_t bPatternSize, uint8_t bPatternNR, bool fRectangle)
+struct PatternRasterizer
 {
-    uint16_t wSize = (uint16_t)bPatternSize;
-
-    PicScreenFlags auxSet = _GetAuxSet<_TFormat>(color, bPriorityValue, bControlValue, dwDrawEnable);
-
-    int16_t xMax = pData->size.cx - 1;
-    int16_t yMax = pData->size.cy - 1;
-
-    // Fix up x and y
-    if (x < wSize)
-    {
-        x = wSize;
-    }
-    if ((x + wSize) > xMax)
-    {
-        x = xMax - wSize;
-    }
-    if (y < wSize)
-    {
-        y = wSize;
-    }
-    if ((y + wSize) > yMax)
-    {
-        y = yMax - wSize;
-    }
+    int16_t x;
+    int16_t y;
+    bool fPattern;
+    uint8_t bPatternSize;
+    uint8_t bPatternNR;
+    bool fRectangle;
 
-    if (bPatternNR < ARRAYSIZE(junqindex))
+    template<typename _TPlotter>
+    void Draw(_TPlotter plotter) const
     {
+        uint16_t wSize = (uint16_t)bPatternSize;
         uint8_t junqbit = junqindex[bPatternNR];
         if (fRectangle)
         {
             uint16_t k, l;
+            if (!fPattern && (x >= wSize) && (y >= wSize))
+            {
+                // Solid rectangles are just spans. (The coordinates are unsigned, so the loops below draw nothing if they'd go negative)
+                for (l = y - wSize; l <= y + wSize; l++)
+                {
+                    plotter.PlotHorizontal((int16_t)(x - wSize), (int16_t)(x + wSize + 1), (int16_t)l);
+                }
+                return;
+            }
             for (l = y - wSize; l <= y + wSize; l++)
             {
                 for (k = x - wSize; k <= (x + wSize + 1); k++)
@@ -889,7 +1129,7 @@ void _DrawPattern(PicData *pData, int16_t x, int16_t y, typename _TFormat::Pixel
                     {
                         if ( (junq[junqbit>>3] >> (7-(junqbit & 7))) & 1)
                         {
-                            _PlotPix<_TFormat>(pData, k, l, dwDrawEnable, auxSet, color, bPriorityValue, bControlValue);
+                            plotter.Plot(k, l);
                         }
                         junqbit++;
                         if (junqbit == 0xff)
@@ -899,7 +1139,7 @@ void _DrawPattern(PicData *pData, int16_t x, int16_t y, typename _TFormat::Pixel
                     }
                     else
                     {
-                        _PlotPix<_TFormat>(pData, k, l, dwDrawEnable, auxSet, color, bPriorityValue, bControlValue);
+                        plotter.Plot(k, l);
                     }
                 }
             }
@@ -919,7 +1159,7 @@ void _DrawPattern(PicData *pData, int16_t x, int16_t y, typename _TFormat::Pixel
                         {
                             if ((junq[junqbit>>3] >> (7-(junqbit & 7))) & 1)
                             {
-                                _PlotPix<_TFormat>(pData, k, l, dwDrawEnable, auxSet, color, bPriorityValue, bControlValue);
+                                plotter.Plot(k, l);
                             }
                             junqbit++;
                             if (junqbit == 0xff)
@@ -929,7 +1169,7 @@ void _DrawPattern(PicData *pData, int16_t x, int16_t y, typename _TFormat::Pixel
                         }
                         else
                         {
-                            _PlotPix<_TFormat>(pData, k, l, dwDrawEnable, auxSet, color, bPriorityValue, bControlValue);
+                            plotter.Plot(k, l);
                         }
                     }
                     circlebit++;
@@ -937,6 +1177,45 @@ void _DrawPattern(PicData *pData, int16_t x, int16_t y, typename _TFormat::Pixel
             }
         }
     }
+};
+
+//
+// fPattern:        pattern or solid?
+// fRectangle:      rect or circle?
+//
+template<typename _TFormat>
+void _DrawPattern(PicData *pData, int16_t x, int16_t y, typename _TFormat::PixelType color, uint8_t bPriorityValue, uint8_t bControlValue, PicScreenFlags dwDrawEnable, bool fPattern, uint8_t bPatternSize, uint8_t bPatternNR, bool fRectangle)
+{
+    uint16_t wSize = (uint16_t)bPatternSize;
+
+    PicScreenFlags auxSet = _GetAuxSet<_TFormat>(color, bPriorityValue, bControlValue, dwDrawEnable);
+
+    int16_t xMax = pData->size.cx - 1;
+    int16_t yMax = pData->size.cy - 1;
+
+    // Fix up x and y
+    if (x < wSize)
+    {
+        x = wSize;
+    }
+    if ((x + wSize) > xMax)
+    {
+        x = xMax - wSize;
+    }
+    if (y < wSize)
+    {
+        y = wSize;
+    }
+    if ((y + wSize) > yMax)
+    {
+        y = yMax - wSize;
+    }
+
+    if (bPatternNR < ARRAYSIZE(junqindex))
+    {
+        PatternRasterizer pattern = { x, y, fPattern, bPatternSize, bPatternNR, fRectangle };
+        _DispatchPlotter<_TFormat>(pData, dwDrawEnable, auxSet, color, bPriorityValue, bControlValue, pattern);
+    }
     else
     {
         REPORTERROR(TEXT("bPatternNR was too high"));
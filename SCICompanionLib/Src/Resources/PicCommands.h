@@ -454,6 +454,9 @@ struct PICCOMMAND_ADJUST
 };
 
 void PastedCommands_GetBounds(size16 displaySize, const PicCommand *pCommand, size_t cCommands, sRECT *prc);
+// The area a single command draws into (right and bottom are exclusive). Returns false if that can't be known ahead of time, e.g. for fills.
+bool Command_GetDrawBounds(size16 displaySize, const PicCommand *pCommand, sRECT *prc);
+bool Command_Adjust(size16 size, PicCommand *pCommand, const PICCOMMAND_ADJUST *pAdjust);
 void Command_DrawWithOffset(const PicCommand *pCommandIn, PicData *pData, ViewPort *pState, const PICCOMMAND_ADJUST *pAdjust);
 void PastedCommands_Adjust(size16 displaySize, std::vector<PicCommand> &commandsIn, const PICCOMMAND_ADJUST *pAdjust);
 HGLOBAL CopiedCommands_AllocAndFillMemory(const PicCommand *pCommands, size_t cCommands);
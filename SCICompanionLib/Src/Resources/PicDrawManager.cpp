@@ -23,6 +23,69 @@
 
 using namespace Gdiplus;
 
+void PicDirtyTiles::Reset(size16 size)
+{
+    _size = size;
+    _cxTiles = (size.cx + TileSize - 1) / TileSize;
+    _cyTiles = (size.cy + TileSize - 1) / TileSize;
+    _dirty.assign(_cxTiles * _cyTiles, false);
+}
+
+void PicDirtyTiles::MarkAll()
+{
+    _dirty.assign(_dirty.size(), true);
+}
+
+void PicDirtyTiles::MarkRect(const sRECT &rc)
+{
+    int left = max(0, (int)rc.left);
+    int top = max(0, (int)rc.top);
+    int right = min((int)_size.cx, (int)rc.right);
+    int bottom = min((int)_size.cy, (int)rc.bottom);
+    if ((left < right) && (top < bottom))
+    {
+        for (int yTile = top / TileSize; yTile <= (bottom - 1) / TileSize; yTile++)
+        {
+            for (int xTile = left / TileSize; xTile <= (right - 1) / TileSize; xTile++)
+            {
+                _dirty[yTile * _cxTiles + xTile] = true;
+            }
+        }
+    }
+}
+
+void PicDirtyTiles::CopyTiles(uint8_t *dest, const uint8_t *src) const
+{
+    for (int yTile = 0; yTile < _cyTiles; yTile++)
+    {
+        int yStart = yTile * TileSize;
+        int yEnd = min(yStart + TileSize, (int)_size.cy);
+        int xTile = 0;
+        while (xTile < _cxTiles)
+        {
+            if (!_dirty[yTile * _cxTiles + xTile])
+            {
+                xTile++;
+                continue;
+            }
+            // Copy runs of adjacent tiles a row at a time.
+            int xTileEnd = xTile + 1;
+            while ((xTileEnd < _cxTiles) && _dirty[yTile * _cxTiles + xTileEnd])
+            {
+                xTileEnd++;
+            }
+            int xStart = xTile * TileSize;
+            int xEnd = min(xTileEnd * TileSize, (int)_size.cx);
+            for (int y = yStart; y < yEnd; y++)
+            {
+                size_t offset = BUFFEROFFSET_NONSTD(_size.cx, _size.cy, xStart, y);
+                memcpy(dest + offset, src + offset, xEnd - xStart);
+            }
+            xTile = xTileEnd;
+        }
+    }
+}
+
 PicScreenFlags PicScreenToFlags(PicScreen screen)
 {
     return (PicScreenFlags)(0x1 << (int)screen);
@@ -39,7 +102,8 @@ PicDrawManager::PicDrawManager(const PicComponent *pPic, const PaletteComponent
     _isVGA(pPalette != nullptr),
     _isContinuousPri(pPic && pPic->Traits->ContinuousPriority),
 	_isUndithered(isEGAUndithered),
-    _screenBuffers{}
+    _screenBuffers{},
+    _bufferSize(0)
 {
     _viewPorts = std::make_unique<ViewPort[]>(3);
     _Reset();
@@ -57,13 +121,31 @@ PicDrawManager::PicDrawManager(const PicComponent *pPic, const PaletteComponent
 void PicDrawManager::_EnsureBufferPool(size16 size)
 {
     size_t byteSize = size.cx * size.cy;
-    if (!_bufferPool || (_bufferPool->GetSize() != byteSize))
+    if (_bufferSize != byteSize)
     {
-        _bufferPool = std::make_unique<BufferPool<12>>(byteSize);
+        // The old buffers are the wrong size, so give them all back.
+        memset(_screenBuffers, 0, sizeof(_screenBuffers));
+        _buffers.clear();
+        _bufferSize = byteSize;
         Invalidate();
     }
 }
 
+uint8_t *PicDrawManager::_AllocateBuffer()
+{
+    _buffers.push_back(BufferPool::Instance().Allocate(_bufferSize));
+    return _buffers.back().get();
+}
+
+void PicDrawManager::_FreeBuffer(uint8_t *buffer)
+{
+    auto it = std::find_if(_buffers.begin(), _buffers.end(), [buffer](const BufferPool::Buffer &owned) { return owned.get() == buffer; });
+    if (it != _buffers.end())
+    {
+        _buffers.erase(it);
+    }
+}
+
 RGBQUAD *PicDrawManager::_GetPalette()
 {
     return (_isVGA ? _paletteVGA :
@@ -84,6 +166,7 @@ void PicDrawManager::_Reset()
     _iDrawPos = -1;
     _fValidPalette = false;
     _fValidState = false;
+    _fValidPluginTiles = false;
     _bPaletteNumber = 0;
     //_currentState.Reset(_bPaletteNumber);
     _iInsertPos = -1;
@@ -225,7 +308,7 @@ void PicDrawManager::_EnsureInitialBuffers(PicScreenFlags screenFlags)
         {
             if (!_screenBuffers[0][i])
             {
-                _screenBuffers[0][i] = _bufferPool->AllocateBuffer();
+                _screenBuffers[0][i] = _AllocateBuffer();
 
                 // REVIEW test -> indicate uninitlaize data.
                 *_screenBuffers[0][i] = 0xe;
@@ -300,11 +383,19 @@ void PicDrawManager::_RedrawBuffers(ViewPort *pState, PicScreenFlags screenFlags
         clearOutFromHereOn = PicPosition::Final;
     }
 
+    // If only the plugins need redrawing (e.g. the mouse moved while previewing a drawing tool), we can hold onto the
+    // PostPlugin buffers and just restore the parts the plugins drew on last time.
+    bool restorePluginTiles = _fValidPluginTiles &&
+        (clearOutFromHereOn == PicPosition::PostPlugin) &&
+        IsFlagSet(picPositionFlags, PicPositionFlags::PrePlugin) &&
+        (_pluginTiles.GetSize() == size);
+    _fValidPluginTiles = false;
+
     if (clearOutFromHereOn <= PicPosition::PrePlugin)
     {
         _ReturnOldBufferIfNotUsedAnywhere(PicPosition::PrePlugin);
     }
-    if (clearOutFromHereOn <= PicPosition::PostPlugin)
+    if ((clearOutFromHereOn <= PicPosition::PostPlugin) && !restorePluginTiles)
     {
         _ReturnOldBufferIfNotUsedAnywhere(PicPosition::PostPlugin);
     }
@@ -327,17 +418,17 @@ void PicDrawManager::_RedrawBuffers(ViewPort *pState, PicScreenFlags screenFlags
         // Default states
         if (IsFlagSet(screenFlags, PicScreenFlags::Priority))
         {
-            memset(GetScreenData(PicScreen::Priority, PicPosition::PrePlugin), 0x00, _bufferPool->GetSize());
+            memset(GetScreenData(PicScreen::Priority, PicPosition::PrePlugin), 0x00, _bufferSize);
         }
         if (IsFlagSet(screenFlags, PicScreenFlags::Control))
         {
-            memset(GetScreenData(PicScreen::Control, PicPosition::PrePlugin), 0x00, _bufferPool->GetSize());
+            memset(GetScreenData(PicScreen::Control, PicPosition::PrePlugin), 0x00, _bufferSize);
         }
         if (IsFlagSet(screenFlags, PicScreenFlags::Visual))
         {
-            memset(GetScreenData(PicScreen::Visual, PicPosition::PrePlugin), (_isVGA || _isUndithered) ? 0xff : 0x0f, _bufferPool->GetSize());
+            memset(GetScreenData(PicScreen::Visual, PicPosition::PrePlugin), (_isVGA || _isUndithered) ? 0xff : 0x0f, _bufferSize);
         }
-        memset(GetScreenData(PicScreen::Aux, PicPosition::PrePlugin), 0x00, _bufferPool->GetSize());
+        memset(GetScreenData(PicScreen::Aux, PicPosition::PrePlugin), 0x00, _bufferSize);
 
         PicData data =
         {
@@ -365,7 +456,12 @@ void PicDrawManager::_RedrawBuffers(ViewPort *pState, PicScreenFlags screenFlags
     if (willDrawOnPic)
     {
         // Now do the plugins
-        _MoveToNextStep(picPositionFlags, PicPosition::PrePlugin);
+        if (!restorePluginTiles || !_RestorePluginTiles())
+        {
+            _MoveToNextStep(picPositionFlags, PicPosition::PrePlugin);
+        }
+        // Nothing has been drawn on the PostPlugin buffers yet.
+        _pluginTiles.Reset(size);
 
         // TODO: NEeds to be an if statement here
         // Basically, if someone needs PostPlugin or Final, and PostPlugin is not valid
@@ -390,8 +486,20 @@ void PicDrawManager::_RedrawBuffers(ViewPort *pState, PicScreenFlags screenFlags
             for (IPicDrawPlugin *plugin : _plugins)
             {
                 plugin->DrawOnPic(_viewPorts[1], data, screenFlags);
+                sRECT bounds;
+                if (plugin->GetDrawBounds(size, bounds))
+                {
+                    _pluginTiles.MarkRect(bounds);
+                }
+                else
+                {
+                    _pluginTiles.MarkAll();
+                }
             }
         }
+
+        // If the PostPlugin buffers were branched off, next time we can just undo what the plugins drew.
+        _fValidPluginTiles = IsFlagSet(picPositionFlags, PicPositionFlags::PrePlugin);
     }
     else
     {
@@ -438,6 +546,42 @@ void PicDrawManager::_RedrawBuffers(ViewPort *pState, PicScreenFlags screenFlags
     _fValidScreens = screenFlags;
 }
 
+//
+// Gets the PostPlugin buffers back to how they were before the plugins drew on them, by copying back only the tiles
+// that the plugins touched. This avoids a full copy of each screen for every mouse move in the pic editor.
+//
+bool PicDrawManager::_RestorePluginTiles()
+{
+    // Make sure the PostPlugin buffers really are separate copies.
+    for (int screenIndex = 0; screenIndex < 4; screenIndex++)
+    {
+        PicScreen screen = (PicScreen)screenIndex;
+        uint8_t *prev = GetScreenData(screen, PicPosition::PrePlugin);
+        uint8_t *cur = GetScreenData(screen, PicPosition::PostPlugin);
+        if (prev && (!cur || (cur == prev)))
+        {
+            return false;
+        }
+    }
+
+    _viewPorts[(int)PicPosition::PostPlugin] = _viewPorts[(int)PicPosition::PrePlugin];
+    for (int screenIndex = 0; screenIndex < 4; screenIndex++)
+    {
+        PicScreen screen = (PicScreen)screenIndex;
+        uint8_t *prev = GetScreenData(screen, PicPosition::PrePlugin);
+        if (prev)
+        {
+            _pluginTiles.CopyTiles(GetScreenData(screen, PicPosition::PostPlugin), prev);
+        }
+        else
+        {
+            // This screen is no longer needed.
+            _ReturnOldBufferIfNotUsedAnywhere(screen, PicPosition::PostPlugin);
+        }
+    }
+    return true;
+}
+
 void PicDrawManager::_ReturnOldBufferIfNotUsedAnywhere(PicPosition pos)
 {
     for (int screenIndex = 0; screenIndex < 4; screenIndex++)
@@ -459,7 +603,7 @@ void PicDrawManager::_ReturnOldBufferIfNotUsedAnywhere(PicScreen screen, PicPosi
     }
     if (!usedElsewhere)
     {
-        _bufferPool->FreeBuffer(buffer);
+        _FreeBuffer(buffer);
     }
     SetScreenData(screen, pos, nullptr);
 }
@@ -485,7 +629,7 @@ void PicDrawManager::_MoveToNextStep(PicPositionFlags requestedFlags, PicPositio
             // Otherwise just assign pointers.
             if (IsFlagSet(requestedFlags, posFlagsCompleted))
             {
-                SetScreenData(screen, nextPos, _bufferPool->AllocateBuffer());
+                SetScreenData(screen, nextPos, _AllocateBuffer());
                 size16 size = _GetPicSize();
                 memcpy(GetScreenData(screen, nextPos), prev, size.cx * size.cy);
                 debugFlag = true;
@@ -683,16 +827,18 @@ ptrdiff_t PicDrawManager::PosFromPoint(int x, int y, ptrdiff_t iStart)
     size_t byteSize = size.cx * size.cy;
     // Clear out our cached bitmaps.
     PicScreenFlags dwMapsToRedraw = PicScreenFlags::None;
-    std::vector<uint8_t> pdataVisual(byteSize, 0x0f);
-    std::vector<uint8_t> pdataAux(byteSize, 0x00);
+    BufferPool::Buffer pdataVisual = BufferPool::Instance().Allocate(byteSize);
+    BufferPool::Buffer pdataAux = BufferPool::Instance().Allocate(byteSize);
+    memset(pdataVisual.get(), 0x0f, byteSize);
+    memset(pdataAux.get(), 0x00, byteSize);
     dwMapsToRedraw |= PicScreenFlags::Visual;
     PicData data =
     {
         dwMapsToRedraw,
-        &pdataVisual[0], // Visual always needs to be provided (for fill)
+        pdataVisual.get(), // Visual always needs to be provided (for fill)
         nullptr,
         nullptr,
-        &pdataAux[0], // Aux always needs to be provided (for fill)
+        pdataAux.get(), // Aux always needs to be provided (for fill)
         _isVGA,
 		_isUndithered,
         _GetPicSize(),
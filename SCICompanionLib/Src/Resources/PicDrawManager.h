@@ -20,6 +20,7 @@ struct PicData;
 struct PicComponent;
 struct PaletteComponent;
 struct Cel;
+struct sRECT;
 
 enum class PicPosition
 {
@@ -47,6 +48,31 @@ public:
     virtual bool WillDrawOnPic() = 0;
     virtual PicScreenFlags GetRequiredScreens() = 0;
     virtual PicPositionFlags GetRequiredPicPosition() = 0;
+    // The area that the last DrawOnPic drew into. Return false if it could have been anywhere.
+    virtual bool GetDrawBounds(size16 picSize, sRECT &bounds) { return false; }
+};
+
+// Keeps track of which 16x16 tiles of a pic-sized buffer have been changed.
+class PicDirtyTiles
+{
+public:
+    PicDirtyTiles() : _cxTiles(0), _cyTiles(0) {}
+
+    void Reset(size16 size);
+    size16 GetSize() const { return _size; }
+    void MarkAll();
+    void MarkRect(const sRECT &rc);
+
+    // Copies the marked tiles of src into dest (both pic-sized buffers)
+    void CopyTiles(uint8_t *dest, const uint8_t *src) const;
+
+private:
+    static const int TileSize = 16;
+
+    size16 _size;
+    int _cxTiles;
+    int _cyTiles;
+    std::vector<bool> _dirty;
 };
 
 // Holds onto the results of a pic resource being rendered.
@@ -87,6 +113,7 @@ private:
     void _Reset();
     void _Init();
     void _MoveToNextStep(PicPositionFlags requestedFlags, PicPosition posCompleted);
+    bool _RestorePluginTiles();
     ptrdiff_t _GetDrawPos() const { return _iDrawPos; }
     void _RedrawBuffers(ViewPort *pState, PicScreenFlags dwRequestedMaps, PicPositionFlags picPositionFlags, bool assertIfCausedRedraw = false);
     HBITMAP _CreateBitmap(uint8_t *pData, size16 sizePic, int cxRequest, int cyRequest, const RGBQUAD *palette, int paletteCount, SCIBitmapInfo *pbmi = nullptr, uint8_t **pBitsDest = nullptr) const;
@@ -102,11 +129,15 @@ private:
     void _ApplyVGAPalette(const PaletteComponent *pPalette);
     RGBQUAD *PicDrawManager::_GetPalette();
     void _EnsureBufferPool(size16 size);
+    uint8_t *_AllocateBuffer();
+    void _FreeBuffer(uint8_t *buffer);
 
     const PicComponent *_pPicWeak;
     RGBQUAD _paletteVGA[256];
 
-    std::unique_ptr<BufferPool<12>> _bufferPool;
+    // The buffers we've borrowed from the BufferPool. _screenBuffers point into these.
+    std::vector<BufferPool::Buffer> _buffers;
+    size_t _bufferSize;
     // These are the screens (PicPosition is the first dimension, PicScreen is the second)
     // These are not necessarily all unique. If we only need the final version, then all 3
     // will be the same.
@@ -117,6 +148,11 @@ private:
     // Are the bitmaps valid? (note, if any of these are valid, then the aux is valid too)
     PicScreenFlags _fValidScreens;
     PicPositionFlags _validPositions;
+
+    // The parts of the PostPlugin buffers that the plugins drew on. If _fValidPluginTiles, the PostPlugin buffers
+    // are their own copies, and are identical to the PrePlugin ones outside of these tiles.
+    PicDirtyTiles _pluginTiles;
+    bool _fValidPluginTiles;
     bool _fValidPalette;
     uint8_t _bPaletteNumber; // 0-3: the palette number in which to draw.
     bool _fValidState; // Is picstate valid?
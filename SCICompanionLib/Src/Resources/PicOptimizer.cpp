@@ -0,0 +1,347 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#include "stdafx.h"
+#include "Pic.h"
+#include "PicCommands.h"
+#include "PicDrawManager.h"
+#include "PicOptimizer.h"
+#include <chrono>
+
+using namespace std;
+
+namespace
+{
+    const PicScreen OptimizedScreens[] = { PicScreen::Visual, PicScreen::Priority, PicScreen::Control };
+
+    // Commands that only change the ViewPort state used for drawing.
+    bool _IsDrawStateCommand(PicCommand::CommandType type)
+    {
+        switch (type)
+        {
+            case PicCommand::SetVisual:
+            case PicCommand::SetPriority:
+            case PicCommand::SetControl:
+            case PicCommand::DisableVisual:
+            case PicCommand::DisablePriority:
+            case PicCommand::DisableControl:
+                return true;
+        }
+        return false;
+    }
+
+    // Palette commands also only change the ViewPort, and they affect what SetVisual does. We never remove them though.
+    bool _IsPaletteCommand(PicCommand::CommandType type)
+    {
+        return (type == PicCommand::SetPalette) || (type == PicCommand::SetPaletteEntry);
+    }
+
+    // The final screens, under each palette we need to check.
+    typedef vector<vector<uint8_t>> RenderedScreens;
+
+    class PicRenderer
+    {
+    public:
+        PicRenderer(const PicComponent &pic, const PaletteComponent *palette) : _pic(pic), _palette(palette)
+        {
+            _paletteCount = palette ? 1 : 4;
+        }
+
+        bool IsVGA() const { return _palette != nullptr; }
+
+        RenderedScreens Render(const vector<PicCommand> &commands) const
+        {
+            RenderedScreens screens;
+            PicComponent pic(_pic);
+            pic.commands = commands;
+            PicDrawManager pdm(&pic, _palette);
+            for (uint8_t paletteNumber = 0; paletteNumber < _paletteCount; paletteNumber++)
+            {
+                pdm.SetPalette(paletteNumber);
+                pdm.RefreshAllScreens(PicScreenFlags::Visual | PicScreenFlags::Priority | PicScreenFlags::Control, PicPositionFlags::Final);
+                for (PicScreen screen : OptimizedScreens)
+                {
+                    if ((screen != PicScreen::Control) || _pic.Traits->SupportsControlScreen)
+                    {
+                        const uint8_t *bits = pdm.GetPicBits(screen, PicPosition::Final, _pic.Size);
+                        screens.emplace_back(bits, bits + _pic.Size.cx * _pic.Size.cy);
+                    }
+                }
+            }
+            return screens;
+        }
+
+        long long TimeRender(const vector<PicCommand> &commands) const
+        {
+            PicComponent pic(_pic);
+            pic.commands = commands;
+            // Best of a few, to filter out noise.
+            long long best = (numeric_limits<long long>::max)();
+            for (int i = 0; i < 3; i++)
+            {
+                PicDrawManager pdm(&pic, _palette);
+                auto start = chrono::high_resolution_clock::now();
+                pdm.RefreshAllScreens(PicScreenFlags::Visual | PicScreenFlags::Priority | PicScreenFlags::Control, PicPositionFlags::Final);
+                auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now() - start).count();
+                best = min(best, (long long)elapsed);
+            }
+            return best;
+        }
+
+        // Draws the commands one by one, and returns which ones still have a pixel of theirs showing on
+        // the visual, priority or control screen at the end.
+        vector<bool> GetVisibleCommands(const vector<PicCommand> &commands) const
+        {
+            size_t size = _pic.Size.cx * _pic.Size.cy;
+            vector<uint8_t> buffers[4];
+            vector<uint8_t> previous[3];
+            buffers[(int)PicScreen::Visual].assign(size, IsVGA() ? 0xff : 0x0f);
+            buffers[(int)PicScreen::Priority].assign(size, 0);
+            buffers[(int)PicScreen::Control].assign(size, 0);
+            buffers[(int)PicScreen::Aux].assign(size, 0);
+            PicData data =
+            {
+                PicScreenFlags::Visual | PicScreenFlags::Priority | PicScreenFlags::Control | PicScreenFlags::Aux,
+                &buffers[(int)PicScreen::Visual][0],
+                &buffers[(int)PicScreen::Priority][0],
+                &buffers[(int)PicScreen::Control][0],
+                &buffers[(int)PicScreen::Aux][0],
+                IsVGA(),
+                false,
+                _pic.Size,
+                _pic.Traits->ContinuousPriority
+            };
+            ViewPort state(0);
+
+            // The index of the last command that changed each pixel, or -1.
+            vector<int> lastChangedBy[3];
+            for (int screen = 0; screen < 3; screen++)
+            {
+                lastChangedBy[screen].assign(size, -1);
+            }
+            for (size_t i = 0; i < commands.size(); i++)
+            {
+                if (_IsDrawStateCommand(commands[i].type) || _IsPaletteCommand(commands[i].type))
+                {
+                    // These don't touch the screens.
+                    commands[i].Draw(&data, state);
+                    continue;
+                }
+                for (int screen = 0; screen < 3; screen++)
+                {
+                    previous[screen] = buffers[screen];
+                }
+                commands[i].Draw(&data, state);
+                for (int screen = 0; screen < 3; screen++)
+                {
+                    const uint8_t *before = &previous[screen][0];
+                    const uint8_t *after = &buffers[screen][0];
+                    int *owners = &lastChangedBy[screen][0];
+                    for (size_t p = 0; p < size; p++)
+                    {
+                        if (before[p] != after[p])
+                        {
+                            owners[p] = (int)i;
+                        }
+                    }
+                }
+            }
+
+            vector<bool> visible(commands.size(), false);
+            for (int screen = 0; screen < 3; screen++)
+            {
+                for (int owner : lastChangedBy[screen])
+                {
+                    if (owner != -1)
+                    {
+                        visible[owner] = true;
+                    }
+                }
+            }
+            return visible;
+        }
+
+    private:
+        const PicComponent &_pic;
+        const PaletteComponent *_palette;
+        uint8_t _paletteCount;
+    };
+
+    vector<PicCommand> _WithoutCommands(const vector<PicCommand> &commands, const vector<bool> &remove)
+    {
+        vector<PicCommand> result;
+        result.reserve(commands.size());
+        for (size_t i = 0; i < commands.size(); i++)
+        {
+            if (!remove[i])
+            {
+                result.push_back(commands[i]);
+            }
+        }
+        return result;
+    }
+
+    size_t _GetSerializedSize(const vector<PicCommand> &commands)
+    {
+        sci::ostream serial;
+        SerializeAllCommands_SCI0_SCI1(&serial, commands, commands.size());
+        return serial.tellp();
+    }
+
+    bool _IsSameDrawState(const ViewPort &one, const ViewPort &two)
+    {
+        return (one.dwDrawEnable == two.dwDrawEnable) &&
+            (one.bPriorityValue == two.bPriorityValue) &&
+            (one.bControlValue == two.bControlValue) &&
+            EGACOLOR_EQUAL(one.egaColor, two.egaColor) &&
+            (one.bPaletteNumber == two.bPaletteNumber) &&
+            (one.bPaletteOffset == two.bPaletteOffset);
+    }
+
+    // Within each run of state commands (where nothing is drawn), removes the ones that don't affect
+    // the drawing state at the end of the run. Runs at the very end of the pic are dropped entirely.
+    void _RemoveRedundantStateCommands(const PicComponent &pic, bool isVGA, const vector<PicCommand> &commands, vector<bool> &remove)
+    {
+        // Only ContinuousPriority is looked at by the state commands.
+        PicData data = { PicScreenFlags::None, nullptr, nullptr, nullptr, nullptr, isVGA, false, pic.Size, pic.Traits->ContinuousPriority };
+        // SetVisual depends on the palette the pic is drawn with, so track the state for each of them.
+        vector<ViewPort> states;
+        for (uint8_t paletteNumber = 0; paletteNumber < (isVGA ? 1 : 4); paletteNumber++)
+        {
+            states.emplace_back(paletteNumber);
+        }
+
+        size_t i = 0;
+        while (i < commands.size())
+        {
+            if (!_IsDrawStateCommand(commands[i].type) && !_IsPaletteCommand(commands[i].type))
+            {
+                i++;
+                continue;
+            }
+
+            size_t runStart = i;
+            while ((i < commands.size()) && (_IsDrawStateCommand(commands[i].type) || _IsPaletteCommand(commands[i].type)))
+            {
+                i++;
+            }
+            size_t runEnd = i;
+
+            auto simulateRun = [&](size_t skip)
+            {
+                vector<ViewPort> result = states;
+                for (ViewPort &state : result)
+                {
+                    for (size_t j = runStart; j < runEnd; j++)
+                    {
+                        if ((j != skip) && !remove[j])
+                        {
+                            commands[j].Draw(&data, state);
+                        }
+                    }
+                }
+                return result;
+            };
+
+            vector<ViewPort> endStates = simulateRun(runEnd);
+            for (size_t j = runStart; j < runEnd; j++)
+            {
+                if (_IsDrawStateCommand(commands[j].type))
+                {
+                    if (runEnd == commands.size())
+                    {
+                        // Nothing is drawn after this.
+                        remove[j] = true;
+                    }
+                    else
+                    {
+                        vector<ViewPort> endStatesWithout = simulateRun(j);
+                        bool same = true;
+                        for (size_t s = 0; same && (s < endStates.size()); s++)
+                        {
+                            same = _IsSameDrawState(endStates[s], endStatesWithout[s]);
+                        }
+                        remove[j] = same;
+                    }
+                }
+            }
+            states = endStates;
+        }
+    }
+
+    // Tries removing the candidates in [begin, end) all at once, then splits them up if that doesn't work.
+    void _RemoveOverdrawnCommands(const PicRenderer &renderer, const RenderedScreens &reference, const vector<PicCommand> &commands,
+        const vector<size_t> &candidates, size_t begin, size_t end, vector<bool> &remove)
+    {
+        vector<bool> attempt = remove;
+        for (size_t i = begin; i < end; i++)
+        {
+            attempt[candidates[i]] = true;
+        }
+        if (renderer.Render(_WithoutCommands(commands, attempt)) == reference)
+        {
+            remove = attempt;
+        }
+        else if ((end - begin) > 1)
+        {
+            size_t middle = begin + (end - begin) / 2;
+            _RemoveOverdrawnCommands(renderer, reference, commands, candidates, begin, middle, remove);
+            _RemoveOverdrawnCommands(renderer, reference, commands, candidates, middle, end, remove);
+        }
+    }
+}
+
+bool OptimizePicCommands(const PicComponent &pic, const PaletteComponent *palette, std::vector<PicCommand> &commands, PicOptimizeStats *pStats)
+{
+    PicRenderer renderer(pic, palette);
+    RenderedScreens reference = renderer.Render(commands);
+
+    vector<bool> remove(commands.size(), false);
+    _RemoveRedundantStateCommands(pic, renderer.IsVGA(), commands, remove);
+    vector<PicCommand> optimized = _WithoutCommands(commands, remove);
+
+    vector<bool> visible = renderer.GetVisibleCommands(optimized);
+    vector<size_t> candidates;
+    for (size_t i = 0; i < optimized.size(); i++)
+    {
+        if (!visible[i] && !_IsDrawStateCommand(optimized[i].type) && !_IsPaletteCommand(optimized[i].type) &&
+            (optimized[i].type != PicCommand::SetPriorityBars))
+        {
+            candidates.push_back(i);
+        }
+    }
+    if (!candidates.empty())
+    {
+        // Later fills can depend on the pixels (and aux screen) of overdrawn commands, so each removal needs checking.
+        vector<bool> removeOverdrawn(optimized.size(), false);
+        _RemoveOverdrawnCommands(renderer, reference, optimized, candidates, 0, candidates.size(), removeOverdrawn);
+        optimized = _WithoutCommands(optimized, removeOverdrawn);
+    }
+
+    bool changed = (optimized.size() < commands.size()) && (renderer.Render(optimized) == reference);
+    if (pStats)
+    {
+        pStats->CommandsBefore = commands.size();
+        pStats->BytesBefore = _GetSerializedSize(commands);
+        pStats->DrawMicrosecondsBefore = renderer.TimeRender(commands);
+        const vector<PicCommand> &result = changed ? optimized : commands;
+        pStats->CommandsAfter = result.size();
+        pStats->BytesAfter = _GetSerializedSize(result);
+        pStats->DrawMicrosecondsAfter = renderer.TimeRender(result);
+    }
+    if (changed)
+    {
+        commands.swap(optimized);
+    }
+    return changed;
+}
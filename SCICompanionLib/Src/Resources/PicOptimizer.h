@@ -0,0 +1,41 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#pragma once
+
+// Removes commands from a pic that have no effect on the final visual, priority and control screens:
+//  - Set/Disable visual, priority and control commands that don't change the drawing state (or are
+//    superseded before anything is drawn).
+//  - Drawing commands whose pixels are all overdrawn later on.
+// The result is checked by rendering both versions with PicDrawManager (under every EGA palette), and
+// the commands are left alone if they don't match exactly.
+
+struct PicComponent;
+struct PaletteComponent;
+class PicCommand;
+
+struct PicOptimizeStats
+{
+    PicOptimizeStats() : CommandsBefore(0), CommandsAfter(0), BytesBefore(0), BytesAfter(0), DrawMicrosecondsBefore(0), DrawMicrosecondsAfter(0) {}
+
+    size_t CommandsBefore;
+    size_t CommandsAfter;
+    size_t BytesBefore;             // Size of the serialized command stream
+    size_t BytesAfter;
+    long long DrawMicrosecondsBefore;   // Time to render all screens
+    long long DrawMicrosecondsAfter;
+};
+
+// pic supplies the size and traits; commands are the ones to optimize (which need not be the pic's own).
+// Returns true if anything was removed.
+bool OptimizePicCommands(const PicComponent &pic, const PaletteComponent *palette, std::vector<PicCommand> &commands, PicOptimizeStats *pStats = nullptr);
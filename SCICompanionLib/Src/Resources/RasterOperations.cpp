@@ -63,7 +63,7 @@ void ReallocBits(
     if ((newSize != cel.size) || fForce)
     {
         size_t cItems = PaddedSize(newSize);
-        sci::array<uint8_t> newBits(cItems);
+        sci::shared_array<uint8_t> newBits(cItems);
         if (fCopy || fFill)
         {
             if (fFill)
@@ -74,7 +74,7 @@ void ReallocBits(
             if (fCopy)
             {
                 uint8_t *pBitsNew = &newBits[0];   // Access to raw data
-                uint8_t *pBits = &cel.Data[0];      // Access to old raw data
+                const uint8_t *pBits = &std::as_const(cel.Data)[0];      // Access to old raw data (without copying it)
 
                 // Copy from the old bitmap (y = 0 is at the bottom)
                 int yEnd = min(newSize.cy, cel.size.cy);
@@ -90,7 +90,7 @@ void ReallocBits(
                     {
                         uint8_t *pLineDest = pBitsNew + CX_ACTUAL(newSize.cx) * y;
                         // Careful of overflow (should be ok, views don't tend to be bigger than 256):
-                        uint8_t *pLineSrc = pBits + CX_ACTUAL(cel.size.cx) * (y * cel.size.cy / newSize.cy);
+                        const uint8_t *pLineSrc = pBits + CX_ACTUAL(cel.size.cx) * (y * cel.size.cy / newSize.cy);
                         for (int x = 0; x < newSize.cx; x++)
                         {
                             *(pLineDest + x) = *(pLineSrc + x * cel.size.cx / newSize.cx);
@@ -116,7 +116,7 @@ void ReallocBits(
                         }
                     } // Otherwise we anchor on the top left.
                     uint8_t *pDest = (dy > 0) ? (pBitsNew + dy * CX_ACTUAL(newSize.cx)) : pBitsNew;
-                    uint8_t *pSrc = (dy < 0) ? (pBits + (-dy) * CX_ACTUAL(cel.size.cx)) : pBits;
+                    const uint8_t *pSrc = (dy < 0) ? (pBits + (-dy) * CX_ACTUAL(cel.size.cx)) : pBits;
                     for (int y = 0; y < yEnd; y++)
                     {
                         CopyMemory(pDest + y * CX_ACTUAL(newSize.cx) + xDestOffset,
@@ -412,16 +412,21 @@ void SyncCelMirrorState(Cel &celMirror, const Cel &celOrig)
     celMirror.placement.x = -celOrig.placement.x; // Note that we invert x here!  It's a mirror!
     celMirror.placement.y = celOrig.placement.y;
 
-    ReallocBits(celMirror, celOrig.size, false, false, false, 0, RasterResizeFlags::Normal);
-    CopyMirrored(celMirror, celOrig);
+    // If we were already flipped from these exact pixels, there is nothing more to do.
+    if (!celMirror.MirrorSource.refers_to(celOrig.Data) || (celMirror.size != celOrig.size))
+    {
+        ReallocBits(celMirror, celOrig.size, false, false, false, 0, RasterResizeFlags::Normal);
+        CopyMirrored(celMirror, celOrig);
+        celMirror.MirrorSource = celOrig.Data;
+    }
 }
 
 const uint8_t UpdateFromMirror = 0xff;
 
 RasterChange MirrorLoopFrom(Loop &loop, uint8_t nOriginal, const Loop &orig)
 {
-    // Reallocate all cels.
-    loop.Cels.clear();
+    // Keep the existing cels around, so SyncCelMirrorState can skip the ones whose original hasn't changed.
+    loop.Cels.resize(orig.Cels.size());
     if (nOriginal != UpdateFromMirror)
     {
         loop.MirrorOf = nOriginal;
@@ -429,9 +434,6 @@ RasterChange MirrorLoopFrom(Loop &loop, uint8_t nOriginal, const Loop &orig)
     }
     for (size_t i = 0; i < orig.Cels.size(); i++)
     {
-        // Make new empty cels, and for each one, do a "sync mirror state" if the original.
-        loop.Cels.push_back(Cel());
-        assert(loop.Cels.size() == (i + 1));
         SyncCelMirrorState(loop.Cels[i], orig.Cels[i]);
     }
     return RasterChange(RasterChangeHint::NewView);
@@ -1084,14 +1086,22 @@ RasterChange RemoveCel(RasterComponent &raster, CelIndex celIndex)
 
 void SerializeCelRuntime(sci::ostream &out, const Cel &cel)
 {
-    out << cel;
+    // Cel holds reference-counted pixel buffers, so we can't just write out its raw bytes.
+    out << cel.size;
+    out << cel.placement;
+    out << cel.TransparentColor;
+    out << (uint8_t)(cel.Stride32 ? 1 : 0);
     out.WriteBytes(&cel.Data[0], PaddedSize(cel.size));
 }
 void DeserializeCelRuntime(sci::istream &in, Cel &cel)
 {
     assert(cel.Data.empty());
-    in >> cel;
-    memset(&cel.Data, 0, sizeof(cel.Data)); // A bit of a hack
+    uint8_t stride32;
+    in >> cel.size;
+    in >> cel.placement;
+    in >> cel.TransparentColor;
+    in >> stride32;
+    cel.Stride32 = (stride32 != 0);
     cel.Data.allocate(PaddedSize(cel.size));
     in.read_data(&cel.Data[0], cel.Data.size());
 }
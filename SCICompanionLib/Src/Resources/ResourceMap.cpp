@@ -43,6 +43,7 @@
 #include "ResourceUtil.h"
 #include "BaseWindowsUtil.h"
 #include "ResourceSourceImpls.h"
+#include "AudioCacheResourceSource.h"
 
 using namespace std;
 
@@ -346,15 +347,19 @@ void CResourceMap::PokeResourceMapReloaded()
     });
 }
  
-void CResourceMap::RepackageAudio(bool force)
+void CResourceMap::RepackageAudio(bool force, IAudioRebuildProgress *progress, AudioRebuildStats *stats)
 {
     // Rebuild any out-of-date audio resources. This should nearly be a no-op if none are out of data.
-    // TODO: This could be slow, so provide some kind of UI feedback?
     if (GetSCIVersion().AudioVolumeName != AudioVolumeName::None)
     {
-        std::map<ResourceType, RebuildStats> stats;
-        std::unique_ptr<ResourceSource> resourceSource = CreateResourceSource(_version, ResourceTypeFlags::All, _gameFolderHelper, ResourceSourceFlags::AudioCache);
-        resourceSource->RebuildResources(force, *resourceSource, stats);
+        std::map<ResourceType, RebuildStats> rebuildStats;
+        AudioCacheResourceSource resourceSource(this, _gameFolderHelper, -1, ResourceSourceAccessFlags::Read);
+        resourceSource.SetRebuildProgress(progress);
+        resourceSource.RebuildResources(force, resourceSource, rebuildStats);
+        if (stats)
+        {
+            *stats = resourceSource.GetRebuildStats();
+        }
     }
 }
 
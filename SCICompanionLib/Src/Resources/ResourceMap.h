@@ -35,6 +35,8 @@ class ResourceRecency;
 class ResourceEntity;
 class GlobalCompiledScriptLookups;
 class IResourceMapEvents;
+class IAudioRebuildProgress;
+struct AudioRebuildStats;
 enum class ResourceSaveLocation : uint16_t;
 
 //
@@ -131,7 +133,7 @@ public:
 
     void PokeResourceMapReloaded();
 
-    void RepackageAudio(bool force = false);
+    void RepackageAudio(bool force = false, IAudioRebuildProgress *progress = nullptr, AudioRebuildStats *stats = nullptr);
 
 private:
     void _SniffGameLanguage();
@@ -32,16 +32,108 @@
 
 using namespace std;
 
-static ViewFormat _DetectViewVGAVersion(const ResourceLoader& resource_loader, const SCIVersion& version)
+namespace
+{
+    // Views whose headers we look at to figure out the compression and view formats. Each one we look at
+    // may need to be decompressed several ways, so we stop at a handful. Ten is what detection has always
+    // used: enough that a few unusual views (uncompressed, or from a different version) don't decide it.
+    const size_t ViewsToExamine = 10;
+
+    // What we learn from a single walk over the game's resource map (patch files excluded). We only hang onto
+    // iterators here, since dereferencing them decompresses resources, and we don't know the compression
+    // format yet.
+    struct ResourceMapEvidence
+    {
+        ResourceMapEvidence() : HasHeap(false), HasMessage(false), HasPalette(false) {}
+
+        bool HasHeap;
+        bool HasMessage;
+        bool HasPalette;
+        std::vector<ResourceContainer::ResourceIterator> Views;     // Only the first ViewsToExamine
+        std::vector<ResourceContainer::ResourceIterator> Pics;      // Only the first
+        std::vector<ResourceContainer::ResourceIterator> Scripts;
+        std::set<int> Vocabs;
+    };
+
+    // Loading the global class table means loading every script in the game, so the sound and kernel
+    // probes share one.
+    class DetectionScriptLookups
+    {
+    public:
+        DetectionScriptLookups(const ResourceLoader &resourceLoader) : _resourceLoader(resourceLoader), _attempted(false), _loaded(false) {}
+
+        GlobalCompiledScriptLookups *Get(const SCIVersion &version)
+        {
+            if (!_attempted)
+            {
+                _attempted = true;
+                try
+                {
+                    _loaded = _lookups.Load(version, _resourceLoader);
+                }
+                catch (std::exception)
+                {
+                }
+            }
+            return _loaded ? &_lookups : nullptr;
+        }
+
+    private:
+        const ResourceLoader &_resourceLoader;
+        GlobalCompiledScriptLookups _lookups;
+        bool _attempted;
+        bool _loaded;
+    };
+}
+
+static void _GatherResourceMapEvidence(ResourceContainer &container, ResourceMapEvidence &evidence)
+{
+    for (auto blobIt = container.begin(); blobIt != container.end(); ++blobIt)
+    {
+        ResourceId resourceId = blobIt.GetResourceId();
+        switch (resourceId.GetType())
+        {
+            case ResourceType::Heap:
+                evidence.HasHeap = true;
+                break;
+            case ResourceType::Message:
+                evidence.HasMessage = true;
+                break;
+            case ResourceType::Palette:
+                evidence.HasPalette = true;
+                break;
+            case ResourceType::View:
+                if (evidence.Views.size() < ViewsToExamine)
+                {
+                    evidence.Views.push_back(blobIt);
+                }
+                break;
+            case ResourceType::Pic:
+                if (evidence.Pics.empty())
+                {
+                    evidence.Pics.push_back(blobIt);
+                }
+                break;
+            case ResourceType::Script:
+                evidence.Scripts.push_back(blobIt);
+                break;
+            case ResourceType::Vocab:
+                evidence.Vocabs.insert(resourceId.GetNumber());
+                break;
+        }
+    }
+}
+
+static ViewFormat _DetectViewVGAVersion(const std::vector<ResourceContainer::ResourceIterator> &views, const SCIVersion& version)
 {
     ViewFormat viewFormat = version.ViewFormat;
     // Enclose this in a try/catch block, as we need to be robust here.
     try
     {
         int remainingToCheck = 5;
-        auto viewContainer = resource_loader.Resources(version, ResourceTypeFlags::View, ResourceEnumFlags::MostRecentOnly | ResourceEnumFlags::ExcludePatchFiles);
-        for (auto &blob : *viewContainer)
+        for (auto &viewIt : views)
         {
+            std::unique_ptr<ResourceBlob> blob = viewIt.CreateForVersion(version);
             sci::istream stream = blob->GetReadStream();
             if (stream.GetDataSize() >= 16)
             {
@@ -165,14 +257,13 @@ ResourcePackageFormat _DetectPackageFormat(const GameFolderHelper &helper, Resou
     return packageFormat;
 }
 
-static bool _HasEarlySCI0Scripts(const GameFolderHelper &helper, const SCIVersion& currentVersion)
+static bool _HasEarlySCI0Scripts(const ResourceBlob *script0)
 {
     bool hasEarly = false;
     // Look at script 0
-    std::unique_ptr<ResourceBlob> data = helper.MostRecentResource(currentVersion, ResourceId(ResourceType::Script, ResourceNum::FromNumber(0)), ResourceEnumFlags::AddInDefaultEnumFlags);
-    if (data)
+    if (script0)
     {
-        sci::istream byteStream = data->GetReadStream();
+        sci::istream byteStream = script0->GetReadStream();
         uint32_t offset = 2;
         while (byteStream.GetDataSize() > offset)
         {
@@ -206,63 +297,69 @@ static bool _HasEarlySCI0Scripts(const GameFolderHelper &helper, const SCIVersio
     return hasEarly;
 }
 
-std::optional<SoundFormat> _DetectSoundType(const ResourceLoader& resource_loader, const SCIVersion& currentVersion)
+// Runs analyzeInstruction over the code in Sound::play. Returns false if we couldn't find it.
+template<typename _TAnalyze>
+static bool _InspectSoundPlay(GlobalCompiledScriptLookups &scriptLookups, _TAnalyze analyzeInstruction)
+{
+    uint16_t species;
+    if (scriptLookups.GetGlobalClassTable().LookupSpeciesCompiledName("Sound", species))
+    {
+        uint16_t soundScript;
+        if (scriptLookups.GetGlobalClassTable().GetSpeciesScriptNumber(species, soundScript))
+        {
+            std::vector<CompiledScript*> allScripts = scriptLookups.GetGlobalClassTable().GetAllScripts();
+            for (auto compiledScript : allScripts)
+            {
+                if (compiledScript->GetScriptNumber() == soundScript)
+                {
+                    InspectScriptCode(*compiledScript, &scriptLookups, "Sound", "play", analyzeInstruction);
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+static std::optional<SoundFormat> _DetectSoundType(DetectionScriptLookups &lookups, const SCIVersion& currentVersion)
 {
     // We'll mirror (a slightly simplified version of) what ScummVM does here, which
     // is to look for certain kernel calls in sound::play
-    // First, we need to find where the Sound object lives.
     try
     {
-        GlobalCompiledScriptLookups scriptLookups;
-        if (scriptLookups.Load(currentVersion, resource_loader))
+        GlobalCompiledScriptLookups *scriptLookups = lookups.Get(currentVersion);
+        if (scriptLookups)
         {
-            uint16_t species;
-            if (scriptLookups.GetGlobalClassTable().LookupSpeciesCompiledName("Sound", species))
+            SoundFormat soundFormat = SoundFormat::SCI0;
+            uint16_t pushiParam = 0;
+            if (_InspectSoundPlay(*scriptLookups,
+                [&pushiParam, &soundFormat](Opcode opcode, const uint16_t *operands, uint16_t currentPCOffset)
             {
-                uint16_t soundScript;
-                if (scriptLookups.GetGlobalClassTable().GetSpeciesScriptNumber(species, soundScript))
+                if (opcode == Opcode::PUSHI)
                 {
-                    std::vector<CompiledScript*> allScripts = scriptLookups.GetGlobalClassTable().GetAllScripts();
-                    for (auto compiledScript : allScripts)
+                    pushiParam = operands[0];
+                }
+                else if (opcode == Opcode::CALLK)
+                {
+                    uint16_t kernelIndex = operands[0];
+                    if (kernelIndex == 45) // DoSound (SCI1)
                     {
-                        if (compiledScript->GetScriptNumber() == soundScript)
+                        if (pushiParam == 1)
+                        {
+                            soundFormat = SoundFormat::SCI0;
+                        }
+                        else
                         {
-                            SoundFormat soundFormat = SoundFormat::SCI0;
-                            uint16_t pushiParam = 0;
-                            bool foundTarget = false;
-                            InspectScriptCode(*compiledScript,
-                                &scriptLookups,
-                                "Sound",
-                                "play",
-                                [&pushiParam, &foundTarget, &soundFormat](Opcode opcode, const uint16_t *operands, uint16_t currentPCOffset)
-                            {
-                                if (opcode == Opcode::PUSHI)
-                                {
-                                    pushiParam = operands[0];
-                                }
-                                else if (opcode == Opcode::CALLK)
-                                {
-                                    uint16_t kernelIndex = operands[0];
-                                    if (kernelIndex == 45) // DoSound (SCI1)
-                                    {
-                                        if (pushiParam == 1)
-                                        {
-                                            soundFormat = SoundFormat::SCI0;
-                                        }
-                                        else
-                                        {
-                                            soundFormat = SoundFormat::SCI1;
-                                        }
-                                        return false; // Done
-                                    }
-                                }
-                                return true; // To keep going.
-                            }
-                            );
-                            return soundFormat;
+                            soundFormat = SoundFormat::SCI1;
                         }
+                        return false; // Done
                     }
                 }
+                return true; // To keep going.
+            }
+            ))
+            {
+                return soundFormat;
             }
         }
     }
@@ -272,7 +369,7 @@ std::optional<SoundFormat> _DetectSoundType(const ResourceLoader& resource_loade
     return std::nullopt;
 }
 
-KernelSet _DetectKernelSet(const ResourceLoader& resource_loader, const SCIVersion& currentVersion)
+static KernelSet _DetectKernelSet(DetectionScriptLookups &lookups, const ResourceMapEvidence &evidence, const SCIVersion& currentVersion)
 {
     KernelSet kernelSet = KernelSet::Provided;
     if (currentVersion.PackageFormat >= ResourcePackageFormat::SCI2)
@@ -282,51 +379,30 @@ KernelSet _DetectKernelSet(const ResourceLoader& resource_loader, const SCIVersi
 
         // Figure out SCI2 kernel is being used. We'll mirror what ScummVM does here, which
         // is to look for the kernel call in Sound::play().
-        // First, we need to find where the Sound object lives.
         try
         {
-            GlobalCompiledScriptLookups scriptLookups;
-            if (scriptLookups.Load(currentVersion, resource_loader))
+            GlobalCompiledScriptLookups *scriptLookups = lookups.Get(currentVersion);
+            if (scriptLookups)
             {
-                uint16_t species;
-                if (scriptLookups.GetGlobalClassTable().LookupSpeciesCompiledName("Sound", species))
+                _InspectSoundPlay(*scriptLookups,
+                    [&kernelSet](Opcode opcode, const uint16_t *operands, uint16_t currentPCOffset)
                 {
-                    uint16_t soundScript;
-                    if (scriptLookups.GetGlobalClassTable().GetSpeciesScriptNumber(species, soundScript))
+                    if (opcode == Opcode::CALLK)
                     {
-                        std::vector<CompiledScript*> allScripts = scriptLookups.GetGlobalClassTable().GetAllScripts();
-                        for (auto compiledScript : allScripts)
+                        if (operands[0] == 0x40)
+                        {
+                            kernelSet = KernelSet::SCI2;
+                            return false;
+                        }
+                        else if (operands[0] == 0x75)
                         {
-                            if (compiledScript->GetScriptNumber() == soundScript)
-                            {
-                                InspectScriptCode(*compiledScript,
-                                    &scriptLookups,
-                                    "Sound",
-                                    "play",
-                                    [&kernelSet](Opcode opcode, const uint16_t *operands, uint16_t currentPCOffset)
-                                {
-                                    if (opcode == Opcode::CALLK)
-                                    {
-                                        if (operands[0] == 0x40)
-                                        {
-                                            kernelSet = KernelSet::SCI2;
-                                            return false;
-                                        }
-                                        else if (operands[0] == 0x75)
-                                        {
-                                            kernelSet = KernelSet::SCI21;
-                                            return false;
-                                        }
-                                    }
-                                    return true;
-                                }
-                                    );
-
-                                break;
-                            }
+                            kernelSet = KernelSet::SCI21;
+                            return false;
                         }
                     }
+                    return true;
                 }
+                );
             }
         }
         catch (std::exception)
@@ -334,7 +410,7 @@ KernelSet _DetectKernelSet(const ResourceLoader& resource_loader, const SCIVersi
     }
     else
     {
-        if (resource_loader.DoesResourceExist(currentVersion, ResourceId::Create(ResourceType::Vocab, VocabKernelNames), nullptr, ResourceSaveLocation::Package))
+        if (evidence.Vocabs.find(VocabKernelNames) != evidence.Vocabs.end())
         {
             // The kernels are listed in a vocab resource (typical for SCI0).
             kernelSet = KernelSet::Provided;
@@ -494,19 +570,21 @@ enum LofsaType
     Relative
 };
 
-bool _DetectLofsaFormat(const GameFolderHelper &helper, const SCIVersion& currentVersion)
+bool _DetectLofsaFormat(const GameFolderHelper &helper, std::vector<ResourceContainer::ResourceIterator> &scripts, const SCIVersion& currentVersion)
 {
     LofsaType lofsaType = LofsaType::Unknown;
 
     // Don't load exports, because loading the export table depends on lofsaAbsolute being correct (IsExportWide).
     GlobalCompiledScriptLookups scriptLookups;
 
-    auto scriptContainer = helper.Resources(currentVersion, ResourceTypeFlags::Script, ResourceEnumFlags::MostRecentOnly | ResourceEnumFlags::ExcludePatchFiles);
     bool continueSearch = true;
-    for (auto &blobIt = scriptContainer->begin(); continueSearch && (blobIt != scriptContainer->end()); ++blobIt)
+    for (auto blobIt = scripts.begin(); continueSearch && (blobIt != scripts.end()); ++blobIt)
     {
-        CompiledScript compiledScript(blobIt.GetResourceNumber(), CompiledScriptFlags::DontLoadExports);
-        if (compiledScript.Load(helper, currentVersion, blobIt.GetResourceNumber(), (*blobIt)->GetReadStream()))
+        int scriptNumber = blobIt->GetResourceNumber();
+        CompiledScript compiledScript(scriptNumber, CompiledScriptFlags::DontLoadExports);
+        std::unique_ptr<ResourceBlob> blob = blobIt->CreateForVersion(currentVersion);
+        sci::istream scriptStream = blob->GetReadStream();
+        if (compiledScript.Load(helper, currentVersion, scriptNumber, scriptStream))
         {
             continueSearch = InspectScriptCode(
                 compiledScript,
@@ -561,7 +639,7 @@ bool _DetectLofsaFormat(const GameFolderHelper &helper, const SCIVersion& curren
     return lofsaAbsolute;
 }
 
-bool _DetectIsExportWide(const GameFolderHelper &helper, const SCIVersion& currentVersion)
+bool _DetectIsExportWide(const ResourceBlob *script0, const SCIVersion& currentVersion)
 {
     // This use to be SCI0_LayoutSCI1, but LSL1-VGA was incorrectly detected as non-wide exports.
     if (currentVersion.MapFormat <= ResourceMapFormat::SCI0)
@@ -574,16 +652,138 @@ bool _DetectIsExportWide(const GameFolderHelper &helper, const SCIVersion& curre
     }
     // Now we're left with the middle ones, which sometimes were 32-bit.
     bool isWide = false;
-    auto blob = helper.MostRecentResource(currentVersion, ResourceId(ResourceType::Script, ResourceNum::FromNumber(0)), ResourceEnumFlags::AddInDefaultEnumFlags);
-    if (blob)
+    if (script0)
     {
-        sci::istream byteStream = blob->GetReadStream();
+        sci::istream byteStream = script0->GetReadStream();
         isWide = CompiledScript::DetectIfExportsAreWide(currentVersion, byteStream);
     }
     return isWide;
 }
 
-SCIVersion SniffSCIVersion(const GameFolderHelper& helper)
+// The detected version is cached in the game's per-user cache folder (not the game folder itself), keyed by a
+// fingerprint of the files detection looks at. Bump SCIVersionCacheFormat if the detection logic or SCIVersion changes.
+const char SCIVersionCacheFilename[] = "version.cache";
+const uint32_t SCIVersionCacheMagic = 0x52455643; // CVER
+const uint32_t SCIVersionCacheFormat = 1;
+
+#include <pshpack1.h>
+struct SCIVersionCacheHeader
+{
+    uint32_t magic;
+    uint32_t format;
+    uint32_t versionSize;
+    uint64_t fingerprint;
+};
+#include <poppack.h>
+
+static bool _IsVersionCacheIgnoredFile(const std::string &filename)
+{
+    // Files that we write ourselves, or that detection doesn't depend on.
+    const char *ignoredExtensions[] = { ".cache", ".tmp", ".bak", ".ini" };
+    for (const char *extension : ignoredExtensions)
+    {
+        size_t length = strlen(extension);
+        if ((filename.length() >= length) && (filename.compare(filename.length() - length, length, extension) == 0))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Hashes the name, size and timestamp of the files in the game folder (resource.map, the volumes, message maps,
+// audio volumes and patch files). Listing the folder is much cheaper than opening the game's resources.
+static uint64_t _GetVersionFingerprint(const std::string &gameFolder)
+{
+    std::vector<std::pair<std::string, uint64_t>> files;
+    WIN32_FIND_DATA findData = { 0 };
+    HANDLE hFFF = FindFirstFile((gameFolder + "\\*").c_str(), &findData);
+    if (hFFF != INVALID_HANDLE_VALUE)
+    {
+        BOOL fOk = TRUE;
+        while (fOk)
+        {
+            if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            {
+                std::string filename = findData.cFileName;
+                std::transform(filename.begin(), filename.end(), filename.begin(), ::tolower);
+                if (!_IsVersionCacheIgnoredFile(filename))
+                {
+                    uint64_t size = ((uint64_t)findData.nFileSizeHigh << 32) | findData.nFileSizeLow;
+                    uint64_t writeTime = ((uint64_t)findData.ftLastWriteTime.dwHighDateTime << 32) | findData.ftLastWriteTime.dwLowDateTime;
+                    files.emplace_back(filename, size ^ (writeTime * 31));
+                }
+            }
+            fOk = FindNextFile(hFFF, &findData);
+        }
+        FindClose(hFFF);
+    }
+    // The order FindNextFile returns them in isn't guaranteed.
+    std::sort(files.begin(), files.end());
+
+    // 64-bit FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto addBytes = [&hash](const void *data, size_t size)
+    {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ULL;
+        }
+    };
+    addBytes(&SCIVersionCacheFormat, sizeof(SCIVersionCacheFormat));
+    for (auto &file : files)
+    {
+        addBytes(file.first.c_str(), file.first.length() + 1);
+        addBytes(&file.second, sizeof(file.second));
+    }
+    return hash;
+}
+
+static bool _TryReadVersionCache(const std::string &cacheFilename, uint64_t fingerprint, SCIVersion &version)
+{
+    bool found = false;
+    if (PathFileExists(cacheFilename.c_str()))
+    {
+        try
+        {
+            sci::istream stream = sci::istream::ReadFromFile(cacheFilename);
+            SCIVersionCacheHeader header;
+            stream >> header;
+            if (stream.IsGood() &&
+                (header.magic == SCIVersionCacheMagic) &&
+                (header.format == SCIVersionCacheFormat) &&
+                (header.versionSize == sizeof(SCIVersion)) &&
+                (header.fingerprint == fingerprint) &&
+                (stream.GetBytesRemaining() >= sizeof(SCIVersion)))
+            {
+                stream.read_data(reinterpret_cast<uint8_t*>(&version), sizeof(SCIVersion));
+                found = stream.IsGood();
+            }
+        }
+        catch (std::exception)
+        {
+        }
+    }
+    return found;
+}
+
+static void _WriteVersionCache(const std::string &cacheFilename, uint64_t fingerprint, const SCIVersion &version)
+{
+    SCIVersionCacheHeader header = { SCIVersionCacheMagic, SCIVersionCacheFormat, sizeof(SCIVersion), fingerprint };
+    sci::ostream out;
+    out << header;
+    out.WriteBytes(reinterpret_cast<const uint8_t*>(&version), sizeof(SCIVersion));
+    // If this fails, we'll just detect again next time.
+    std::ofstream file(cacheFilename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (file.is_open())
+    {
+        file.write(reinterpret_cast<const char*>(out.GetInternalPointer()), out.GetDataSize());
+    }
+}
+
+static SCIVersion _DetectSCIVersion(const GameFolderHelper& helper)
 {
     SCIVersion result;
     // Just as a start...
@@ -647,17 +847,23 @@ SCIVersion SniffSCIVersion(const GameFolderHelper& helper)
     FileDescriptorResourceMap resourceMapFileDescriptor(helper.GetGameFolder());
     result.DefaultVolumeFile = resourceMapFileDescriptor.DoesVolumeExist(0) ? 0 : 1;
 
+    // Now that we've determined a resource map format, we can walk through it. We do that just once, and note down
+    // everything we need. Messages only matter if they aren't in a separate message map.
+    ResourceTypeFlags evidenceTypes = ResourceTypeFlags::Heap | ResourceTypeFlags::Palette | ResourceTypeFlags::View | ResourceTypeFlags::Pic | ResourceTypeFlags::Script | ResourceTypeFlags::Vocab;
+    if (result.MessageMapSource == MessageMapSource::Included)
+    {
+        evidenceTypes |= ResourceTypeFlags::Message;
+    }
+    auto evidenceContainer = helper.Resources(result, evidenceTypes, ResourceEnumFlags::MostRecentOnly | ResourceEnumFlags::ExcludePatchFiles);
+    ResourceMapEvidence evidence;
+    _GatherResourceMapEvidence(*evidenceContainer, evidence);
+
     // See if this is a version that uses hep files
     // (this may always correspond to ResourceMapFormat::SCI11, but I'm not positive)
     // Nope! PQ1-VGA is ResourceMapFormat::SCI1, but has separate heap resources.
     if (result.MapFormat >= ResourceMapFormat::SCI1)
     {
-        auto hepContainer = helper.Resources(result, ResourceTypeFlags::Heap, ResourceEnumFlags::MostRecentOnly | ResourceEnumFlags::ExcludePatchFiles);
-        for (auto blobIt = hepContainer->begin(); blobIt != hepContainer->end(); ++blobIt)
-        {
-            result.SeparateHeapResources = true;
-            break;
-        }
+        result.SeparateHeapResources = evidence.HasHeap;
     }
 
     // More about messages...
@@ -665,46 +871,28 @@ SCIVersion SniffSCIVersion(const GameFolderHelper& helper)
     if (result.MessageMapSource == MessageMapSource::Included)
     {
         // Still might support messages... PQ1VGA... well actually, that has a separate message.map file. But... still possible.
-        if (result.MapFormat >= ResourceMapFormat::SCI1)
+        if ((result.MapFormat >= ResourceMapFormat::SCI1) && evidence.HasMessage)
         {
-            auto msgContainer = helper.Resources(result, ResourceTypeFlags::Message, ResourceEnumFlags::MostRecentOnly | ResourceEnumFlags::ExcludePatchFiles);
-            for (auto &blobIt = msgContainer->begin(); blobIt != msgContainer->end(); ++blobIt)
-            {
-                result.SupportsMessages = true;
-                break;
-            }
+            result.SupportsMessages = true;
         }
     }
 
-
-
-    // Now that we've determined a resource map format, we can iterate through them.
-    // Now see if we can load a palette. If so, then we'll assume we have VGA pics and views
-    auto paletteContainer = helper.Resources(result, ResourceTypeFlags::Palette, ResourceEnumFlags::MostRecentOnly | ResourceEnumFlags::ExcludePatchFiles);
-    // I use a for loop (instead of ranged for), because I don't want to dereference the iterator until needed
-    // Dereferencing the iterator will decompress the resource, which we don't want yet (since we're not sure
-    // of our decompression)
-    for (auto blobIt = paletteContainer->begin(); blobIt != paletteContainer->end(); ++blobIt)
-    {
-        result.HasPalette = true;
-        break;
-    }
+    // If we can load a palette, then we'll assume we have VGA pics and views
+    result.HasPalette = evidence.HasPalette;
 
     // Let's test the first few views for compression format. If any of them use formats > 2, then
     // we know this is not SCI0 compression formats.
     // If any of them are huffman, this is probably an "early SCI1" EGA game but which uses the newer compression formats.
-    int remainingToCheck = 10;
-    auto viewContainer = helper.Resources(result, ResourceTypeFlags::View, ResourceEnumFlags::MostRecentOnly | ResourceEnumFlags::ExcludePatchFiles);
-    for (auto blobIt = viewContainer->begin(); remainingToCheck && (blobIt != viewContainer->end()); ++blobIt)
+    // This only reads the resource headers, since we're not sure of our decompression yet.
+    for (auto &viewIt : evidence.Views)
     {
-        if (blobIt.GetResourceHeader().CompressionMethod >= 2)
+        if (viewIt.GetResourceHeader().CompressionMethod >= 2)
         {
             // Though 2 is a valid compression method for CompressionFormat::SCI0, it is apparently not
             // used with views.
             result.CompressionFormat = CompressionFormat::SCI1;
             break;
         }
-        remainingToCheck--;
     }
 
     // Prescence of a palette does not necessarily indicate a VGA game. Some SCI1 EGA games have palettes left in them from their conversion from VGA.
@@ -715,9 +903,9 @@ SCIVersion SniffSCIVersion(const GameFolderHelper& helper)
         bool mustBeVGA = (result.MapFormat >= ResourceMapFormat::SCI11) || result.SeparateHeapResources;
         if (!mustBeVGA)
         {
-            auto viewContainer = helper.Resources(result, ResourceTypeFlags::View, ResourceEnumFlags::MostRecentOnly | ResourceEnumFlags::ExcludePatchFiles);
-            for (auto &view : *viewContainer)
+            for (auto &viewIt : evidence.Views)
             {
+                std::unique_ptr<ResourceBlob> view = viewIt.CreateForVersion(result);
                 if (view->GetDecompressedLength() >= 2)
                 {
                     uint8_t secondByte = view->GetData()[1];
@@ -753,7 +941,7 @@ SCIVersion SniffSCIVersion(const GameFolderHelper& helper)
         }
         else
         {
-            result.ViewFormat = _DetectViewVGAVersion(helper.GetResourceLoader(), result);
+            result.ViewFormat = _DetectViewVGAVersion(evidence.Views, result);
         }
 
         // ASSUMPTION: All VGA games uses SCI1 sound.
@@ -776,19 +964,15 @@ SCIVersion SniffSCIVersion(const GameFolderHelper& helper)
     result.GrayScaleCursors = (result.ViewFormat == ViewFormat::EGA) ? false : true;
 
     // As long as not EGA, detect picture format. Look at the first picture and see if it starts with 0x0026 (header size)
-    if (result.PicFormat != PicFormat::EGA)
+    if ((result.PicFormat != PicFormat::EGA) && !evidence.Pics.empty())
     {
-        auto picContainer = helper.Resources(result, ResourceTypeFlags::Pic, ResourceEnumFlags::MostRecentOnly | ResourceEnumFlags::ExcludePatchFiles);
-        for (auto &pic : *picContainer)
+        std::unique_ptr<ResourceBlob> pic = evidence.Pics[0].CreateForVersion(result);
+        sci::istream stream = pic->GetReadStream();
+        uint16_t headerSize;
+        stream >> headerSize;
+        if (headerSize == 0x26)
         {
-            sci::istream stream = pic->GetReadStream();
-            uint16_t headerSize;
-            stream >> headerSize;
-            if (headerSize == 0x26)
-            {
-                result.PicFormat = PicFormat::VGA1_1;
-            }
-            break;
+            result.PicFormat = PicFormat::VGA1_1;
         }
     }
 
@@ -811,18 +995,26 @@ SCIVersion SniffSCIVersion(const GameFolderHelper& helper)
     }
     else
     {
-        result.lofsaOpcodeIsAbsolute = _DetectLofsaFormat(helper, result);
+        result.lofsaOpcodeIsAbsolute = _DetectLofsaFormat(helper, evidence.Scripts, result);
     }
 
-    result.IsExportWide = _DetectIsExportWide(helper, result);
+    // Script 0 (which may be a patch file) tells us about exports and early SCI0 script headers.
+    std::unique_ptr<ResourceBlob> script0 = helper.MostRecentResource(result, ResourceId(ResourceType::Script, ResourceNum::FromNumber(0)), ResourceEnumFlags::AddInDefaultEnumFlags);
+    result.IsExportWide = _DetectIsExportWide(script0.get(), result);
 
     // Which is the parser vocab? If resource 0 is present it's 0. Otherwise it's 900 (or none).
-    result.MainVocabResource = (helper.MostRecentResource(result, ResourceId::Create(ResourceType::Vocab, 0), ResourceEnumFlags::AddInDefaultEnumFlags)) ? 0 : 900;
-    result.HasSaidVocab = helper.DoesResourceExist(result, ResourceId::Create(ResourceType::Vocab, result.MainVocabResource), nullptr, ResourceSaveLocation::Package);
+    bool hasVocab0 = (evidence.Vocabs.find(0) != evidence.Vocabs.end());
+    if (!hasVocab0)
+    {
+        // It might be a patch file.
+        hasVocab0 = (helper.MostRecentResource(result, ResourceId::Create(ResourceType::Vocab, 0), ResourceEnumFlags::AddInDefaultEnumFlags) != nullptr);
+    }
+    result.MainVocabResource = hasVocab0 ? 0 : 900;
+    result.HasSaidVocab = (evidence.Vocabs.find(result.MainVocabResource) != evidence.Vocabs.end());
 
     if (result.MapFormat == ResourceMapFormat::SCI0)
     {
-        result.HasOldSCI0ScriptHeader = _HasEarlySCI0Scripts(helper, result);
+        result.HasOldSCI0ScriptHeader = _HasEarlySCI0Scripts(script0.get());
     }
 
     // Not sure about this, but it seems reasonable. Another clue, I think, is if there is more than just one global palette.
@@ -897,21 +1089,17 @@ SCIVersion SniffSCIVersion(const GameFolderHelper& helper)
     }
 
     // Detect resolution (SCI2 and above only... this is an expensive test, since we need to decompress views)
-    if (result.PackageFormat >= ResourcePackageFormat::SCI2)
+    if ((result.PackageFormat >= ResourcePackageFormat::SCI2) && !evidence.Views.empty())
     {
         // For SCI2 and above package formats.
         try
         {
-            auto viewContainer = helper.Resources(result, ResourceTypeFlags::View, ResourceEnumFlags::MostRecentOnly | ResourceEnumFlags::ExcludePatchFiles);
-            for (auto &viewBlob : *viewContainer)
-            {
-                // REVIEW: Could test a few instead of just one. The 2nd one from KQ7 would show 320x200, so if the first one were deleted
-                // we'd get the wrong result
-                std::unique_ptr<ResourceEntity> view = CreateResourceFromResourceData(*viewBlob, false);
-                RasterComponent &raster = view->GetComponent<RasterComponent>();
-                result.DefaultResolution = raster.Resolution;
-                break;
-            }
+            // REVIEW: Could test a few instead of just one. The 2nd one from KQ7 would show 320x200, so if the first one were deleted
+            // we'd get the wrong result
+            std::unique_ptr<ResourceBlob> viewBlob = evidence.Views[0].CreateForVersion(result);
+            std::unique_ptr<ResourceEntity> view = CreateResourceFromResourceData(*viewBlob, false);
+            RasterComponent &raster = view->GetComponent<RasterComponent>();
+            result.DefaultResolution = raster.Resolution;
         }
         catch (...)
         {
@@ -919,17 +1107,39 @@ SCIVersion SniffSCIVersion(const GameFolderHelper& helper)
         }
     }
 
+    DetectionScriptLookups scriptLookups(helper.GetResourceLoader());
     if (needSoundAutoDetect)
     {
-        if (auto sound_type = _DetectSoundType(helper.GetResourceLoader(), result))
+        if (auto sound_type = _DetectSoundType(scriptLookups, result))
         {
             result.SoundFormat = *sound_type;
         }
     }
 
     result.UsesPolygons = (result.PicFormat != PicFormat::EGA);
-    result.UsesPolygons = helper.GetIniBool("Version", "UsesPolygons", result.UsesPolygons);
 
-    result.Kernels = _DetectKernelSet(helper.GetResourceLoader(), result);
+    result.Kernels = _DetectKernelSet(scriptLookups, evidence, result);
     return result;
-}
\ No newline at end of file
+}
+
+SCIVersion SniffSCIVersion(const GameFolderHelper& helper)
+{
+    // Detection walks through the resource map and decompresses a number of resources, so we only do it
+    // if something in the game folder has changed since the last time.
+    std::string cacheFolder = GetAppCacheFolder(helper.GetGameFolder());
+    std::string cacheFilename = cacheFolder.empty() ? "" : (cacheFolder + "\\" + SCIVersionCacheFilename);
+    uint64_t fingerprint = _GetVersionFingerprint(helper.GetGameFolder());
+    SCIVersion result;
+    if (cacheFilename.empty() || !_TryReadVersionCache(cacheFilename, fingerprint, result))
+    {
+        result = _DetectSCIVersion(helper);
+        if (!cacheFilename.empty())
+        {
+            _WriteVersionCache(cacheFilename, fingerprint, result);
+        }
+    }
+
+    // This can be overridden by the game's ini file, which isn't part of the fingerprint.
+    result.UsesPolygons = helper.GetIniBool("Version", "UsesPolygons", result.UsesPolygons);
+    return result;
+}
@@ -20,6 +20,7 @@
 #include "AppState.h"
 #include "format.h"
 #include "ImageUtil.h"
+#include "CelRLE.h"
 
 using namespace std;
 
@@ -35,14 +36,6 @@ bool IsMirror(uint16_t nLoop, uint16_t mask)
     return (0 != (((mask) >> (nLoop)) & 1));
 }
 
-enum class GNPResult
-{
-    Done = 0,   // pColor is not set
-    NewLine = 1,// pColor is set
-    Ok = 2,    // pColor is set
-};
-
-
 void ReadImageData(sci::istream &byteStream, Cel &cel, bool isVGA)
 {
     ReadImageData(byteStream, cel, isVGA, byteStream);
@@ -50,6 +43,8 @@ void ReadImageData(sci::istream &byteStream, Cel &cel, bool isVGA)
 
 const size_t ReasonableLimit = 640 * 480;
 
+// ReadImageData uses the faster kernels in CelRLE.cpp. This is still used to calculate
+// the SCI2 row offsets, since it lets us observe the stream positions at each scanline.
 template<typename _TCalcFunc>
 void ReadImageDataWorker(sci::istream &byteStreamRLE, Cel &cel, bool isVGA, sci::istream &byteStreamLiteral, _TCalcFunc calcFunc)
 {
@@ -170,11 +165,29 @@ void ReadImageDataWorker(sci::istream &byteStreamRLE, Cel &cel, bool isVGA, sci:
     }
 }
 
-void CalcNothing(int y, sci::istream &byteStreamRLE, sci::istream &byteStreamLiteral) {}
-
 void ReadImageData(sci::istream &byteStreamRLE, Cel &cel, bool isVGA, sci::istream &byteStreamLiteral)
 {
-    ReadImageDataWorker(byteStreamRLE, cel, isVGA, byteStreamLiteral, CalcNothing);
+    size_t dataSize = CX_ACTUAL(cel.size.cx) * cel.size.cy;
+    if (dataSize > ReasonableLimit)
+    {
+        throw std::exception("Corrupt raster resource.");
+    }
+    cel.Data.allocate(max(1, dataSize));
+
+    // Decode straight from the stream's buffer. VGA1.0 interleaves the literal data with the RLE data.
+    bool interleaved = (&byteStreamRLE == &byteStreamLiteral);
+    const uint8_t *rleBase = byteStreamRLE.GetInternalPointer();
+    CelRLEBuffer rle = { rleBase + byteStreamRLE.GetAbsolutePosition(), rleBase + max(byteStreamRLE.GetAbsolutePosition(), byteStreamRLE.GetDataSize()) };
+    const uint8_t *literalBase = byteStreamLiteral.GetInternalPointer();
+    CelRLEBuffer literal = { literalBase + byteStreamLiteral.GetAbsolutePosition(), literalBase + max(byteStreamLiteral.GetAbsolutePosition(), byteStreamLiteral.GetDataSize()) };
+
+    DecodeCelRLE(isVGA ? CelRLEFormat::VGA : CelRLEFormat::EGA, rle, interleaved ? nullptr : &literal, &cel.Data[0], cel.size.cx, cel.size.cy, CX_ACTUAL(cel.size.cx), cel.TransparentColor);
+
+    byteStreamRLE.SeekAbsolute((uint32_t)(rle.begin - rleBase));
+    if (!interleaved)
+    {
+        byteStreamLiteral.SeekAbsolute((uint32_t)(literal.begin - literalBase));
+    }
 }
 
 // RLE, followed by Literal
@@ -289,124 +302,6 @@ void ReadLoopFrom(ResourceEntity &resource, sci::istream byteStream, Loop &loop,
     assert(loop.Cels.size() == nCels); // Ensure cel count is right.
 }
 
-uint8_t GetPixel(const uint8_t *p, int x, int y, int cxActual)
-{
-    return (*((p)+((y)* (cxActual)) + (x)));
-}
-
-// The sole purpose of this is to ignore the padding at the end of each scanline.
-GNPResult GetNextPixel(const uint8_t *pData, int &x, int &y, int cx, uint8_t *pColor)
-{
-    GNPResult iResult = GNPResult::Ok;
-    if (x >= cx)
-    {
-        x = 0;
-        y--;
-        iResult = GNPResult::NewLine;
-    }
-
-    if (y < 0)
-    {
-        iResult = GNPResult::Done;
-    }
-
-    if (iResult != GNPResult::Done)
-    {
-        *pColor = GetPixel(pData, x, y, CX_ACTUAL(cx));
-    }
-    ++x;
-    return iResult;
-}
-
-const int ValuableIdenticalColorsThreshold = 2;
-
-// Returns the next pixel color, and how many pixels after that are identical
-int GetNextIdenticalPixelCount(const uint8_t *pData, int x, int y, int cx, uint8_t *pColor)
-{
-    int count = 0;
-    if (GetNextPixel(pData, x, y, cx, pColor) == GNPResult::Ok)
-    {
-        count++;
-        uint8_t temp;
-        while ((GetNextPixel(pData, x, y, cx, &temp) == GNPResult::Ok) && (*pColor == temp) && (count < 0x3f))
-        {
-            count++;
-        }
-    }
-    return count;
-}
-
-// Sierra actually handles 127 (63 + 64) here, but SV.exe barfs on it, so limit ourselves to 63.
-const int MaxDifferentPixelCount = 63;
-
-// The way this works is:
-//  - sequences of 2 are allowed in these sequences (since it would end up
-//      costing the same just to keep going), unless they are immediately
-//      followed by another sequence of 2.
-int GetNextDifferentPixelCount(const uint8_t *pData, int x, int y, int cx, uint8_t transparent)
-{
-    int count = 0;
-    uint8_t previousColor;
-    if (GetNextPixel(pData, x, y, cx, &previousColor) == GNPResult::Ok)
-    {
-        count++;
-        uint8_t nextColor;
-        int identicalColorCount = 1;
-        int previousIdenticalColorCountSequence = 0;
-        while ((count < MaxDifferentPixelCount) && (GetNextPixel(pData, x, y, cx, &nextColor) == GNPResult::Ok))
-        {
-            count++;
-            if (nextColor == previousColor)
-            {
-                identicalColorCount++;
-
-                if ((identicalColorCount >= 3) || (identicalColorCount >= 2 && (previousColor == transparent)))
-                {
-                    // 3 in a row. Time to bail.
-                    count -= identicalColorCount;
-                    assert(count > 0);
-                    break;
-                }
-                // Hmm, this makes it a bit worse. I'm close to the "offical size" with this algorithm
-                // but not quite.
-                // The remaining difference might just be in palette size.
-                /*
-                if ((identicalColorCount >= 2) && (previousIdenticalColorCountSequence >= 2))
-                {
-                // 2 in a row right after 2 in a row. Time to bail.
-                count -= (identicalColorCount + previousIdenticalColorCountSequence);
-                assert(count > 0);
-                break;
-                }*/
-            }
-            else
-            {
-                previousIdenticalColorCountSequence = identicalColorCount;
-                identicalColorCount = 1;
-                previousColor = nextColor;
-            }
-        }
-    }
-    return count;
-}
-
-// Advances x and y by amount, and returns the color at x and y
-void AdvanceXY(const uint8_t *pData, int amount, int &x, int &y, int cx, uint8_t *pColor)
-{
-    assert(y >= 0);
-    *pColor = GetPixel(pData, x, y, CX_ACTUAL(cx));
-    int lines = amount / cx;
-    int columns = amount % cx;
-    y -= (amount / cx);
-    x += columns;
-    if (x >= cx)
-    {
-        x %= cx;
-        y--;
-    }
-    assert((y >= 0) || ((y == -1) && (x == 0)));
-}
-
 void WriteImageData(sci::ostream &byteStream, const Cel &cel, bool isVGA, bool isEmbeddedView)
 {
     WriteImageData(byteStream, cel, isVGA, byteStream, !isVGA || isEmbeddedView);
@@ -414,17 +309,6 @@ void WriteImageData(sci::ostream &byteStream, const Cel &cel, bool isVGA, bool i
 
 void WriteImageData(sci::ostream &rleStream, const Cel &cel, bool isVGA, sci::ostream &literalStream, bool writeZero)
 {
-    // Now the image data
-    // cxActual is how wide our bitmap data is (a boundary of 4 pixels - 32 bits)
-    int cxActual = CX_ACTUAL(cel.size.cx);
-
-    // Start at the bottom
-    int y = cel.size.cy - 1;
-    int x = 0;
-
-    uint8_t cCount = 0;
-    uint8_t cColorPrev = 0xff; // invalid colour value (hmm, but not for VGA)
-
     // For some reason, image data always starts with a 0x00
     // REVIEW: With VGA1.1 it definitely does not. Still need to check VGA1.0
     // REVIEW: I can not find any circumstance in VGA where the image data starts with a zero. So it should always
@@ -434,83 +318,20 @@ void WriteImageData(sci::ostream &rleStream, const Cel &cel, bool isVGA, sci::os
         rleStream.WriteByte(0);
     }
 
-    const uint8_t *bits = &cel.Data[0];
+    // VGA1.0 interleaves the literal data with the RLE data.
+    bool interleaved = (&rleStream == &literalStream);
+    std::vector<uint8_t> rle;
+    std::vector<uint8_t> literal;
+    rle.reserve(cel.Data.size() / 2);
+    EncodeCelRLE(isVGA ? CelRLEFormat::VGA : CelRLEFormat::EGA, &cel.Data[0], cel.size.cx, cel.size.cy, CX_ACTUAL(cel.size.cx), cel.TransparentColor, rle, interleaved ? rle : literal);
 
-    if (isVGA)
+    if (!rle.empty())
     {
-        int count = 1;  // Anything but zero
-        while (count)
-        {
-            uint8_t identicalColor;
-            count = GetNextIdenticalPixelCount(bits, x, y, cel.size.cx, &identicalColor);
-            if (count > 1)
-            {
-                assert(count <= 0x3f);
-                uint8_t byte = (uint8_t)count;
-                if (identicalColor == cel.TransparentColor)
-                {
-                    // Sequence of transparent color
-                    byte |= (0x3 << 6);
-                    rleStream.WriteByte(byte);
-                }
-                else
-                {
-                    // Sequence of identical color
-                    byte |= (0x2 << 6);
-                    rleStream.WriteByte(byte);
-                    literalStream.WriteByte(identicalColor);
-                }
-                uint8_t dummy;
-                AdvanceXY(bits, count, x, y, cel.size.cx, &dummy);
-            }
-            else
-            {
-                count = GetNextDifferentPixelCount(bits, x, y, cel.size.cx, cel.TransparentColor);
-                if (count > 0x3f)
-                {
-                    uint8_t byte = (uint8_t)(count - 64);
-                    byte |= (0x1 << 6);
-                    rleStream.WriteByte(byte);
-                }
-                else if (count > 0)
-                {
-                    rleStream.WriteByte((uint8_t)count);
-                }
-                // Now copy over that many bits.
-                for (int i = 0; i < count; i++)
-                {
-                    uint8_t color;
-                    AdvanceXY(bits, 1, x, y, cel.size.cx, &color);
-                    literalStream.WriteByte(color);
-                }
-            }
-        }
+        rleStream.WriteBytes(&rle[0], (int)rle.size());
     }
-    else
+    if (!literal.empty())
     {
-        // EGA
-        GNPResult result = GetNextPixel(bits, x, y, cel.size.cx, &cColorPrev);
-        cCount = 1;
-
-        uint8_t cColor;
-        while (result != GNPResult::Done)
-        {
-            // Look at the next pixel.
-            result = GetNextPixel(bits, x, y, cel.size.cx, &cColor);
-            if ((result == GNPResult::Done) || (result == GNPResult::NewLine) || (cCount == 15) || (cColor != cColorPrev))
-            {
-                // (It is not valid to test cColor if iResult is GNP_DONE)
-                assert((result == GNPResult::Done) || (cColor < 16));
-                assert(cCount < 16);
-
-                // Write out our data
-                uint8_t b = ((cCount << 4) | cColorPrev);
-                rleStream.WriteByte(b);
-                cCount = 0;
-            }
-            cColorPrev = cColor;
-            cCount++;
-        }
+        literalStream.WriteBytes(&literal[0], (int)literal.size());
     }
 }
 
@@ -48,10 +48,13 @@ struct Cel
         return (GetStride() * size.cy);
     }
 
-    // REVIEW: std::vector is 16 bytes. We could change this to 4 bytes if we wish
-    // (thus reducing size of a cel from 24 to 12?) 
-    // But we'd need to write a manual copy/assignment constructor.
-    sci::array<uint8_t> Data;
+    // Copies of a cel (undo frames, clipboard, etc...) share their pixels until one of them is modified.
+    // Code that only reads the pixels should do so through a const Cel, to avoid an unnecessary copy.
+    sci::shared_array<uint8_t> Data;
+    // For cels in mirrored loops, the pixels of the original cel that Data was flipped from.
+    // This lets us skip re-flipping cels whose original hasn't changed. It doesn't keep the
+    // original's pixels alive, or stop them from being written to in place.
+    sci::shared_array<uint8_t>::weak_ref MirrorSource;
     size16 size;
     point16 placement;
     uint8_t TransparentColor;
@@ -173,6 +176,9 @@ struct RasterComponent : ResourceComponent
         return std::make_unique<RasterComponent>(*this);
     }
 
+    size_t GetMemorySize() const override;
+    size_t AccumulateMemorySize(std::unordered_set<const void*> &seen) const override;
+
     // Helper functions. None of these are bounds checked.
     int LoopCount() const { return (int)Loops.size(); }
     int CelCount(int nLoop) const { return (int)Loops[nLoop].Cels.size(); }
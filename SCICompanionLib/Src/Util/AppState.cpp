@@ -57,6 +57,8 @@
 #include "SyntaxParser.h"
 #include "ImageUtil.h"
 #include "DependencyTracker.h"
+#include "ThumbnailCache.h"
+#include "BufferPool.h"
 #include "PostBuildThread.h"
 #include "SaveResourceDialog.h"
 #include "BaseResourceUtil.h"
@@ -86,6 +88,7 @@ AppState::AppState(CWinApp *pApp) : _resourceMap(this, &_resourceRecency)
     _dependencyTracker = std::make_unique<DependencyTracker>(_fTrackHeaderFiles);
     // This is a pointer because we don't want a dependency on it in the header file.
     _classBrowser = std::make_unique<SCIClassBrowser>(*_dependencyTracker);
+    _thumbnailCache = std::make_unique<ThumbnailCache>();
 
     _pApp = pApp;
     _audioProcessing = std::make_unique<AudioProcessingSettings>();
@@ -194,6 +197,10 @@ SCIClassBrowser &AppState::GetClassBrowser()
 {
     return *_classBrowser;
 }
+ThumbnailCache &AppState::GetThumbnailCache()
+{
+    return *_thumbnailCache;
+}
 
 int AppState::AspectRatioY(int value) const
 {
@@ -680,6 +687,8 @@ int AppState::ExitInstance()
 
     _pPicTemplate = nullptr; // Just in case someone asks us (note: don't need to free)
 
+    _thumbnailCache->Close();
+
     if (!_fNoGdiPlus)
     {
         Gdiplus::GdiplusShutdown(_gdiplusToken);
@@ -710,6 +719,7 @@ void AppState::SetGameFolder(PCSTR pszGameFolder)
     _runLogic.SetGameFolder(pszGameFolder);
     AbortDebuggerThread();
     _resourceMap.SetGameFolder(pszGameFolder);
+    _thumbnailCache->Open(pszGameFolder, _resourceMap.GetSCIVersion());
     _fUseOriginalAspectRatioCached = _resourceMap.Helper().GetUseSierraAspectRatio(!!appState->_fUseOriginalAspectRatioDefault);
     LogInfo(TEXT("Open game: %s"), (PCTSTR)pszGameFolder);
 }
@@ -717,9 +727,12 @@ void AppState::SetGameFolder(PCSTR pszGameFolder)
 void AppState::CloseGameFolder()
 {
     _dependencyTracker->Clear();
+    _thumbnailCache->Close();
     _resourceMap.SetGameFolder("");
     ResetClassBrowser();
     ClearResourceManagerDoc();
+    // The next game may draw at a different size, so don't hang on to idle pic buffers.
+    BufferPool::Instance().Trim();
 }
 
 void AppState::AddResourceSync(IResourceMapEvents* pSync)
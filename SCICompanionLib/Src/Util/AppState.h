@@ -38,6 +38,7 @@ class CResourceListDoc;
 class AppState;
 class SCIClassBrowser;
 class DependencyTracker;
+class ThumbnailCache;
 struct AudioProcessingSettings;
 
 template<typename _TPayload, typename _TResponse>
@@ -133,6 +134,7 @@ public:
 
     DependencyTracker &GetDependencyTracker();
     SCIClassBrowser &GetClassBrowser();
+    ThumbnailCache &GetThumbnailCache();
 
     // Game properties
     std::string GetGameName();
@@ -269,6 +271,7 @@ public: // TODO for now
 
     std::unique_ptr<DependencyTracker> _dependencyTracker;
     std::unique_ptr<SCIClassBrowser> _classBrowser;
+    std::unique_ptr<ThumbnailCache> _thumbnailCache;
 
 private:
     void StartDebuggerThread(int optionalResourceNumber);
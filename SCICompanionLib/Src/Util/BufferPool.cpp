@@ -0,0 +1,115 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#include "stdafx.h"
+#include "BufferPool.h"
+
+using namespace std;
+
+// Beyond this, returned buffers are freed instead of being kept around.
+const size_t MaxIdleBytes = 16 * 1024 * 1024;
+
+void BufferPool::Deleter::operator()(uint8_t *buffer) const
+{
+    if (buffer)
+    {
+        BufferPool::Instance()._Return(buffer, _sizeClass);
+    }
+}
+
+BufferPool &BufferPool::Instance()
+{
+    static BufferPool pool;
+    return pool;
+}
+
+BufferPool::BufferPool() : _bytesInUse(0), _highWaterMark(0), _idleBytes(0) {}
+
+size_t BufferPool::_GetSizeClass(size_t size)
+{
+    return max((size + SizeClassGranularity - 1) / SizeClassGranularity, (size_t)1) * SizeClassGranularity;
+}
+
+BufferPool::SizeClass *BufferPool::_GetSizeClassList(size_t sizeClass)
+{
+    size_t index = sizeClass / SizeClassGranularity - 1;
+    return (index < _classes.size()) ? &_classes[index] : nullptr;
+}
+
+BufferPool::Buffer BufferPool::Allocate(size_t size)
+{
+    size_t sizeClass = _GetSizeClass(size);
+    unique_ptr<uint8_t[]> buffer;
+    SizeClass *list = _GetSizeClassList(sizeClass);
+    if (list)
+    {
+        lock_guard<mutex> lock(list->mutex);
+        if (!list->idle.empty())
+        {
+            buffer = move(list->idle.back());
+            list->idle.pop_back();
+            _idleBytes -= sizeClass;
+        }
+    }
+    if (!buffer)
+    {
+        buffer = make_unique<uint8_t[]>(sizeClass);
+    }
+
+    size_t inUse = (_bytesInUse += sizeClass);
+    size_t highWaterMark = _highWaterMark;
+    while ((inUse > highWaterMark) && !_highWaterMark.compare_exchange_weak(highWaterMark, inUse))
+    {
+    }
+    return Buffer(buffer.release(), Deleter(sizeClass));
+}
+
+void BufferPool::_Return(uint8_t *buffer, size_t sizeClass)
+{
+    unique_ptr<uint8_t[]> owned(buffer);
+    _bytesInUse -= sizeClass;
+    SizeClass *list = _GetSizeClassList(sizeClass);
+    if (list && ((_idleBytes + sizeClass) <= MaxIdleBytes))
+    {
+        lock_guard<mutex> lock(list->mutex);
+        list->idle.push_back(move(owned));
+        _idleBytes += sizeClass;
+    }
+    // Otherwise it just gets freed.
+}
+
+void BufferPool::Trim()
+{
+    for (size_t i = 0; i < _classes.size(); i++)
+    {
+        SizeClass &list = _classes[i];
+        lock_guard<mutex> lock(list.mutex);
+        _idleBytes -= (i + 1) * SizeClassGranularity * list.idle.size();
+        list.idle.clear();
+    }
+}
+
+size_t BufferPool::GetBytesInUse() const
+{
+    return _bytesInUse;
+}
+
+size_t BufferPool::GetHighWaterMark() const
+{
+    return _highWaterMark;
+}
+
+size_t BufferPool::GetIdleBytes() const
+{
+    return _idleBytes;
+}
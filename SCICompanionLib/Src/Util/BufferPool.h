@@ -13,51 +13,70 @@
 ***************************************************************************/
 #pragma once
 
-#pragma warning(disable: 4351)      // New behavior for arrays in initializer list.
+#include <atomic>
+#include <array>
 
-template<int MaxBuffer>
+//
+// A process-wide pool of large byte buffers, such as pic screens. Pic editors, previews and
+// thumbnail workers all render into buffers of the same few sizes, so instead of each one
+// allocating its own, they borrow them from here.
+//
+// Requests are rounded up to a size class. Freed buffers are kept for re-use, up to a limit
+// on the total idle memory; beyond that they are just freed. Buffers bigger than the largest
+// size class aren't pooled at all. Trim() frees all idle buffers, and is called when a game is
+// closed. It is safe to use from multiple threads.
+//
 class BufferPool
 {
 public:
-    BufferPool(size_t size) : _used{}, _size(size) {}
+    class Deleter
+    {
+    public:
+        Deleter() : _sizeClass(0) {}
+        Deleter(size_t sizeClass) : _sizeClass(sizeClass) {}
+        void operator()(uint8_t *buffer) const;
 
-    size_t GetSize() { return _size; }
+    private:
+        size_t _sizeClass;
+    };
 
-    uint8_t *AllocateBuffer()
-    {
-        for (size_t i = 0; i < ARRAYSIZE(_buffers); i++)
-        {
-            if (!_used[i])
-            {
-                if (!_buffers[i])
-                {
-                    _buffers[i] = std::make_unique<uint8_t[]>(_size);
-                }
-                _used[i] = true;
-                return _buffers[i].get();
-            }
-        } 
-        assert(false && "Requesting more buffers than indicated.");
-        return nullptr;
-    }
-
-    void FreeBuffer(uint8_t *buffer)
-    {
-        if (buffer)
-        {
-            for (size_t i = 0; i < ARRAYSIZE(_buffers); i++)
-            {
-                if (buffer == _buffers[i].get())
-                {
-                    _used[i] = false;
-                    break;
-                }
-            }
-        }
-    }
+    // Goes back to the pool when destroyed.
+    typedef std::unique_ptr<uint8_t[], Deleter> Buffer;
+
+    static BufferPool &Instance();
+
+    // The buffer is at least size bytes, and not initialized.
+    Buffer Allocate(size_t size);
+    void Trim();
+
+    // Bytes currently handed out, and the most that have ever been.
+    size_t GetBytesInUse() const;
+    size_t GetHighWaterMark() const;
+    size_t GetIdleBytes() const;
 
 private:
-    std::unique_ptr<uint8_t[]> _buffers[MaxBuffer];
-    bool _used[MaxBuffer];
-    size_t _size;
-};
\ No newline at end of file
+    BufferPool();
+    BufferPool(const BufferPool &src) = delete;
+    BufferPool &operator=(const BufferPool &src) = delete;
+
+    static size_t _GetSizeClass(size_t size);
+    void _Return(uint8_t *buffer, size_t sizeClass);
+
+    // Each size class has its own lock, so that (for instance) thumbnails don't hold up the pic editor.
+    struct SizeClass
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<uint8_t[]>> idle;
+    };
+    // Null if buffers of this size aren't pooled.
+    SizeClass *_GetSizeClassList(size_t sizeClass);
+
+    static const size_t SizeClassGranularity = 4096;
+    // Enough for the largest pic screens (640x480).
+    static const size_t SizeClassCount = 128;
+    // All the size classes exist up front, so finding one doesn't need a lock.
+    std::array<SizeClass, SizeClassCount> _classes;
+    std::atomic<size_t> _bytesInUse;
+    std::atomic<size_t> _highWaterMark;
+    std::atomic<size_t> _idleBytes;
+};
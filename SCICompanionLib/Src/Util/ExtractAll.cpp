@@ -33,6 +33,60 @@
 #include "AudioCacheResourceSource.h"
 #include "BaseResourceUtil.h"
 #include "ResourceUtil.h"
+#include <atomic>
+
+namespace
+{
+    // Each thread loads the object files it needs for itself, so don't bother with threads for only a few scripts.
+    const size_t MinScriptsPerThread = 4;
+    // Scripts are loaded this many at a time, then disassembled and written out together.
+    const size_t ScriptBatchSize = 64;
+
+    struct LoadedScript
+    {
+        std::unique_ptr<CompiledScript> Script;
+        std::string Path;
+    };
+
+    // Disassembles the scripts into their text files on all processors. The scripts are loaded
+    // beforehand, so nothing here touches the resource map.
+    void _DisassembleScripts(std::vector<LoadedScript> &scripts, const GameFolderHelper &helper, const SelectorTable &selectors, GlobalCompiledScriptLookups &scriptLookups, const Vocab000 *pWords)
+    {
+        int threadCount = max(1, min((int)std::thread::hardware_concurrency(), (int)(scripts.size() / MinScriptsPerThread)));
+        std::atomic<size_t> nextScript(0);
+        auto worker = [&](int threadIndex)
+        {
+            // This loads object files as they're needed, so it can't be shared.
+            ObjectFileScriptLookups objectFileLookups(helper, selectors);
+            std::string text;
+            // Scripts vary a lot in size, so threads take the next one when they're ready rather than a fixed share.
+            for (size_t i = nextScript++; i < scripts.size(); i = nextScript++)
+            {
+                try
+                {
+                    DisassembleScript(*scripts[i].Script, text, &scriptLookups, &objectFileLookups, pWords);
+                    MakeTextFile(text.c_str(), scripts[i].Path);
+                }
+                catch (std::exception)
+                {
+
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (int i = 1; i < threadCount; i++)
+        {
+            threads.emplace_back(worker, i);
+        }
+        worker(0);
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+        scripts.clear();
+    }
+}
 
 void ExtractAllResources(CResourceMap& resource_map, SCIVersion version, const std::string &destinationFolderIn, bool extractResources, bool extractPicImages, bool extractViewImages, bool disassembleScripts, bool extractMessages, bool generateWavs, IExtractProgress *progress)
 {
@@ -42,18 +96,19 @@ void ExtractAllResources(CResourceMap& resource_map, SCIVersion version, const s
         destinationFolder += "\\";
     }
 
-    ObjectFileScriptLookups objectFileLookups(resource_map.Helper(),
-                                              resource_map
-                                                  .GetCompiledScriptLookups()
-                                                  ->GetSelectorTable());
+    const SelectorTable &selectors = resource_map.GetCompiledScriptLookups()->GetSelectorTable();
     GlobalCompiledScriptLookups scriptLookups;
+    const Vocab000 *pWords = nullptr;
     if (disassembleScripts)
     {
       if (!scriptLookups.Load(resource_map.GetSCIVersion(), resource_map.Helper().GetResourceLoader()))
         {
             disassembleScripts = false;
         }
+        pWords = resource_map.GetVocab000();
     }
+    // Loaded here, and disassembled in batches on other threads.
+    std::vector<LoadedScript> loadedScripts;
 
     int totalCount = 0;
     auto resourceContainer = resource_map.Resources(
@@ -73,7 +128,7 @@ void ExtractAllResources(CResourceMap& resource_map, SCIVersion version, const s
         {
             totalCount++;
         }
-        if (disassembleScripts && (blob->GetType() == ResourceType::Pic))
+        if (disassembleScripts && (blob->GetType() == ResourceType::Script))
         {
             totalCount++;
         }
@@ -196,16 +251,16 @@ void ExtractAllResources(CResourceMap& resource_map, SCIVersion version, const s
                         heapStream = std::make_unique<sci::istream>(heapBlob->GetReadStream());
                     }
 
-                    CompiledScript compiledScript(blob->GetNumber());
-                    compiledScript.Load(
+                    std::unique_ptr<CompiledScript> compiledScript = std::make_unique<CompiledScript>(blob->GetNumber());
+                    compiledScript->Load(
                         resource_map.Helper(), version,
                         blob->GetNumber(), blob->GetReadStream(),
                         heapStream.get());
-                    std::stringstream out;
-                    DisassembleScript(compiledScript, out, &scriptLookups,
-                                      &objectFileLookups,
-                                      resource_map.GetVocab000());
-                    std::string actualPath = MakeTextFile(out.str().c_str(), scriptPath.c_str());
+                    loadedScripts.push_back({ std::move(compiledScript), scriptPath });
+                    if (loadedScripts.size() >= ScriptBatchSize)
+                    {
+                        _DisassembleScripts(loadedScripts, resource_map.Helper(), selectors, scriptLookups, pWords);
+                    }
                 }
 
                 if (extractMessages && (blob->GetType() == ResourceType::Message))
@@ -231,6 +286,11 @@ void ExtractAllResources(CResourceMap& resource_map, SCIVersion version, const s
         }
     }
 
+    if (!loadedScripts.empty())
+    {
+        _DisassembleScripts(loadedScripts, resource_map.Helper(), selectors, scriptLookups, pWords);
+    }
+
     // Finally, the sync36 and audio36 resources and the audio maps
     if (keepGoing)
     {
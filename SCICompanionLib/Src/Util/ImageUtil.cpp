@@ -20,6 +20,7 @@
 #include "RGBOctree.h"
 #include "ResourceBlob.h"
 #include "GameFolderHelper.h"
+#include <atomic>
 
 using namespace Gdiplus;
 
@@ -589,30 +590,9 @@ double GetColorDistanceCCIR(RGBQUAD one, RGBQUAD two)
         + lumadiff*lumadiff;
 }
 
-template<typename _TCompare>
-uint8_t _FindBestPaletteIndexMatch(_TCompare compare, uint8_t transparentColor, bool excludeTransparentIndexFromMatching, RGBQUAD desiredColor, int colorCount, const uint8_t *mapping, const RGBQUAD *colors)
-{
-    int bestIndex = 1;  // Just something that's not zero, so we can determine when we failed.
-    double bestDistance = 1000000000000000.0;
-    for (int i = 0; i < colorCount; i++)
-    {
-        RGBQUAD paletteColor = colors[mapping[i]];
-        if ((!excludeTransparentIndexFromMatching || (i != (int)transparentColor)) &&
-            (paletteColor.rgbReserved != 0x0))
-        {
-            double distance = compare(desiredColor, paletteColor);
-            if (distance < bestDistance)
-            {
-                bestIndex = i;
-                bestDistance = distance;
-            }
-        }
-    }
-    return (uint8_t)bestIndex;
-}
-
 void ConvertCelToNewPalette(Cel &cel, const PaletteComponent &currentPalette, uint8_t transparentColor, bool egaDither, int colorCount, const uint8_t *paletteMapping, const RGBQUAD *colors)
 {
+    RGBSpatial paletteSearch(ColorMatching::RGB, colorCount, paletteMapping, colors, transparentColor, true);
     int height = cel.size.cy;
     int width = cel.size.cx;
     for (int y = 0; y < height; y++)
@@ -630,7 +610,7 @@ void ConvertCelToNewPalette(Cel &cel, const PaletteComponent &currentPalette, ui
             {
                 RGBQUAD rgbExisting = currentPalette.Colors[value];
                 // find closest match.
-                uint8_t bestMatch = _FindBestPaletteIndexMatch(GetColorDistanceRGB, transparentColor, true, rgbExisting, colorCount, paletteMapping, colors);;
+                uint8_t bestMatch = paletteSearch.FindBestMatch(rgbExisting);
                 *setValuePointer = bestMatch;
             }
         }
@@ -664,39 +644,152 @@ std::unique_ptr<RGBQUAD[]> ConvertGdiplusToRaw(Gdiplus::Bitmap &bitmap)
     return data;
 }
 
-// This assumes cutout alpha.
-void RGBToPalettized(ColorMatching colorMatching, uint8_t *sciData, const RGBQUAD *dataOrig, int cx, int cy, bool performDither, bool gammaCorrected, int colorCount, const uint8_t *paletteMapping, const RGBQUAD *paletteColors, uint8_t transparentColor, bool excludeTransparentIndexFromMatch, BitmapConvertStatus &convertStatus)
+namespace
 {
-    ErrorDiffusionDither<RGBQUAD, FloydSteinberg> dither(cx, cy);
-    for (int y = 0; y < cy; y++)
+    // Error diffusion makes each pixel depend on the ones before it and above it, but a row only needs
+    // the row above it to be a few pixels ahead (the dither's RowLead). So rows are handed out to threads
+    // round robin, and each thread waits for the row above to get far enough along. This produces exactly the
+    // same result as doing it serially, since the error contributions are just summed.
+    class RowWavefront
     {
-        const RGBQUAD *origRow = dataOrig + y * cx;
-        uint8_t *destRow = sciData + y * CX_ACTUAL(cx);
-        for (int x = 0; x < cx; x++)
+    public:
+        RowWavefront(int cx, int cy, int rowLead) : _cx(cx), _rowLead(rowLead), _progress(std::make_unique<std::atomic<int>[]>(cy))
         {
-            RGBQUAD rgbOrig = gammaCorrected ? _ToLinear(origRow[x]) : origRow[x];
-            rgbOrig = dither.ApplyErrorAt(rgbOrig, x, y);
-            if (rgbOrig.rgbReserved == 0xff)
+            for (int y = 0; y < cy; y++)
             {
-                uint8_t bestMatch =
-                    colorMatching == ColorMatching::RGB ?
-                    _FindBestPaletteIndexMatch(GetColorDistanceRGB, transparentColor, excludeTransparentIndexFromMatch, rgbOrig, colorCount, paletteMapping, paletteColors) :
-                    _FindBestPaletteIndexMatch(GetColorDistanceCCIR, transparentColor, excludeTransparentIndexFromMatch, rgbOrig, colorCount, paletteMapping, paletteColors);
-                destRow[x] = bestMatch;
-                if (performDither)
-                {
-                    dither.PropagateError(rgbOrig, paletteColors[bestMatch], x, y);
-                }
-                if (bestMatch == transparentColor)
+                _progress[y].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        // Waits until it's ok to process pixel x on row y. available caches how far along the previous row was.
+        void WaitFor(int y, int x, int &available) const
+        {
+            int needed = min(_cx, x + _rowLead);
+            if ((y > 0) && (available < needed))
+            {
+                while ((available = _progress[y - 1].load(std::memory_order_acquire)) < needed)
                 {
-                    convertStatus |= BitmapConvertStatus::MappedToTransparentColor;
+                    std::this_thread::yield();
                 }
             }
-            else
+        }
+
+        void Publish(int y, int completedPixels)
+        {
+            _progress[y].store(completedPixels, std::memory_order_release);
+        }
+
+    private:
+        int _cx;
+        int _rowLead;
+        std::unique_ptr<std::atomic<int>[]> _progress;
+    };
+
+    // Don't bother with threads for tiny images.
+    const int MinPixelsPerThread = 4096;
+    // How often a row reports its progress to the row below it.
+    const int PublishInterval = 16;
+    // Roughly the distance between neighboring colors in a typical 256 color palette.
+    const int OrderedColorSpread = 48;
+
+    template<typename _TDither>
+    void _RGBToPalettized(_TDither &dither, ColorMatching colorMatching, uint8_t *sciData, const RGBQUAD *dataOrig, int cx, int cy, bool gammaCorrected, int colorCount, const uint8_t *paletteMapping, const RGBQUAD *paletteColors, uint8_t transparentColor, bool excludeTransparentIndexFromMatch, BitmapConvertStatus &convertStatus)
+    {
+        int threadCount = max(1, min((int)std::thread::hardware_concurrency(), min(cy, (cx * cy) / MinPixelsPerThread)));
+        RowWavefront wavefront(cx, cy, _TDither::RowLead);
+        std::vector<BitmapConvertStatus> threadStatus(threadCount, BitmapConvertStatus::None);
+
+        auto worker = [&](int threadIndex)
+        {
+            // The palette search caches results, so each thread needs its own.
+            RGBSpatial paletteSearch(colorMatching, colorCount, paletteMapping, paletteColors, transparentColor, excludeTransparentIndexFromMatch);
+            BitmapConvertStatus &status = threadStatus[threadIndex];
+            for (int y = threadIndex; y < cy; y += threadCount)
             {
-                destRow[x] = transparentColor;
-                // And no need to propagate error...
+                const RGBQUAD *origRow = dataOrig + y * cx;
+                uint8_t *destRow = sciData + y * CX_ACTUAL(cx);
+                int available = 0;
+                for (int x = 0; x < cx; x++)
+                {
+                    if (_TDither::PropagatesError)
+                    {
+                        wavefront.WaitFor(y, x, available);
+                        if ((x % PublishInterval) == 0)
+                        {
+                            wavefront.Publish(y, x);
+                        }
+                    }
+                    RGBQUAD rgbOrig = gammaCorrected ? _ToLinear(origRow[x]) : origRow[x];
+                    rgbOrig = dither.ApplyErrorAt(rgbOrig, x, y);
+                    if (rgbOrig.rgbReserved == 0xff)
+                    {
+                        uint8_t bestMatch = paletteSearch.FindBestMatch(rgbOrig);
+                        destRow[x] = bestMatch;
+                        dither.PropagateError(rgbOrig, paletteColors[bestMatch], x, y);
+                        if (bestMatch == transparentColor)
+                        {
+                            status |= BitmapConvertStatus::MappedToTransparentColor;
+                        }
+                    }
+                    else
+                    {
+                        destRow[x] = transparentColor;
+                        // And no need to propagate error...
+                    }
+                }
+                if (_TDither::PropagatesError)
+                {
+                    wavefront.Publish(y, cx);
+                }
             }
+        };
+
+        std::vector<std::thread> threads;
+        for (int i = 1; i < threadCount; i++)
+        {
+            threads.emplace_back(worker, i);
+        }
+        worker(0);
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+
+        for (BitmapConvertStatus status : threadStatus)
+        {
+            convertStatus |= status;
+        }
+    }
+}
+
+// This assumes cutout alpha.
+void RGBToPalettized(ColorMatching colorMatching, uint8_t *sciData, const RGBQUAD *dataOrig, int cx, int cy, DitherAlgorithm ditherAlgorithm, bool gammaCorrected, int colorCount, const uint8_t *paletteMapping, const RGBQUAD *paletteColors, uint8_t transparentColor, bool excludeTransparentIndexFromMatch, BitmapConvertStatus &convertStatus)
+{
+    switch (ditherAlgorithm)
+    {
+        case DitherAlgorithm::FloydSteinberg:
+        {
+            ErrorDiffusionDither<RGBQUAD, FloydSteinberg> dither(cx, cy);
+            _RGBToPalettized(dither, colorMatching, sciData, dataOrig, cx, cy, gammaCorrected, colorCount, paletteMapping, paletteColors, transparentColor, excludeTransparentIndexFromMatch, convertStatus);
+            break;
+        }
+        case DitherAlgorithm::JarvisJudiceNinke:
+        {
+            ErrorDiffusionDither<RGBQUAD, JarvisJudiceNinke> dither(cx, cy);
+            _RGBToPalettized(dither, colorMatching, sciData, dataOrig, cx, cy, gammaCorrected, colorCount, paletteMapping, paletteColors, transparentColor, excludeTransparentIndexFromMatch, convertStatus);
+            break;
+        }
+        case DitherAlgorithm::OrderedBayer:
+        {
+            OrderedDither<RGBQUAD> dither(cx, cy, OrderedColorSpread);
+            _RGBToPalettized(dither, colorMatching, sciData, dataOrig, cx, cy, gammaCorrected, colorCount, paletteMapping, paletteColors, transparentColor, excludeTransparentIndexFromMatch, convertStatus);
+            break;
+        }
+        case DitherAlgorithm::None:
+        {
+            NoDither<RGBQUAD> dither(cx, cy);
+            _RGBToPalettized(dither, colorMatching, sciData, dataOrig, cx, cy, gammaCorrected, colorCount, paletteMapping, paletteColors, transparentColor, excludeTransparentIndexFromMatch, convertStatus);
+            break;
         }
     }
 }
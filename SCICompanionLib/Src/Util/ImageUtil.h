@@ -41,6 +41,7 @@ enum class DitherAlgorithm
 
 RGBQUAD _ToSRGB(RGBQUAD color);
 RGBQUAD _ToLinear(RGBQUAD color);
+double GetColorDistanceCCIR(RGBQUAD one, RGBQUAD two);
 
 enum class BitmapConvertStatus : uint32_t
 {
@@ -63,7 +64,7 @@ bool GetCelsAndPaletteFromGdiplus(Gdiplus::Bitmap &bitmap, uint8_t transparentCo
 bool DoPalettesMatch(const PaletteComponent &paletteA, const PaletteComponent &paletteB);
 void ConvertCelToNewPalette(Cel &cel, const PaletteComponent &currentPalette, uint8_t transparentColor, bool ditherImages, int colorCount, const uint8_t *paletteMapping, const RGBQUAD *colors);
 std::unique_ptr<RGBQUAD[]> ConvertGdiplusToRaw(Gdiplus::Bitmap &bitmap);
-void RGBToPalettized(ColorMatching colorMatching, uint8_t *sciData, const RGBQUAD *dataOrig, int cx, int cy, bool performDither, bool gammaCorrected, int colorCount, const uint8_t *paletteMapping, const RGBQUAD *paletteColors, uint8_t transparentColor, bool excludeTransparentIndexFromMatch, BitmapConvertStatus &convertStatus);
+void RGBToPalettized(ColorMatching colorMatching, uint8_t *sciData, const RGBQUAD *dataOrig, int cx, int cy, DitherAlgorithm ditherAlgorithm, bool gammaCorrected, int colorCount, const uint8_t *paletteMapping, const RGBQUAD *paletteColors, uint8_t transparentColor, bool excludeTransparentIndexFromMatch, BitmapConvertStatus &convertStatus);
 void CutoutAlpha(DitherAlgorithm ditherAlgorithm, RGBQUAD *data, int cx, int cy, uint8_t alphaThreshold);
 std::string GetGdiplusStatusString(Gdiplus::Status status);
 HBITMAP Create32bbpBitmap(const Cel &cel, const RGBQUAD *palette, int paletteSize);
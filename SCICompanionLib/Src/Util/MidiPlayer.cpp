@@ -17,6 +17,27 @@
 
 using namespace std;
 
+namespace
+{
+    // Turns what the sequencer plays into the MIDIEVENTs that midiStreamOut takes. The stream
+    // device keeps time itself, so only the deltas matter.
+    class MidiStreamSink : public IMidiSink
+    {
+    public:
+        MidiStreamSink(vector<DWORD> &streamData) : _streamData(streamData) {}
+
+        void OnMessage(const MidiMessage &message) override
+        {
+            _streamData.push_back(message.DeltaTicks);
+            _streamData.push_back(0);
+            _streamData.push_back((MEVT_SHORTMSG << 24) | message.Status | (((DWORD)message.Param1) << 8) | (((DWORD)message.Param2) << 16));
+        }
+
+    private:
+        vector<DWORD> &_streamData;
+    };
+}
+
 //
 // Midi helper
 //
@@ -24,7 +45,6 @@ MidiPlayer::MidiPlayer()
 {
     _handle = NULL;
     ZeroMemory(&_midiHdr, sizeof(_midiHdr));
-    _pRealData = NULL;
     _device = DeviceType::RolandMT32;
     _fPlaying = false;
     _wTotalTime = 0;
@@ -174,59 +194,21 @@ DWORD MidiPlayer::SetSound(const SoundComponent &sound, uint16_t wInitialTempo)
     _wTimeDivision = sound.GetTimeDivision();
     _dwLoopPoint = sound.GetLoopPoint();
 
-    // Combine events into one.
-    // First, get the channels that apply to this device.
-    vector<vector<SoundEvent>> eventChannels;
-    for (const auto &trackInfo : sound.GetTrackInfos())
-    {
-        if (trackInfo.Type == (uint8_t)_device)
-        {
-            for (int channelId : trackInfo.ChannelIds)
-            {
-                for (const auto &channelInfo : sound.GetChannelInfos())
-                {
-                    if (channelInfo.Id == channelId)
-                    {
-                        // A bit expensive, since we're copying all events, but it should be fine.
-                        eventChannels.push_back(channelInfo.Events);
-                        break;
-                    }
-                }
-            }
-            break;
-        }
-    }
-
-    vector<SoundEvent> finalEvents;
-    DWORD totalTicks = CombineSoundEvents(eventChannels, finalEvents);
+    // The sequencer combines the events of the channels that apply to this device.
+    _sequencer.SetSound(sound, _device);
 
-    if (!finalEvents.empty() && _Init())
+    if ((_sequencer.GetEventCount() > 0) && _Init())
     {
-        // Set up the stream.
-        // Put new data in.
-        // Accumulated ticks will need to be at most this big:
-        _accumulatedStreamTicks.resize(finalEvents.size());
-        DWORD cbSize = (DWORD)(finalEvents.size() * 3) * sizeof(DWORD);
-        unsigned long *stuff = new unsigned long[cbSize / sizeof(DWORD)];
-        _pRealData = stuff;
-
-        DWORD cbEventsUsed = 0;
-        _wTotalTime = 0;
-        DWORD dwAccumulatedTicks = 0;
-        for (size_t i = 0; i < finalEvents.size(); ++i)
-        {
-            DWORD dwThisTimeDelta = finalEvents[i].wTimeDelta;
-            *stuff++ = dwThisTimeDelta;
-            dwAccumulatedTicks += dwThisTimeDelta;
-            _accumulatedStreamTicks[cbEventsUsed] = dwAccumulatedTicks;
-            *stuff++ = 0;
-            *stuff++ = (MEVT_SHORTMSG << 24) | finalEvents[i].GetRawStatus() | (((DWORD)finalEvents[i].bParam1) << 8) | (((DWORD)finalEvents[i].bParam2) << 16);
-            _wTotalTime += finalEvents[i].wTimeDelta; // Not quite right - there could be empty space at the end.
-            cbEventsUsed++;
-        }
+        // Set up the stream with one pass through the sound. We loop by cueing the loop point
+        // when the stream is done.
+        _streamData.clear();
+        _streamData.reserve(_sequencer.GetEventCount() * 3);
+        MidiStreamSink sink(_streamData);
+        _sequencer.Render(sink);
+        _wTotalTime = _sequencer.GetTotalTicks(); // Not quite right - there could be empty space at the end.
 
         SetTempo(wInitialTempo);
-        _cTotalStreamEvents = cbEventsUsed;
+        _cTotalStreamEvents = (DWORD)(_streamData.size() / 3);
         _CuePosition(0, 0);
     }
     return ++_dwCookie;
@@ -239,7 +221,7 @@ void MidiPlayer::Play()
         _Init();
     }
 
-    if (!_accumulatedStreamTicks.empty())
+    if (!_streamData.empty())
     {
         unsigned int err = midiStreamRestart(_handle);
         if (!err)
@@ -298,7 +280,7 @@ void MidiPlayer::_ClearHeaders()
     if (_handle)
     {
         // Stop and unhook the old data
-        if (_pRealData)
+        if (!_streamData.empty())
         {
             _fStoppingStream = true;
             midiOutReset((HMIDIOUT)_handle);
@@ -311,9 +293,8 @@ void MidiPlayer::_ClearHeaders()
                 _fQueuedUp = false;
             }
 
-            delete[] _pRealData;
+            _streamData.clear();
             _midiHdr.lpData = NULL;
-            _pRealData = NULL;
         }
     }
 }
@@ -325,34 +306,13 @@ void MidiPlayer::CuePosition(DWORD dwTicks, DWORD scope)
 {
     dwTicks = min(scope, dwTicks);
     dwTicks = _wTotalTime * dwTicks / scope;
-    //dwTicks = _accumulatedStreamTicks[_cTotalStreamEvents - 1] * dwTicks / scope;
-    // Find the spot to cue.
-    size_t i = 0;
-    for (; i < _accumulatedStreamTicks.size(); i++)
-    {
-        if (_accumulatedStreamTicks[i] >= dwTicks)
-        {
-            break;
-        }
-    }
-    if (i >= _accumulatedStreamTicks.size())
-    {
-        i = 0;
-    }
-    _CuePosition((DWORD)i, dwTicks);
+    CueTickPosition(dwTicks);
 }
 void MidiPlayer::CueTickPosition(DWORD dwTicks)
 {
     // Find the spot to cue.
-    size_t i = 0;
-    for (; i < _accumulatedStreamTicks.size(); i++)
-    {
-        if (_accumulatedStreamTicks[i] >= dwTicks)
-        {
-            break;
-        }
-    }
-    if (i >= _accumulatedStreamTicks.size())
+    size_t i = _sequencer.FindEvent(dwTicks);
+    if (i >= _sequencer.GetEventCount())
     {
         i = 0;
     }
@@ -364,7 +324,7 @@ void MidiPlayer::CueTickPosition(DWORD dwTicks)
 //
 void MidiPlayer::_CuePosition(DWORD dwEventIndex, DWORD ticks)
 {
-    if (_pRealData)
+    if (!_streamData.empty())
     {
         if (_fQueuedUp)
         {
@@ -376,7 +336,7 @@ void MidiPlayer::_CuePosition(DWORD dwEventIndex, DWORD ticks)
         }
 
         ZeroMemory(&_midiHdr, sizeof(_midiHdr));
-        _midiHdr.lpData = (LPSTR)(&_pRealData[dwEventIndex * 3]);
+        _midiHdr.lpData = (LPSTR)(&_streamData[dwEventIndex * 3]);
         // How long is it?
         DWORD cEvents;
         if (_cTotalStreamEvents > (dwEventIndex + MAX_STREAM_EVENTS))
@@ -392,9 +352,9 @@ void MidiPlayer::_CuePosition(DWORD dwEventIndex, DWORD ticks)
         }
 
         _dwCurrentChunkTickStart = 0;
-        if (dwEventIndex < (DWORD)_accumulatedStreamTicks.size())
+        if (dwEventIndex < (DWORD)_sequencer.GetEventCount())
         {
-            _dwCurrentChunkTickStart = _accumulatedStreamTicks[dwEventIndex];
+            _dwCurrentChunkTickStart = _sequencer.GetEventTicks(dwEventIndex);
         }
         _dwCurrentTickPos = (ticks == 0xffffffff) ? _dwCurrentChunkTickStart : ticks;
         _midiHdr.dwBufferLength = _midiHdr.dwBytesRecorded = (cEvents * 3 * sizeof(DWORD));
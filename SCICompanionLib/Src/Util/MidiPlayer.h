@@ -14,6 +14,7 @@
 #pragma once
 
 #include "Components/Sound.h"
+#include "MidiSequencer.h"
 
 class MidiPlayer
 {
@@ -49,8 +50,8 @@ private:
     MIDIHDR _midiHdr;
     DWORD _cRemainingStreamEvents; // In case it didn't fit into a 64k chunk
     DWORD _cTotalStreamEvents;
-    DWORD *_pRealData; // Full data for the 64k chunk in _midiHdr.
-    std::vector<DWORD> _accumulatedStreamTicks;   // Corresponds to _midiHdr.lpData / 3
+    std::vector<DWORD> _streamData; // Full data for the 64k chunk in _midiHdr. 3 DWORDs per event.
+    MidiSequencer _sequencer;
     DWORD _dwCurrentChunkTickStart;
     DWORD _dwCurrentTickPos;
     DeviceType _device;
@@ -13,17 +13,155 @@
 ***************************************************************************/
 #include "stdafx.h"
 #include "RGBOctree.h"
+#include "ImageUtil.h"
 
-RGBSpatial::RGBSpatial(int colorCount, const RGBQUAD *colors)
+namespace
 {
-    memset(_counts, 0, sizeof(_counts));
-    // Insert them into the tree.
+    const int BoxShift = 5;
+    const int BoxWidth = 1 << BoxShift;
+
+    int _GetBox(RGBQUAD color)
+    {
+        return (color.rgbRed >> BoxShift) | ((color.rgbGreen >> BoxShift) << 3) | ((color.rgbBlue >> BoxShift) << 6);
+    }
+
+    // Distance from a value to the nearest value covered by a box, along one channel.
+    int _GetDistanceToBox(int value, int low)
+    {
+        int high = low + BoxWidth - 1;
+        return (value < low) ? (low - value) : ((value > high) ? (value - high) : 0);
+    }
+}
+
+RGBSpatial::RGBSpatial(ColorMatching colorMatching, int colorCount, const uint8_t *mapping, const RGBQUAD *colors, uint8_t transparentColor, bool excludeTransparentIndex) :
+    _colorMatching(colorMatching),
+    _colorCount(colorCount),
+    _mapping(mapping),
+    _colors(colors),
+    _transparentColor(transparentColor),
+    _excludeTransparentIndex(excludeTransparentIndex),
+    _cache(CacheSize)
+{
+    if (colorMatching == ColorMatching::RGB)
+    {
+        std::fill_n(_lowerBoundWeights, 3, 1.0);
+    }
+    else
+    {
+        // The CCIR distance is 0.75 * (0.299 dr^2 + 0.587 dg^2 + 0.114 db^2) / 255^2 + (luma difference)^2.
+        // Dropping the luma term gives a lower bound. We shave a little off so that rounding can't make it
+        // exceed the real distance.
+        double scale = 0.75 / (255.0 * 255.0) * 0.999;
+        _lowerBoundWeights[0] = 0.299 * scale;
+        _lowerBoundWeights[1] = 0.587 * scale;
+        _lowerBoundWeights[2] = 0.114 * scale;
+    }
 
     for (int i = 0; i < colorCount; i++)
     {
-        RGBQUAD rgb = colors[i];
-        int box = (rgb.rgbRed >> 5) | ((rgb.rgbRed >> 2) & 0x38) | (((uint16_t)rgb.rgbBlue << 1) & 0x01c0);
-        _counts[box]++;
+        if (_IsCandidate(i))
+        {
+            _eligible.push_back((uint8_t)i);
+        }
     }
+    std::fill_n(_boxBuilt, BoxCount, false);
+}
 
+bool RGBSpatial::_IsCandidate(int index) const
+{
+    return (!_excludeTransparentIndex || (index != (int)_transparentColor)) &&
+        (_colors[_mapping[index]].rgbReserved != 0x0);
+}
+
+double RGBSpatial::_GetDistance(RGBQUAD one, RGBQUAD two) const
+{
+    return (_colorMatching == ColorMatching::RGB) ? (double)GetColorDistanceRGB(one, two) : GetColorDistanceCCIR(one, two);
+}
+
+const std::vector<uint8_t> &RGBSpatial::_GetBoxCandidates(int box)
+{
+    std::vector<uint8_t> &candidates = _boxCandidates[box];
+    if (!_boxBuilt[box])
+    {
+        _boxBuilt[box] = true;
+        int low[3] = { (box & 0x7) * BoxWidth, ((box >> 3) & 0x7) * BoxWidth, ((box >> 6) & 0x7) * BoxWidth };
+
+        // Both metrics are convex, so the furthest point in the box from any color is one of its corners.
+        std::vector<double> lowerBounds;
+        double smallestUpperBound = (std::numeric_limits<double>::max)();
+        for (uint8_t index : _eligible)
+        {
+            RGBQUAD color = _colors[_mapping[index]];
+            double upperBound = 0.0;
+            for (int corner = 0; corner < 8; corner++)
+            {
+                RGBQUAD cornerColor = {
+                    (uint8_t)(low[2] + ((corner & 4) ? (BoxWidth - 1) : 0)),
+                    (uint8_t)(low[1] + ((corner & 2) ? (BoxWidth - 1) : 0)),
+                    (uint8_t)(low[0] + ((corner & 1) ? (BoxWidth - 1) : 0)),
+                    0 };
+                upperBound = max(upperBound, _GetDistance(cornerColor, color));
+            }
+            smallestUpperBound = min(smallestUpperBound, upperBound);
+
+            int dr = _GetDistanceToBox(color.rgbRed, low[0]);
+            int dg = _GetDistanceToBox(color.rgbGreen, low[1]);
+            int db = _GetDistanceToBox(color.rgbBlue, low[2]);
+            lowerBounds.push_back(_lowerBoundWeights[0] * dr * dr + _lowerBoundWeights[1] * dg * dg + _lowerBoundWeights[2] * db * db);
+        }
+        // Allow a little slack for rounding, and use <= so that ties (which go to the lowest index) are kept.
+        smallestUpperBound *= 1.000001;
+        for (size_t i = 0; i < _eligible.size(); i++)
+        {
+            if (lowerBounds[i] <= smallestUpperBound)
+            {
+                candidates.push_back(_eligible[i]);
+            }
+        }
+    }
+    return candidates;
+}
+
+uint8_t RGBSpatial::FindBestMatch(RGBQUAD color)
+{
+    uint32_t rgb = (color.rgbRed << 16) | (color.rgbGreen << 8) | color.rgbBlue;
+    CacheEntry &entry = _cache[(uint32_t)(rgb * 2654435761u) >> 20];
+    if (entry.key != (rgb + 1))
+    {
+        // Same as the brute force search, but only over the candidates for this color's box. They're
+        // in ascending order, so ties go to the same index.
+        int bestIndex = 1;
+        double bestDistance = 1000000000000000.0;
+        for (uint8_t index : _GetBoxCandidates(_GetBox(color)))
+        {
+            double distance = _GetDistance(color, _colors[_mapping[index]]);
+            if (distance < bestDistance)
+            {
+                bestIndex = index;
+                bestDistance = distance;
+            }
+        }
+        entry.key = rgb + 1;
+        entry.index = (uint8_t)bestIndex;
+    }
+    return entry.index;
+}
+
+uint8_t RGBSpatial::FindBestMatchBruteForce(RGBQUAD color) const
+{
+    int bestIndex = 1;  // Just something that's not zero, so we can determine when we failed.
+    double bestDistance = 1000000000000000.0;
+    for (int i = 0; i < _colorCount; i++)
+    {
+        if (_IsCandidate(i))
+        {
+            double distance = _GetDistance(color, _colors[_mapping[i]]);
+            if (distance < bestDistance)
+            {
+                bestIndex = i;
+                bestDistance = distance;
+            }
+        }
+    }
+    return (uint8_t)bestIndex;
 }
@@ -13,14 +13,50 @@
 ***************************************************************************/
 #pragma once
 
+enum class ColorMatching;
+
+// Finds the closest palette entry to an RGB value, without having to check every palette entry.
+//
+// RGB space is divided into an 8x8x8 grid of boxes. For each box we keep a list of the palette entries that
+// could possibly be the closest match for some color in that box: those whose smallest possible distance
+// to the box is no more than the largest distance from the box to the palette entry that's nearest to it.
+// These lists are built the first time a box is used, and are usually just a handful of entries long.
+// The results are identical to FindBestMatchBruteForce (including which index wins a tie). Results are also
+// remembered in a small cache, since images tend to repeat colors.
+//
+// Not thread-safe: use one per thread.
 class RGBSpatial
 {
 public:
-    RGBSpatial(int colorCount, const RGBQUAD *colors);
+    RGBSpatial(ColorMatching colorMatching, int colorCount, const uint8_t *mapping, const RGBQUAD *colors, uint8_t transparentColor, bool excludeTransparentIndex);
+
+    uint8_t FindBestMatch(RGBQUAD color);
+    uint8_t FindBestMatchBruteForce(RGBQUAD color) const;
 
 private:
+    bool _IsCandidate(int index) const;
+    double _GetDistance(RGBQUAD one, RGBQUAD two) const;
+    const std::vector<uint8_t> &_GetBoxCandidates(int box);
+
+    static const int BoxCount = 8 * 8 * 8;
+    static const int CacheSize = 4096;
+    struct CacheEntry
+    {
+        uint32_t key;       // 0 if empty, otherwise the RGB value + 1
+        uint8_t index;
+    };
+
+    ColorMatching _colorMatching;
+    int _colorCount;
+    const uint8_t *_mapping;
+    const RGBQUAD *_colors;
+    uint8_t _transparentColor;
+    bool _excludeTransparentIndex;
+    // Per channel multipliers that turn squared channel differences into a lower bound for our metric.
+    double _lowerBoundWeights[3];
 
-    int _counts[8 * 8 * 8];
-    //int _colors[];
-    uint8_t _indexPool[256];
-};
\ No newline at end of file
+    std::vector<uint8_t> _eligible;
+    bool _boxBuilt[BoxCount];
+    std::vector<uint8_t> _boxCandidates[BoxCount];
+    std::vector<CacheEntry> _cache;
+};
@@ -0,0 +1,407 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#include "stdafx.h"
+#include "ThumbnailCache.h"
+#include "ResourceBlob.h"
+#include "PaletteOperations.h"
+#include "AppState.h"
+
+using namespace std;
+
+// Pack file layout:
+//  PackHeader
+//  PackIndexEntry[entryCount], sorted by key
+//  entry data
+// Each entry is an EntryHeader, followed by the palette colors and then the pixels.
+
+const char ThumbnailPackFilename[] = "thumbnails.cache";
+const uint32_t ThumbnailPackMagic = 0x4e485443; // CTHN
+const uint32_t ThumbnailPackVersion = 2;
+// If a pack grows larger than this, only the entries used in the current session are kept.
+const size_t MaxThumbnailPackSize = 64 * 1024 * 1024;
+
+#include <pshpack1.h>
+struct PackHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+};
+
+struct PackIndexEntry
+{
+    uint64_t key;
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct EntryHeader
+{
+    uint16_t cx;
+    uint16_t cy;
+    uint8_t bitsPerPixel;
+    uint8_t reserved;
+    uint16_t colorCount;
+};
+#include <poppack.h>
+
+// 64-bit FNV-1a
+const uint64_t FNVOffsetBasis = 0xcbf29ce484222325ULL;
+const uint64_t FNVPrime = 0x100000001b3ULL;
+
+static uint64_t _AddToHash(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= FNVPrime;
+    }
+    return hash;
+}
+
+template<typename _T>
+static uint64_t _AddValueToHash(uint64_t hash, const _T &value)
+{
+    return _AddToHash(hash, &value, sizeof(value));
+}
+
+ThumbnailKey::ThumbnailKey(ThumbnailKind kind) : _hash(FNVOffsetBasis)
+{
+    AddValue(ThumbnailPackVersion);
+    AddValue(kind);
+}
+
+ThumbnailKey &ThumbnailKey::Add(const void *data, size_t size)
+{
+    _hash = _AddToHash(_hash, data, size);
+    return *this;
+}
+
+ThumbnailKey &ThumbnailKey::Add(const ResourceBlob &blob)
+{
+    // Prefer the bytes as they are on disk, since they're smaller. We still need to distinguish
+    // the encoding, since the same bytes could decompress differently.
+    AddValue((uint32_t)blob.GetType());
+    AddValue(blob.GetEncoding());
+    AddValue(blob.GetDecompressedLength());
+    const uint8_t *compressed = blob.GetDataCompressed();
+    if (compressed && (blob.GetEncoding() != 0))
+    {
+        Add(compressed, blob.GetCompressedLength());
+    }
+    else if (blob.GetLength() > 0)
+    {
+        Add(blob.GetData(), blob.GetLength());
+    }
+    return *this;
+}
+
+ThumbnailKey &ThumbnailKey::Add(const PaletteComponent *palette)
+{
+    if (palette)
+    {
+        Add(palette->Colors, sizeof(palette->Colors));
+    }
+    else
+    {
+        AddValue((uint32_t)0);
+    }
+    return *this;
+}
+
+ThumbnailCache::ThumbnailCache() : _scope(FNVOffsetBasis), _packEntryCount(0) {}
+
+ThumbnailCache::~ThumbnailCache()
+{
+    Close();
+}
+
+void ThumbnailCache::Open(const std::string &gameFolder, const SCIVersion &version)
+{
+    Close();
+
+    lock_guard<mutex> lock(_mutex);
+    std::string cacheFolder = GetAppCacheFolder(gameFolder);
+    if (cacheFolder.empty())
+    {
+        return;
+    }
+    _packFilename = cacheFolder + "\\" + ThumbnailPackFilename;
+
+    // The parts of the version that affect how resources are read and drawn, and which resource
+    // map they come from (the cache folder is per game, but it's keyed by a hash of the path).
+    uint64_t scope = FNVOffsetBasis;
+    scope = _AddValueToHash(scope, version.MapFormat);
+    scope = _AddValueToHash(scope, version.PackageFormat);
+    scope = _AddValueToHash(scope, version.CompressionFormat);
+    scope = _AddValueToHash(scope, version.ViewFormat);
+    scope = _AddValueToHash(scope, version.PicFormat);
+    scope = _AddValueToHash(scope, version.HasPalette);
+    scope = _AddValueToHash(scope, version.sci11Palettes);
+    scope = _AddValueToHash(scope, version.DefaultResolution);
+    std::string mapFolder = gameFolder;
+    std::transform(mapFolder.begin(), mapFolder.end(), mapFolder.begin(), ::tolower);
+    _scope = _AddToHash(scope, mapFolder.c_str(), mapFolder.size());
+
+    auto mapped = MemoryMappedFile::FromFilename(_packFilename);
+    if (mapped.ok())
+    {
+        absl::Span<const uint8_t> data = mapped->GetDataBuffer();
+        if (data.size() >= sizeof(PackHeader))
+        {
+            const PackHeader *header = reinterpret_cast<const PackHeader *>(data.data());
+            if ((header->magic == ThumbnailPackMagic) &&
+                (header->version == ThumbnailPackVersion) &&
+                ((data.size() - sizeof(PackHeader)) / sizeof(PackIndexEntry) >= header->entryCount))
+            {
+                _packEntryCount = header->entryCount;
+                _pack = std::move(mapped).value();
+            }
+        }
+    }
+}
+
+void ThumbnailCache::Close()
+{
+    lock_guard<mutex> lock(_mutex);
+    if (!_packFilename.empty() && !_pending.empty())
+    {
+        try
+        {
+            _WritePack();
+        }
+        catch (std::exception &e)
+        {
+            // The cache is just an optimization. Don't let this get in the way.
+            appState->LogInfo("Unable to write thumbnail cache: %s", e.what());
+        }
+    }
+    _pack = MemoryMappedFile();
+    _packEntryCount = 0;
+    _pending.clear();
+    _touched.clear();
+    _packFilename.clear();
+    _scope = FNVOffsetBasis;
+}
+
+uint64_t ThumbnailCache::_GetScopedKey(uint64_t key) const
+{
+    return _AddValueToHash(_scope, key);
+}
+
+bool ThumbnailCache::_FindInPack(uint64_t key, const uint8_t *&entry, uint32_t &size) const
+{
+    if (_packEntryCount == 0)
+    {
+        return false;
+    }
+    absl::Span<const uint8_t> data = _pack.GetDataBuffer();
+    const PackIndexEntry *indexBegin = reinterpret_cast<const PackIndexEntry *>(data.data() + sizeof(PackHeader));
+    const PackIndexEntry *indexEnd = indexBegin + _packEntryCount;
+    const PackIndexEntry *found = lower_bound(indexBegin, indexEnd, key,
+        [](const PackIndexEntry &indexEntry, uint64_t key) { return indexEntry.key < key; });
+    if ((found != indexEnd) && (found->key == key) && (((size_t)found->offset + found->size) <= data.size()))
+    {
+        entry = data.data() + found->offset;
+        size = found->size;
+        return true;
+    }
+    return false;
+}
+
+static bool _DeserializeEntry(const uint8_t *entry, uint32_t size, ThumbnailImage &image)
+{
+    if (size < sizeof(EntryHeader))
+    {
+        return false;
+    }
+    const EntryHeader *header = reinterpret_cast<const EntryHeader *>(entry);
+    size_t colorBytes = header->colorCount * sizeof(RGBQUAD);
+    if ((sizeof(EntryHeader) + colorBytes) > size)
+    {
+        return false;
+    }
+    image.cx = header->cx;
+    image.cy = header->cy;
+    image.bitsPerPixel = header->bitsPerPixel;
+    const RGBQUAD *colors = reinterpret_cast<const RGBQUAD *>(entry + sizeof(EntryHeader));
+    image.colors.assign(colors, colors + header->colorCount);
+    const uint8_t *bits = entry + sizeof(EntryHeader) + colorBytes;
+    image.bits.assign(bits, entry + size);
+    return true;
+}
+
+static void _SerializeEntry(const ThumbnailImage &image, std::vector<uint8_t> &entry)
+{
+    EntryHeader header = { image.cx, image.cy, image.bitsPerPixel, 0, (uint16_t)image.colors.size() };
+    size_t colorBytes = image.colors.size() * sizeof(RGBQUAD);
+    entry.resize(sizeof(header) + colorBytes + image.bits.size());
+    memcpy(&entry[0], &header, sizeof(header));
+    if (colorBytes)
+    {
+        memcpy(&entry[sizeof(header)], &image.colors[0], colorBytes);
+    }
+    if (!image.bits.empty())
+    {
+        memcpy(&entry[sizeof(header) + colorBytes], &image.bits[0], image.bits.size());
+    }
+}
+
+bool ThumbnailCache::TryGet(uint64_t key, ThumbnailImage &image)
+{
+    lock_guard<mutex> lock(_mutex);
+    key = _GetScopedKey(key);
+    auto it = _pending.find(key);
+    if (it != _pending.end())
+    {
+        _touched.insert(key);
+        return _DeserializeEntry(&it->second[0], (uint32_t)it->second.size(), image);
+    }
+    const uint8_t *entry;
+    uint32_t size;
+    if (_FindInPack(key, entry, size))
+    {
+        _touched.insert(key);
+        return _DeserializeEntry(entry, size, image);
+    }
+    return false;
+}
+
+void ThumbnailCache::Put(uint64_t key, const ThumbnailImage &image)
+{
+    lock_guard<mutex> lock(_mutex);
+    if (!_packFilename.empty())
+    {
+        key = _GetScopedKey(key);
+        _SerializeEntry(image, _pending[key]);
+        _touched.insert(key);
+    }
+}
+
+void ThumbnailCache::_WritePack()
+{
+    // Gather everything we want to keep, from both the existing pack and this session.
+    map<uint64_t, pair<const uint8_t *, uint32_t>> entries;
+    size_t totalSize = 0;
+    for (auto &pending : _pending)
+    {
+        entries[pending.first] = make_pair(&pending.second[0], (uint32_t)pending.second.size());
+        totalSize += pending.second.size();
+    }
+    absl::Span<const uint8_t> data = _pack.GetDataBuffer();
+    const PackIndexEntry *index = (_packEntryCount > 0) ? reinterpret_cast<const PackIndexEntry *>(data.data() + sizeof(PackHeader)) : nullptr;
+    for (uint32_t i = 0; i < _packEntryCount; i++)
+    {
+        if ((entries.find(index[i].key) == entries.end()) && (((size_t)index[i].offset + index[i].size) <= data.size()))
+        {
+            entries[index[i].key] = make_pair(data.data() + index[i].offset, index[i].size);
+            totalSize += index[i].size;
+        }
+    }
+
+    if (totalSize > MaxThumbnailPackSize)
+    {
+        // Trim policy: thumbnails that weren't needed this session are the first to go.
+        for (auto it = entries.begin(); it != entries.end();)
+        {
+            if (_touched.find(it->first) == _touched.end())
+            {
+                it = entries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    sci::ostream out;
+    PackHeader header = { ThumbnailPackMagic, ThumbnailPackVersion, (uint32_t)entries.size() };
+    out << header;
+    uint32_t offset = (uint32_t)(sizeof(PackHeader) + entries.size() * sizeof(PackIndexEntry));
+    for (auto &entry : entries) // std::map, so these are sorted by key
+    {
+        PackIndexEntry indexEntry = { entry.first, offset, entry.second.second };
+        out << indexEntry;
+        offset += entry.second.second;
+    }
+    for (auto &entry : entries)
+    {
+        out.WriteBytes(entry.second.first, entry.second.second);
+    }
+
+    // Write to a temp file first, since we're still reading from the mapped pack.
+    string tempFilename = _packFilename + ".tmp";
+    {
+        CFile file(tempFilename.c_str(), CFile::modeCreate | CFile::modeWrite | CFile::typeBinary);
+        file.Write(out.GetInternalPointer(), out.GetDataSize());
+    }
+    _pack = MemoryMappedFile();
+    _packEntryCount = 0;
+    if (!MoveFileEx(tempFilename.c_str(), _packFilename.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFile(tempFilename.c_str());
+    }
+}
+
+HBITMAP ThumbnailCache::TryGetBitmap(uint64_t key)
+{
+    HBITMAP hbm = nullptr;
+    ThumbnailImage image;
+    if (TryGet(key, image))
+    {
+        SCIBitmapInfo bmi(image.cx, image.cy, image.colors.empty() ? nullptr : &image.colors[0], (int)image.colors.size());
+        bmi.bmiHeader.biBitCount = image.bitsPerPixel;
+        size_t stride = ((image.cx * image.bitsPerPixel + 31) / 32) * 4;
+        if (image.bits.size() == stride * image.cy)
+        {
+            uint8_t *bitsDest;
+            hbm = CreateDIBSection(nullptr, &bmi, DIB_RGB_COLORS, (void**)&bitsDest, nullptr, 0);
+            if (hbm)
+            {
+                memcpy(bitsDest, &image.bits[0], image.bits.size());
+            }
+        }
+    }
+    return hbm;
+}
+
+void ThumbnailCache::PutBitmap(uint64_t key, HBITMAP hbm)
+{
+    BITMAP bm;
+    if (hbm && GetObject(hbm, sizeof(bm), &bm))
+    {
+        ThumbnailImage image;
+        image.cx = (uint16_t)bm.bmWidth;
+        image.cy = (uint16_t)abs(bm.bmHeight);
+        image.bitsPerPixel = 32;
+        image.bits.resize(image.cx * 4 * image.cy);
+
+        BITMAPINFO bmi = {};
+        bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+        bmi.bmiHeader.biWidth = image.cx;
+        bmi.bmiHeader.biHeight = image.cy;
+        bmi.bmiHeader.biPlanes = 1;
+        bmi.bmiHeader.biBitCount = 32;
+        bmi.bmiHeader.biCompression = BI_RGB;
+        HDC hdc = GetDC(nullptr);
+        int lines = GetDIBits(hdc, hbm, 0, image.cy, &image.bits[0], &bmi, DIB_RGB_COLORS);
+        ReleaseDC(nullptr, hdc);
+        if (lines == image.cy)
+        {
+            Put(key, image);
+        }
+    }
+}
@@ -0,0 +1,96 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#pragma once
+
+// A content-addressed cache of rendered thumbnails (pic list, view list, room explorer).
+//
+// Entries are keyed by a hash of the resource bytes, palette and render settings, so they never
+// need to be explicitly invalidated: a changed resource just produces a different key. The cache
+// also mixes the game's SCI version and resource map into every key, since they change how the
+// same bytes are drawn.
+// All entries for a game live in a single pack file in the per-user cache folder for the game.
+// The pack is memory-mapped when the game is opened, and its sorted index is binary searched in
+// place. New entries are kept in memory and merged into a fresh pack when the game is closed.
+
+class ResourceBlob;
+struct PaletteComponent;
+
+// Different kinds of thumbnails for the same resource need different keys.
+enum class ThumbnailKind : uint32_t
+{
+    PicList = 1,
+    ViewList = 2,
+    RoomExplorer = 3,
+};
+
+class ThumbnailKey
+{
+public:
+    ThumbnailKey(ThumbnailKind kind);
+
+    ThumbnailKey &Add(const void *data, size_t size);
+    ThumbnailKey &Add(const ResourceBlob &blob);
+    ThumbnailKey &Add(const PaletteComponent *palette);
+    template<typename _T>
+    ThumbnailKey &AddValue(const _T &value) { return Add(&value, sizeof(value)); }
+
+    uint64_t GetValue() const { return _hash; }
+
+private:
+    uint64_t _hash;
+};
+
+struct ThumbnailImage
+{
+    ThumbnailImage() : cx(0), cy(0), bitsPerPixel(0) {}
+
+    uint16_t cx;
+    uint16_t cy;
+    uint8_t bitsPerPixel;           // 8 or 32
+    std::vector<RGBQUAD> colors;    // Only for 8bpp images
+    std::vector<uint8_t> bits;      // Bottom-up, DWORD aligned scanlines
+};
+
+class ThumbnailCache
+{
+public:
+    ThumbnailCache();
+    ~ThumbnailCache();
+
+    void Open(const std::string &gameFolder, const SCIVersion &version);
+    void Close();
+
+    bool TryGet(uint64_t key, ThumbnailImage &image);
+    void Put(uint64_t key, const ThumbnailImage &image);
+
+    // Convenience wrappers for the list views, which deal in HBITMAPs.
+    HBITMAP TryGetBitmap(uint64_t key);
+    void PutBitmap(uint64_t key, HBITMAP hbm);
+
+private:
+    uint64_t _GetScopedKey(uint64_t key) const;
+    bool _FindInPack(uint64_t key, const uint8_t *&entry, uint32_t &size) const;
+    void _WritePack();
+
+    std::mutex _mutex;
+    std::string _packFilename;
+    // Identifies the SCI version and resource map that entries were drawn for.
+    uint64_t _scope;
+    MemoryMappedFile _pack;
+    uint32_t _packEntryCount;
+    // Serialized entries that were added this session and aren't in the pack yet.
+    std::unordered_map<uint64_t, std::vector<uint8_t>> _pending;
+    // Keys that were requested or added this session. Used for trimming the pack.
+    std::unordered_set<uint64_t> _touched;
+};
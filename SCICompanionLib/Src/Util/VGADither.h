@@ -13,7 +13,10 @@
 ***************************************************************************/
 #pragma once
 
-// We use error diffusion dithering. Ordered dithering won't work with arbitrary or non-evenly spaced palettes.
+#include <emmintrin.h>
+
+// We use error diffusion dithering. Ordered dithering won't work well with arbitrary or non-evenly spaced palettes,
+// so it's only used for alpha, and as a cheap approximation for live previews.
 
 template <typename T>
 class dither_traits
@@ -21,12 +24,15 @@ class dither_traits
 public:
 };
 
-struct RGBError
+// Padded to 64 bits so the error can be accumulated with a single SSE2 operation.
+struct alignas(8) RGBError
 {
-    RGBError() : r(0), g(0), b(0) {}
+    RGBError() : r(0), g(0), b(0), unused(0) {}
+    explicit RGBError(int16_t value) : r(value), g(value), b(value), unused(0) {}
     int16_t r;
     int16_t g;
     int16_t b;
+    int16_t unused;
 
     RGBError operator*(int16_t m)
     {
@@ -93,6 +99,19 @@ int16_t CalculateError(uint8_t orig, uint8_t chosen);
 RGBQUAD AdjustWithError(RGBQUAD orig, RGBError accError, int16_t factor);
 uint8_t AdjustWithError(uint8_t orig, int16_t accError, int16_t factor);
 
+// accError += error * weight, with the same 16 bit wraparound as the scalar operators.
+inline void AccumulateError(RGBError &accError, const RGBError &error, int16_t weight)
+{
+    __m128i acc = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&accError));
+    __m128i err = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&error));
+    acc = _mm_add_epi16(acc, _mm_mullo_epi16(err, _mm_set1_epi16(weight)));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(&accError), acc);
+}
+inline void AccumulateError(int16_t &accError, int16_t error, int16_t weight)
+{
+    accError += error * weight;
+}
+
 template<typename T, typename _TAlgorithm>
 class ErrorDiffusionDither
 {
@@ -100,6 +119,11 @@ public:
     typedef typename dither_traits<T>::error_type TError;
     typedef _TAlgorithm Algorithm;
 
+    // Pixels on the next row can't be processed until this many more pixels on the current row are done.
+    // This is what lets rows be processed concurrently (see RGBToPalettized).
+    static const bool PropagatesError = true;
+    static const int RowLead = Algorithm::ExpandX + 1;
+
     ErrorDiffusionDither(int cx, int cy)
     {
         _cxE = cx + Algorithm::ExpandX;   // Room for below left and right
@@ -121,12 +145,10 @@ public:
         for (auto &offsetAndWeight : Algorithm::Matrix)
         {
             int index = (y + offsetAndWeight.y) * _cxE + x + offsetAndWeight.x;
-            TError temp = _error[index];
-            temp += errorBase * offsetAndWeight.weight;
             // Trying to fix error with JarvisJudiceNinke where completely transparent pixels
             // Overall, things should average out, not sure why I'm getting error values beyond our range.
-            // _error[index] = ClampToSpan(temp, Algorithm::Divisor);
-            _error[index] = temp;
+            // _error[index] = ClampToSpan(_error[index], Algorithm::Divisor);
+            AccumulateError(_error[index], errorBase, (int16_t)offsetAndWeight.weight);
         }
     }
 
@@ -142,6 +164,9 @@ template<typename T>
 class NoDither
 {
 public:
+    static const bool PropagatesError = false;
+    static const int RowLead = 0;
+
     NoDither(int cx, int cy) {}
     T ApplyErrorAt(T rgb, int x, int y)
     {
@@ -158,22 +183,25 @@ public:
     typedef typename dither_traits<T>::error_type TError;
     static const int MatrixSize = 4;
     static const int Divisor = (MatrixSize * MatrixSize) + 1;
+    static const bool PropagatesError = false;
+    static const int RowLead = 0;
 
-    OrderedDither(int cx, int cy)
+    // By default the matrix is scaled to 0-255, which only works for white/black dithering.
+    // A smaller spread nudges colors towards their neighbors in a palette instead.
+    OrderedDither(int cx, int cy, int spread = 255)
     {
-        // Scale the matrix to 0-255. So basically, this only works for white/black dithering.
         for (int y = 0; y < MatrixSize; y++)
         {
             for (int x = 0; x < MatrixSize; x++)
             {
-                _matrix[x][y] = BayerMatrix[x][y] * 255 - 128 * Divisor;
+                _matrix[x][y] = (int16_t)(BayerMatrix[x][y] * spread - ((spread + 1) / 2) * Divisor);
             }
         }
     }
 
     T ApplyErrorAt(T rgb, int x, int y)
     {
-        TError errorAccum = _matrix[x % MatrixSize][y % MatrixSize];
+        TError errorAccum(_matrix[x % MatrixSize][y % MatrixSize]);
         return AdjustWithError(rgb, errorAccum, Divisor);
     }
 
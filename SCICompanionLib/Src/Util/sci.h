@@ -347,6 +347,8 @@ DEFINE_ENUM_FLAGS(PicScreenFlags, uint32_t)
 bool CopyFilesOver(HWND hwnd, const std::string &from, const std::string &to);
 bool DeleteDirectory(HWND hwnd, const std::string &folder);
 std::string GetRandomTempFolder();
+// A per-user folder for caches belonging to a game, outside of the game folder. Empty if it can't be created.
+std::string GetAppCacheFolder(const std::string &gameFolder);
 bool EnsureFolderExists(const std::string &folderName, bool throwException = true);
 
 enum class OutputPaneType
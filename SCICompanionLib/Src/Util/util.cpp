@@ -17,6 +17,7 @@
 #include "format.h"
 #include "WindowsUtil.h"
 #include "TlHelp32.h"
+#include <shlobj.h>
 #include <filesystem>
 #include "BaseWindowsUtil.h"
 
@@ -666,6 +667,37 @@ std::string GetRandomTempFolder()
     return final;
 }
 
+std::string GetAppCacheFolder(const std::string &gameFolder)
+{
+    std::string folder;
+    char szPath[MAX_PATH];
+    if (!gameFolder.empty() && SHGetSpecialFolderPath(nullptr, szPath, CSIDL_LOCAL_APPDATA, TRUE))
+    {
+        // One sub-folder per game, named by a hash (FNV-1a) of its path.
+        std::string normalized = gameFolder;
+        std::transform(normalized.begin(), normalized.end(), normalized.begin(), ::tolower);
+        while (!normalized.empty() && (normalized.back() == '\\'))
+        {
+            normalized.pop_back();
+        }
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (char ch : normalized)
+        {
+            hash ^= (uint8_t)ch;
+            hash *= 0x100000001b3ULL;
+        }
+
+        std::string appFolder = std::string(szPath) + "\\SCICompanion";
+        std::string cacheFolder = appFolder + "\\Cache";
+        std::string gameCacheFolder = cacheFolder + "\\" + fmt::format("{0:016x}", hash);
+        if (EnsureFolderExists(appFolder, false) && EnsureFolderExists(cacheFolder, false) && EnsureFolderExists(gameCacheFolder, false))
+        {
+            folder = gameCacheFolder;
+        }
+    }
+    return folder;
+}
+
 std::string GetBinaryDataVisualization(const uint8_t *data, size_t length, int columns)
 {
     uint32_t position = 0;
@@ -22,6 +22,11 @@
 #include "ResourceMap.h"
 #include "AppState.h"
 #include "ResourceContainer.h"
+#include "RasterOperations.h"
+#include "Pic.h"
+#include "PicCommands.h"
+#include "PicDrawManager.h"
+#include "PicOperations.h"
 #include "Helper.h"
 #include "format.h"
 
@@ -33,6 +38,12 @@ using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 const char SierraGameFolder[] = "e:\\SierraGames\\";
 // Each subfolder of this folder will be analyzed to find a resource.map.
 
+// BenchmarkPicDraw checks a hash of every rendered pic against this file in each game folder. It fails
+// if the file is missing. To record (or accept new) rendering results, set RecordPicGoldenHashes to true
+// for a run.
+const char PicGoldenHashFile[] = "picdraw.golden";
+const bool RecordPicGoldenHashes = false;
+
 // We can't easily identify the game, so just identify type/number pairs that are known to fail.
 // These are the known problems out of about 35 games from SCI0 to SCI1.1
 std::pair<ResourceType, int> KnownFailures[]
@@ -63,6 +74,257 @@ namespace UnitTests
         }
 
         TEST_METHOD(TestAllGames)
+        {
+            for (auto &gameFolder : _GetGameFolders())
+            {
+                _LoadAllResources(gameFolder);
+            }
+        }
+
+        // Decodes every view in each game, and reports how long it took. Every cel is also run through
+        // the RLE encoder and decoder, to check they round trip.
+        TEST_METHOD(BenchmarkViewDecode)
+        {
+            for (auto &gameFolder : _GetGameFolders())
+            {
+                appState = new AppState(nullptr);
+                appState->SetGameFolder(gameFolder.c_str());
+                Assert::IsTrue(appState->GetResourceMap().IsGameLoaded());
+
+                std::vector<std::unique_ptr<ResourceBlob>> blobs;
+                auto container = appState->GetResourceMap().Resources(ResourceTypeFlags::View, ResourceEnumFlags::None | ResourceEnumFlags::AddInDefaultEnumFlags);
+                for (auto blob : *container)
+                {
+                    blobs.push_back(std::move(blob));
+                }
+
+                std::vector<std::unique_ptr<ResourceEntity>> views;
+                LARGE_INTEGER frequency, start, end;
+                QueryPerformanceFrequency(&frequency);
+                QueryPerformanceCounter(&start);
+                for (auto &blob : blobs)
+                {
+                    try
+                    {
+                        views.push_back(CreateResourceFromResourceData(*blob, false));
+                    }
+                    catch (std::exception)
+                    {
+                        // Known failures are covered by TestAllGames.
+                    }
+                }
+                QueryPerformanceCounter(&end);
+
+                int celCount = 0;
+                for (auto &view : views)
+                {
+                    for (const Loop &loop : view->GetComponent<RasterComponent>().Loops)
+                    {
+                        for (const Cel &cel : loop.Cels)
+                        {
+                            sci::ostream rleStream;
+                            sci::ostream literalStream;
+                            WriteImageData(rleStream, cel, true, literalStream, false);
+                            sci::istream rleRead = sci::istream_from_ostream(rleStream);
+                            sci::istream literalRead = sci::istream_from_ostream(literalStream);
+                            Cel celRoundTrip(cel.size, cel.placement, cel.TransparentColor);
+                            ReadImageData(rleRead, celRoundTrip, true, literalRead);
+                            Assert::IsTrue(0 == memcmp(&cel.Data[0], &celRoundTrip.Data[0], cel.Data.size()), L"Cel did not round trip.");
+                            celCount++;
+                        }
+                    }
+                }
+
+                double ms = (double)(end.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+                Logger::WriteMessage(absl::StrFormat("%s: decoded %d views (%d cels) in %.2fms.", gameFolder, (int)views.size(), celCount, ms).c_str());
+
+                appState->ResetClassBrowser();
+                delete appState;
+                appState = nullptr;
+            }
+        }
+
+        // Renders every pic in each game through PicDrawManager, for all screens and positions, and checks
+        // the results against the golden hashes. Reports throughput, the slowest pics, and the time spent
+        // in each kind of command. Use this to check changes to the fill, line and pattern drawing code.
+        TEST_METHOD(BenchmarkPicDraw)
+        {
+            LARGE_INTEGER frequency;
+            QueryPerformanceFrequency(&frequency);
+            auto toMs = [&frequency](LONGLONG ticks) { return (double)ticks * 1000.0 / (double)frequency.QuadPart; };
+
+            for (auto &gameFolder : _GetGameFolders())
+            {
+                appState = new AppState(nullptr);
+                appState->SetGameFolder(gameFolder.c_str());
+                Assert::IsTrue(appState->GetResourceMap().IsGameLoaded());
+
+                std::vector<std::unique_ptr<ResourceEntity>> pics;
+                auto container = appState->GetResourceMap().Resources(ResourceTypeFlags::Pic, ResourceEnumFlags::None | ResourceEnumFlags::AddInDefaultEnumFlags);
+                for (auto blob : *container)
+                {
+                    try
+                    {
+                        pics.push_back(CreateResourceFromResourceData(*blob, false));
+                    }
+                    catch (std::exception)
+                    {
+                        // Known failures are covered by TestAllGames.
+                    }
+                }
+
+                std::map<int, uint64_t> hashes;
+                std::vector<std::pair<double, int>> picTimes;
+                LONGLONG commandTicks[PicCommand::CommandTypeMax + 1] = {};
+                size_t commandCounts[PicCommand::CommandTypeMax + 1] = {};
+                size_t totalCommands = 0;
+                LONGLONG totalTicks = 0;
+                for (auto &resource : pics)
+                {
+                    const PicComponent &pic = resource->GetComponent<PicComponent>();
+                    const PaletteComponent *palette = resource->TryGetComponent<PaletteComponent>();
+                    PicScreenFlags screens = PicScreenFlags::Visual | PicScreenFlags::Priority;
+                    if (pic.Traits->SupportsControlScreen)
+                    {
+                        screens |= PicScreenFlags::Control;
+                    }
+
+                    LARGE_INTEGER start, end;
+                    PicDrawManager pdm(&pic, palette);
+                    QueryPerformanceCounter(&start);
+                    pdm.RefreshAllScreens(screens, PicPositionFlags::PrePlugin | PicPositionFlags::PostPlugin | PicPositionFlags::Final);
+                    QueryPerformanceCounter(&end);
+                    totalTicks += end.QuadPart - start.QuadPart;
+                    totalCommands += pic.commands.size();
+                    picTimes.emplace_back(toMs(end.QuadPart - start.QuadPart), resource->ResourceNumber);
+
+                    uint64_t hash = 0xcbf29ce484222325;
+                    for (PicPosition position : { PicPosition::PrePlugin, PicPosition::PostPlugin, PicPosition::Final })
+                    {
+                        for (PicScreen screen : { PicScreen::Visual, PicScreen::Priority, PicScreen::Control })
+                        {
+                            if (IsFlagSet(screens, PicScreenToFlags(screen)))
+                            {
+                                const uint8_t *bits = pdm.GetPicBits(screen, position, pic.Size);
+                                for (int i = 0; i < pic.Size.cx * pic.Size.cy; i++)
+                                {
+                                    hash = (hash ^ bits[i]) * 0x100000001b3;
+                                }
+                            }
+                        }
+                    }
+                    hashes[resource->ResourceNumber] = hash;
+
+                    _TimeCommands(pic, palette != nullptr, commandTicks, commandCounts);
+                }
+
+                double totalMs = toMs(totalTicks);
+                Logger::WriteMessage(absl::StrFormat("%s: drew %d pics (%d commands) in %.2fms: %.1f pics/sec, %.0f commands/sec.",
+                    gameFolder, (int)pics.size(), (int)totalCommands, totalMs, pics.size() * 1000.0 / totalMs, totalCommands * 1000.0 / totalMs).c_str());
+
+                std::sort(picTimes.begin(), picTimes.end(), std::greater<std::pair<double, int>>());
+                for (size_t i = 0; i < min((size_t)10, picTimes.size()); i++)
+                {
+                    Logger::WriteMessage(absl::StrFormat("    pic %d: %.3fms", picTimes[i].second, picTimes[i].first).c_str());
+                }
+                for (int type = 0; type <= PicCommand::CommandTypeMax; type++)
+                {
+                    if (commandCounts[type])
+                    {
+                        Logger::WriteMessage(absl::StrFormat("    command type %d: %d commands in %.2fms (%.2fus each)",
+                            type, (int)commandCounts[type], toMs(commandTicks[type]), toMs(commandTicks[type]) * 1000.0 / commandCounts[type]).c_str());
+                    }
+                }
+
+                _CheckGoldenHashes(gameFolder, hashes);
+
+                appState->ResetClassBrowser();
+                delete appState;
+                appState = nullptr;
+            }
+        }
+
+        // Draws each command on its own, the same way PicDrawManager does, and accumulates the time by command type.
+        void _TimeCommands(const PicComponent &pic, bool isVGA, LONGLONG *commandTicks, size_t *commandCounts)
+        {
+            size_t size = pic.Size.cx * pic.Size.cy;
+            std::vector<uint8_t> visual(size, isVGA ? 0xff : 0x0f);
+            std::vector<uint8_t> priority(size, 0);
+            std::vector<uint8_t> control(size, 0);
+            std::vector<uint8_t> aux(size, 0);
+            PicData data =
+            {
+                PicScreenFlags::Visual | PicScreenFlags::Priority | PicScreenFlags::Control | PicScreenFlags::Aux,
+                &visual[0], &priority[0], &control[0], &aux[0],
+                isVGA,
+                false,
+                pic.Size,
+                pic.Traits->ContinuousPriority
+            };
+            ViewPort state(0);
+            for (const PicCommand &command : pic.commands)
+            {
+                LARGE_INTEGER start, end;
+                QueryPerformanceCounter(&start);
+                command.Draw(&data, state);
+                QueryPerformanceCounter(&end);
+                commandTicks[command.type] += end.QuadPart - start.QuadPart;
+                commandCounts[command.type]++;
+            }
+        }
+
+        void _CheckGoldenHashes(const std::string &gameFolder, const std::map<int, uint64_t> &hashes)
+        {
+            std::string goldenFilename = gameFolder + "\\" + PicGoldenHashFile;
+            if (RecordPicGoldenHashes)
+            {
+                std::ofstream newGoldenFile(goldenFilename);
+                for (auto &pair : hashes)
+                {
+                    newGoldenFile << pair.first << " " << std::hex << pair.second << std::dec << "\n";
+                }
+                Logger::WriteMessage(absl::StrFormat("    Recorded golden hashes for %d pics.", (int)hashes.size()).c_str());
+                return;
+            }
+
+            std::ifstream goldenFile(goldenFilename);
+            if (!goldenFile)
+            {
+                Logger::WriteMessage(absl::StrFormat("    Not verified: there is no %s.", goldenFilename).c_str());
+                Assert::Fail(L"Pic rendering was not verified, since there are no golden hashes. Set RecordPicGoldenHashes to record them.");
+            }
+
+            int mismatches = 0;
+            std::set<int> verified;
+            int number;
+            uint64_t expected;
+            while (goldenFile >> std::dec >> number >> std::hex >> expected)
+            {
+                auto it = hashes.find(number);
+                if (it != hashes.end())
+                {
+                    verified.insert(number);
+                    if (it->second != expected)
+                    {
+                        Logger::WriteMessage(absl::StrFormat("    pic %d does not match its golden hash.", number).c_str());
+                        mismatches++;
+                    }
+                }
+            }
+            int unverified = 0;
+            for (auto &pair : hashes)
+            {
+                if (verified.find(pair.first) == verified.end())
+                {
+                    Logger::WriteMessage(absl::StrFormat("    pic %d not verified: it has no golden hash.", pair.first).c_str());
+                    unverified++;
+                }
+            }
+            Assert::AreEqual(0, mismatches, L"Some pics were rendered differently.");
+            Assert::AreEqual(0, unverified, L"Some pics have no golden hash. Set RecordPicGoldenHashes to record them.");
+        }
+
+        std::vector<std::string> _GetGameFolders()
         {
             std::string findString = SierraGameFolder;
             findString += "*";
@@ -79,7 +341,7 @@ namespace UnitTests
                     {
                         if (*findData.cFileName != '.')
                         {
-                            folders.push_back(findData.cFileName);
+                            folders.push_back(std::string(SierraGameFolder) + findData.cFileName);
                         }
                     }
 
@@ -92,13 +354,7 @@ namespace UnitTests
             {
                 Logger::WriteMessage(absl::StrFormat("Found no games. Directory: %s", findString).c_str());
             }
-
-            for (auto folder : folders)
-            {
-                std::string finalPath = SierraGameFolder;
-                finalPath += folder;
-                _LoadAllResources(finalPath);
-            }
+            return folders;
         }
 
         void _LoadAllResources(const std::string &gameFolder)
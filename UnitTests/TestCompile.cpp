@@ -19,6 +19,20 @@
 #include "CompileContext.h"
 #include "Helper.h"
 #include "ScriptConvert.h"
+#include "CompiledScript.h"
+#include "GameFolderHelper.h"
+#include "PMachineInterpreter.h"
+#include "SaidMatcher.h"
+#include "InstructionDecoder.h"
+#include "ScriptOMAll.h"
+#include "SyntaxParser.h"
+#include "ScriptStream.h"
+#include "ClassBrowser.h"
+#include "format.h"
+#include "ExportUsage.h"
+#include "Vocab99x.h"
+#include "Disassembler.h"
+#include "Text.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -47,6 +61,525 @@ namespace UnitTests
             _DoIt();
         }
 
+        TEST_METHOD(TestPeepholeOptimizer)
+        {
+            scicode code(sciVersion0);
+            code.inst(0, Opcode::LINK, 1);
+            code_pos start = code.get_cur_pos();
+            code.inst(0, Opcode::PUSH0);
+            code.inst(0, Opcode::TOSS);             // push0; toss -> gone
+            code.inst(0, Opcode::SAL, 4);
+            code.inst(0, Opcode::LAL, 4);           // Already in the acc
+            code.inst(0, Opcode::BNT, code.get_undetermined());
+            code_pos branchOverJump = code.get_cur_pos();
+            code.inst(0, Opcode::JMP, code.get_undetermined());
+            code_pos jumpToJump = code.get_cur_pos();
+            code.inst(0, Opcode::LDI, 1);
+            code_pos elseCase = code.get_cur_pos();
+            code.inst(0, Opcode::JMP, code.get_undetermined());
+            code_pos jumpToReturn = code.get_cur_pos();
+            code.inst(0, Opcode::LDI, 5);           // Unreachable
+            code.inst(0, Opcode::RET);
+            code_pos ret = code.get_cur_pos();
+            code.set_call_target(branchOverJump, elseCase);
+            code.set_call_target(jumpToJump, jumpToReturn);
+            code.set_call_target(jumpToReturn, ret);
+
+            uint16_t sizeBefore = 2 + 1 + 1 + 2 + 2 + 2 + 2 + 2 + 2 + 2 + 1;
+            int saved = code.optimize({ start });
+            // link 1; sal 4; bt L; ldi 1; ret; L: ret
+            uint16_t sizeAfter = code.calc_size();
+            Assert::AreEqual((int)(sizeBefore - sizeAfter), saved);
+            Assert::AreEqual((uint16_t)(2 + 2 + 2 + 2 + 1 + 1), sizeAfter);
+            Assert::IsTrue(start == code.get_beginning());
+            Assert::IsTrue(Opcode::BT == branchOverJump->get_opcode());
+        }
+
+        TEST_METHOD(TestInterpreter)
+        {
+            // (procedure (proc x) (return (+ (* x 3) 4)))
+            scicode code(sciVersion0);
+            code.inst(0, Opcode::LAP, 1);
+            code.inst(0, Opcode::PUSH);
+            code.inst(0, Opcode::LDI, 3);
+            code.inst(0, Opcode::MUL);
+            code.inst(0, Opcode::PUSH);
+            code.inst(0, Opcode::LDI, 4);
+            code.inst(0, Opcode::ADD);
+            code.inst(0, Opcode::RET);
+            CompiledScript script(100);
+            _LoadCode(code, script);
+
+            PMachineInterpreter interpreter(sciVersion0);
+            interpreter.AddScript(script);
+            PMachineValue result = interpreter.CallProcedure(100, 0, { 5 });
+            Assert::IsTrue(result.IsNumber());
+            Assert::AreEqual((uint16_t)19, result.Offset);
+            const PMachineStats &stats = interpreter.GetStats();
+            Assert::AreEqual((uint64_t)8, stats.Instructions);
+            Assert::AreEqual((uint64_t)2, stats.OpcodeCounts[(int)Opcode::PUSH]);
+            Assert::AreEqual((size_t)3, stats.MaxStackDepth);     // argc, x, x*3
+            Assert::AreEqual((size_t)1, stats.MaxCallDepth);
+        }
+
+        TEST_METHOD(TestInterpreterSkipsDebugInfo)
+        {
+            // SCI2 code can have filename and line number instructions mixed in.
+            const TargetArchitecture *arch = GetTargetArchitecture(sciVersion2);
+            std::vector<uint8_t> codeBytes = { arch->OpcodeToRaw(Opcode::Filename, false), 'm', 'a', 'i', 'n', '.', 's', 'c', 0 };
+            codeBytes.insert(codeBytes.end(), { arch->OpcodeToRaw(Opcode::LineNumber, false), 12, 0 });
+            codeBytes.insert(codeBytes.end(), { arch->OpcodeToRaw(Opcode::LDI, false), 42, 0 });
+            codeBytes.insert(codeBytes.end(), { arch->OpcodeToRaw(Opcode::LineNumber, false), 13, 0 });
+            codeBytes.push_back(arch->OpcodeToRaw(Opcode::RET, false));
+            CompiledScript script(100);
+            _LoadCodeBytes(codeBytes, script);
+
+            PMachineInterpreter interpreter(sciVersion2);
+            interpreter.AddScript(script);
+            PMachineValue result = interpreter.CallProcedure(100, 0, {});
+            Assert::AreEqual((uint16_t)42, result.Offset);
+            Assert::AreEqual((uint64_t)5, interpreter.GetStats().Instructions);
+        }
+
+        TEST_METHOD(TestIndexedSCOLookups)
+        {
+            CSCOFile sco = _MakeSCOFile(12, 40);
+            IndexedSCOFile indexed(sco);
+
+            // The hashed lookups find the same things as the linear ones, including for duplicates.
+            for (const char *name : { "a", "b", "c" })
+            {
+                WORD expected = 0xffff, actual = 0xffff;
+                Assert::AreEqual(sco.GetVariableIndex(name, expected), indexed.GetVariableIndex(name, actual));
+                Assert::AreEqual(expected, actual);
+            }
+            for (const char *name : { "proc1", "proc2", "proc3" })
+            {
+                WORD expected = 0xffff, actual = 0xffff;
+                Assert::AreEqual(sco.GetExportIndex(name, expected), indexed.GetExportIndex(name, actual));
+                Assert::AreEqual(expected, actual);
+            }
+            for (const char *name : { "Foo", "Bar", "Baz" })
+            {
+                const CSCOObjectClass *expected = nullptr;
+                sco.GetClass(name, &expected);
+                const CSCOObjectClass *actual = indexed.GetClass(name);
+                Assert::AreEqual(expected != nullptr, actual != nullptr);
+                if (expected)
+                {
+                    Assert::AreEqual(expected->GetSpecies(), actual->GetSpecies());
+                }
+            }
+            Assert::AreEqual(std::string("Bar"), indexed.GetClassBySpecies(41)->GetName());
+            Assert::AreEqual((WORD)42, indexed.GetClassBySpecies(42)->GetSpecies());
+            Assert::IsTrue(indexed.GetClassBySpecies(43) == nullptr);
+        }
+
+        TEST_METHOD(TestSCOCacheSharesFiles)
+        {
+            SelectorTable selectors;
+            _CountingSCOLoader loader;
+            SCOCache cache;
+
+            // Failures aren't remembered, since the .sco may be generated later in the build.
+            Assert::IsFalse(cache.Load("Test", loader, selectors).ok());
+            loader.Files["Test"] = _MakeSCOFile(12, 40);
+            auto first = cache.Load("Test", loader, selectors);
+            Assert::IsTrue(first.ok());
+            Assert::AreEqual(2, loader.Loads);
+
+            // Later loads, in any case, share the same file without reading it again.
+            auto second = cache.Load("TEST", loader, selectors);
+            Assert::IsTrue(second.ok());
+            Assert::IsTrue(first->get() == second->get());
+            Assert::AreEqual(2, loader.Loads);
+
+            std::shared_ptr<const IndexedSCOFile> bySpecies;
+            const CSCOObjectClass *pClass = nullptr;
+            Assert::IsTrue(cache.FindClassBySpecies(41, bySpecies, pClass));
+            Assert::IsTrue(bySpecies.get() == first->get());
+            Assert::AreEqual(std::string("Bar"), pClass->GetName());
+
+            // Once the script is rewritten, it's read again.
+            cache.Invalidate(12);
+            Assert::IsFalse(cache.FindClassBySpecies(41, bySpecies, pClass));
+            loader.Files["Test"] = _MakeSCOFile(12, 50);
+            auto third = cache.Load("Test", loader, selectors);
+            Assert::IsTrue(third.ok());
+            Assert::AreEqual(3, loader.Loads);
+            Assert::IsTrue(first->get() != third->get());
+            Assert::IsTrue(cache.FindClassBySpecies(51, bySpecies, pClass));
+            // The old file is still usable by anyone holding on to it.
+            Assert::AreEqual(std::string("Bar"), (*first)->GetClassBySpecies(41)->GetName());
+        }
+
+        TEST_METHOD(TestSaidMatcher)
+        {
+            Vocab000 vocab;
+            vocab.AddNewWord("look", WordClass::ImperativeVerb, false);
+            vocab.AddNewWord("put", WordClass::ImperativeVerb, false);
+            vocab.AddNewWord("the", WordClass::Article, false);
+            vocab.AddNewWord("at", WordClass::Proposition, false);
+            vocab.AddNewWord("in", WordClass::Proposition, false);
+            vocab.AddNewWord("tree", WordClass::Noun, false);
+            vocab.AddNewWord("key", WordClass::Noun, false);
+            vocab.AddNewWord("box", WordClass::Noun, false);
+
+            SaidMatcher matcher(vocab);
+            Assert::IsTrue(matcher.AddSpec(1, "look/tree"));
+            Assert::IsTrue(matcher.AddSpec(1, "look<at/tree"));
+            Assert::IsTrue(matcher.AddSpec(1, "look[/tree]"));
+            Assert::IsTrue(matcher.AddSpec(1, "put/key/box"));
+            Assert::IsTrue(matcher.AddSpec(1, "look>"));
+            Assert::IsFalse(matcher.AddSpec(1, "climb/tree"));
+
+            std::vector<size_t> matches;
+            Assert::IsTrue(matcher.Match("Look at the tree.", matches));
+            Assert::IsTrue(std::vector<size_t>({ 0, 1, 2, 4 }) == matches);
+            Assert::IsTrue(matcher.Match("look", matches));
+            Assert::IsTrue(std::vector<size_t>({ 2, 4 }) == matches);
+            Assert::IsTrue(matcher.Match("put the key in the box", matches));
+            Assert::IsTrue(std::vector<size_t>({ 3 }) == matches);
+            Assert::IsFalse(matcher.Match("climb the tree", matches));
+
+            SaidMatchResults results = matcher.MatchAll({ "look at the tree", "look", "put the key in the box", "climb the tree", "box" });
+            Assert::AreEqual((size_t)1, results.NotUnderstood);
+            Assert::AreEqual((size_t)1, results.Unmatched);
+            Assert::AreEqual((size_t)1, results.SpecHits[3]);
+            Assert::AreEqual((size_t)2, results.SpecHits[4]);
+        }
+
+        TEST_METHOD(TestInstructionDecoder)
+        {
+            const TargetArchitecture *arch = GetTargetArchitecture(sciVersion0);
+            const InstructionDecoder &decoder = GetInstructionDecoder(sciVersion0);
+            const uint8_t code[] = { arch->OpcodeToRaw(Opcode::PUSHI, true), 0x34, 0x12, arch->OpcodeToRaw(Opcode::JMP, false), 0xfe };
+            DecodedInstruction instruction;
+            Assert::IsTrue(decoder.Decode(code, std::end(code), 0x10, instruction));
+            Assert::IsTrue(Opcode::PUSHI == instruction.Op);
+            Assert::AreEqual((uint8_t)1, instruction.OperandCount);
+            Assert::AreEqual((uint16_t)0x1234, instruction.Operands[0]);
+            Assert::AreEqual((uint16_t)3, instruction.Size);
+            Assert::AreEqual("pushi", instruction.Name);
+            Assert::IsTrue(decoder.Decode(code + 3, std::end(code), 0x13, instruction));
+            Assert::IsTrue(Opcode::JMP == instruction.Op);
+            Assert::AreEqual((uint16_t)1, instruction.OperandSizes[0]);
+            Assert::AreEqual((uint16_t)0xfe, instruction.Operands[0]);
+            Assert::AreEqual((uint16_t)2, instruction.Size);
+            // Truncated
+            Assert::IsFalse(decoder.Decode(code, code + 2, 0x10, instruction));
+
+            const uint8_t debugCode[] = { 0x7d, 'a', '.', 's', 'c', 0 };
+            const InstructionDecoder &decoderSCI2 = GetInstructionDecoder(sciVersion2);
+            Assert::IsTrue(decoderSCI2.Decode(debugCode, std::end(debugCode), 0, instruction));
+            Assert::IsTrue(Opcode::Filename == instruction.Op);
+            Assert::AreEqual("a.sc", instruction.DebugString);
+            Assert::AreEqual((uint16_t)6, instruction.Size);
+            Assert::IsFalse(decoderSCI2.Decode(debugCode, debugCode + 5, 0, instruction));
+        }
+
+        TEST_METHOD(TestDeadBranchInProcedureCall)
+        {
+            _gameFolder = SetUpGameSCI0();
+            // The dead branch is a parameter, so it needs to become a 0 rather than disappear.
+            PMachineValue result = _CompileAndRun(
+                "(script# 850)\n"
+                "(public Test 0)\n"
+                "(procedure (Count a b c) (return (+ (* argc 100) (* a 10) b c)))\n"
+                "(procedure (Test) (return (Count 1 (if 0 2) 3)))\n",
+                850);
+            Assert::AreEqual((uint16_t)313, result.Offset);
+        }
+
+        TEST_METHOD(TestDeadBranchInSend)
+        {
+            _gameFolder = SetUpGameSCI0();
+            PMachineValue result = _CompileAndRun(
+                "(script# 851)\n"
+                "(use Obj)\n"
+                "(public Test 0)\n"
+                "(instance foo of Obj\n"
+                "    (method (init a b c) (return (+ (* argc 100) (* a 10) b c)))\n"
+                ")\n"
+                "(procedure (Test) (return (foo init: 1 (if 0 2) 3)))\n",
+                851);
+            Assert::AreEqual((uint16_t)313, result.Offset);
+        }
+
+        TEST_METHOD(TestDeadBranchInCodeBlock)
+        {
+            _gameFolder = SetUpGameSCI0();
+            // Statements whose values are unused can go away, but the last one is the value of the block.
+            PMachineValue result = _CompileAndRun(
+                "(script# 852)\n"
+                "(public Test 0)\n"
+                "(procedure (Test &tmp x)\n"
+                "    (= x 4)\n"
+                "    (if 0 (= x 5))\n"
+                "    (return (+ x (if 1 (if 0 7))))\n"
+                ")\n",
+                852);
+            Assert::AreEqual((uint16_t)4, result.Offset);
+        }
+
+        TEST_METHOD(TestEvaluateMod)
+        {
+            _NoDefines noDefines;
+            uint16_t result;
+            Assert::IsTrue(_MakeBinaryOp(BinaryOperator::Mod, (uint16_t)-7, 3)->Evaluate(noDefines, result, nullptr));
+            Assert::AreEqual((uint16_t)2, result);
+            Assert::IsTrue(_MakeBinaryOp(BinaryOperator::Mod, 7, (uint16_t)-3)->Evaluate(noDefines, result, nullptr));
+            Assert::AreEqual((uint16_t)1, result);
+            Assert::IsTrue(_MakeBinaryOp(BinaryOperator::Mod, (uint16_t)-6, 3)->Evaluate(noDefines, result, nullptr));
+            Assert::AreEqual((uint16_t)0, result);
+        }
+
+        TEST_METHOD(TestEvaluateShortCircuit)
+        {
+            _NoDefines noDefines;
+            uint16_t result;
+            // The second operand isn't known at compile time, but it isn't needed.
+            Assert::IsTrue(_MakeBinaryOp(BinaryOperator::LogicalAnd, 0, "someVar")->Evaluate(noDefines, result, nullptr));
+            Assert::AreEqual((uint16_t)0, result);
+            Assert::IsTrue(_MakeBinaryOp(BinaryOperator::LogicalOr, 5, "someVar")->Evaluate(noDefines, result, nullptr));
+            Assert::AreEqual((uint16_t)1, result);
+            // Here it is.
+            Assert::IsFalse(_MakeBinaryOp(BinaryOperator::LogicalAnd, 5, "someVar")->Evaluate(noDefines, result, nullptr));
+            Assert::IsFalse(_MakeBinaryOp(BinaryOperator::LogicalOr, 0, "someVar")->Evaluate(noDefines, result, nullptr));
+            Assert::IsTrue(_MakeBinaryOp(BinaryOperator::LogicalAnd, 5, 3)->Evaluate(noDefines, result, nullptr));
+            Assert::AreEqual((uint16_t)1, result);
+            Assert::IsTrue(_MakeBinaryOp(BinaryOperator::LogicalOr, 0, 0)->Evaluate(noDefines, result, nullptr));
+            Assert::AreEqual((uint16_t)0, result);
+        }
+
+        TEST_METHOD(TestDisassembleGolden)
+        {
+            // script.988 is from the SCI0 template game. script.988-disasm.txt is what the disassembler
+            // wrote for its code before it used InstructionDecoder.
+            std::string folder = GetTestFileDirectory("Scripts\\SCI0");
+            std::ifstream scriptFile(folder + "\\script.988", std::ios::binary);
+            std::vector<uint8_t> resource((std::istreambuf_iterator<char>(scriptFile)), std::istreambuf_iterator<char>());
+            Assert::IsFalse(resource.empty());
+            CompiledScript script(988);
+            _Load(resource, script);
+
+            std::stringstream out;
+            out << std::hex;
+            _NamingLookups lookups;
+            const std::vector<uint8_t> &bytes = script.GetRawBytes();
+            for (const CodeSection &section : script._codeSections)
+            {
+                DisassembleCode(sciVersion0, out, &lookups, &lookups, &lookups, &lookups, &bytes[0] + section.begin, &bytes[0] + section.end, section.begin);
+            }
+
+            std::ifstream goldenFile(folder + "\\script.988-disasm.txt", std::ios::binary);
+            std::string golden((std::istreambuf_iterator<char>(goldenFile)), std::istreambuf_iterator<char>());
+            Assert::IsFalse(golden.empty());
+            Assert::AreEqual(golden, out.str());
+        }
+
+        TEST_METHOD(TestExportReferences)
+        {
+            _gameFolder = SetUpGameSCI0();
+            GlobalCompiledScriptLookups lookups;
+            Assert::IsTrue(lookups.Load(appState->GetVersion(), appState->GetResourceMap().Helper().GetResourceLoader()));
+            KernelTable kernels;
+            Assert::IsTrue(kernels.Load(appState->GetVersion(), appState->GetResourceMap().Helper().GetResourceLoader()));
+            uint16_t scriptID;
+            Assert::IsTrue(kernels.ReverseLookup("ScriptID", scriptID));
+
+            scicode code(sciVersion0);
+            code.inst(0, Opcode::PUSH0);
+            code.inst(0, Opcode::CALLB, 5, 0);          // Export 5 of the main script
+            code.inst(0, Opcode::PUSH0);
+            code.inst(0, Opcode::CALLE, 851, 3, 0);
+            code.inst(0, Opcode::PUSHI, 2);
+            code.inst(0, Opcode::PUSHI, 852);
+            code.inst(0, Opcode::PUSHI, 4);
+            code.inst(0, Opcode::CALLK, scriptID, 4);   // (ScriptID 852 4)
+            code.inst(0, Opcode::PUSHI, 2);
+            code.inst(0, Opcode::PUSHI, 853);
+            code.inst(0, Opcode::LAL, 0);
+            code.inst(0, Opcode::PUSH);
+            code.inst(0, Opcode::CALLK, scriptID, 4);   // (ScriptID 853 local0)
+            code.inst(0, Opcode::RET);
+            CompiledScript script(850);
+            _LoadCode(code, script);
+
+            ExportReferences references(lookups);
+            references.Scan(script);
+            Assert::IsFalse(references.HasUnresolved());
+            Assert::IsTrue(references.IsUsed(0, 5));
+            Assert::IsFalse(references.IsUsed(0, 6));
+            Assert::IsTrue(references.IsUsed(851, 3));
+            Assert::IsFalse(references.IsUsed(851, 4));
+            Assert::IsTrue(references.IsUsed(852, 4));
+            Assert::IsFalse(references.IsUsed(852, 3));
+            Assert::IsTrue(references.IsUsed(853, 9));
+            Assert::IsTrue(references.IsUsed(854, 0));  // Export 0 is always used
+            Assert::IsFalse(references.IsUsed(854, 1));
+
+            scicode codeUnresolved(sciVersion0);
+            codeUnresolved.inst(0, Opcode::PUSHI, 2);
+            codeUnresolved.inst(0, Opcode::LAL, 0);
+            codeUnresolved.inst(0, Opcode::PUSH);
+            codeUnresolved.inst(0, Opcode::LAL, 1);
+            codeUnresolved.inst(0, Opcode::PUSH);
+            codeUnresolved.inst(0, Opcode::CALLK, scriptID, 4);   // (ScriptID local0 local1)
+            codeUnresolved.inst(0, Opcode::RET);
+            CompiledScript scriptUnresolved(851);
+            _LoadCode(codeUnresolved, scriptUnresolved);
+            references.Scan(scriptUnresolved);
+            Assert::IsTrue(references.HasUnresolved());
+        }
+
+        TEST_METHOD(TestFindUnusedExports)
+        {
+            _gameFolder = SetUpGameSCI0();
+            GlobalCompiledScriptLookups lookups;
+            Assert::IsTrue(lookups.Load(appState->GetVersion(), appState->GetResourceMap().Helper().GetResourceLoader()));
+            ObjectFileScriptLookups objectFileLookups(appState->GetResourceMap().Helper(), lookups.GetSelectorTable());
+            std::vector<UnusedExport> unused;
+            Assert::IsTrue(FindUnusedExports(lookups, objectFileLookups, unused));
+
+            ExportReferences references(lookups);
+            for (CompiledScript *script : lookups.GetGlobalClassTable().GetAllScripts())
+            {
+                references.Scan(*script);
+            }
+            for (const UnusedExport &unusedExport : unused)
+            {
+                Assert::AreNotEqual((uint16_t)0, unusedExport.Index);
+                Assert::IsFalse(references.IsUsed(unusedExport.Script, unusedExport.Index));
+            }
+        }
+
+        TEST_METHOD(TestStripUnusedProcedures)
+        {
+            _gameFolder = SetUpGameSCI0();
+            const std::string source =
+                "(script# 850)\n"
+                "(public Foo 0 Bar 1 Baz 2 Bar 3)\n"
+                "(procedure (Foo) (return 1))\n"
+                "(procedure (Bar) (return 2))\n"
+                "(procedure (Baz) (return 3))\n";
+
+            // Bar is still used through slot 3, so only Baz goes.
+            CompileTables tables;
+            tables.Load(appState->GetResourceMap());
+            tables.StrippedProcedures()[850] = { { 1, "Bar" }, { 2, "Baz" } };
+            CompiledScript script(850);
+            CSCOFile sco;
+            _Load(_Compile(source, tables, true, nullptr, &sco), script);
+            Assert::AreEqual((size_t)4, script._exportsTO.size());
+            Assert::AreEqual((uint16_t)0, script._exportsTO[2]);
+            Assert::AreNotEqual((uint16_t)0, script._exportsTO[1]);
+            Assert::AreEqual(script._exportsTO[1], script._exportsTO[3]);
+            PMachineInterpreter interpreter(appState->GetVersion());
+            interpreter.AddScript(script);
+            Assert::AreEqual((uint16_t)1, interpreter.CallProcedure(850, 0, {}).Offset);
+            Assert::AreEqual((uint16_t)2, interpreter.CallProcedure(850, 1, {}).Offset);
+            Assert::AreEqual((uint16_t)2, interpreter.CallProcedure(850, 3, {}).Offset);
+            // Baz isn't in the .sco either, so nothing can start calling it without compiling it again.
+            WORD exportIndex;
+            Assert::IsTrue(sco.GetExportIndex("Bar", exportIndex));
+            Assert::IsFalse(sco.GetExportIndex("Baz", exportIndex));
+
+            // Now all of its slots are unused.
+            CompileTables tablesAllUnused;
+            tablesAllUnused.Load(appState->GetResourceMap());
+            tablesAllUnused.StrippedProcedures()[850] = { { 1, "Bar" }, { 2, "Baz" }, { 3, "Bar" } };
+            CompiledScript scriptAllUnused(850);
+            _Load(_Compile(source, tablesAllUnused), scriptAllUnused);
+            Assert::AreEqual((uint16_t)0, scriptAllUnused._exportsTO[1]);
+            Assert::AreEqual((uint16_t)0, scriptAllUnused._exportsTO[2]);
+            Assert::AreEqual((uint16_t)0, scriptAllUnused._exportsTO[3]);
+            Assert::IsTrue(scriptAllUnused.GetRawBytes().size() < script.GetRawBytes().size());
+            PMachineInterpreter interpreterAllUnused(appState->GetVersion());
+            interpreterAllUnused.AddScript(scriptAllUnused);
+            Assert::AreEqual((uint16_t)1, interpreterAllUnused.CallProcedure(850, 0, {}).Offset);
+
+            // The names need to match too, in case the exports moved since they were found unused.
+            CompileTables tablesMoved;
+            tablesMoved.Load(appState->GetResourceMap());
+            tablesMoved.StrippedProcedures()[850] = { { 1, "Baz" }, { 2, "Bar" }, { 3, "Baz" } };
+            CompiledScript scriptMoved(850);
+            _Load(_Compile(source, tablesMoved), scriptMoved);
+            Assert::AreEqual(script._exportsTO.size(), scriptMoved._exportsTO.size());
+            Assert::IsTrue(std::find(scriptMoved._exportsTO.begin(), scriptMoved._exportsTO.end(), (uint16_t)0) == scriptMoved._exportsTO.end());
+        }
+
+        TEST_METHOD(TestPooledStringsAndSaids)
+        {
+            _gameFolder = SetUpGameSCI0();
+            // "world" is the tail of "Hello world", and the saids only differ in spacing.
+            const std::vector<std::string> args = { "\"Hello world\"", "\"world\"", "\"Hello world\"", "'save[/game]'", "'save [ /game ]'", "'restore[/game]'" };
+
+            // Each one on its own, so nothing can be pooled.
+            std::vector<std::string> unpooled;
+            for (const std::string &arg : args)
+            {
+                CompiledScript script(850);
+                _CompileCall(arg, script, false);
+                for (const std::string &value : _DecodeCodeValues(script))
+                {
+                    if (_IsStringOrSaid(value))
+                    {
+                        unpooled.push_back(value);
+                    }
+                }
+            }
+            Assert::AreEqual(args.size(), unpooled.size());
+
+            std::string allArgs;
+            for (const std::string &arg : args)
+            {
+                allArgs += arg + " ";
+            }
+            CompiledScript pooledScript(850);
+            _CompileCall(allArgs, pooledScript, true);
+            Assert::AreEqual((size_t)1, pooledScript._strings.size());
+            Assert::AreEqual((size_t)2, pooledScript._saids.size());
+            std::vector<std::string> pooled;
+            for (const std::string &value : _DecodeCodeValues(pooledScript))
+            {
+                if (_IsStringOrSaid(value))
+                {
+                    pooled.push_back(value);
+                }
+            }
+            Assert::IsTrue(unpooled == pooled);
+
+            // Without optimization, tails aren't pooled but identical strings still are.
+            CompiledScript unoptimizedScript(850);
+            _CompileCall(allArgs, unoptimizedScript, false);
+            Assert::AreEqual((size_t)2, unoptimizedScript._strings.size());
+            Assert::IsTrue(pooledScript.GetRawBytes().size() < unoptimizedScript.GetRawBytes().size());
+        }
+
+        TEST_METHOD(TestPooledTextEntries)
+        {
+            _gameFolder = SetUpGameSCI0();
+            std::vector<TextEntry> texts;
+            CompiledScript script(850);
+            _CompileCall("\"Hello\" \"Bye\" \"Hello\"", script, true, &texts);
+            Assert::AreEqual((size_t)2, texts.size());
+
+            // Each text is pushed as the text resource number followed by the entry index.
+            std::vector<std::string> values = _DecodeCodeValues(script);
+            std::vector<std::string> decoded;
+            for (size_t i = 0; (i + 1) < values.size(); i++)
+            {
+                if (values[i] == "850")
+                {
+                    size_t index = std::stoul(values[++i]);
+                    Assert::IsTrue(index < texts.size());
+                    decoded.push_back(texts[index].Text);
+                }
+            }
+            Assert::IsTrue(std::vector<std::string>({ "Hello", "Bye", "Hello" }) == decoded);
+        }
+
         TEST_METHOD_CLEANUP(TestCompileAll_Clean)
         {
             CleanUpGame(_gameFolder);
@@ -83,7 +616,222 @@ namespace UnitTests
             _DoItHelper();
         }
 
+        // Compiles Sierra syntax source in the current game, and returns the script resource.
+        std::vector<uint8_t> _Compile(const std::string &source, CompileTables &tables, bool optimize = true, std::vector<TextEntry> *texts = nullptr, CSCOFile *sco = nullptr)
+        {
+            CompileLog log;
+            PrecompiledHeaders headers(appState->GetResourceMap());
+            sci::Script script(LangSyntaxSCI, appState->GetResourceMap().Helper().GetScriptId("test"));
+            StringLineSource lineSource(source);
+            ScriptStream stream(&lineSource);
+            Assert::IsTrue(SyntaxParser_Parse(script, stream, PreProcessorDefinesFromSCIVersion(appState->GetVersion()), &log));
+            CompileResults results(appState->GetVersion(), log);
+            {
+                ClassBrowserLock lock(appState->GetClassBrowser());
+                lock.Lock();
+                Assert::IsTrue(GenerateScriptResource(appState->GetClassBrowser(), appState->GetResourceMap(), appState->GetVersion(), script, headers, tables, results, false, optimize));
+            }
+            Assert::IsFalse(log.HasErrors());
+            if (texts)
+            {
+                *texts = results.GetTextComponent().Texts;
+            }
+            if (sco)
+            {
+                *sco = results.GetSCO();
+            }
+            return results.GetScriptResource();
+        }
+
+        void _Load(const std::vector<uint8_t> &resource, CompiledScript &script)
+        {
+            sci::istream stream(&resource[0], (uint32_t)resource.size());
+            Assert::IsTrue(script.Load(appState->GetResourceMap().Helper(), appState->GetVersion(), script.GetScriptNumber(), stream));
+        }
+
+        // Makes an SCI0 script with a single export, for code.
+        void _LoadCode(scicode &code, CompiledScript &script)
+        {
+            code.calc_size();
+            std::vector<uint8_t> codeBytes;
+            _NullTrackCodeSink sink;
+            code.write_code(sink, codeBytes, nullptr);
+            _LoadCodeBytes(codeBytes, script);
+        }
+
+        void _LoadCodeBytes(const std::vector<uint8_t> &codeBytes, CompiledScript &script)
+        {
+            // An exports block followed by a code block.
+            std::vector<uint8_t> resource = { 7, 0, 8, 0, 1, 0, 12, 0, 2, 0, (uint8_t)(4 + codeBytes.size()), 0 };
+            resource.insert(resource.end(), codeBytes.begin(), codeBytes.end());
+            resource.push_back(0);
+            resource.push_back(0);
+            sci::istream stream(&resource[0], (uint32_t)resource.size());
+            Assert::IsTrue(script.Load(*GameFolderHelper::Create(), sciVersion0, script.GetScriptNumber(), stream));
+        }
+
+        // Compiles source in the current game, and calls its first export.
+        PMachineValue _CompileAndRun(const std::string &source, uint16_t scriptNumber)
+        {
+            CompileTables tables;
+            tables.Load(appState->GetResourceMap());
+            CompiledScript compiledScript(scriptNumber);
+            _Load(_Compile(source, tables), compiledScript);
+
+            GlobalCompiledScriptLookups lookups;
+            Assert::IsTrue(lookups.Load(appState->GetVersion(), appState->GetResourceMap().Helper().GetResourceLoader()));
+            PMachineInterpreter interpreter(appState->GetVersion());
+            interpreter.AddScripts(lookups.GetGlobalClassTable());
+            interpreter.AddScript(compiledScript);
+            PMachineValue result = interpreter.CallProcedure(scriptNumber, 0, {});
+            Assert::IsTrue(result.IsNumber());
+            return result;
+        }
+
+        // Compiles a call with the given arguments in script 850, and loads it.
+        void _CompileCall(const std::string &args, CompiledScript &script, bool optimize, std::vector<TextEntry> *texts = nullptr)
+        {
+            std::string source =
+                "(script# 850)\n" +
+                std::string(texts ? "(text# 850)\n" : "") +
+                "(public Test 0)\n"
+                "(procedure (Show a b c d e f) (return 0))\n"
+                "(procedure (Test) (Show " + args + "))\n";
+            CompileTables tables;
+            tables.Load(appState->GetResourceMap());
+            _Load(_Compile(source, tables, optimize, texts), script);
+        }
+
+        // What the script's code loads and pushes, in order. Strings are in double quotes, saids
+        // in single quotes, and immediate values are numbers.
+        std::vector<std::string> _DecodeCodeValues(const CompiledScript &script)
+        {
+            script.PopulateSaidStrings(appState->GetResourceMap().GetVocab000());
+            std::vector<std::string> values;
+            const InstructionDecoder &decoder = GetInstructionDecoder(appState->GetVersion());
+            const std::vector<uint8_t> &bytes = script.GetRawBytes();
+            for (const CodeSection &section : script._codeSections)
+            {
+                DecodedInstruction instruction;
+                for (uint16_t offset = section.begin; (offset < section.end) && decoder.Decode(&bytes[0] + offset, &bytes[0] + section.end, offset, instruction); offset += instruction.Size)
+                {
+                    switch (instruction.Op)
+                    {
+                        case Opcode::LOFSA:
+                        case Opcode::LOFSS:
+                        {
+                            uint16_t address = appState->GetVersion().lofsaOpcodeIsAbsolute ? instruction.Operands[0] : (uint16_t)(offset + instruction.Size + instruction.Operands[0]);
+                            sci::ValueType type;
+                            std::string value = script.GetStringOrSaidFromOffset(address, type);
+                            Assert::IsTrue((type == sci::ValueType::String) || (type == sci::ValueType::Said));
+                            const char *quote = (type == sci::ValueType::Said) ? "'" : "\"";
+                            values.push_back(quote + value + quote);
+                        }
+                            break;
+                        case Opcode::PUSHI:
+                            values.push_back(std::to_string(instruction.Operands[0]));
+                            break;
+                        case Opcode::PUSH0:
+                            values.push_back("0");
+                            break;
+                        case Opcode::PUSH1:
+                            values.push_back("1");
+                            break;
+                        case Opcode::PUSH2:
+                            values.push_back("2");
+                            break;
+                    }
+                }
+            }
+            return values;
+        }
+
+        static bool _IsStringOrSaid(const std::string &value)
+        {
+            return !value.empty() && ((value[0] == '"') || (value[0] == '\''));
+        }
+
+        template<typename _TA, typename _TB>
+        static std::unique_ptr<sci::BinaryOp> _MakeBinaryOp(BinaryOperator op, _TA a, _TB b)
+        {
+            std::unique_ptr<sci::BinaryOp> binaryOp = std::make_unique<sci::BinaryOp>(op);
+            binaryOp->SetStatement1(_MakeValue(a));
+            binaryOp->SetStatement2(_MakeValue(b));
+            return binaryOp;
+        }
+        static std::unique_ptr<sci::SyntaxNode> _MakeValue(int value) { return std::make_unique<sci::PropertyValueNode>((uint16_t)value); }
+        static std::unique_ptr<sci::SyntaxNode> _MakeValue(const char *token) { return std::make_unique<sci::PropertyValueNode>(token, sci::ValueType::Token); }
+
     private:
+        // Makes up names for everything, so disassembly doesn't depend on a game.
+        class _NamingLookups : public ICompiledScriptLookups, public IObjectFileScriptLookups, public ICompiledScriptSpecificLookups, public ILookupPropertyName
+        {
+        public:
+            std::string LookupSelectorName(uint16_t wIndex) override { return "sel" + std::to_string(wIndex); }
+            std::string LookupKernelName(uint16_t wIndex) override { return "kernel" + std::to_string(wIndex); }
+            std::string LookupClassName(uint16_t wIndex) override { return "class" + std::to_string(wIndex); }
+            bool LookupSpeciesPropertyList(uint16_t wIndex, std::vector<uint16_t> &props) override { return false; }
+            bool LookupSpeciesPropertyListAndValues(uint16_t wIndex, std::vector<uint16_t> &props, std::vector<CompiledVarValue> &values) override { return false; }
+            std::string ReverseLookupGlobalVariableName(uint16_t wIndex) override { return "global" + std::to_string(wIndex); }
+            std::string ReverseLookupPublicExportName(uint16_t wScript, uint16_t wIndex) override { return "export" + std::to_string(wScript) + "_" + std::to_string(wIndex); }
+            bool LookupObjectName(uint16_t wOffset, ObjectType &type, std::string &name) const override { return false; }
+            std::string LookupPropertyName(ICompiledScriptLookups *pLookup, uint16_t wPropertyIndex) const override { return "prop" + std::to_string(wPropertyIndex); }
+        };
+
+        class _NoDefines : public ILookupDefine
+        {
+        public:
+            bool LookupDefine(const std::string &str, uint16_t &wValue) override { return false; }
+        };
+
+        class _NullTrackCodeSink : public ITrackCodeSink
+        {
+        public:
+            void WroteCodeSink(uint16_t tempToken, uint16_t offset) override {}
+        };
+
+        // Hands out .sco files from memory, and counts how often it's asked.
+        class _CountingSCOLoader : public CompilerFileLoader
+        {
+        public:
+            absl::StatusOr<CSCOFile> LoadSCOFile(const std::string &objectName, const SelectorTable &selectors) override
+            {
+                Loads++;
+                auto it = Files.find(objectName);
+                if (it == Files.end())
+                {
+                    return absl::NotFoundError(objectName);
+                }
+                return it->second;
+            }
+
+            std::map<std::string, CSCOFile> Files;
+            int Loads = 0;
+        };
+
+        static CSCOFile _MakeSCOFile(WORD scriptNumber, WORD firstSpecies)
+        {
+            // Duplicate names, to check that the first one wins.
+            CSCOFile sco;
+            sco.SetScriptNumber(scriptNumber);
+            for (const char *name : { "a", "b", "a" })
+            {
+                sco.AddVariable(CSCOLocalVariable(name));
+            }
+            sco.AddPublic(CSCOPublicExport("proc1", 3));
+            sco.AddPublic(CSCOPublicExport("proc2", 0));
+            sco.AddPublic(CSCOPublicExport("proc1", 7));
+            WORD species = firstSpecies;
+            for (const char *name : { "Foo", "Bar", "Foo" })
+            {
+                CSCOObjectClass theClass;
+                theClass.SetName(name);
+                theClass.SetSpecies(species++);
+                sco.AddObject(theClass);
+            }
+            return sco;
+        }
+
         static std::string _gameFolder;
 	};
 
@@ -0,0 +1,126 @@
+/***************************************************************************
+    Copyright (c) 2015 Philip Fortier
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+***************************************************************************/
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "ImageUtil.h"
+#include "RGBOctree.h"
+#include "VGADither.h"
+#include "View.h"
+#include <random>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    TEST_CLASS(TestImageUtil)
+    {
+    public:
+        TEST_METHOD(TestRGBSpatialMatchesBruteForce)
+        {
+            std::mt19937 random(1234);
+            for (int iteration = 0; iteration < 40; iteration++)
+            {
+                // Random palettes, some with unused entries, some with duplicate colors (so there are ties),
+                // and some with a remapping.
+                RGBQUAD colors[256];
+                uint8_t mapping[256];
+                for (int i = 0; i < 256; i++)
+                {
+                    colors[i].rgbRed = (uint8_t)random();
+                    colors[i].rgbGreen = (uint8_t)random();
+                    colors[i].rgbBlue = (uint8_t)random();
+                    colors[i].rgbReserved = (random() % 8) ? 0x1 : 0x0;
+                    if (iteration % 3 == 1)
+                    {
+                        colors[i].rgbRed &= 0xc0;
+                        colors[i].rgbGreen &= 0xc0;
+                        colors[i].rgbBlue &= 0xc0;
+                    }
+                    mapping[i] = (iteration % 3 == 2) ? (uint8_t)random() : (uint8_t)i;
+                }
+                int colorCount = 1 + random() % 256;
+                ColorMatching colorMatching = (iteration % 2) ? ColorMatching::RGB : ColorMatching::CCIR;
+                RGBSpatial paletteSearch(colorMatching, colorCount, mapping, colors, (uint8_t)random(), (iteration % 4) < 2);
+
+                for (int i = 0; i < 5000; i++)
+                {
+                    RGBQUAD color = { (uint8_t)random(), (uint8_t)random(), (uint8_t)random(), 0xff };
+                    if (i % 3 == 0)
+                    {
+                        color = colors[random() % 256];
+                    }
+                    Assert::AreEqual(paletteSearch.FindBestMatchBruteForce(color), paletteSearch.FindBestMatch(color));
+                }
+            }
+        }
+
+        // The multithreaded dither must produce exactly what a straightforward serial dither does.
+        template<typename _TAlgorithm>
+        void _VerifyParallelDither(DitherAlgorithm ditherAlgorithm, int cx, int cy, std::mt19937 &random)
+        {
+            RGBQUAD colors[256];
+            uint8_t mapping[256];
+            for (int i = 0; i < 256; i++)
+            {
+                colors[i] = { (uint8_t)random(), (uint8_t)random(), (uint8_t)random(), 0x1 };
+                mapping[i] = (uint8_t)i;
+            }
+            std::vector<RGBQUAD> image(cx * cy);
+            for (int y = 0; y < cy; y++)
+            {
+                for (int x = 0; x < cx; x++)
+                {
+                    image[y * cx + x] = { (uint8_t)(x * 255 / cx), (uint8_t)(y * 255 / cy), (uint8_t)(x + y), (uint8_t)((random() % 16) ? 0xff : 0x00) };
+                }
+            }
+
+            std::vector<uint8_t> expected(CX_ACTUAL(cx) * cy);
+            ErrorDiffusionDither<RGBQUAD, _TAlgorithm> dither(cx, cy);
+            RGBSpatial paletteSearch(ColorMatching::RGB, 256, mapping, colors, 0, false);
+            for (int y = 0; y < cy; y++)
+            {
+                for (int x = 0; x < cx; x++)
+                {
+                    RGBQUAD color = dither.ApplyErrorAt(image[y * cx + x], x, y);
+                    uint8_t index = 0;
+                    if (color.rgbReserved == 0xff)
+                    {
+                        index = paletteSearch.FindBestMatch(color);
+                        dither.PropagateError(color, colors[index], x, y);
+                    }
+                    expected[y * CX_ACTUAL(cx) + x] = index;
+                }
+            }
+
+            std::vector<uint8_t> actual(CX_ACTUAL(cx) * cy);
+            BitmapConvertStatus convertStatus = BitmapConvertStatus::None;
+            RGBToPalettized(ColorMatching::RGB, &actual[0], &image[0], cx, cy, ditherAlgorithm, false, 256, mapping, colors, 0, false, convertStatus);
+            for (int y = 0; y < cy; y++)
+            {
+                for (int x = 0; x < cx; x++)
+                {
+                    Assert::AreEqual(expected[y * CX_ACTUAL(cx) + x], actual[y * CX_ACTUAL(cx) + x]);
+                }
+            }
+        }
+
+        TEST_METHOD(TestParallelDitherMatchesSerial)
+        {
+            std::mt19937 random(5678);
+            _VerifyParallelDither<FloydSteinberg>(DitherAlgorithm::FloydSteinberg, 640, 480, random);
+            _VerifyParallelDither<JarvisJudiceNinke>(DitherAlgorithm::JarvisJudiceNinke, 321, 200, random);
+            _VerifyParallelDither<FloydSteinberg>(DitherAlgorithm::FloydSteinberg, 3, 1000, random);
+        }
+    };
+}
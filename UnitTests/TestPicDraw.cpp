@@ -30,6 +30,8 @@ using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 #include "Helper.h"
 #include "BaseResourceUtil.h"
 #include "ResourceUtil.h"
+#include "PicCommands.h"
+#include "PicOptimizer.h"
 
 std::unique_ptr<Cel> CelFromBitmapFile(const std::string &filename)
 {
@@ -171,6 +173,33 @@ void TestPicsHelper(bool saveAndReload)
     VerifyFilesInFolder(saveAndReload, sciVersion2, folder + "\\SCI2");
 }
 
+// Draws a pen preview, like the pic editor does when the mouse moves.
+class TestPenPlugin : public IPicDrawPlugin
+{
+public:
+    TestPenPlugin() : X(0), Y(0) {}
+
+    void DrawOnPic(ViewPort &viewPort, PicData &picData, PicScreenFlags flags) override
+    {
+        PicCommand command = _GetCommand();
+        PatternCommand_Draw_DrawOnly(&command, &picData, &viewPort);
+    }
+    bool WillDrawOnPic() override { return true; }
+    PicScreenFlags GetRequiredScreens() override { return PicScreenFlags::Visual | PicScreenFlags::Priority; }
+    PicPositionFlags GetRequiredPicPosition() override { return PicPositionFlags::PrePlugin | PicPositionFlags::PostPlugin; }
+    bool GetDrawBounds(size16 picSize, sRECT &bounds) override
+    {
+        PicCommand command = _GetCommand();
+        return Command_GetDrawBounds(picSize, &command, &bounds);
+    }
+
+    int16_t X;
+    int16_t Y;
+
+private:
+    PicCommand _GetCommand() { return PicCommand::CreatePattern(X, Y, 5, 0, false, (X % 2) == 0); }
+};
+
 namespace UnitTests
 {
     TEST_CLASS(TextPicDraw)
@@ -199,6 +228,100 @@ namespace UnitTests
             TestPicsHelper(false);
         }
 
+        TEST_METHOD(TestPicOptimizer)
+        {
+            std::unique_ptr<ResourceEntity> resource(CreatePicResourceFactory()->CreateResource(sciVersion0));
+            PicComponent &pic = resource->GetComponent<PicComponent>();
+            std::vector<PicCommand> commands;
+            commands.push_back(PicCommand::CreateSetVisual(0, 4));
+            commands.push_back(PicCommand::CreatePattern(40, 40, 3, 0, false, true));
+            commands.push_back(PicCommand::CreateSetVisual(0, 4));         // No change
+            commands.push_back(PicCommand::CreateSetPriority(5));
+            commands.push_back(PicCommand::CreateSetPriority(6));          // Supersedes the previous one
+            commands.push_back(PicCommand::CreateLine(10, 10, 100, 10));
+            commands.push_back(PicCommand::CreateLine(10, 10, 100, 10));   // Completely overdraws the previous one
+            commands.push_back(PicCommand::CreateSetControl(2));           // Nothing drawn after this
+
+            PicOptimizeStats stats;
+            Assert::IsTrue(OptimizePicCommands(pic, nullptr, commands, &stats));
+            Assert::AreEqual((size_t)8, stats.CommandsBefore);
+            Assert::AreEqual((size_t)4, stats.CommandsAfter);
+            Assert::AreEqual((size_t)4, commands.size());
+            Assert::IsTrue(stats.BytesAfter < stats.BytesBefore);
+
+            // Nothing left to do the second time around.
+            Assert::IsFalse(OptimizePicCommands(pic, nullptr, commands));
+        }
+
+        TEST_METHOD(TestPluginTileRedraw)
+        {
+            std::unique_ptr<ResourceEntity> resource(CreatePicResourceFactory()->CreateResource(sciVersion0));
+            PicComponent &pic = resource->GetComponent<PicComponent>();
+            pic.commands.push_back(PicCommand::CreateSetVisual(0, 4));
+            pic.commands.push_back(PicCommand::CreateSetPriority(7));
+            pic.commands.push_back(PicCommand::CreateLine(0, 50, 319, 120));
+            pic.commands.push_back(PicCommand::CreateFill(10, 10));
+            pic.commands.push_back(PicCommand::CreatePattern(160, 95, 7, 0, true, false));
+
+            PicDrawManager pdm(&pic);
+            TestPenPlugin plugin;
+            pdm.AddPicPlugin(&plugin);
+            size_t byteSize = pic.Size.cx * pic.Size.cy;
+            for (int i = 0; i < 40; i++)
+            {
+                // Move around, including off the edges.
+                plugin.X = (int16_t)((i * 37) % 340 - 10);
+                plugin.Y = (int16_t)((i * 23) % 210 - 10);
+                pdm.InvalidatePlugins();
+
+                // Compare against drawing everything from scratch.
+                PicDrawManager pdmFresh(&pic);
+                TestPenPlugin pluginFresh;
+                pluginFresh.X = plugin.X;
+                pluginFresh.Y = plugin.Y;
+                pdmFresh.AddPicPlugin(&pluginFresh);
+                for (PicScreen screen : { PicScreen::Visual, PicScreen::Priority, PicScreen::Aux })
+                {
+                    for (PicPosition position : { PicPosition::PrePlugin, PicPosition::PostPlugin })
+                    {
+                        const uint8_t *bits = pdm.GetPicBits(screen, position, pic.Size);
+                        const uint8_t *bitsFresh = pdmFresh.GetPicBits(screen, position, pic.Size);
+                        Assert::AreEqual(0, memcmp(bits, bitsFresh, byteSize));
+                    }
+                }
+            }
+        }
+
+        TEST_METHOD(TestBufferPool)
+        {
+            BufferPool &pool = BufferPool::Instance();
+            size_t inUseBefore = pool.GetBytesInUse();
+            uint8_t *first;
+            {
+                BufferPool::Buffer a = pool.Allocate(320 * 190);
+                BufferPool::Buffer b = pool.Allocate(320 * 190 - 100);    // Same size class
+                first = a.get();
+                Assert::IsTrue(pool.GetBytesInUse() >= inUseBefore + 2 * 320 * 190);
+                Assert::IsTrue(pool.GetHighWaterMark() >= pool.GetBytesInUse());
+            }
+            Assert::AreEqual(inUseBefore, pool.GetBytesInUse());
+
+            // The most recently freed buffer gets re-used.
+            BufferPool::Buffer c = pool.Allocate(320 * 190);
+            Assert::IsTrue(c.get() == first);
+            c.reset();
+            pool.Trim();
+            Assert::AreEqual((size_t)0, pool.GetIdleBytes());
+
+            // Buffers bigger than any size class are counted, but not kept.
+            {
+                BufferPool::Buffer big = pool.Allocate(4 * 1024 * 1024);
+                Assert::IsTrue(pool.GetBytesInUse() >= inUseBefore + 4 * 1024 * 1024);
+            }
+            Assert::AreEqual(inUseBefore, pool.GetBytesInUse());
+            Assert::AreEqual((size_t)0, pool.GetIdleBytes());
+        }
+
     private:
         static Gdiplus::GdiplusStartupInput _gdiplusStartupInput;
         static ULONG_PTR _gdiplusToken;
@@ -19,6 +19,10 @@
 #include "AppState.h"
 #include "ResourceContainer.h"
 #include "RasterOperations.h"
+#include "PaletteOperations.h"
+#include "Audio.h"
+#include "Sound.h"
+#include "MidiSequencer.h"
 #include "format.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
@@ -73,5 +77,359 @@ namespace UnitTests
             Assert::AreEqual(loopMirror.MirrorOf, (uint8_t)0xff);
         }
 
+        TEST_METHOD(TestCelCopyOnWrite)
+        {
+            auto pTest = CreateViewResourceFactory()->CreateDefaultResource(sciVersion0);
+            RasterComponent &raster = pTest->GetComponent<RasterComponent>();
+            ::FillEmpty(raster, CelIndex(0, 0), size16(16, 8));
+            InsertLoop(raster, 0, false);
+            MakeMirrorOf(raster, 1, 0);
+            const Cel &celOrig = raster.Loops[0].Cels[0];
+            const Cel &celMirror = raster.Loops[1].Cels[0];
+
+            uint8_t newColor = celOrig.TransparentColor ^ 1;
+
+            // Copies share pixels until one of them is written to.
+            Cel copy = celOrig;
+            Assert::IsTrue(copy.Data.shares_with(celOrig.Data));
+            copy.Data[0] = newColor;
+            Assert::IsFalse(copy.Data.shares_with(celOrig.Data));
+            Assert::AreNotEqual(copy.Data[0], celOrig.Data[0]);
+
+            // Re-syncing a mirror whose original hasn't changed should not touch its pixels.
+            const uint8_t *mirrorBits = &celMirror.Data[0];
+            UpdateMirrors(raster, 0);
+            Assert::IsTrue(mirrorBits == &celMirror.Data[0]);
+
+            // The mirror doesn't hold on to the original's pixels, so they can still be written in place.
+            Assert::IsFalse(celOrig.Data.is_shared());
+
+            // But changing the original should update it.
+            raster.Loops[0].Cels[0].Data[0] = newColor;
+            UpdateMirrors(raster, 0);
+            Assert::AreEqual(newColor, celMirror.Data[celOrig.size.cx - 1]);
+        }
+
+        TEST_METHOD(TestRasterMemorySizeCountsSharedCelsOnce)
+        {
+            auto pTest = CreateViewResourceFactory()->CreateDefaultResource(sciVersion0);
+            RasterComponent &raster = pTest->GetComponent<RasterComponent>();
+            ::FillEmpty(raster, CelIndex(0, 0), size16(64, 64));
+            size_t oneCel = raster.GetMemorySize();
+
+            // Copies of a cel share its pixels, so only the cel itself is added.
+            for (int i = 0; i < 10; i++)
+            {
+                raster.Loops[0].Cels.push_back(raster.Loops[0].Cels[0]);
+            }
+            Assert::AreEqual(oneCel + 10 * sizeof(Cel), raster.GetMemorySize());
+
+            // Until they're written to.
+            raster.Loops[0].Cels[1].Data[0] = 1;
+            Assert::AreEqual(oneCel + 10 * sizeof(Cel) + raster.Loops[0].Cels[1].Data.size(), raster.GetMemorySize());
+        }
+
+        TEST_METHOD(TestUndoFramesShareComponents)
+        {
+            // Build a reasonably large VGA view with a palette.
+            auto pTest = CreateViewResourceFactory()->CreateDefaultResource(sciVersion1_1);
+            auto palette = std::make_unique<PaletteComponent>();
+            memset(palette->Colors, 0, sizeof(palette->Colors));
+            pTest->AddComponent(std::move(palette));
+            RasterComponent &raster = pTest->GetComponent<RasterComponent>();
+            for (int i = 1; i < 8; i++)
+            {
+                raster.Loops.push_back(raster.Loops[0]);
+            }
+            for (Loop &loop : raster.Loops)
+            {
+                for (int i = 1; i < 8; i++)
+                {
+                    loop.Cels.push_back(loop.Cels[0]);
+                }
+            }
+            for (int nLoop = 0; nLoop < raster.LoopCount(); nLoop++)
+            {
+                for (int nCel = 0; nCel < raster.CelCount(nLoop); nCel++)
+                {
+                    ::FillEmpty(raster, CelIndex(nLoop, nCel), size16(64, 64));
+                }
+            }
+
+            // A scripted editing session: mostly palette edits, with the occasional cel edit.
+            std::vector<std::unique_ptr<ResourceEntity>> sharedFrames;
+            std::vector<std::unique_ptr<ResourceEntity>> fullFrames;
+            sharedFrames.push_back(pTest->Clone());
+            fullFrames.push_back(pTest->Clone());
+            for (int edit = 0; edit < 100; edit++)
+            {
+                auto editFunc = [edit](ResourceEntity &entity)
+                {
+                    if ((edit % 10) == 0)
+                    {
+                        entity.GetComponentForWrite<RasterComponent>().GetCel(CelIndex(0, 0)).Data[0] = (uint8_t)edit;
+                    }
+                    else
+                    {
+                        entity.GetComponentForWrite<PaletteComponent>().Colors[edit].rgbRed = (uint8_t)edit;
+                    }
+                };
+                sharedFrames.push_back(sharedFrames.back()->CloneShared());
+                editFunc(*sharedFrames.back());
+                fullFrames.push_back(fullFrames.back()->Clone());
+                editFunc(*fullFrames.back());
+            }
+
+            // Edits must not leak into earlier frames.
+            Assert::AreEqual((uint8_t)0, sharedFrames[0]->GetComponent<PaletteComponent>().Colors[1].rgbRed);
+            Assert::AreEqual((uint8_t)1, sharedFrames[2]->GetComponent<PaletteComponent>().Colors[1].rgbRed);
+            Assert::AreEqual((uint8_t)90, sharedFrames[91]->GetComponent<RasterComponent>().GetCel(CelIndex(0, 0)).Data[0]);
+            Assert::AreEqual((uint8_t)80, sharedFrames[90]->GetComponent<RasterComponent>().GetCel(CelIndex(0, 0)).Data[0]);
+            // Reading, even through a non-const resource, must not un-share.
+            Assert::IsTrue(&sharedFrames[4]->GetComponent<RasterComponent>() == &sharedFrames[5]->GetComponent<RasterComponent>());
+
+            std::unordered_set<const void*> seenShared;
+            size_t sharedSize = 0;
+            for (auto &frame : sharedFrames)
+            {
+                sharedSize += frame->AccumulateMemorySize(seenShared);
+            }
+            // Full clones still share cel pixels, so count each frame on its own, as a deep copy would cost.
+            size_t fullSize = 0;
+            for (auto &frame : fullFrames)
+            {
+                std::unordered_set<const void*> seenFull;
+                fullSize += frame->AccumulateMemorySize(seenFull);
+            }
+            Logger::WriteMessage(fmt::format("Undo stack memory: {0} bytes shared, {1} bytes with full clones", sharedSize, fullSize).c_str());
+            Assert::IsTrue(sharedSize * 4 < fullSize);
+        }
+
+        TEST_METHOD(TestAudioDPCMRoundTrip)
+        {
+            for (bool sixteenBit : { false, true })
+            {
+                auto resource = CreateAudioResourceFactory()->CreateResource(sciVersion1_1);
+                AudioComponent &audio = resource->GetComponent<AudioComponent>();
+                audio.Frequency = 11025;
+                audio.Flags = AudioFlags::DPCM | (sixteenBit ? (AudioFlags::SixteenBit | AudioFlags::Signed) : AudioFlags::None);
+                // A second or so of a tone with an odd number of samples.
+                const int sampleCount = 11025;
+                for (int i = 0; i < sampleCount; i++)
+                {
+                    double value = sin(i * 0.05);
+                    if (sixteenBit)
+                    {
+                        int16_t sample = (int16_t)(value * 8000.0);
+                        audio.DigitalSamplePCM.push_back((uint8_t)(sample & 0xff));
+                        audio.DigitalSamplePCM.push_back((uint8_t)(sample >> 8));
+                    }
+                    else
+                    {
+                        audio.DigitalSamplePCM.push_back((uint8_t)(128 + value * 60.0));
+                    }
+                }
+
+                // Compressed, it should be half (16 bit) or a quarter (8 bit) of the size.
+                std::vector<uint8_t> compressed;
+                EncodeDPCM(audio, compressed);
+                Assert::AreEqual(sixteenBit ? (size_t)sampleCount : (size_t)(sampleCount + 1) / 2, compressed.size());
+                Assert::AreEqual(AudioEstimateSize(*resource), (uint32_t)(sizeof(AudioHeader) + compressed.size()));
+
+                // Run it through the decoder and check it's close.
+                std::map<BlobKey, uint32_t> propertyBag;
+                sci::ostream streamOut;
+                resource->WriteTo(streamOut, false, 0, propertyBag);
+                auto decoded = CreateAudioResourceFactory()->CreateResource(sciVersion1_1);
+                decoded->ReadFrom(sci::istream(streamOut.GetInternalPointer(), streamOut.tellp()), propertyBag);
+                const AudioComponent &audioDecoded = decoded->GetComponent<AudioComponent>();
+                Assert::IsTrue(audio.Flags == audioDecoded.Flags);
+                Assert::IsTrue(audioDecoded.GetLength() >= audio.GetLength());
+                int maxError = 0;
+                for (int i = 0; i < sampleCount; i++)
+                {
+                    int original, roundTripped;
+                    if (sixteenBit)
+                    {
+                        original = reinterpret_cast<const int16_t*>(&audio.DigitalSamplePCM[0])[i];
+                        roundTripped = reinterpret_cast<const int16_t*>(&audioDecoded.DigitalSamplePCM[0])[i];
+                    }
+                    else
+                    {
+                        original = audio.DigitalSamplePCM[i];
+                        roundTripped = audioDecoded.DigitalSamplePCM[i];
+                    }
+                    maxError = max(maxError, abs(original - roundTripped));
+                }
+                Assert::IsTrue(maxError <= (sixteenBit ? 8 : 2));
+
+                // Decoded data can be represented exactly, so compressing it again should be lossless.
+                sci::ostream streamOut2;
+                decoded->WriteTo(streamOut2, false, 0, propertyBag);
+                auto decoded2 = CreateAudioResourceFactory()->CreateResource(sciVersion1_1);
+                decoded2->ReadFrom(sci::istream(streamOut2.GetInternalPointer(), streamOut2.tellp()), propertyBag);
+                Assert::IsTrue(audioDecoded.DigitalSamplePCM == decoded2->GetComponent<AudioComponent>().DigitalSamplePCM);
+            }
+        }
+
+        TEST_METHOD(TestAudioDPCMRoundTripAtLimits)
+        {
+            for (bool sixteenBit : { false, true })
+            {
+                auto resource = CreateAudioResourceFactory()->CreateResource(sciVersion1_1);
+                AudioComponent &audio = resource->GetComponent<AudioComponent>();
+                audio.Frequency = 11025;
+                audio.Flags = AudioFlags::DPCM | (sixteenBit ? (AudioFlags::SixteenBit | AudioFlags::Signed) : AudioFlags::None);
+
+                // Samples the decoder can produce, running into the limits in steps that only land
+                // there because they're clamped (e.g. 237 + 21 to 255).
+                if (sixteenBit)
+                {
+                    const int deltas[] = { 0x4000, 0x3000, 0x0800, 0x0400, 0x0008, 0x4000, 0x4000, -0x0008, 0x0010, -0x4000, -0x4000, -0x4000, -0x3000, 0x0008, -0x0010, -0x4000, 0x0100, 0x4000 };
+                    int s = 0;
+                    for (int delta : deltas)
+                    {
+                        s = min(32767, max(-32768, s + delta));
+                        audio.DigitalSamplePCM.push_back((uint8_t)(s & 0xff));
+                        audio.DigitalSamplePCM.push_back((uint8_t)((s >> 8) & 0xff));
+                    }
+                }
+                else
+                {
+                    const int deltas[] = { 21, 21, 21, 21, 21, 3, 1, 21, 0, -1, 15, -21, -21, -21, -21, -21, -21, -21, -21, -21, -21, -21, -6, -21, 0, 1, -15, 21 };
+                    int s = 0x80;
+                    for (int delta : deltas)
+                    {
+                        s = min(255, max(0, s + delta));
+                        audio.DigitalSamplePCM.push_back((uint8_t)s);
+                    }
+                }
+
+                std::map<BlobKey, uint32_t> propertyBag;
+                sci::ostream streamOut;
+                resource->WriteTo(streamOut, false, 0, propertyBag);
+                auto decoded = CreateAudioResourceFactory()->CreateResource(sciVersion1_1);
+                decoded->ReadFrom(sci::istream(streamOut.GetInternalPointer(), streamOut.tellp()), propertyBag);
+                const AudioComponent &audioDecoded = decoded->GetComponent<AudioComponent>();
+                Assert::IsTrue(audioDecoded.GetLength() >= audio.GetLength());
+                for (uint32_t i = 0; i < audio.GetLength(); i++)
+                {
+                    Assert::AreEqual(audio.DigitalSamplePCM[i], audioDecoded.DigitalSamplePCM[i]);
+                }
+            }
+        }
+
+        TEST_METHOD(TestSoundEventIndex)
+        {
+            SoundComponent sound(soundTraitsSCI1);
+            auto &channels = sound.GetChannelInfos();
+            channels.push_back({ 0, false, 0, 0, 0, { SoundEvent(0, 60, 100, 0x90), SoundEvent(10, 60, 0, 0x90) } });
+            channels.push_back({ 1, false, 0, 1, 0, { SoundEvent(5, 62, 100, 0x91), SoundEvent(10, 62, 0, 0x91) } });
+            sound.SetChannelId(DeviceType::SCI1_GM, 0, true);
+
+            const SoundEventIndex *index = &sound.GetEventIndex(DeviceType::SCI1_GM);
+            Assert::AreEqual((size_t)2, index->Events.size());
+            Assert::AreEqual((DWORD)10, index->TotalTicks);
+
+            // Turning on another channel has to rebuild the index.
+            sound.SetChannelId(DeviceType::SCI1_GM, 1, true);
+            index = &sound.GetEventIndex(DeviceType::SCI1_GM);
+            Assert::AreEqual((size_t)4, index->Events.size());
+            Assert::AreEqual((DWORD)15, index->TotalTicks);
+            Assert::AreEqual((DWORD)5, index->Events[2].wTimeDelta);
+            Assert::AreEqual((DWORD)10, index->EventTicks[2]);
+            Assert::AreEqual((size_t)2, index->FindEvent(6));
+            Assert::AreEqual((size_t)4, index->FindEvent(16));
+        }
+
+        TEST_METHOD(TestMidiSequencer)
+        {
+            SoundComponent sound(soundTraitsSCI1);
+            auto &channels = sound.GetChannelInfos();
+            channels.push_back({ 0, false, 0, 0, 0, { SoundEvent(0, 60, 100, 0x90), SoundEvent(20, 60, 0, 0x90) } });
+            channels.push_back({ 1, false, 0, 1, 0, { SoundEvent(10, 62, 100, 0x91), SoundEvent(20, 62, 0, 0x91) } });
+            sound.SetChannelId(DeviceType::SCI1_GM, 0, true);
+            sound.SetChannelId(DeviceType::SCI1_GM, 1, true);
+            sound.SetLoopPoint(15);
+            sound.AddCuePoint(CuePoint(CuePoint::Cumulative, 25, 2));
+
+            struct RecordingSink : public IMidiSink
+            {
+                void OnMessage(const MidiMessage &message) override { MessageTicks.push_back(message.Ticks); }
+                void OnCue(DWORD ticks, const CuePoint &cue) override { CueTicks.push_back(ticks); }
+                void OnLoop(DWORD ticks) override { LoopTicks.push_back(ticks); }
+                std::vector<DWORD> MessageTicks;
+                std::vector<DWORD> CueTicks;
+                std::vector<DWORD> LoopTicks;
+            };
+
+            // Once through, then back to just after the loop point.
+            MidiSequencer sequencer;
+            sequencer.SetSound(sound, DeviceType::SCI1_GM);
+            RecordingSink sink;
+            sequencer.Render(sink, 1);
+            Assert::IsTrue(std::vector<DWORD>({ 0, 10, 20, 30, 35, 45 }) == sink.MessageTicks);
+            Assert::IsTrue(std::vector<DWORD>({ 25, 40 }) == sink.CueTicks);
+            Assert::IsTrue(std::vector<DWORD>({ 30 }) == sink.LoopTicks);
+            Assert::IsTrue(sequencer.IsDone());
+            // 60 ticks a second at 120bpm.
+            Assert::AreEqual((uint64_t)750000, sequencer.GetMicroseconds());
+
+            // Playing in steps stops where it's told to.
+            sequencer.SetSound(sound, DeviceType::SCI1_GM);
+            RecordingSink stepSink;
+            Assert::IsTrue(sequencer.Advance(12, stepSink));
+            Assert::AreEqual((size_t)2, stepSink.MessageTicks.size());
+            Assert::AreEqual((DWORD)12, sequencer.GetSoundTicks());
+
+            sequencer.SetSound(sound, DeviceType::SCI1_GM);
+            MidiFileSink fileSink(sequencer.GetTimeDivision());
+            sequencer.Render(fileSink);
+            sci::ostream midiFile;
+            fileSink.WriteTo(midiFile, sequencer.GetTicks());
+            Assert::IsTrue(0 == memcmp(midiFile.GetInternalPointer(), "MThd", 4));
+        }
+
+        TEST_METHOD(TestMidiSequencerThroughput)
+        {
+            const int ChannelCount = 15;
+            const int EventsPerChannel = 20000;
+            SoundComponent sound(soundTraitsSCI1);
+            auto &channels = sound.GetChannelInfos();
+            for (int i = 0; i < ChannelCount; i++)
+            {
+                ChannelInfo channel = { i, false, 0, (uint8_t)i, 0 };
+                for (int j = 0; j < EventsPerChannel; j++)
+                {
+                    channel.Events.push_back(SoundEvent(1 + (i + j) % 7, 60, (j % 2) ? 0 : 100, 0x90 | i));
+                }
+                channels.push_back(channel);
+                sound.SetChannelId(DeviceType::SCI1_GM, i, true);
+            }
+
+            struct CountingSink : public IMidiSink
+            {
+                CountingSink() : Count(0) {}
+                void OnMessage(const MidiMessage &message) override { Count++; }
+                size_t Count;
+            };
+
+            MidiSequencer sequencer;
+            sequencer.SetSound(sound, DeviceType::SCI1_GM);
+            CountingSink sink;
+            LARGE_INTEGER frequency, start, end;
+            QueryPerformanceFrequency(&frequency);
+            QueryPerformanceCounter(&start);
+            // A beat at a time, as a player would.
+            while (sequencer.Advance(SCI_PPQN, sink))
+            {
+            }
+            QueryPerformanceCounter(&end);
+            Assert::AreEqual((size_t)(ChannelCount * EventsPerChannel), sink.Count);
+
+            double ms = (double)(end.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+            Logger::WriteMessage(fmt::format("Sequenced {0} events in {1:.2f}ms: {2:.0f} events/sec.", sink.Count, ms, sink.Count * 1000.0 / max(ms, 0.001)).c_str());
+        }
+
 	};
 }
\ No newline at end of file